@@ -45,6 +45,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <deque>
 #include <regex>
 
 using std::endl;
@@ -72,7 +73,8 @@ const double HPWH::MINSINGLEPASSLIFT = dF_TO_dC(15.);
 ///	@param[in]	endFraction			Upper (right) bounding fraction (0 to 1) 	
 /// @return	Resampled value; 0 if undefined.
 //-----------------------------------------------------------------------------
-double getResampledValue(const std::vector<double> &sampleValues,double beginFraction,double endFraction)
+template<typename Sample>
+double getResampledValue(const std::vector<Sample> &sampleValues,double beginFraction,double endFraction)
 {
 	if(beginFraction > endFraction)std::swap(beginFraction,endFraction);
 	if(beginFraction < 0.) beginFraction = 0.;
@@ -103,6 +105,115 @@ double getResampledValue(const std::vector<double> &sampleValues,double beginFra
 	return resampled_value;
 }
 
+//-----------------------------------------------------------------------------
+///	@brief	The resampling of numSamples values to numValues values, worked out at
+///			compile time with the arithmetic of resample and getResampledValue, so
+///			that it gives the same values. Each value is either a copy of sample
+///			first (span 0) or the weighted average of span samples from first.
+//-----------------------------------------------------------------------------
+namespace {
+constexpr double floorPositive(double x) { return static_cast<double>(static_cast<std::size_t>(x)); }
+constexpr double ceilPositive(double x) { return (floorPositive(x) < x) ? floorPositive(x) + 1. : floorPositive(x); }
+
+template<std::size_t numValues,std::size_t numSamples>
+struct ResampleTable {
+	static constexpr std::size_t maxSpan = numSamples / numValues + 2;
+	std::size_t first[numValues] = {};
+	std::size_t span[numValues] = {};
+	double weight[numValues][maxSpan] = {};
+	double totWeight[numValues] = {};
+
+	constexpr ResampleTable() {
+		const double actualSize = static_cast<double>(numValues);
+		const double sizeRatio = static_cast<double>(numSamples) / actualSize;
+		const auto binSize = static_cast<std::size_t>(1. / sizeRatio);
+		double beginFraction = 0.,endFraction = 0.;
+		std::size_t index = 0;
+		while(index < actualSize) {
+			const auto value = static_cast<double>(index);
+			const auto sampleIndex = static_cast<std::size_t>(floorPositive(value * sizeRatio));
+			if(sampleIndex + 1. < (value + 1.) * sizeRatio) {
+				endFraction = static_cast<double>(index + 1) / actualSize;
+				setWeights(index,beginFraction,endFraction);
+				++index;
+			} else {
+				std::size_t beginIndex = index;
+				std::size_t adjustedBinSize = binSize;
+				if(binSize > 1) {
+					beginIndex = static_cast<std::size_t>(ceilPositive(sampleIndex / sizeRatio));
+					adjustedBinSize = static_cast<std::size_t>(floorPositive((sampleIndex + 1) / sizeRatio) - ceilPositive(sampleIndex / sizeRatio));
+				}
+				for(std::size_t i = beginIndex; i < beginIndex + adjustedBinSize; i++) {
+					first[i] = sampleIndex;
+				}
+				index = beginIndex + adjustedBinSize;
+				endFraction = static_cast<double>(index) / actualSize;
+			}
+			beginFraction = endFraction;
+		}
+	}
+
+	constexpr void setWeights(std::size_t index,double beginFraction,double endFraction) {
+		const double nNodes = static_cast<double>(numSamples);
+		first[index] = static_cast<std::size_t>(beginFraction * nNodes);
+		double previousFraction = beginFraction;
+		double nextFraction = previousFraction;
+		for(std::size_t i = first[index]; nextFraction < endFraction && span[index] < maxSpan; ++i) {
+			nextFraction = static_cast<double>(i + 1) / nNodes;
+			if(nextFraction > endFraction) {
+				nextFraction = endFraction;
+			}
+			weight[index][span[index]] = nextFraction - previousFraction;
+			totWeight[index] += weight[index][span[index]];
+			++span[index];
+			previousFraction = nextFraction;
+		}
+	}
+};
+
+template<std::size_t numValues,std::size_t numSamples,typename Value,typename Sample>
+void resampleFixedSize(Value *values,const Sample *sampleValues)
+{
+	static constexpr ResampleTable<numValues,numSamples> table{};
+	for(std::size_t i = 0; i < numValues; i++) {
+		if(table.span[i] == 0) {
+			values[i] = static_cast<Value>(sampleValues[table.first[i]]);
+		} else {
+			double totValueWeight = 0.;
+			for(std::size_t k = 0; k < table.span[i]; k++) {
+				totValueWeight += table.weight[i][k] * sampleValues[table.first[i] + k];
+			}
+			values[i] = static_cast<Value>(totValueWeight / table.totWeight[i]);
+		}
+	}
+}
+
+template<std::size_t numValues,typename Value,typename Sample>
+bool resampleFixedSize(Value *values,const Sample *sampleValues,std::size_t numSamples)
+{
+	switch(numSamples) {
+	case 12: resampleFixedSize<numValues,12>(values,sampleValues); return true;
+	case 24: resampleFixedSize<numValues,24>(values,sampleValues); return true;
+	case 48: resampleFixedSize<numValues,48>(values,sampleValues); return true;
+	case 96: resampleFixedSize<numValues,96>(values,sampleValues); return true;
+	default: return false;
+	}
+}
+
+/// resamples with a compile-time table if both sizes are one of the common node counts, 12, 24, 48 or 96
+template<typename Value,typename Sample>
+bool resampleFixedSize(std::vector<Value> &values,const std::vector<Sample> &sampleValues)
+{
+	switch(values.size()) {
+	case 12: return resampleFixedSize<12>(values.data(),sampleValues.data(),sampleValues.size());
+	case 24: return resampleFixedSize<24>(values.data(),sampleValues.data(),sampleValues.size());
+	case 48: return resampleFixedSize<48>(values.data(),sampleValues.data(),sampleValues.size());
+	case 96: return resampleFixedSize<96>(values.data(),sampleValues.data(),sampleValues.size());
+	default: return false;
+	}
+}
+}
+
 //-----------------------------------------------------------------------------
 ///	@brief	Replaces the values in a std::vector by resampling another std::vector of
 ///			arbitrary size.
@@ -110,9 +221,11 @@ double getResampledValue(const std::vector<double> &sampleValues,double beginFra
 ///	@param[in]		sampleValues	Contains values to replace with
 /// @return	Success: true; Failure: false
 //-----------------------------------------------------------------------------
-bool resample(std::vector<double> &values,const std::vector<double> &sampleValues)
+template<typename Value,typename Sample>
+bool resample(std::vector<Value> &values,const std::vector<Sample> &sampleValues)
 {
     if(sampleValues.empty()) return false;
+    if(resampleFixedSize(values,sampleValues)) return true;
     double actualSize = static_cast<double>(values.size());
     double sizeRatio = static_cast<double>(sampleValues.size()) / actualSize;
     auto binSize = static_cast<std::size_t>(1. / sizeRatio);
@@ -135,7 +248,7 @@ bool resample(std::vector<double> &values,const std::vector<double> &sampleValue
                 beginIndex = static_cast<std::size_t>(ceil(sampleIndex/sizeRatio));
                 adjustedBinSize  = static_cast<std::size_t>(floor((sampleIndex + 1)/sizeRatio) - ceil(sampleIndex/sizeRatio));
             }
-            std::fill_n(values.begin() + beginIndex, adjustedBinSize, sampleValues[sampleIndex]);
+            std::fill_n(values.begin() + beginIndex, adjustedBinSize, static_cast<Value>(sampleValues[sampleIndex]));
             index = beginIndex + adjustedBinSize;
             endFraction = static_cast<double>(index) / actualSize;
         }
@@ -144,6 +257,13 @@ bool resample(std::vector<double> &values,const std::vector<double> &sampleValue
     return true;
 }
 
+template double getResampledValue(const std::vector<float> &sampleValues,double beginFraction,double endFraction);
+template double getResampledValue(const std::vector<double> &sampleValues,double beginFraction,double endFraction);
+template bool resample(std::vector<float> &values,const std::vector<float> &sampleValues);
+template bool resample(std::vector<float> &values,const std::vector<double> &sampleValues);
+template bool resample(std::vector<double> &values,const std::vector<float> &sampleValues);
+template bool resample(std::vector<double> &values,const std::vector<double> &sampleValues);
+
 //-----------------------------------------------------------------------------
 ///	@brief	Resample an extensive property (e.g., heat)
 ///	@note	See definition of int resample.
@@ -171,7 +291,8 @@ void HPWH::setMinutesPerStep(const double minutesPerStep_in)
 const std::string HPWH::version_maint = HPWHVRSN_META;
 
 // public HPWH functions
-HPWH::HPWH(): messageCallback(NULL),messageCallbackContextPtr(NULL),hpwhVerbosity(VRB_silent)
+HPWH::HPWH(): messageCallback(NULL),messageCallbackContextPtr(NULL),hpwhVerbosity(VRB_silent),
+	messageCapacity(1024),messageOverflow(MESSAGES_BLOCK),flushMessagesEachStep(false)
 {
 	setAllDefaults();
 };
@@ -184,13 +305,35 @@ void HPWH::setAllDefaults() {
 	simHasFailed = true; isHeating = false; setpointFixed = false; tankSizeFixed = true; canScale = false;
 	member_inletT_C = HPWH_ABORT;
 	currentSoCFraction = 1.;
+	socNodeCharge.clear(); socChargeSum = 0.; socCacheValid = false;
+	socChangedBegin = 0; socChangedEnd = 0; doSoCCrossCheck = false;
+	doEnergyBalance = false; maxBalanceResidualFraction = 0.;
+	balanceResidual_kJ = 0.; cumulativeBalanceResidual_kJ = 0.; energyBalanceFlagged = false; numEnergyBalanceFlags = 0;
+	balanceTankHeatContent_kJ = 0.; balanceTankHeatContentValid = false;
+	balanceNodeT_C.clear(); balanceNodeTSum_C = 0.; balanceChangedBegin = 0; balanceChangedEnd = 0;
+	extraHeat_kWh = 0.;
+	hasRecircLoop = false; recircUA_kJperHrC = 0.; recircFlowRate_Lper_min = 0.; recircLoopAmbientT_C = 0.;
+	recircPumpFractions.clear(); recircMinuteOfDay = 0.;
+	recircLoss_kWh = 0.; recircVolume_L = 0.; recircReturnT_C = 0.;
+	compressorStageIndices.clear(); compressorStageOnLogics.clear(); compressorStageOffLogics.clear();
+	rotateCompressorLead = true; leadCompressorStage = 0;
 	doTempDepression = false;
 	locationTemperature_C = UNINITIALIZED_LOCATIONTEMP;
 	mixBelowFractionOnDraw = 1. / 3.;
-	doInversionMixing = true; doConduction = true;
+	doInversionMixing = true; doConduction = true; doFastHeatDist = false;
+	stepTopology = TOPOLOGY_RESISTANCE;
+	doClosedFormSP = false; closedFormSPDeltaT_C = 0.5;
+	doClosedFormMP = false; closedFormMPDeltaT_C = 0.5;
 	inletHeight = 0; inlet2Height = 0; fittingsUA_kJperHrC = 0.;
 	prevDRstatus = DR_ALLOW; timerLimitTOT = 60.; timerTOT = 0.;
 	usesSoCLogic = false;
+	adaptiveTankEnergyTol_kJ = 36.; adaptiveOutletTTol_C = 0.5; adaptiveMinSubstep_min = 1.; numAdaptiveSubsteps = 0;
+	numPararealIterations = 0;
+	numSkippedDays = 0;
+	warmStartWasCached = false;
+	tankModel = std::make_shared<NodalTankModel>(this);
+	doAdaptiveGrid = false; maxGridRefinement = 3; gridRefineDeltaT_C = 1.;
+	tankGridSplits.clear(); tankGridTemps_C.clear(); tankGridNodeT_C.clear();
 	setMinutesPerStep(1.0);
 	hpwhVerbosity = VRB_minuteOut;
 }
@@ -205,6 +348,10 @@ HPWH & HPWH::operator=(const HPWH &hpwh) {
 	}
 
 	simHasFailed = hpwh.simHasFailed;
+	isHeating = hpwh.isHeating;
+	setpointFixed = hpwh.setpointFixed;
+	tankSizeFixed = hpwh.tankSizeFixed;
+	canScale = hpwh.canScale;
 
 	hpwhVerbosity = hpwh.hpwhVerbosity;
 
@@ -212,30 +359,138 @@ HPWH & HPWH::operator=(const HPWH &hpwh) {
 	messageCallback = hpwh.messageCallback;
 	messageCallbackContextPtr = hpwh.messageCallbackContextPtr;
 
-	isHeating = hpwh.isHeating;
+	// a copy writes its messages through a writer of its own
+	messageCapacity = hpwh.messageCapacity;
+	messageOverflow = hpwh.messageOverflow;
+	flushMessagesEachStep = hpwh.flushMessagesEachStep;
+	messageSink.reset();
+	if(hpwh.messageSink) {
+		startMessageSink();
+	}
 
+	hpwhModel = hpwh.hpwhModel;
+
+	// The copied heat sources still point at the heat sources and heating logics of hpwh, so point them
+	// at this HPWH instead. Logics shared between heat sources stay shared in the copy.
 	heatSources = hpwh.heatSources;
+	std::vector<std::pair<const HeatingLogic*,std::shared_ptr<HeatingLogic>>> copiedLogics;
+	auto copyLogic = [&](const std::shared_ptr<HeatingLogic> &logic) {
+		if(logic == NULL) {
+			return logic;
+		}
+		for(auto &copiedLogic: copiedLogics) {
+			if(copiedLogic.first == logic.get()) {
+				return copiedLogic.second;
+			}
+		}
+		std::shared_ptr<HeatingLogic> logicCopy = logic->clone(this);
+		copiedLogics.push_back(std::make_pair(logic.get(),logicCopy));
+		return logicCopy;
+	};
+	auto copyHeatSourcePtr = [&](HeatSource *heatSourcePtr) {
+		return (heatSourcePtr == NULL) ? NULL : &heatSources[heatSourcePtr - hpwh.heatSources.data()];
+	};
 	for(auto &heatSource: heatSources) {
 		heatSource.hpwh = this;
-		//HeatSource assignment will fail (causing the simulation to fail) if a
-		//HeatSource has backups/companions.
-		//This could be dealt with in this function (tricky), but the HeatSource
-		//assignment can't know where its backup/companion pointer goes so it either
-		//fails or silently does something that's not at all useful.
-		//I prefer it to fail.  -NDK  1/2016
+		heatSource.backupHeatSource = copyHeatSourcePtr(heatSource.backupHeatSource);
+		heatSource.companionHeatSource = copyHeatSourcePtr(heatSource.companionHeatSource);
+		heatSource.followedByHeatSource = copyHeatSourcePtr(heatSource.followedByHeatSource);
+		for(auto &logic: heatSource.turnOnLogicSet) {
+			logic = copyLogic(logic);
+		}
+		for(auto &logic: heatSource.shutOffLogicSet) {
+			logic = copyLogic(logic);
+		}
+		heatSource.standbyLogic = std::static_pointer_cast<TempBasedHeatingLogic>(copyLogic(heatSource.standbyLogic));
+	}
+
+	compressorStageIndices = hpwh.compressorStageIndices;
+	compressorStageOnLogics.clear();
+	for(const auto &logic: hpwh.compressorStageOnLogics) {
+		compressorStageOnLogics.push_back(copyLogic(logic));
+	}
+	compressorStageOffLogics.clear();
+	for(const auto &logic: hpwh.compressorStageOffLogics) {
+		compressorStageOffLogics.push_back(copyLogic(logic));
 	}
+	rotateCompressorLead = hpwh.rotateCompressorLead;
+	leadCompressorStage = hpwh.leadCompressorStage;
+
+	compressorIndex = hpwh.compressorIndex;
+	lowestElementIndex = hpwh.lowestElementIndex;
+	highestElementIndex = hpwh.highestElementIndex;
+	VIPIndex = hpwh.VIPIndex;
+
+	inletHeight = hpwh.inletHeight;
+	inlet2Height = hpwh.inlet2Height;
 
 	tankVolume_L = hpwh.tankVolume_L;
 	tankUA_kJperHrC = hpwh.tankUA_kJperHrC;
 	fittingsUA_kJperHrC = hpwh.fittingsUA_kJperHrC;
 
+	nodeVolume_L = hpwh.nodeVolume_L;
+	nodeMass_kg = hpwh.nodeMass_kg;
+	nodeCp_kJperC = hpwh.nodeCp_kJperC;
+	nodeHeight_m = hpwh.nodeHeight_m;
+	fracAreaTop = hpwh.fracAreaTop;
+	fracAreaSide = hpwh.fracAreaSide;
+
+	currentSoCFraction = hpwh.currentSoCFraction;
+	socNodeCharge = hpwh.socNodeCharge;
+	socChargeSum = hpwh.socChargeSum;
+	socMainsT_C = hpwh.socMainsT_C;
+	socMinUsefulT_C = hpwh.socMinUsefulT_C;
+	socCacheValid = hpwh.socCacheValid;
+	socChangedBegin = hpwh.socChangedBegin;
+	socChangedEnd = hpwh.socChangedEnd;
+	doSoCCrossCheck = hpwh.doSoCCrossCheck;
+
+	doEnergyBalance = hpwh.doEnergyBalance;
+	maxBalanceResidualFraction = hpwh.maxBalanceResidualFraction;
+	balanceResidual_kJ = hpwh.balanceResidual_kJ;
+	cumulativeBalanceResidual_kJ = hpwh.cumulativeBalanceResidual_kJ;
+	energyBalanceFlagged = hpwh.energyBalanceFlagged;
+	numEnergyBalanceFlags = hpwh.numEnergyBalanceFlags;
+	balanceTankHeatContent_kJ = hpwh.balanceTankHeatContent_kJ;
+	balanceTankHeatContentValid = hpwh.balanceTankHeatContentValid;
+	balanceNodeT_C = hpwh.balanceNodeT_C;
+	balanceNodeTSum_C = hpwh.balanceNodeTSum_C;
+	balanceChangedBegin = hpwh.balanceChangedBegin;
+	balanceChangedEnd = hpwh.balanceChangedEnd;
+
+	hasRecircLoop = hpwh.hasRecircLoop;
+	recircUA_kJperHrC = hpwh.recircUA_kJperHrC;
+	recircFlowRate_Lper_min = hpwh.recircFlowRate_Lper_min;
+	recircLoopAmbientT_C = hpwh.recircLoopAmbientT_C;
+	recircPumpFractions = hpwh.recircPumpFractions;
+	recircMinuteOfDay = hpwh.recircMinuteOfDay;
+
 	setpoint_C = hpwh.setpoint_C;
 
 	tankTemps_C = hpwh.tankTemps_C;
 	nextTankTemps_C = hpwh.nextTankTemps_C;
 
-	inletHeight = hpwh.inletHeight;
-	inlet2Height = hpwh.inlet2Height;
+	prevDRstatus = hpwh.prevDRstatus;
+	timerLimitTOT = hpwh.timerLimitTOT;
+	timerTOT = hpwh.timerTOT;
+
+	usesSoCLogic = hpwh.usesSoCLogic;
+
+	adaptiveTankEnergyTol_kJ = hpwh.adaptiveTankEnergyTol_kJ;
+	adaptiveOutletTTol_C = hpwh.adaptiveOutletTTol_C;
+	adaptiveMinSubstep_min = hpwh.adaptiveMinSubstep_min;
+	numAdaptiveSubsteps = hpwh.numAdaptiveSubsteps;
+	numPararealIterations = hpwh.numPararealIterations;
+	numSkippedDays = hpwh.numSkippedDays;
+	warmStartWasCached = hpwh.warmStartWasCached;
+
+	tankModel = hpwh.tankModel->clone(this);
+	doAdaptiveGrid = hpwh.doAdaptiveGrid;
+	maxGridRefinement = hpwh.maxGridRefinement;
+	gridRefineDeltaT_C = hpwh.gridRefineDeltaT_C;
+	tankGridSplits = hpwh.tankGridSplits;
+	tankGridTemps_C = hpwh.tankGridTemps_C;
+	tankGridNodeT_C = hpwh.tankGridNodeT_C;
 
 	outletTemp_C = hpwh.outletTemp_C;
 	condenserInlet_C = hpwh.condenserInlet_C;
@@ -243,26 +498,31 @@ HPWH & HPWH::operator=(const HPWH &hpwh) {
 	externalVolumeHeated_L = hpwh.externalVolumeHeated_L;
 	energyRemovedFromEnvironment_kWh = hpwh.energyRemovedFromEnvironment_kWh;
 	standbyLosses_kWh = hpwh.standbyLosses_kWh;
+	extraHeat_kWh = hpwh.extraHeat_kWh;
+	recircLoss_kWh = hpwh.recircLoss_kWh;
+	recircVolume_L = hpwh.recircVolume_L;
+	recircReturnT_C = hpwh.recircReturnT_C;
 
 	tankMixesOnDraw = hpwh.tankMixesOnDraw;
 	mixBelowFractionOnDraw = hpwh.mixBelowFractionOnDraw;
 
 	doTempDepression = hpwh.doTempDepression;
-
-	doInversionMixing = hpwh.doInversionMixing;
-	doConduction = hpwh.doConduction;
-
 	locationTemperature_C = hpwh.locationTemperature_C;
+	maxDepression_C = hpwh.maxDepression_C;
 
-	prevDRstatus = hpwh.prevDRstatus;
-	timerLimitTOT = hpwh.timerLimitTOT;
-
-	usesSoCLogic = hpwh.usesSoCLogic;
+	member_inletT_C = hpwh.member_inletT_C;
+	setMinutesPerStep(hpwh.minutesPerStep);
 
-	nodeVolume_L = hpwh.nodeVolume_L;
-	nodeHeight_m = hpwh.nodeHeight_m;
-	fracAreaTop = hpwh.fracAreaTop;
-	fracAreaSide = hpwh.fracAreaSide;
+	doInversionMixing = hpwh.doInversionMixing;
+	doConduction = hpwh.doConduction;
+	doFastHeatDist = hpwh.doFastHeatDist;
+	stepTopology = hpwh.stepTopology;
+	doClosedFormSP = hpwh.doClosedFormSP;
+	closedFormSPDeltaT_C = hpwh.closedFormSPDeltaT_C;
+	doClosedFormMP = hpwh.doClosedFormMP;
+	closedFormMPDeltaT_C = hpwh.closedFormMPDeltaT_C;
+
+	resistanceHeightMap = hpwh.resistanceHeightMap;
 	return *this;
 }
 
@@ -318,12 +578,20 @@ int HPWH::runOneStep(double drawVolume_L,
 	externalVolumeHeated_L = 0.;
 	energyRemovedFromEnvironment_kWh = 0.;
 	standbyLosses_kWh = 0.;
+	extraHeat_kWh = 0.;
+	recircLoss_kWh = 0.;
+	recircVolume_L = 0.;
+	recircReturnT_C = 0.;
 
 	for(int i = 0; i < getNumHeatSources(); i++) {
 		heatSources[i].runtime_min = 0;
 		heatSources[i].energyInput_kWh = 0.;
 		heatSources[i].energyOutput_kWh = 0.;
 	}
+	double startTankHeatContent_kJ = 0.;
+	if(doEnergyBalance) {
+		startTankHeatContent_kJ = updateBalanceTankHeatContent();
+	}
 
 	// if you are doing temp. depression, set tank and heatSource ambient temps
 	// to the tracked locationTemperature
@@ -336,9 +604,19 @@ int HPWH::runOneStep(double drawVolume_L,
 		heatSourceAmbientT_C = locationTemperature_C;
 	}
 
+	// the recirculation loop draws from the top of the tank and returns through the second inlet
+	if(hasRecircLoop) {
+		addRecirculationFlow(drawVolume_L,inletVol2_L,inletT2_C);
+	}
+
 	//process draws and standby losses
 	updateTankTemps(drawVolume_L,member_inletT_C,tankAmbientT_C,inletVol2_L,inletT2_C);
 
+	// the loop loses the heat of the water that left the tank, down to the temperature it came back at
+	if(recircVolume_L > 0.) {
+		recircLoss_kWh = KJ_TO_KWH(DENSITYWATER_kgperL * CPWATER_kJperkgC * recircVolume_L * (outletTemp_C - recircReturnT_C));
+	}
+
 	updateSoCIfNecessary();
 
 	// First Logic DR checks //////////////////////////////////////////////////////////////////
@@ -413,6 +691,12 @@ int HPWH::runOneStep(double drawVolume_L,
 
 		}  //end loop over heat sources
 
+		// the lag compressor stages follow the lead
+		bool compressorStagesRan = false;
+		if(getNumCompressorStages() > 1) {
+			compressorStagesRan = stageCompressors(DRstatus);
+		}
+
 		if(hpwhVerbosity >= VRB_emetic) {
 			msg("after heat source choosing:  ");
 			for(int i = 0; i < getNumHeatSources(); i++) {
@@ -510,6 +794,17 @@ int HPWH::runOneStep(double drawVolume_L,
 				}
 			}  // heat source not engaged
 		} // end while iHS heat source
+
+		// the next stage leads once every stage is done heating
+		if(compressorStagesRan && rotateCompressorLead) {
+			bool stagesDone = true;
+			for(int index: compressorStageIndices) {
+				stagesDone = stagesDone && !heatSources[index].isEngaged();
+			}
+			if(stagesDone) {
+				leadCompressorStage = (leadCompressorStage + 1) % getNumCompressorStages();
+			}
+		}
 	}
 	if(areAllHeatSourcesOff() == true) {
 		isHeating = false;
@@ -522,8 +817,9 @@ int HPWH::runOneStep(double drawVolume_L,
 
 	//track the depressed local temperature
 	if(doTempDepression) {
+		// only compressors depress the temperature
 		bool compressorRan = false;
-		for(int i = 0; i < getNumHeatSources(); i++) {
+		for(int i = 0; i < getNumHeatSources() && stepTopology != TOPOLOGY_RESISTANCE; i++) {
 			if(heatSources[i].isEngaged() && !heatSources[i].isLockedOut() && heatSources[i].depressesTemperature) {
 				compressorRan = true;
 			}
@@ -552,8 +848,12 @@ int HPWH::runOneStep(double drawVolume_L,
 		energyRemovedFromEnvironment_kWh += (heatSources[i].energyOutput_kWh - heatSources[i].energyInput_kWh);
 	}
 
+	if(doEnergyBalance) {
+		checkEnergyBalance(startTankHeatContent_kJ,drawVolume_L,inletVol2_L,inletT2_C);
+	}
+
 	//cursory check for inverted temperature profile
-	if(tankTemps_C[getNumNodes() - 1] < tankTemps_C[0]) {
+	if(tankModel->getNodeT_C(getNumNodes() - 1) < tankModel->getNodeT_C(0)) {
 		if(hpwhVerbosity >= VRB_reluctant) {
 			msg("The top of the tank is cooler than the bottom.  \n");
 		}
@@ -569,17 +869,26 @@ int HPWH::runOneStep(double drawVolume_L,
 	} else if((DRstatus & DR_TOO) == 0 && (DRstatus & DR_TOT) == 0) {
 		resetTopOffTimer();
 	}
+	if(hasRecircLoop) {
+		recircMinuteOfDay = fmod(recircMinuteOfDay + minutesPerStep,1440.);
+	}
 
 	if(simHasFailed) {
 		if(hpwhVerbosity >= VRB_reluctant) {
 			msg("The simulation has encountered an error.  \n");
 		}
+		if(flushMessagesEachStep) {
+			flushMessages();
+		}
 		return HPWH_ABORT;
 	}
 
 	if(hpwhVerbosity >= VRB_typical) {
 		msg("Ending runOneStep.  \n\n\n\n");
 	}
+	if(flushMessagesEachStep) {
+		flushMessages();
+	}
 
 	return 0;  //successful completion of the step returns 0
 } //end runOneStep
@@ -595,6 +904,10 @@ int HPWH::runNSteps(int N,double *inletT_C,double *drawVolume_L,
 	double standbyLosses_kWh_SUM = 0;
 	double outletTemp_C_AVG = 0;
 	double totalDrawVolume_L = 0;
+	double extraHeat_kWh_SUM = 0;
+	double recircLoss_kWh_SUM = 0;
+	double recircVolume_L_SUM = 0;
+	double recircReturnT_C_AVG = 0;
 	std::vector<double> heatSources_runTimes_SUM(getNumHeatSources());
 	std::vector<double> heatSources_energyInputs_SUM(getNumHeatSources());
 	std::vector<double> heatSources_energyOutputs_SUM(getNumHeatSources());
@@ -616,6 +929,10 @@ int HPWH::runNSteps(int N,double *inletT_C,double *drawVolume_L,
 
 		energyRemovedFromEnvironment_kWh_SUM += energyRemovedFromEnvironment_kWh;
 		standbyLosses_kWh_SUM += standbyLosses_kWh;
+		extraHeat_kWh_SUM += extraHeat_kWh;
+		recircLoss_kWh_SUM += recircLoss_kWh;
+		recircVolume_L_SUM += recircVolume_L;
+		recircReturnT_C_AVG += recircReturnT_C * recircVolume_L;
 
 		outletTemp_C_AVG += outletTemp_C * drawVolume_L[i];
 		totalDrawVolume_L += drawVolume_L[i];
@@ -634,7 +951,7 @@ int HPWH::runNSteps(int N,double *inletT_C,double *drawVolume_L,
 			}
 
 			std::vector<double> displayTemps_C(10);
-			resampleIntensive(displayTemps_C, tankTemps_C);
+			resampleIntensive(displayTemps_C, tankModel->getTankTemps());
 			bool first = true;
 			for (auto &displayTemp: displayTemps_C)
 			{
@@ -667,6 +984,10 @@ int HPWH::runNSteps(int N,double *inletT_C,double *drawVolume_L,
 	energyRemovedFromEnvironment_kWh = energyRemovedFromEnvironment_kWh_SUM;
 	standbyLosses_kWh = standbyLosses_kWh_SUM;
 	outletTemp_C = outletTemp_C_AVG;
+	extraHeat_kWh = extraHeat_kWh_SUM;
+	recircLoss_kWh = recircLoss_kWh_SUM;
+	recircVolume_L = recircVolume_L_SUM;
+	recircReturnT_C = (recircVolume_L_SUM > 0.) ? recircReturnT_C_AVG / recircVolume_L_SUM : 0.;
 
 	for(int i = 0; i < getNumHeatSources(); i++) {
 		heatSources[i].runtime_min = heatSources_runTimes_SUM[i];
@@ -680,6 +1001,456 @@ int HPWH::runNSteps(int N,double *inletT_C,double *drawVolume_L,
 	return 0;
 }
 
+int HPWH::runRepeatedDays(int numDays,int N,double *inletT_C,double *drawVolume_L,
+	double *tankAmbientT_C,double *heatSourceAmbientT_C,
+	DRMODES *DRstatus,double tankTTol_C /*=0.01*/,int maxCycleDays /*=7*/) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	if(numDays <= 0 || N <= 0 || tankTTol_C < 0. || maxCycleDays < 1) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runRepeatedDays needs positive numbers of days, steps and cycle days and a non-negative tolerance.  \n");
+		}
+		return HPWH_ABORT;
+	}
+
+	double dayDrawVolume_L = 0.;
+	for(int i = 0; i < N; i++) {
+		dayDrawVolume_L += drawVolume_L[i];
+	}
+
+	// the outputs of each simulated day, kept to be replayed once the cycle is found
+	struct DayOutputs {
+		double energyRemovedFromEnvironment_kWh;
+		double standbyLosses_kWh;
+		double outletTemp_C;
+		double extraHeat_kWh;
+		double recircLoss_kWh;
+		double recircVolume_L;
+		double recircReturnTVolume_CL;
+		std::vector<double> runTimes_min;
+		std::vector<double> energyInputs_kWh;
+		std::vector<double> energyOutputs_kWh;
+	};
+	std::vector<DayOutputs> dayOutputs;
+	// the states at the end of the last maxCycleDays days, oldest first
+	std::deque<HPWH> dayEnds;
+
+	// the end of a day matches an earlier one if every node is within tolerance and the discrete state is the same
+	auto matchesDayEnd = [&](const HPWH &dayEnd) {
+		if(isHeating != dayEnd.isHeating || timerTOT != dayEnd.timerTOT || recircMinuteOfDay != dayEnd.recircMinuteOfDay ||
+			leadCompressorStage != dayEnd.leadCompressorStage) {
+			return false;
+		}
+		for(int i = 0; i < getNumNodes(); i++) {
+			if(fabs(tankModel->getNodeT_C(i) - dayEnd.tankModel->getNodeT_C(i)) > tankTTol_C) {
+				return false;
+			}
+		}
+		for(int i = 0; i < getNumHeatSources(); i++) {
+			if(heatSources[i].isEngaged() != dayEnd.heatSources[i].isEngaged() ||
+				heatSources[i].isLockedOut() != dayEnd.heatSources[i].isLockedOut()) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	int cycleDays = 0;
+	int numSimulatedDays = 0;
+	while(numSimulatedDays < numDays && cycleDays == 0) {
+		if(runNSteps(N,inletT_C,drawVolume_L,tankAmbientT_C,heatSourceAmbientT_C,DRstatus) != 0) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("runRepeatedDays has encountered an error on day %d and has ceased running.  \n",numSimulatedDays + 1);
+			}
+			return HPWH_ABORT;
+		}
+		numSimulatedDays++;
+
+		DayOutputs outputs;
+		outputs.energyRemovedFromEnvironment_kWh = energyRemovedFromEnvironment_kWh;
+		outputs.standbyLosses_kWh = standbyLosses_kWh;
+		outputs.outletTemp_C = (dayDrawVolume_L > 0.) ? outletTemp_C : 0.;
+		outputs.extraHeat_kWh = extraHeat_kWh;
+		outputs.recircLoss_kWh = recircLoss_kWh;
+		outputs.recircVolume_L = recircVolume_L;
+		outputs.recircReturnTVolume_CL = recircReturnT_C * recircVolume_L;
+		for(int j = 0; j < getNumHeatSources(); j++) {
+			outputs.runTimes_min.push_back(getNthHeatSourceRunTime(j));
+			outputs.energyInputs_kWh.push_back(getNthHeatSourceEnergyInput(j));
+			outputs.energyOutputs_kWh.push_back(getNthHeatSourceEnergyOutput(j));
+		}
+		dayOutputs.push_back(outputs);
+
+		// look for the shortest cycle that brings the tank back to where it was
+		for(int days = 1; days <= static_cast<int>(dayEnds.size()); days++) {
+			if(matchesDayEnd(dayEnds[dayEnds.size() - days])) {
+				cycleDays = days;
+				break;
+			}
+		}
+		if(cycleDays == 0) {
+			dayEnds.push_back(*this);
+			if(static_cast<int>(dayEnds.size()) > maxCycleDays) {
+				dayEnds.pop_front();
+			}
+		}
+	}
+
+	// every day left repeats the day one cycle before it
+	for(int day = numSimulatedDays; day < numDays; day++) {
+		dayOutputs.push_back(dayOutputs[day - cycleDays]);
+	}
+	if(numSimulatedDays < numDays) {
+		// the last day ends where the simulated day it repeats ended
+		int lastSimulatedDay = numSimulatedDays - 1;
+		int lastRepeatedDay = lastSimulatedDay - (cycleDays - (numDays - numSimulatedDays) % cycleDays) % cycleDays;
+		if(lastRepeatedDay != lastSimulatedDay) {
+			*this = dayEnds[dayEnds.size() - (lastSimulatedDay - lastRepeatedDay)];
+		}
+	}
+	numSkippedDays = numDays - numSimulatedDays;
+
+	//now, sum all of the days into their original spots
+	energyRemovedFromEnvironment_kWh = 0.;
+	standbyLosses_kWh = 0.;
+	outletTemp_C = 0.;
+	extraHeat_kWh = 0.;
+	recircLoss_kWh = 0.;
+	recircVolume_L = 0.;
+	double recircReturnTVolume_CL = 0.;
+	for(int j = 0; j < getNumHeatSources(); j++) {
+		heatSources[j].runtime_min = 0.;
+		heatSources[j].energyInput_kWh = 0.;
+		heatSources[j].energyOutput_kWh = 0.;
+	}
+	for(auto &outputs: dayOutputs) {
+		energyRemovedFromEnvironment_kWh += outputs.energyRemovedFromEnvironment_kWh;
+		standbyLosses_kWh += outputs.standbyLosses_kWh;
+		outletTemp_C += outputs.outletTemp_C / numDays;
+		extraHeat_kWh += outputs.extraHeat_kWh;
+		recircLoss_kWh += outputs.recircLoss_kWh;
+		recircVolume_L += outputs.recircVolume_L;
+		recircReturnTVolume_CL += outputs.recircReturnTVolume_CL;
+		for(int j = 0; j < getNumHeatSources(); j++) {
+			heatSources[j].runtime_min += outputs.runTimes_min[j];
+			heatSources[j].energyInput_kWh += outputs.energyInputs_kWh[j];
+			heatSources[j].energyOutput_kWh += outputs.energyOutputs_kWh[j];
+		}
+	}
+	recircReturnT_C = (recircVolume_L > 0.) ? recircReturnTVolume_CL / recircVolume_L : 0.;
+
+	if(hpwhVerbosity >= VRB_typical) {
+		msg("Ending runRepeatedDays after simulating %d of %d days.  \n",numSimulatedDays,numDays);
+	}
+	return 0;
+}
+
+int HPWH::getNumSkippedDays() const {
+	return numSkippedDays;
+}
+
+int HPWH::runAdaptiveStep(double minutesToRun,double inletT_C,double drawVolume_L,
+	double tankAmbientT_C,double heatSourceAmbientT_C,DRMODES DRstatus,
+	double inletVol2_L /*=0.*/,double inletT2_C /*=0.*/,std::vector<double>* nodePowerExtra_W /*=NULL*/) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	if(minutesToRun <= 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runAdaptiveStep needs a positive step length.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	// temperature depression is fit to one minute steps, so only whole minutes can be run with it
+	if(doTempDepression && minutesToRun != floor(minutesToRun)) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runAdaptiveStep needs a whole number of minutes for temperature depression to work.  \n");
+		}
+		return HPWH_ABORT;
+	}
+
+	if(hpwhVerbosity >= VRB_typical) {
+		msg("Begin runAdaptiveStep.  \n");
+	}
+	setInletT(inletT_C);
+	const double hostMinutesPerStep = minutesPerStep;
+	const double drawRate_Lpermin = drawVolume_L / minutesToRun;
+	const double inlet2Rate_Lpermin = inletVol2_L / minutesToRun;
+
+	//these are all the accumulating variables we'll need, kept for the accepted steps and the trial steps
+	struct StepSums {
+		double energyRemovedFromEnvironment_kWh = 0.;
+		double standbyLosses_kWh = 0.;
+		double extraHeat_kWh = 0.;
+		double recircLoss_kWh = 0.;
+		double recircVolume_L = 0.;
+		double recircReturnTVolume_CL = 0.;
+		double balanceResidual_kJ = 0.;
+		bool energyBalanceFlagged = false;
+		double outletTempVolume_CL = 0.;
+		double drawVolume_L = 0.;
+		std::vector<double> runTimes_min;
+		std::vector<double> energyInputs_kWh;
+		std::vector<double> energyOutputs_kWh;
+	};
+	auto clearSums = [&](StepSums &sums) {
+		sums = StepSums();
+		sums.runTimes_min.assign(getNumHeatSources(),0.);
+		sums.energyInputs_kWh.assign(getNumHeatSources(),0.);
+		sums.energyOutputs_kWh.assign(getNumHeatSources(),0.);
+	};
+	auto addStepToSums = [&](StepSums &sums,double stepDraw_L) {
+		sums.energyRemovedFromEnvironment_kWh += energyRemovedFromEnvironment_kWh;
+		sums.standbyLosses_kWh += standbyLosses_kWh;
+		sums.extraHeat_kWh += extraHeat_kWh;
+		sums.recircLoss_kWh += recircLoss_kWh;
+		sums.recircVolume_L += recircVolume_L;
+		sums.recircReturnTVolume_CL += recircReturnT_C * recircVolume_L;
+		sums.balanceResidual_kJ += balanceResidual_kJ;
+		sums.energyBalanceFlagged = sums.energyBalanceFlagged || energyBalanceFlagged;
+		sums.outletTempVolume_CL += outletTemp_C * stepDraw_L;
+		sums.drawVolume_L += stepDraw_L;
+		for(int j = 0; j < getNumHeatSources(); j++) {
+			sums.runTimes_min[j] += heatSources[j].runtime_min;
+			sums.energyInputs_kWh[j] += heatSources[j].energyInput_kWh;
+			sums.energyOutputs_kWh[j] += heatSources[j].energyOutput_kWh;
+		}
+	};
+	auto addSums = [&](StepSums &sums,const StepSums &moreSums) {
+		sums.energyRemovedFromEnvironment_kWh += moreSums.energyRemovedFromEnvironment_kWh;
+		sums.standbyLosses_kWh += moreSums.standbyLosses_kWh;
+		sums.extraHeat_kWh += moreSums.extraHeat_kWh;
+		sums.recircLoss_kWh += moreSums.recircLoss_kWh;
+		sums.recircVolume_L += moreSums.recircVolume_L;
+		sums.recircReturnTVolume_CL += moreSums.recircReturnTVolume_CL;
+		sums.balanceResidual_kJ += moreSums.balanceResidual_kJ;
+		sums.energyBalanceFlagged = sums.energyBalanceFlagged || moreSums.energyBalanceFlagged;
+		sums.outletTempVolume_CL += moreSums.outletTempVolume_CL;
+		sums.drawVolume_L += moreSums.drawVolume_L;
+		for(int j = 0; j < getNumHeatSources(); j++) {
+			sums.runTimes_min[j] += moreSums.runTimes_min[j];
+			sums.energyInputs_kWh[j] += moreSums.energyInputs_kWh[j];
+			sums.energyOutputs_kWh[j] += moreSums.energyOutputs_kWh[j];
+		}
+	};
+	auto runSubstep = [&](double substep_min,StepSums &sums) {
+		setMinutesPerStep(substep_min);
+		double stepDraw_L = drawRate_Lpermin * substep_min;
+		int returnVal = runOneStep(stepDraw_L,tankAmbientT_C,heatSourceAmbientT_C,DRstatus,
+			inlet2Rate_Lpermin * substep_min,inletT2_C,nodePowerExtra_W);
+		if(returnVal == 0) {
+			addStepToSums(sums,stepDraw_L);
+		}
+		return returnVal;
+	};
+
+	// a heat source turning on, off, or locking out part way through a step is only caught at the start of the next
+	auto heatSourcesChanged = [&](const StepState &state) {
+		for(int i = 0; i < getNumHeatSources(); i++) {
+			if(heatSources[i].isOn != state.heatSourceIsOn[i] || heatSources[i].lockedOut != state.heatSourceLockedOut[i]) {
+				return true;
+			}
+			if(heatSources[i].isEngaged() ? heatSources[i].shutsOff()
+				: (!isHeating || heatSources[i].isVIP) && heatSources[i].shouldHeat()) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// the heat sources decide on averages of node temperatures, which the tank heat content alone does not pin down
+	auto getLogicTankTemps = [&](std::vector<double> &logicTemps_C) {
+		logicTemps_C.clear();
+		for(int i = 0; i < getNumHeatSources(); i++) {
+			for(auto logicSet : {&heatSources[i].turnOnLogicSet,&heatSources[i].shutOffLogicSet}) {
+				for(std::shared_ptr<HeatingLogic> logic : *logicSet) {
+					if(std::dynamic_pointer_cast<TempBasedHeatingLogic>(logic) != NULL) {
+						logicTemps_C.push_back(logic->getTankValue());
+					}
+				}
+			}
+		}
+	};
+
+	// the explicit conduction calculation limits how long one step can be, keep a little margin below tau = 0.5
+	double maxSubstep_min = minutesToRun;
+	if(doConduction) {
+		const double tauPerMinute = KWATER_WpermC / ((CPWATER_kJperkgC * 1000.0) * (DENSITYWATER_kgperL * 1000.0)
+			* (nodeHeight_m * nodeHeight_m)) * 60.;
+		maxSubstep_min = std::min(maxSubstep_min,0.49 / tauPerMinute);
+	}
+	// each draw step mixes the node it moves part way into, so minute steps smear the thermocline more than a few long
+	// steps would; step doubling cannot see that, so draw no more than half a node per step
+	if(drawRate_Lpermin > 0.) {
+		maxSubstep_min = std::min(maxSubstep_min,std::max(0.5 * nodeVolume_L / drawRate_Lpermin,adaptiveMinSubstep_min));
+	}
+
+	StepSums totalSums,fullSums,halfSums;
+	clearSums(totalSums);
+	StepState startState,fullState;
+	std::vector<double> fullLogicTemps_C,halfLogicTemps_C;
+	numAdaptiveSubsteps = 0;
+
+	// Step doubling: compare one step against two half steps and keep the half steps if they agree within the
+	// tolerances and no heat source changed state, otherwise retry with half the length.
+	// The step length grows again after each accepted step.
+	double timeLeft_min = minutesToRun;
+	double substep_min = doTempDepression ? 1. : maxSubstep_min;
+	int returnVal = 0;
+	while(timeLeft_min > 0. && returnVal == 0) {
+		substep_min = std::min(std::min(substep_min,maxSubstep_min),timeLeft_min);
+
+		if(doTempDepression || substep_min <= adaptiveMinSubstep_min) {
+			returnVal = runSubstep(substep_min,totalSums);
+			numAdaptiveSubsteps++;
+			timeLeft_min -= substep_min;
+			continue;
+		}
+
+		saveStepState(startState);
+
+		clearSums(fullSums);
+		returnVal = runSubstep(substep_min,fullSums);
+		if(returnVal != 0) {
+			break;
+		}
+		double fullTankEnergy_kJ = getTankHeatContent_kJ();
+		bool isAccurate = !heatSourcesChanged(startState);
+		getLogicTankTemps(fullLogicTemps_C);
+		saveStepState(fullState);
+		restoreStepState(startState);
+
+		clearSums(halfSums);
+		returnVal = runSubstep(0.5 * substep_min,halfSums);
+		if(returnVal == 0) {
+			returnVal = runSubstep(0.5 * substep_min,halfSums);
+		}
+		if(returnVal != 0) {
+			break;
+		}
+
+		isAccurate = isAccurate && !heatSourcesChanged(fullState) &&
+			fabs(getTankHeatContent_kJ() - fullTankEnergy_kJ) <= adaptiveTankEnergyTol_kJ;
+		getLogicTankTemps(halfLogicTemps_C);
+		for(std::size_t k = 0; k < halfLogicTemps_C.size() && isAccurate; k++) {
+			isAccurate = fabs(halfLogicTemps_C[k] - fullLogicTemps_C[k]) <= adaptiveOutletTTol_C;
+		}
+		// the heat sources must agree too: the tank can come out the same while a heat pump ran at another COP
+		for(int j = 0; j < getNumHeatSources() && isAccurate; j++) {
+			isAccurate = KWH_TO_KJ(fabs(halfSums.energyOutputs_kWh[j] - fullSums.energyOutputs_kWh[j])) <= adaptiveTankEnergyTol_kJ
+				&& KWH_TO_KJ(fabs(halfSums.energyInputs_kWh[j] - fullSums.energyInputs_kWh[j])) <= adaptiveTankEnergyTol_kJ
+				&& fabs(halfSums.runTimes_min[j] - fullSums.runTimes_min[j]) <= adaptiveMinSubstep_min;
+			// a heat source that ran for part of the step turned on or off inside it
+			isAccurate = isAccurate && (fullSums.runTimes_min[j] == 0. || fullSums.runTimes_min[j] >= substep_min * (1. - 1.e-9));
+		}
+		if(isAccurate && halfSums.drawVolume_L > 0.) {
+			double fullOutletT_C = fullSums.outletTempVolume_CL / fullSums.drawVolume_L;
+			double halfOutletT_C = halfSums.outletTempVolume_CL / halfSums.drawVolume_L;
+			isAccurate = fabs(halfOutletT_C - fullOutletT_C) <= adaptiveOutletTTol_C;
+		}
+
+		if(isAccurate) {
+			addSums(totalSums,halfSums);
+			numAdaptiveSubsteps += 2;
+			timeLeft_min -= substep_min;
+			substep_min *= 2.;
+		} else {
+			restoreStepState(startState);
+			substep_min = std::max(0.5 * substep_min,adaptiveMinSubstep_min);
+		}
+	}
+	setMinutesPerStep(hostMinutesPerStep);
+
+	if(returnVal != 0) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runAdaptiveStep has encountered an error with %.2lf minutes left and has ceased running.  \n",timeLeft_min);
+		}
+		return HPWH_ABORT;
+	}
+
+	//now, reassign all of the accumulated values to their original spots
+	energyRemovedFromEnvironment_kWh = totalSums.energyRemovedFromEnvironment_kWh;
+	standbyLosses_kWh = totalSums.standbyLosses_kWh;
+	extraHeat_kWh = totalSums.extraHeat_kWh;
+	recircLoss_kWh = totalSums.recircLoss_kWh;
+	recircVolume_L = totalSums.recircVolume_L;
+	recircReturnT_C = (totalSums.recircVolume_L > 0.) ? totalSums.recircReturnTVolume_CL / totalSums.recircVolume_L : 0.;
+	balanceResidual_kJ = totalSums.balanceResidual_kJ;
+	energyBalanceFlagged = totalSums.energyBalanceFlagged;
+	outletTemp_C = (totalSums.drawVolume_L > 0.) ? totalSums.outletTempVolume_CL / totalSums.drawVolume_L : 0.;
+
+	for(int i = 0; i < getNumHeatSources(); i++) {
+		heatSources[i].runtime_min = totalSums.runTimes_min[i];
+		heatSources[i].energyInput_kWh = totalSums.energyInputs_kWh[i];
+		heatSources[i].energyOutput_kWh = totalSums.energyOutputs_kWh[i];
+	}
+
+	if(hpwhVerbosity >= VRB_typical) {
+		msg("Ending runAdaptiveStep after %d steps.  \n\n\n\n",numAdaptiveSubsteps);
+	}
+	return 0;
+}
+
+int HPWH::setAdaptiveStepTolerance(double tankEnergyTol_kJ,double outletTTol_C,double minSubstep_min /*=1.*/) {
+	if(tankEnergyTol_kJ <= 0. || outletTTol_C <= 0. || minSubstep_min <= 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The adaptive step tolerances and minimum step must be positive.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	adaptiveTankEnergyTol_kJ = tankEnergyTol_kJ;
+	adaptiveOutletTTol_C = outletTTol_C;
+	adaptiveMinSubstep_min = minSubstep_min;
+	return 0;
+}
+
+int HPWH::getNumAdaptiveSubsteps() const {
+	return numAdaptiveSubsteps;
+}
+
+void HPWH::saveStepState(StepState &state) const {
+	state.tankTemps_C = tankModel->getTankTemps();
+	state.heatSourceIsOn.resize(getNumHeatSources());
+	state.heatSourceLockedOut.resize(getNumHeatSources());
+	for(int i = 0; i < getNumHeatSources(); i++) {
+		state.heatSourceIsOn[i] = heatSources[i].isOn;
+		state.heatSourceLockedOut[i] = heatSources[i].lockedOut;
+	}
+	state.isHeating = isHeating;
+	state.prevDRstatus = prevDRstatus;
+	state.timerTOT = timerTOT;
+	state.locationTemperature_C = locationTemperature_C;
+	state.currentSoCFraction = currentSoCFraction;
+	state.tankGridSplits = tankGridSplits;
+	state.tankGridTemps_C = tankGridTemps_C;
+	state.tankGridNodeT_C = tankGridNodeT_C;
+	state.cumulativeBalanceResidual_kJ = cumulativeBalanceResidual_kJ;
+	state.numEnergyBalanceFlags = numEnergyBalanceFlags;
+	state.recircMinuteOfDay = recircMinuteOfDay;
+	state.leadCompressorStage = leadCompressorStage;
+}
+
+void HPWH::restoreStepState(const StepState &state) {
+	tankModel->editTankTemps() = state.tankTemps_C;
+	markNodesChanged(0,getNumNodes());
+	balanceTankHeatContentValid = false;
+	for(int i = 0; i < getNumHeatSources(); i++) {
+		heatSources[i].isOn = state.heatSourceIsOn[i];
+		heatSources[i].lockedOut = state.heatSourceLockedOut[i];
+	}
+	isHeating = state.isHeating;
+	prevDRstatus = state.prevDRstatus;
+	timerTOT = state.timerTOT;
+	locationTemperature_C = state.locationTemperature_C;
+	currentSoCFraction = state.currentSoCFraction;
+	tankGridSplits = state.tankGridSplits;
+	tankGridTemps_C = state.tankGridTemps_C;
+	tankGridNodeT_C = state.tankGridNodeT_C;
+	cumulativeBalanceResidual_kJ = state.cumulativeBalanceResidual_kJ;
+	numEnergyBalanceFlags = state.numEnergyBalanceFlags;
+	recircMinuteOfDay = state.recircMinuteOfDay;
+	leadCompressorStage = state.leadCompressorStage;
+}
+
 void HPWH::addHeatParent(HeatSource *heatSourcePtr,double heatSourceAmbientT_C,double minutesToRun) {
 
 	double tempSetpoint_C = -273.15;
@@ -709,6 +1480,11 @@ void HPWH::setVerbosity(VERBOSITY hpwhVrb) {
 void HPWH::setMessageCallback(void(*callbackFunc)(const string message,void* contextPtr),void* contextPtr) {
 	messageCallback = callbackFunc;
 	messageCallbackContextPtr = contextPtr;
+	// the writer passes the messages made so far to the old callback, and the rest to the new one
+	if(messageSink) {
+		messageSink.reset();
+		startMessageSink();
+	}
 }
 void HPWH::sayMessage(const string message) const {
 	if(messageCallback != NULL) {
@@ -722,6 +1498,10 @@ void HPWH::msg(const char* fmt,...) const {
 	msgV(fmt,ap);
 }
 void HPWH::msgV(const char* fmt,va_list ap /*=NULL*/) const {
+	if(messageSink && ap) {
+		pushMessage(fmt,ap);
+		return;
+	}
 	char outputString[MAXOUTSTRING];
 
 	const char* p;
@@ -995,7 +1775,7 @@ double HPWH::calcSoCFraction(double tMains_C,double tMinUseful_C,double tMax_C)
 	}
 
 	double chargeEquivalent = 0.;
-	for(auto &T: tankTemps_C) {
+	for(auto &T: tankModel->getTankTemps()) {
 		chargeEquivalent += getChargePerNode(tMains_C,tMinUseful_C,T);
 	}
 	double maxSoC = getNumNodes() * getChargePerNode(tMains_C,tMinUseful_C,tMax_C);
@@ -1007,12 +1787,124 @@ double HPWH::getSoCFraction() const {
 }
 
 void HPWH::calcAndSetSoCFraction() {
-	double newSoCFraction = -1.;
-
 	std::shared_ptr<SoCBasedHeatingLogic> logicSoC = std::dynamic_pointer_cast<SoCBasedHeatingLogic>(heatSources[compressorIndex].turnOnLogicSet[0]);
-	newSoCFraction = calcSoCFraction(logicSoC->getMainsT_C(),logicSoC->getTempMinUseful_C());
+	double tMains_C = logicSoC->getMainsT_C();
+	double tMinUseful_C = logicSoC->getTempMinUseful_C();
+
+	if(tMains_C >= tMinUseful_C || tMinUseful_C > getSetpoint()) {
+		// let the full calculation report the bad inputs
+		socCacheValid = false;
+		currentSoCFraction = calcSoCFraction(tMains_C,tMinUseful_C);
+		return;
+	}
+
+	// rebuild the node charges if the temperatures they depend on moved or the whole tank changed,
+	// otherwise only recalculate the nodes that changed since the last update
+	if(!socCacheValid || tMains_C != socMainsT_C || tMinUseful_C != socMinUsefulT_C ||
+		static_cast<int>(socNodeCharge.size()) != getNumNodes() ||
+		(socChangedBegin <= 0 && socChangedEnd >= getNumNodes())) {
+		const std::vector<tankReal_t> &nodeT_C = tankModel->getTankTemps();
+		socNodeCharge.resize(getNumNodes());
+		socChargeSum = 0.;
+		for(int i = 0; i < getNumNodes(); i++) {
+			socNodeCharge[i] = getChargePerNode(tMains_C,tMinUseful_C,nodeT_C[i]);
+			socChargeSum += socNodeCharge[i];
+		}
+		socMainsT_C = tMains_C;
+		socMinUsefulT_C = tMinUseful_C;
+		socCacheValid = true;
+	} else {
+		const std::vector<tankReal_t> &nodeT_C = tankModel->getTankTemps();
+		for(int i = socChangedBegin; i < socChangedEnd; i++) {
+			double nodeCharge = getChargePerNode(tMains_C,tMinUseful_C,nodeT_C[i]);
+			socChargeSum += nodeCharge - socNodeCharge[i];
+			socNodeCharge[i] = nodeCharge;
+		}
+	}
+	socChangedBegin = getNumNodes();
+	socChangedEnd = 0;
+
+	double maxSoC = getNumNodes() * getChargePerNode(tMains_C,tMinUseful_C,getSetpoint());
+	currentSoCFraction = socChargeSum / maxSoC;
+
+	if(doSoCCrossCheck) {
+		double fullSoCFraction = calcSoCFraction(tMains_C,tMinUseful_C);
+		if(fabs(fullSoCFraction - currentSoCFraction) > 1.e-9) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("Incremental SoC fraction %.12f does not match the full calculation %.12f. \n",currentSoCFraction,fullSoCFraction);
+			}
+			socCacheValid = false;
+			currentSoCFraction = fullSoCFraction;
+		}
+	}
+}
+
+int HPWH::setDoSoCCrossCheck(bool doCheck) {
+	doSoCCrossCheck = doCheck;
+	return 0;
+}
+
+int HPWH::setEnergyBalanceCheck(bool doCheck,double maxResidualFraction /*=0.*/) {
+	if(maxResidualFraction < 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The energy balance threshold can not be negative.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	doEnergyBalance = doCheck;
+	maxBalanceResidualFraction = maxResidualFraction;
+	balanceResidual_kJ = 0.;
+	cumulativeBalanceResidual_kJ = 0.;
+	energyBalanceFlagged = false;
+	numEnergyBalanceFlags = 0;
+	// the tank may have changed while the check was off, with nothing to record it
+	balanceTankHeatContentValid = false;
+	return 0;
+}
 
-	currentSoCFraction = newSoCFraction;
+double HPWH::updateBalanceTankHeatContent() {
+	// sum the whole tank if it was set or resized, or every node changed, otherwise only the nodes that changed
+	const std::vector<tankReal_t> &nodeT_C = tankModel->getTankTemps();
+	if(!balanceTankHeatContentValid || static_cast<int>(balanceNodeT_C.size()) != getNumNodes() ||
+		(balanceChangedBegin <= 0 && balanceChangedEnd >= getNumNodes())) {
+		balanceNodeT_C.assign(nodeT_C.begin(),nodeT_C.end());
+		balanceNodeTSum_C = 0.;
+		for(int i = 0; i < getNumNodes(); i++) {
+			balanceNodeTSum_C += nodeT_C[i];
+		}
+	} else {
+		for(int i = balanceChangedBegin; i < balanceChangedEnd; i++) {
+			balanceNodeTSum_C += nodeT_C[i] - balanceNodeT_C[i];
+			balanceNodeT_C[i] = nodeT_C[i];
+		}
+	}
+	balanceChangedBegin = getNumNodes();
+	balanceChangedEnd = 0;
+
+	balanceTankHeatContent_kJ = balanceNodeTSum_C / getNumNodes() * DENSITYWATER_kgperL * CPWATER_kJperkgC * tankVolume_L;
+	balanceTankHeatContentValid = true;
+	return balanceTankHeatContent_kJ;
+}
+
+void HPWH::checkEnergyBalance(double startTankHeatContent_kJ,double drawVolume_L,double inletVol2_L,double inletT2_C) {
+	double heatIn_kJ = KWH_TO_KJ(extraHeat_kWh - standbyLosses_kWh);
+	for(int i = 0; i < getNumHeatSources(); i++) {
+		heatIn_kJ += KWH_TO_KJ(heatSources[i].energyOutput_kWh);
+	}
+	// the draw takes water out at the outlet temperature and lets it in at the temperatures of the inlets
+	double drawHeat_kJ = DENSITYWATER_kgperL * CPWATER_kJperkgC * (drawVolume_L * outletTemp_C
+		- (drawVolume_L - inletVol2_L) * member_inletT_C - inletVol2_L * inletT2_C);
+
+	balanceResidual_kJ = heatIn_kJ - drawHeat_kJ - (updateBalanceTankHeatContent() - startTankHeatContent_kJ);
+	cumulativeBalanceResidual_kJ += balanceResidual_kJ;
+	energyBalanceFlagged = maxBalanceResidualFraction > 0. &&
+		fabs(balanceResidual_kJ) > maxBalanceResidualFraction * std::max(startTankHeatContent_kJ,1.);
+	if(energyBalanceFlagged) {
+		numEnergyBalanceFlags++;
+		if(hpwhVerbosity >= VRB_typical) {
+			msg("The energy balance of the step is off by %.3f kJ.  \n",balanceResidual_kJ);
+		}
+	}
 }
 
 double HPWH::getChargePerNode(double tCold,double tMix,double tHot) const {
@@ -1080,14 +1972,18 @@ int HPWH::setTankLayerTemperatures(std::vector<double> setTankTemps,const UNITS
 			T = F_TO_C(T);
 
 	// set node temps
-	if(!resampleIntensive(tankTemps_C,setTankTemps))
+	if(!resampleIntensive(tankModel->editTankTemps(),setTankTemps))
 		return HPWH_ABORT;
+	// the grid and the energy balance are rebuilt from the new node temps
+	tankGridSplits.clear();
+	balanceTankHeatContentValid = false;
 
 	return 0;
 }
 
 void HPWH::getTankTemps(std::vector<double> &tankTemps) {
-	tankTemps = tankTemps_C;
+	const std::vector<tankReal_t> &nodeT_C = tankModel->getTankTemps();
+	tankTemps.assign(nodeT_C.begin(),nodeT_C.end());
 }
 
 int HPWH::setAirFlowFreedom(double fanFraction) {
@@ -1247,6 +2143,35 @@ int HPWH::setDoConduction(bool doCondu) {
 	this->doConduction = doCondu;
 	return 0;
 }
+int HPWH::setFastHeatDistribution(bool doFast) {
+	this->doFastHeatDist = doFast;
+	return 0;
+}
+HPWH::STEP_TOPOLOGY HPWH::getStepTopology() const {
+	return stepTopology;
+}
+int HPWH::setClosedFormSinglePass(bool doClosedForm,double capacityDeltaT_C /*=0.5*/) {
+	if(capacityDeltaT_C < 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The capacity threshold of the closed form single pass can not be negative.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	this->doClosedFormSP = doClosedForm;
+	this->closedFormSPDeltaT_C = capacityDeltaT_C;
+	return 0;
+}
+int HPWH::setClosedFormMultipass(bool doClosedForm,double capacityDeltaT_C /*=0.5*/) {
+	if(capacityDeltaT_C < 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The capacity threshold of the closed form multipass can not be negative.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	this->doClosedFormMP = doClosedForm;
+	this->closedFormMPDeltaT_C = capacityDeltaT_C;
+	return 0;
+}
 
 int HPWH::setUA(double UA,UNITS units /*=UNITS_kJperHrC*/) {
 	if(units == UNITS_kJperHrC) {
@@ -1307,6 +2232,239 @@ int HPWH::getFittingsUA(double& UA,UNITS units /*=UNITS_kJperHrC*/) const {
 	return 0;
 }
 
+int HPWH::setRecirculationLoop(double UA_kJperHrC,double flowRate_Lper_min,double loopAmbientT_C,
+	const std::vector<double> &hourlyPumpFractions /*=std::vector<double>()*/,double startMinuteOfDay /*=0.*/) {
+	if(UA_kJperHrC < 0. || flowRate_Lper_min < 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The recirculation loop UA and flow rate can not be negative.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	if(!hourlyPumpFractions.empty() && hourlyPumpFractions.size() != 24) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The recirculation pump schedule needs a fraction for each of the 24 hours of the day.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	for(double fraction: hourlyPumpFractions) {
+		if(fraction < 0. || fraction > 1.) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("The recirculation pump fractions must be between 0 and 1.  \n");
+			}
+			return HPWH_ABORT;
+		}
+	}
+	hasRecircLoop = true;
+	recircUA_kJperHrC = UA_kJperHrC;
+	recircFlowRate_Lper_min = flowRate_Lper_min;
+	recircLoopAmbientT_C = loopAmbientT_C;
+	recircPumpFractions = hourlyPumpFractions;
+	recircMinuteOfDay = fmod(fmod(startMinuteOfDay,1440.) + 1440.,1440.);
+	return 0;
+}
+
+void HPWH::clearRecirculationLoop() {
+	hasRecircLoop = false;
+	recircPumpFractions.clear();
+	recircMinuteOfDay = 0.;
+}
+
+bool HPWH::hasRecirculationLoop() const {
+	return hasRecircLoop;
+}
+
+int HPWH::setCompressorStages(int numStages,
+	const std::vector<std::shared_ptr<HeatingLogic>> &stageOnLogics /*=std::vector<std::shared_ptr<HeatingLogic>>()*/,
+	const std::vector<std::shared_ptr<HeatingLogic>> &stageOffLogics /*=std::vector<std::shared_ptr<HeatingLogic>>()*/,
+	bool rotateLead /*=true*/) {
+	if(!hasACompressor()) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("Current model does not have a compressor to stage.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	if(numStages < 1 || static_cast<int>(stageOnLogics.size()) != numStages - 1 ||
+		(!stageOffLogics.empty() && static_cast<int>(stageOffLogics.size()) != numStages - 1)) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The compressor stages need a stage-on logic for each lag stage, and a stage-off logic for each or none.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	// the logics read this tank, whichever HPWH made them
+	std::vector<std::shared_ptr<HeatingLogic>> onLogics,offLogics;
+	for(auto logics: {std::make_pair(&stageOnLogics,&onLogics),std::make_pair(&stageOffLogics,&offLogics)}) {
+		for(const std::shared_ptr<HeatingLogic> &logic: *logics.first) {
+			if(logic == NULL) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("The compressor stage logics can not be empty.  \n");
+				}
+				return HPWH_ABORT;
+			}
+			logics.second->push_back(logic->clone(this));
+			if(!logics.second->back()->isValid()) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("The compressor stage logic %s is invalid.  \n",logic->description.c_str());
+				}
+				return HPWH_ABORT;
+			}
+			if(std::dynamic_pointer_cast<SoCBasedHeatingLogic>(logic) != NULL && !usesSoCLogic) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("Staging the compressor by state of charge needs state of charge controls.  \n");
+				}
+				return HPWH_ABORT;
+			}
+		}
+	}
+
+	// rebuild the heat sources with the lag stages right after the compressor, in place of any there were
+	std::vector<HeatSource> stagedHeatSources;
+	std::vector<int> stagedIndex(getNumHeatSources(),-1);
+	std::vector<int> stageIndices;
+	for(int i = 0; i < getNumHeatSources(); i++) {
+		if(i != compressorIndex &&
+			std::find(compressorStageIndices.begin(),compressorStageIndices.end(),i) != compressorStageIndices.end()) {
+			continue;
+		}
+		stagedIndex[i] = static_cast<int>(stagedHeatSources.size());
+		stagedHeatSources.push_back(heatSources[i]);
+		if(i == compressorIndex) {
+			stageIndices.push_back(stagedIndex[i]);
+			for(int stage = 1; stage < numStages; stage++) {
+				// only the lead has the compressor's backup, companion and follower, so each comes on once
+				HeatSource lagStage(heatSources[i]);
+				lagStage.clearAllTurnOnLogic();
+				lagStage.backupHeatSource = NULL;
+				lagStage.companionHeatSource = NULL;
+				lagStage.followedByHeatSource = NULL;
+				lagStage.isOn = false;
+				lagStage.lockedOut = false;
+				stageIndices.push_back(static_cast<int>(stagedHeatSources.size()));
+				stagedHeatSources.push_back(lagStage);
+			}
+		}
+	}
+	auto stagedHeatSourcePtr = [&](HeatSource *heatSourcePtr) {
+		if(heatSourcePtr == NULL || stagedIndex[heatSourcePtr - heatSources.data()] < 0) {
+			return static_cast<HeatSource *>(NULL);
+		}
+		return &stagedHeatSources[stagedIndex[heatSourcePtr - heatSources.data()]];
+	};
+	for(HeatSource &heatSource: stagedHeatSources) {
+		heatSource.backupHeatSource = stagedHeatSourcePtr(heatSource.backupHeatSource);
+		heatSource.companionHeatSource = stagedHeatSourcePtr(heatSource.companionHeatSource);
+		heatSource.followedByHeatSource = stagedHeatSourcePtr(heatSource.followedByHeatSource);
+	}
+	heatSources.swap(stagedHeatSources);
+
+	if(numStages > 1) {
+		compressorStageIndices = stageIndices;
+		compressorStageOnLogics = onLogics;
+		compressorStageOffLogics = offLogics;
+	} else {
+		compressorStageIndices.clear();
+		compressorStageOnLogics.clear();
+		compressorStageOffLogics.clear();
+	}
+	rotateCompressorLead = rotateLead;
+	leadCompressorStage = 0;
+
+	calcDerivedHeatingValues();
+	mapResRelativePosToHeatSources();
+	return 0;
+}
+
+int HPWH::getNumCompressorStages() const {
+	if(!compressorStageIndices.empty()) {
+		return static_cast<int>(compressorStageIndices.size());
+	}
+	return hasACompressor() ? 1 : 0;
+}
+
+int HPWH::getCompressorStageIndex(int stage) const {
+	if(stage < 0 || stage >= getNumCompressorStages()) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("You have attempted to access a compressor stage that does not exist.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	return compressorStageIndices.empty() ? compressorIndex : compressorStageIndices[stage];
+}
+
+int HPWH::getLeadCompressorStage() const {
+	return leadCompressorStage;
+}
+
+bool HPWH::stageCompressors(DRMODES DRstatus) {
+	const int numStages = getNumCompressorStages();
+	int numStagesOn = 0;
+	for(int index: compressorStageIndices) {
+		if(heatSources[index].isEngaged()) {
+			numStagesOn++;
+		}
+	}
+	if(numStagesOn == 0) {
+		return false;
+	}
+
+	// a lag stage comes on behind the ones ahead of it, and the last ones on go off first
+	auto holds = [](const std::shared_ptr<HeatingLogic> &logic) {
+		return logic->compare(logic->getTankValue(),logic->getComparisonValue());
+	};
+	while(numStagesOn < numStages && holds(compressorStageOnLogics[numStagesOn - 1]) &&
+		!heatSources[compressorStageIndices[numStagesOn]].shutsOff()) {
+		numStagesOn++;
+	}
+	while(numStagesOn > 1 && !compressorStageOffLogics.empty() && holds(compressorStageOffLogics[numStagesOn - 2])) {
+		numStagesOn--;
+	}
+
+	// the lead runs and the lags follow it in turn, whichever of the identical stages the choice engaged
+	for(int k = 0; k < numStages; k++) {
+		HeatSource &stage = heatSources[compressorStageIndices[(leadCompressorStage + k) % numStages]];
+		if(k < numStagesOn && !stage.isEngaged()) {
+			stage.engageHeatSource(DRstatus);
+		} else if(k >= numStagesOn && stage.isEngaged()) {
+			stage.disengageHeatSource();
+		}
+	}
+	if(hpwhVerbosity >= VRB_emetic) {
+		msg("compressor stages on: %d, lead stage: %d\n",numStagesOn,leadCompressorStage);
+	}
+	return true;
+}
+
+void HPWH::addRecirculationFlow(double &drawVolume_L,double &inletVol2_L,double &inletT2_C) {
+	double pumpFraction = 1.;
+	if(!recircPumpFractions.empty()) {
+		pumpFraction = recircPumpFractions[static_cast<int>(recircMinuteOfDay / 60.) % 24];
+	}
+	double volume_L = recircFlowRate_Lper_min * minutesPerStep * pumpFraction;
+	if(volume_L <= 0.) {
+		return;
+	}
+
+	// the step draws its water off the top of the tank, so the loop is supplied at about the mean of that volume
+	const double suppliedVolume_L = std::min(drawVolume_L + volume_L,tankVolume_L);
+	double supplyTV_CL = 0.;
+	double volumeLeft_L = suppliedVolume_L;
+	for(int i = getNumNodes() - 1; i >= 0 && volumeLeft_L > 0.; i--) {
+		double nodeDraw_L = std::min(nodeVolume_L,volumeLeft_L);
+		supplyTV_CL += tankModel->getNodeT_C(i) * nodeDraw_L;
+		volumeLeft_L -= nodeDraw_L;
+	}
+	const double supplyT_C = supplyTV_CL / suppliedVolume_L;
+
+	// the steady temperature at the end of a pipe that loses heat through its UA, at the flow's heat capacity rate
+	const double flowCapacity_kJperHrC = recircFlowRate_Lper_min * 60. * DENSITYWATER_kgperL * CPWATER_kJperkgC;
+	recircReturnT_C = recircLoopAmbientT_C
+		+ (supplyT_C - recircLoopAmbientT_C) * exp(-recircUA_kJperHrC / flowCapacity_kJperHrC);
+	recircVolume_L = volume_L;
+
+	inletT2_C = (inletVol2_L * inletT2_C + volume_L * recircReturnT_C) / (inletVol2_L + volume_L);
+	inletVol2_L += volume_L;
+	drawVolume_L += volume_L;
+}
+
 int HPWH::setInletByFraction(double fractionalHeight) {
 	return setNodeNumFromFractionalHeight(fractionalHeight,inletHeight);
 }
@@ -1581,6 +2739,10 @@ int HPWH::switchToSoCControls(double targetSoC,double hysteresisFraction /*= 0.0
 		heatSources[i].shutOffLogicSet.push_back(shutOffSoC("SoC Shut Off",targetSoC,hysteresisFraction,tempMinUseful_C,constantMainsT,mainsT_C));
 		heatSources[i].turnOnLogicSet.push_back(turnOnSoC("SoC Turn On",targetSoC,hysteresisFraction,tempMinUseful_C,constantMainsT,mainsT_C));
 	}
+	// the lag compressor stages come on by their staging logics
+	for(int stage = 1; stage < getNumCompressorStages(); stage++) {
+		heatSources[compressorStageIndices[stage]].clearAllTurnOnLogic();
+	}
 
 	usesSoCLogic = true;
 
@@ -1756,7 +2918,7 @@ double HPWH::getTankNodeTemp(int nodeNum,UNITS units  /*=UNITS_C*/) const {
 		}
 		return double(HPWH_ABORT);
 	} else {
-		double result = tankTemps_C[nodeNum];
+		double result = tankModel->getNodeT_C(nodeNum);
 		//if (result == double(HPWH_ABORT)) { can't happen?
 		//	return result;
 		//}
@@ -1984,6 +3146,36 @@ HPWH::HEATSOURCE_TYPE HPWH::getNthHeatSourceType(int N) const {
 	return heatSources[N].typeOfHeatSource;
 }
 
+double HPWH::getNthCompressorStageEnergyInput(int N,UNITS units /*=UNITS_KWH*/) const {
+	if(N >= getNumCompressorStages() || N < 0) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("You have attempted to access the energy input of a compressor stage that does not exist.  \n");
+		}
+		return double(HPWH_ABORT);
+	}
+	return getNthHeatSourceEnergyInput(getCompressorStageIndex(N),units);
+}
+
+double HPWH::getNthCompressorStageEnergyOutput(int N,UNITS units /*=UNITS_KWH*/) const {
+	if(N >= getNumCompressorStages() || N < 0) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("You have attempted to access the energy output of a compressor stage that does not exist.  \n");
+		}
+		return double(HPWH_ABORT);
+	}
+	return getNthHeatSourceEnergyOutput(getCompressorStageIndex(N),units);
+}
+
+double HPWH::getNthCompressorStageRunTime(int N) const {
+	if(N >= getNumCompressorStages() || N < 0) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("You have attempted to access the run time of a compressor stage that does not exist.  \n");
+		}
+		return double(HPWH_ABORT);
+	}
+	return getNthHeatSourceRunTime(getCompressorStageIndex(N));
+}
+
 
 double HPWH::getTankSize(UNITS units /*=UNITS_L*/) const {
 	if(units == UNITS_L) {
@@ -2084,13 +3276,90 @@ double HPWH::getStandbyLosses(UNITS units /*=UNITS_KWH*/) const {
 	}
 }
 
+double HPWH::getEnergyBalanceResidual(UNITS units /*=UNITS_KWH*/) const {
+	if(units == UNITS_KWH) {
+		return KJ_TO_KWH(balanceResidual_kJ);
+	} else if(units == UNITS_BTU) {
+		return KWH_TO_BTU(KJ_TO_KWH(balanceResidual_kJ));
+	} else if(units == UNITS_KJ) {
+		return balanceResidual_kJ;
+	} else {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("Incorrect unit specification for getEnergyBalanceResidual.  \n");
+		}
+		return double(HPWH_ABORT);
+	}
+}
+
+double HPWH::getCumulativeEnergyBalanceResidual(UNITS units /*=UNITS_KWH*/) const {
+	if(units == UNITS_KWH) {
+		return KJ_TO_KWH(cumulativeBalanceResidual_kJ);
+	} else if(units == UNITS_BTU) {
+		return KWH_TO_BTU(KJ_TO_KWH(cumulativeBalanceResidual_kJ));
+	} else if(units == UNITS_KJ) {
+		return cumulativeBalanceResidual_kJ;
+	} else {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("Incorrect unit specification for getCumulativeEnergyBalanceResidual.  \n");
+		}
+		return double(HPWH_ABORT);
+	}
+}
+
+bool HPWH::isEnergyBalanceFlagged() const {
+	return energyBalanceFlagged;
+}
+
+int HPWH::getNumEnergyBalanceFlags() const {
+	return numEnergyBalanceFlags;
+}
+
+double HPWH::getExtraHeatEnergy(UNITS units /*=UNITS_KWH*/) const {
+	if(units == UNITS_KWH) {
+		return extraHeat_kWh;
+	} else if(units == UNITS_BTU) {
+		return KWH_TO_BTU(extraHeat_kWh);
+	} else if(units == UNITS_KJ) {
+		return KWH_TO_KJ(extraHeat_kWh);
+	} else {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("Incorrect unit specification for getExtraHeatEnergy.  \n");
+		}
+		return double(HPWH_ABORT);
+	}
+}
+
+double HPWH::getRecirculationLoss(UNITS units /*=UNITS_KWH*/) const {
+	if(units == UNITS_KWH) {
+		return recircLoss_kWh;
+	} else if(units == UNITS_BTU) {
+		return KWH_TO_BTU(recircLoss_kWh);
+	} else if(units == UNITS_KJ) {
+		return KWH_TO_KJ(recircLoss_kWh);
+	} else {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("Incorrect unit specification for getRecirculationLoss.  \n");
+		}
+		return double(HPWH_ABORT);
+	}
+}
+
+double HPWH::getRecirculationVolume_L() const {
+	return recircVolume_L;
+}
+
+double HPWH::getRecirculationReturnT_C() const {
+	return recircReturnT_C;
+}
+
 double HPWH::getTankHeatContent_kJ() const {
 	// returns tank heat content relative to 0 C using kJ
 
 	//get average tank temperature
+	const std::vector<tankReal_t> &nodeT_C = tankModel->getTankTemps();
 	double avgTemp = 0.0;
 	for(int i = 0; i < getNumNodes(); i++) {
-		avgTemp += tankTemps_C[i];
+		avgTemp += nodeT_C[i];
 	}
 	avgTemp /= getNumNodes();
 
@@ -2448,6 +3717,11 @@ int HPWH::getResistancePosition(int elementIndex) const {
 //the privates
 void HPWH::updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,
 	double inletVol2_L,double inletT2_C) {
+	tankModel->updateTankTemps(drawVolume_L,inletT_C,tankAmbientT_C,inletVol2_L,inletT2_C);
+}
+
+void HPWH::updateNodalTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,
+	double inletVol2_L,double inletT2_C) {
 
 	outletTemp_C = 0.;
 
@@ -2564,10 +3838,10 @@ void HPWH::updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbien
 	} //end if(draw_volume_L > 0)
 
 
+	// Get the "constant" tau for the stability condition and the conduction calculation
+	double tau = 0.;
 	if(doConduction) {
-
-		// Get the "constant" tau for the stability condition and the conduction calculation
-		const double tau = KWATER_WpermC / ((CPWATER_kJperkgC * 1000.0) * (DENSITYWATER_kgperL * 1000.0) 
+		tau = KWATER_WpermC / ((CPWATER_kJperkgC * 1000.0) * (DENSITYWATER_kgperL * 1000.0) 
 			* (nodeHeight_m * nodeHeight_m)) * secondsPerStep;
 		if(tau > 0.5) {
 			if(hpwhVerbosity >= VRB_reluctant) {
@@ -2576,78 +3850,118 @@ void HPWH::updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbien
 			simHasFailed = true;
 			return;
 		}
+	}
+	// every node changes here, so the energy balance takes the new temperatures and their sum from the same pass
+	const bool refreshBalance = doEnergyBalance && balanceTankHeatContentValid
+		&& static_cast<int>(balanceNodeT_C.size()) == getNumNodes();
+	double balanceSumT_C = updateConductionAndLosses(tankTemps_C,nextTankTemps_C,tau,tankAmbientT_C,
+		refreshBalance ? balanceNodeT_C.data() : nullptr);
+	// the losses take heat from every node, so the next SoC update goes over the whole tank
+	markNodesChanged(0,getNumNodes());
+	if(refreshBalance) {
+		balanceNodeTSum_C = balanceSumT_C;
+		balanceChangedBegin = getNumNodes();
+		balanceChangedEnd = 0;
+	}
 
+	// check for inverted temperature profile 
+	mixTankInversions();
+
+}  //end updateNodalTankTemps
+
+template<typename Real>
+double HPWH::updateConductionAndLosses(std::vector<Real> &temps_C,std::vector<Real> &nextTemps_C,double tau,double tankAmbientT_C,
+	Real *balanceT_C) {
+	// One pass over the tank does the conduction (when tau > 0) and the top, bottom and side losses into
+	// nextTemps_C, which then swaps with temps_C. The node temperatures are the same, bit for bit, as
+	// doing these one after another; the standby losses are summed once, so they agree to round-off.
+	// The node arithmetic is all in Real, so that a float tank runs in float. When balanceT_C is given,
+	// the new temperatures are copied there too, and their sum is returned.
+	const int numNodes = static_cast<int>(temps_C.size());
+	const Real *T = temps_C.data();
+	Real *nextT = nextTemps_C.data();
+	const Real tau_ = static_cast<Real>(tau);
+	const Real ambientT_C = static_cast<Real>(tankAmbientT_C);
+	const Real hoursPerStep_ = static_cast<Real>(hoursPerStep);
+	const Real nodeCp_ = static_cast<Real>(nodeCp_kJperC);
+
+	// kJ's lost as standby in the current time step through the top, the bottom and each node's share of the sides
+	const double topUA_kJperHrC = tankUA_kJperHrC * fracAreaTop;
+	const Real sideUA_kJperHrC = static_cast<Real>((tankUA_kJperHrC * fracAreaSide + fittingsUA_kJperHrC) / numNodes);
+	const double bottomLoss_kJ = topUA_kJperHrC * (T[0] - tankAmbientT_C) * hoursPerStep;
+	const double topLoss_kJ = topUA_kJperHrC * (T[numNodes - 1] - tankAmbientT_C) * hoursPerStep;
+
+	// the bottom and top nodes
+	if(doConduction) {
 		// Boundary condition for the finite difference. 
 		const double bc = 2.0 * tau *  tankUA_kJperHrC * fracAreaTop * nodeHeight_m / KWATER_WpermC;
 
-		// Small truncation differences here lead to larger differences later 
-		double T0 = tankTemps_C[0];
-		double Tn0 = tankTemps_C[getNumNodes() - 1];
-
 		// Boundary nodes for finite difference; outer edge of top and bottom nodes first
-		double nextT0 = (1. - bc) * T0 + bc * tankAmbientT_C;
-		double nextTn0 = (1. - bc) * Tn0 + bc * tankAmbientT_C;
-		if (getNumNodes() > 1) { // inner edges of top and bottom nodes
-			nextT0 += 2. * tau * (tankTemps_C[1] - T0);
-			nextTn0 += 2. * tau * (tankTemps_C[getNumNodes() - 2] - Tn0);
-		}
-		nextTankTemps_C[0] = nextT0;
-		nextTankTemps_C[getNumNodes() - 1] = nextTn0;
-
-		// Internal nodes for the finite difference
-		for(int i = 1; i < getNumNodes() - 1; i++) {
-			nextTankTemps_C[i] = tankTemps_C[i] + tau * (tankTemps_C[i + 1] - 2.0 * tankTemps_C[i] + tankTemps_C[i - 1]);
-		}
-
-		// nextTankTemps_C gets assigns to tankTemps_C at the bottom of the function after q_UA.
-		// UA loss from the sides are found at the bottom of the function.
-		double standbyLosses_kJ = (tankUA_kJperHrC * fracAreaTop * (tankTemps_C[0] - tankAmbientT_C) * hoursPerStep);
-		standbyLosses_kJ += (tankUA_kJperHrC * fracAreaTop * (tankTemps_C[getNumNodes() - 1] - tankAmbientT_C) * hoursPerStep);
-		standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
-	} else { // Ignore tank conduction and calculate UA losses from top and bottom. UA loss from the sides are found at the bottom of the function
-
-		for(int i = 0; i < getNumNodes(); i++) {
-			nextTankTemps_C[i] = tankTemps_C[i];
+		double nextT0 = (1. - bc) * T[0] + bc * tankAmbientT_C;
+		double nextTn0 = (1. - bc) * T[numNodes - 1] + bc * tankAmbientT_C;
+		if(numNodes > 1) { // inner edges of top and bottom nodes
+			nextT0 += 2. * tau * (T[1] - T[0]);
+			nextTn0 += 2. * tau * (T[numNodes - 2] - T[numNodes - 1]);
+		}
+		nextT[0] = static_cast<Real>(nextT0);
+		nextT[numNodes - 1] = static_cast<Real>(nextTn0);
+	} else {
+		nextT[0] = T[0];
+		nextT[numNodes - 1] = T[numNodes - 1];
+		nextT[0] -= bottomLoss_kJ / nodeCp_kJperC;
+		nextT[numNodes - 1] -= topLoss_kJ / nodeCp_kJperC;
+	}
+	nextT[0] -= sideUA_kJperHrC * (T[0] - ambientT_C) * hoursPerStep_ / nodeCp_;
+	Real sumT_C = T[0];
+	double newSumT_C = 0.;
+	if(numNodes > 1) {
+		nextT[numNodes - 1] -= sideUA_kJperHrC * (T[numNodes - 1] - ambientT_C) * hoursPerStep_ / nodeCp_;
+		sumT_C += T[numNodes - 1];
+	}
+	if(balanceT_C != nullptr) {
+		balanceT_C[0] = nextT[0];
+		balanceT_C[numNodes - 1] = nextT[numNodes - 1];
+		newSumT_C = (numNodes > 1) ? static_cast<double>(nextT[0]) + nextT[numNodes - 1] : nextT[0];
+	}
+
+	// Internal nodes, with four running sums so the loop has no dependence from one node to the next
+	Real laneSumT_C[4] = {0.,0.,0.,0.};
+	double laneNewSumT_C[4] = {0.,0.,0.,0.};
+	int i = 1;
+	for(; i + 4 <= numNodes - 1; i += 4) {
+		for(int lane = 0; lane < 4; lane++) {
+			const int j = i + lane;
+			nextT[j] = T[j] + tau_ * (T[j + 1] - Real(2.0) * T[j] + T[j - 1])
+				- sideUA_kJperHrC * (T[j] - ambientT_C) * hoursPerStep_ / nodeCp_;
+			laneSumT_C[lane] += T[j];
+			if(balanceT_C != nullptr) {
+				balanceT_C[j] = nextT[j];
+				laneNewSumT_C[lane] += nextT[j];
+			}
 		}
-
-		//kJ's lost as standby in the current time step for the top node.
-		double standbyLosses_kJ = (tankUA_kJperHrC * fracAreaTop * (tankTemps_C[0] - tankAmbientT_C) * hoursPerStep);
-		standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
-
-		nextTankTemps_C.front() -= standbyLosses_kJ / nodeCp_kJperC;
-
-		//kJ's lost as standby in the current time step for the bottom node.
-		standbyLosses_kJ = (tankUA_kJperHrC * fracAreaTop * (tankTemps_C[getNumNodes() - 1] - tankAmbientT_C) * hoursPerStep);
-		standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
-
-		nextTankTemps_C.back() -= standbyLosses_kJ / nodeCp_kJperC;
-		// UA loss from the sides are found at the bottom of the function.
-
 	}
-
-	//calculate standby losses from the sides of the tank
-	{
-		auto rat = (tankUA_kJperHrC * fracAreaSide + fittingsUA_kJperHrC) / getNumNodes();
-		auto nextT = nextTankTemps_C.begin();
-		for(auto T: tankTemps_C) {
-			//faction of tank area on the sides
-			//kJ's lost as standby in the current time step for each node.
-			double standbyLosses_kJ = rat * (T - tankAmbientT_C) * hoursPerStep;
-			standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
-
-			//The effect of standby loss on temperature in each node
-			*nextT -= standbyLosses_kJ / nodeCp_kJperC;
-			++nextT;
+	for(; i < numNodes - 1; i++) {
+		nextT[i] = T[i] + tau_ * (T[i + 1] - Real(2.0) * T[i] + T[i - 1])
+			- sideUA_kJperHrC * (T[i] - ambientT_C) * hoursPerStep_ / nodeCp_;
+		laneSumT_C[0] += T[i];
+		if(balanceT_C != nullptr) {
+			balanceT_C[i] = nextT[i];
+			laneNewSumT_C[0] += nextT[i];
 		}
 	}
+	sumT_C += (laneSumT_C[0] + laneSumT_C[1]) + (laneSumT_C[2] + laneSumT_C[3]);
+	newSumT_C += (laneNewSumT_C[0] + laneNewSumT_C[1]) + (laneNewSumT_C[2] + laneNewSumT_C[3]);
 
-	// Assign the new temporary tank temps to the real tank temps.
-	for(int i = 0; i < getNumNodes(); i++) 	tankTemps_C[i] = nextTankTemps_C[i];
-
-	// check for inverted temperature profile 
-	mixTankInversions();
+	double sideLosses_kJ = sideUA_kJperHrC * (sumT_C - numNodes * tankAmbientT_C) * hoursPerStep;
+	standbyLosses_kWh += KJ_TO_KWH(bottomLoss_kJ + topLoss_kJ + sideLosses_kJ);
 
-}  //end updateTankTemps
+	temps_C.swap(nextTemps_C);
+	return newSumT_C;
+}
+template double HPWH::updateConductionAndLosses(std::vector<float> &temps_C,std::vector<float> &nextTemps_C,double tau,double tankAmbientT_C,
+	float *balanceT_C);
+template double HPWH::updateConductionAndLosses(std::vector<double> &temps_C,std::vector<double> &nextTemps_C,double tau,double tankAmbientT_C,
+	double *balanceT_C);
 
 void HPWH::updateSoCIfNecessary() {
 	if(usesSoCLogic) {
@@ -2655,35 +3969,58 @@ void HPWH::updateSoCIfNecessary() {
 	}
 }
 
+void HPWH::markNodesChanged(int nodeBegin,int nodeEnd) {
+	if(nodeBegin < socChangedBegin) {
+		socChangedBegin = nodeBegin;
+	}
+	if(nodeEnd > socChangedEnd) {
+		socChangedEnd = nodeEnd;
+	}
+	if(nodeBegin < balanceChangedBegin) {
+		balanceChangedBegin = nodeBegin;
+	}
+	if(nodeEnd > balanceChangedEnd) {
+		balanceChangedEnd = nodeEnd;
+	}
+}
+
 // Inversion mixing modeled after bigladder EnergyPlus code PK
 void HPWH::mixTankInversions() {
+	mixTankInversions(tankTemps_C);
+}
+
+template<typename Real>
+void HPWH::mixTankInversions(std::vector<Real> &temps_C) {
+	// The mixed temperature is worked out in Real, so the one that is assigned is the one that was compared
 	bool hasInversion;
-	const double volumePerNode_L = tankVolume_L / getNumNodes();
+	const int numNodes = static_cast<int>(temps_C.size());
+	const Real massPerNode_kg = static_cast<Real>(tankVolume_L / numNodes * DENSITYWATER_kgperL);
 	//int numdos = 0;
 	if(doInversionMixing) {
 		do {
 			hasInversion = false;
 			//Start from the top and check downwards
-			for(int i = getNumNodes() - 1; i > 0; i--) {
-				if(tankTemps_C[i] < tankTemps_C[i - 1]) {
+			for(int i = numNodes - 1; i > 0; i--) {
+				if(temps_C[i] < temps_C[i - 1]) {
 					// Temperature inversion!
 					hasInversion = true;
 
 					//Mix this inversion mixing temperature by averaging all of the inverted nodes together together. 
-					double Tmixed = 0.0;
-					double massMixed = 0.0;
+					Real Tmixed = 0.0;
+					Real massMixed = 0.0;
 					int m;
 					for(m = i; m >= 0; m--) {
-						Tmixed += tankTemps_C[m] * (volumePerNode_L * DENSITYWATER_kgperL);
-						massMixed += (volumePerNode_L * DENSITYWATER_kgperL);
-						if((m == 0) || (Tmixed / massMixed > tankTemps_C[m - 1])) {
+						Tmixed += temps_C[m] * massPerNode_kg;
+						massMixed += massPerNode_kg;
+						if((m == 0) || (Tmixed / massMixed > temps_C[m - 1])) {
 							break;
 						}
 					}
 					Tmixed /= massMixed;
 
 					// Assign the tank temps from i to k
-					for(int k = i; k >= m; k--) tankTemps_C[k] = Tmixed;
+					for(int k = i; k >= m; k--) temps_C[k] = Tmixed;
+					markNodesChanged(m,i + 1);
 				}
 
 			}
@@ -2691,6 +4028,8 @@ void HPWH::mixTankInversions() {
 		} while(hasInversion);
 	}
 }
+template void HPWH::mixTankInversions(std::vector<float> &temps_C);
+template void HPWH::mixTankInversions(std::vector<double> &temps_C);
 
 void HPWH::addExtraHeat(std::vector<double> &nodePowerExtra_W,double tankAmbientT_C){
 
@@ -2706,7 +4045,8 @@ void HPWH::addExtraHeat(std::vector<double> &nodePowerExtra_W,double tankAmbient
 			// add heat 
 			heatSources[i].addHeat(tankAmbientT_C,minutesPerStep);			 
 
-			// 0 out to ignore features
+			// 0 out to ignore features, keeping the heat for the energy balance
+			extraHeat_kWh += heatSources[i].energyOutput_kWh;
 			heatSources[i].perfMap.clear();
 			heatSources[i].energyInput_kWh = 0.0;
 			heatSources[i].energyOutput_kWh = 0.0;
@@ -2737,15 +4077,15 @@ double HPWH::tankAvg_C(const std::vector<HPWH::NodeWeight> nodeWeights) const {
 	double totWeight = 0;
 
 	std::vector<double> resampledTankTemps(LOGIC_NODE_SIZE);
-	resample(resampledTankTemps, tankTemps_C);
+	tankModel->getSectionTemps(resampledTankTemps);
 
 	for (auto &nodeWeight : nodeWeights) {		
 		if (nodeWeight.nodeNum == 0) { // bottom node only
-			sum +=  tankTemps_C.front() * nodeWeight.weight;
+			sum +=  tankModel->getNodeT_C(0) * nodeWeight.weight;
 			totWeight += nodeWeight.weight;
 		}		
 		else if (nodeWeight.nodeNum > LOGIC_NODE_SIZE) { // top node only
-			sum += tankTemps_C.back() * nodeWeight.weight;
+			sum += tankModel->getNodeT_C(getNumNodes() - 1) * nodeWeight.weight;
 			totWeight += nodeWeight.weight;
 		}
 		else { // general case; sum over all weighted nodes
@@ -2768,9 +4108,13 @@ void HPWH::mixTankNodes(int mixedAboveNode,int mixedBelowNode,double mixFactor)
 		tankTemps_C[i] += ((ave - tankTemps_C[i]) / mixFactor);
 		//tankTemps_C[i] = tankTemps_C[i] * (1.0 - 1.0 / mixFactor) + ave / mixFactor;
 	}
+	markNodesChanged(mixedAboveNode,mixedBelowNode);
 }
 
 void HPWH::calcSizeConstants() {
+	// the heat content of the tank goes with its volume
+	balanceTankHeatContentValid = false;
+
 	// calculate conduction between the nodes AND heat loss by node with top and bottom having greater surface area.
 	// model uses explicit finite difference to find conductive heat exchange between the tank nodes with the boundary conditions
 	// on the top and bottom node being the fraction of UA that corresponds to the top and bottom of the tank.  
@@ -2810,7 +4154,7 @@ void HPWH::calcDerivedValues() {
 }
 
 void HPWH::calcDerivedHeatingValues(){
-	static char outputString[MAXOUTSTRING];  //this is used for debugging outputs
+	char outputString[MAXOUTSTRING];  //this is used for debugging outputs
 
 	//condentropy/shrinkage
 	double condentropy = 0.;
@@ -2869,7 +4213,10 @@ void HPWH::calcDerivedHeatingValues(){
 	double highestPos = 0.; // -1 to make sure a an element on the bottom can still be identified.
 	for(int i = 0; i < getNumHeatSources(); i++) {
 		if(heatSources[i].isACompressor()) {
-			compressorIndex = i;  // NOTE: Maybe won't work with multiple compressors (last compressor will be used)
+			// the first compressor, which leads any compressor stages copied after it
+			if(compressorIndex == -1) {
+				compressorIndex = i;
+			}
 		} else if(heatSources[i].isAResistance()){
 			// Gets VIP element index
 			if(heatSources[i].isVIP) {
@@ -2913,6 +4260,16 @@ void HPWH::calcDerivedHeatingValues(){
 		}
 	}
 
+	// the topology, from the compressor
+	if(!hasACompressor()) {
+		stepTopology = TOPOLOGY_RESISTANCE;
+	} else if(heatSources[compressorIndex].configuration != HeatSource::CONFIG_EXTERNAL) {
+		stepTopology = TOPOLOGY_INTEGRATED;
+	} else if(heatSources[compressorIndex].isMultipass) {
+		stepTopology = TOPOLOGY_MULTIPASS;
+	} else {
+		stepTopology = TOPOLOGY_SINGLEPASS;
+	}
 }
 
 void HPWH::mapResRelativePosToHeatSources() {
@@ -20,6 +20,11 @@ namespace Btwxt { class RegularGridInterpolator; };
  *  excluded from compiling.  This is done in order to reduce the size of the
  * final compiled code.  */
 
+//#define HPWH_FLOAT_TANK
+/**<  If HPWH_FLOAT_TANK is defined, then the tank node temperatures and the kernels
+ * that update them use float instead of double.  This halves the memory of the tank
+ * and doubles the width of its vector arithmetic, at some loss of precision.  */
+
 #define HPWHVRSN_MAJOR @HPWHsim_VRSN_MAJOR@
 #define HPWHVRSN_MINOR @HPWHsim_VRSN_MINOR@
 #define HPWHVRSN_PATCH @HPWHsim_VRSN_PATCH@
@@ -51,6 +56,13 @@ public:
 	static const double MAXOUTLET_R744; /**< The max oulet temperature for compressors with the refrigerant R744*/
 	static const double MINSINGLEPASSLIFT; /**< The minimum temperature lift for single pass compressors */
 
+#ifdef HPWH_FLOAT_TANK
+	typedef float tankReal_t;
+#else
+	typedef double tankReal_t;
+#endif
+	/**< the scalar type of the tank node temperatures, see HPWH_FLOAT_TANK */
+
 	HPWH();  /**< default constructor */
 	HPWH(const HPWH &hpwh);  /**< copy constructor  */
 	HPWH & operator=(const HPWH &hpwh);  /**< assignment operator  */
@@ -232,6 +244,12 @@ public:
 		VRB_emetic = 30      /**< print all the things  */
 	};
 
+	/** what the asynchronous messages of setAsyncMessages do when the buffer is full  */
+	enum MESSAGE_OVERFLOW {
+		MESSAGES_BLOCK,		/**< wait for the writer thread to make room, losing nothing  */
+		MESSAGES_DROP		/**< drop the new message, and count it  */
+	};
+
 
 	enum UNITS{
 		UNITS_C,          /**< celsius  */
@@ -276,6 +294,126 @@ public:
 		CSVOPT_IPUNITS
 	};
 
+	/** specifies the engine that moves water and heat through the tank between the heat sources  */
+	enum TANK_MODEL {
+		TANK_MODEL_NODAL,		/**< the stratified node model, the default  */
+		TANK_MODEL_THERMOCLINE	/**< a cold zone and a hot zone with a linear thermocline between them  */
+	};
+
+	/** the kind of heat pump a model has, which picks the routines its heat sources step with  */
+	enum STEP_TOPOLOGY {
+		TOPOLOGY_RESISTANCE,	/**< resistance elements only, or no heat sources at all  */
+		TOPOLOGY_INTEGRATED,	/**< a compressor wrapped around or submerged in the tank  */
+		TOPOLOGY_SINGLEPASS,	/**< an external single pass compressor  */
+		TOPOLOGY_MULTIPASS		/**< an external multipass compressor  */
+	};
+
+	/** the draw patterns of the DOE 24 hour simulated-use test, picked by the first-hour rating  */
+	enum DRAW_PATTERN {
+		DRAW_PATTERN_VERYSMALL,	/**< a first-hour rating under 18 gal  */
+		DRAW_PATTERN_LOW,		/**< from 18 gal up to 51 gal  */
+		DRAW_PATTERN_MEDIUM,	/**< from 51 gal up to 75 gal  */
+		DRAW_PATTERN_HIGH		/**< 75 gal and over  */
+	};
+
+	/** how far rate runs the DOE test procedure; each part needs the ones before it  */
+	enum RATING_PARTS {
+		RATE_FHR,	/**< the first-hour rating only  */
+		RATE_RE,	/**< the 24 hour test up to the end of its first recovery, for the recovery efficiency  */
+		RATE_UEF	/**< the whole 24 hour test  */
+	};
+
+	/** the results of rate  */
+	struct Rating {
+		double firstHourRating_L = 0.;	/**< the first-hour rating  */
+		DRAW_PATTERN drawPattern = DRAW_PATTERN_VERYSMALL;	/**< the draw pattern the first-hour rating calls for  */
+		double recoveryEfficiency = 0.;	/**< from the first recovery of the 24 hour test  */
+		double UEF = 0.;	/**< the uniform energy factor  */
+		double adjustedDailyEnergy_kWh = 0.;	/**< the energy input of the 24 hour test, adjusted to the nominal test  */
+	};
+
+	/** the model parameters calibrate can tune  */
+	enum CALIBRATION_PARAMETER {
+		CALIBRATE_UA,				/**< the tank UA in kJ/hrC, as setUA  */
+		CALIBRATE_COP_SCALE,		/**< a factor on the COP curves of the compressors, not for performance grids  */
+		CALIBRATE_RESISTANCE_SCALE	/**< a factor on the power of every resistance element  */
+	};
+
+	/** the ratings calibrate can aim for  */
+	enum RATING_METRIC {
+		METRIC_UEF,			/**< Rating::UEF  */
+		METRIC_RE,			/**< Rating::recoveryEfficiency  */
+		METRIC_FHR_L		/**< Rating::firstHourRating_L  */
+	};
+
+	/** the values runSizingSweep tries; it runs every combination, and an empty list keeps the model's value  */
+	struct SizingGrid {
+		std::vector<double> tankVolumes_L;				/**< as setTankSize_adjustUA  */
+		std::vector<double> compressorCapacities_kW;	/**< as setCompressorOutputCapacity at its default conditions  */
+		std::vector<double> resistanceCapacities_kW;	/**< of every element, as setResistanceCapacity  */
+		std::vector<double> setpoints_C;
+	};
+
+	/** one configuration of runSizingSweep and how it did on the schedule  */
+	struct SizingResult {
+		double tankVolume_L = 0.;
+		double compressorCapacity_kW = 0.;	/**< at the default conditions of getCompressorCapacity, 0 without a compressor  */
+		double resistanceCapacity_kW = 0.;	/**< of all the elements together, 0 without resistance elements  */
+		double setpoint_C = 0.;
+		bool isConfigurable = false;	/**< false if the model would not take these values, so it was not run  */
+		bool meetsDelivery = false;		/**< whether the draws below the delivery temperature stayed within the allowance  */
+		int numStepsRun = 0;			/**< the steps simulated, fewer than the schedule's if the configuration was pruned  */
+		double energyInput_kWh = 0.;	/**< the energy input of the heat sources over the steps run  */
+		double unmetDrawVolume_L = 0.;	/**< the draw volume delivered below the delivery temperature over the steps run  */
+		bool isParetoOptimal = false;	/**< whether no other configuration that meets delivery is at least as good in energy
+											input, tank volume, compressor capacity and resistance capacity, and better in one  */
+	};
+
+	/** one parameter for calibrate to tune, and the rating it is tuned to hit  */
+	struct CalibrationGoal {
+		CALIBRATION_PARAMETER parameter;
+		double minValue;	/**< the low end of the range searched  */
+		double maxValue;	/**< the high end of the range searched  */
+		RATING_METRIC metric;
+		double target;		/**< the rating to hit  */
+		double tolerance;	/**< how close the rating must come to the target  */
+	};
+
+	/** a kind of draw for generateDraws, such as showers; its events come as a Poisson process through the day  */
+	struct DrawEventType {
+		double eventsPerDay = 0.;		/**< the mean number of events a day  */
+		double meanVolume_L = 0.;		/**< the mean hot water volume of an event  */
+		double sdVolume_L = 0.;			/**< the standard deviation of the volume, which is lognormal; 0 for a fixed volume  */
+		double flowRate_Lper_min = 0.;	/**< the flow while an event runs, which sets how many minutes it spans  */
+		std::vector<double> hourlyWeights;	/**< the relative likelihood of an event starting in each of the 24 hours
+												of the day, or empty for all hours alike  */
+	};
+
+	/** how one trial of runMonteCarloDraws went  */
+	struct DrawTrialResult {
+		double drawVolume_L = 0.;
+		double unmetDrawVolume_L = 0.;		/**< the draw volume delivered below the use temperature  */
+		double shortfallEnergy_kWh = 0.;	/**< the heat the draws below the use temperature lacked to reach it  */
+		int numShortfallSteps = 0;			/**< the steps with a draw delivered below the use temperature  */
+		double minOutletT_C = 0.;			/**< the lowest outlet temperature of a step with a draw, 0 without draws  */
+		double meanOutletT_C = 0.;			/**< the outlet temperature averaged over the draw volume, 0 without draws  */
+		double energyInput_kWh = 0.;		/**< the energy input of the heat sources  */
+	};
+
+	/** the statistics of runMonteCarloDraws over its trials  */
+	struct DrawStatistics {
+		int numTrials = 0;
+		double shortfallProbability = 0.;	/**< the fraction of the trials with any draw delivered below the use temperature  */
+		double meanUnmetFraction = 0.;		/**< the fraction of the draw volume delivered below the use temperature,
+												averaged over the trials  */
+		double p95UnmetFraction = 0.;		/**< the 95th percentile of that fraction over the trials  */
+		double maxUnmetFraction = 0.;		/**< the largest of that fraction over the trials  */
+		double meanShortfallEnergy_kWh = 0.;
+		double meanOutletT_C = 0.;			/**< the outlet temperature averaged over the draw volume of all the trials  */
+		double minOutletT_C = 0.;			/**< the lowest outlet temperature of a step with a draw in any trial  */
+		double meanEnergyInput_kWh = 0.;
+	};
+
 	struct NodeWeight {
 		int nodeNum;
 		double weight;
@@ -308,6 +446,11 @@ public:
 
 		virtual int setDecisionPoint(double value) = 0;
 		double getDecisionPoint() { return decisionPoint; }
+
+		/**< makes a copy of this logic that reads its tank values from hpwh_in */
+		virtual std::shared_ptr<HeatingLogic> clone(HPWH *hpwh_in) const = 0;
+		/**< appends the values that set how this logic decides, e.g. for the key of warmStart */
+		virtual void getParameters(std::vector<double> &parameters) const = 0;
 		bool getIsEnteringWaterHighTempShutoff() { return isEnteringWaterHighTempShutoff; }
 
 	protected:
@@ -335,6 +478,8 @@ public:
 		const double getTempMinUseful_C();
 		int setDecisionPoint(double value);
 		int setConstantMainsTemperature(double mains_C);
+		std::shared_ptr<HeatingLogic> clone(HPWH *hpwh_in) const;
+		void getParameters(std::vector<double> &parameters) const;
 
 	private:
 		double tempMinUseful_C;
@@ -362,6 +507,8 @@ public:
 
 		int setDecisionPoint(double value);
 		int setDecisionPoint(double value,bool absolute);
+		std::shared_ptr<HeatingLogic> clone(HPWH *hpwh_in) const;
+		void getParameters(std::vector<double> &parameters) const;
 
 	private:
 		const bool areNodeWeightsValid();
@@ -488,6 +635,156 @@ public:
 	 * The return value is 0 for successful simulation run, HPWH_ABORT otherwise
 	 */
 
+	int runAdaptiveStep(double minutesToRun,double inletT_C,double drawVolume_L,
+		double tankAmbientT_C,double heatSourceAmbientT_C,DRMODES DRstatus,
+		double inletVol2_L = 0.,double inletT2_C = 0.,std::vector<double>* nodePowerExtra_W = NULL);
+	/**< This function will progress the simulation forward by a host step of any length, taking shorter
+	 * steps internally only where a single step would miss the adaptive step tolerances, typically
+	 * around draws, heat source transitions and lockouts. The draw volumes are spread evenly over the step,
+	 * with no more than half a node drawn in one internal step. Over a day of draws the heat source energy
+	 * input stays within about 2% of one minute steps at the default tolerances.
+	 * The calculated values will be summed or averaged as in runNSteps.
+	 *
+	 * The return value is 0 for successful simulation run, HPWH_ABORT otherwise
+	 */
+
+	int setAdaptiveStepTolerance(double tankEnergyTol_kJ,double outletTTol_C,double minSubstep_min = 1.);
+	/**< sets the allowed error in tank heat content and outlet temperature for runAdaptiveStep and the
+	 * shortest internal step it will take. The energy tolerance also holds for each heat source's input and
+	 * output, and the temperature tolerance for the temperatures the heat source logics read.
+	 * Defaults are 36 kJ, 0.5 C and 1 minute. */
+
+	int getNumAdaptiveSubsteps() const;
+	/**< returns the number of internal steps taken by the last runAdaptiveStep */
+
+	int runNStepsParallel(int N,double *inletT_C,double *drawVolume_L,
+		double *tankAmbientT_C,double *heatSourceAmbientT_C,
+		DRMODES *DRstatus,int numSegments,double tankTTol_C = 0.01,int maxIterations = 0);
+	/**< This function will progress the simulation forward by N steps like runNSteps, but splits the steps
+	 * into numSegments segments that run in parallel (Parareal). The start of each segment is first guessed
+	 * with hourly adaptive steps, then the segments are rerun with the full model and their starts corrected
+	 * until the end of every segment matches the start of the next within tankTTol_C in every node.
+	 * A maxIterations of 0 allows numSegments iterations, after which the result is the sequential one.
+	 * The calculated values will be summed or averaged as in runNSteps.
+	 *
+	 * The return value is 0 for successful simulation run, HPWH_ABORT otherwise
+	 */
+
+	int getNumPararealIterations() const;
+	/**< returns the number of parallel passes taken by the last runNStepsParallel */
+
+	static void parallelFor(int begin,int end,const std::function<void(int)> &fn);
+	/**< calls fn for each index in [begin, end) on as many threads as the hardware has, for work on
+	 * separate models or copies of one  */
+
+	int runRepeatedDays(int numDays,int N,double *inletT_C,double *drawVolume_L,
+		double *tankAmbientT_C,double *heatSourceAmbientT_C,
+		DRMODES *DRstatus,double tankTTol_C = 0.01,int maxCycleDays = 7);
+	/**< This function will run the same schedule of N steps numDays times in a row, as for a rating or design
+	 * day study. Once a day ends with every node within tankTTol_C of the end of one of the last maxCycleDays
+	 * days, and with the heat sources, lockouts and DR timer in the same state, the tank is taken to have
+	 * settled into a periodic cycle and the outputs of the days in that cycle are replayed for the days left
+	 * instead of simulating them.
+	 * The calculated values will be summed or averaged over all the days as in runNSteps.
+	 *
+	 * The return value is 0 for successful simulation run, HPWH_ABORT otherwise
+	 */
+
+	int getNumSkippedDays() const;
+	/**< returns the number of days the last runRepeatedDays repeated instead of simulating */
+
+	int rate(Rating &rating,RATING_PARTS parts = RATE_UEF) const;
+	/**< Runs the DOE test procedure for storage water heaters on a copy of this model, with the draw patterns made
+	 * in memory: the first-hour rating, then the 24 hour simulated-use test with the draw pattern it calls for.
+	 * The test runs in one minute steps at a setpoint of 125 F, unless the setpoint is fixed, with 58 F inlet water
+	 * and a 67.5 F ambient. It stops as soon as the parts asked for are known; the fields of rating it did not reach
+	 * are left at 0.
+	 *
+	 * The return value is 0 for successful completion, HPWH_ABORT otherwise
+	 */
+
+	static int rateModels(const std::vector<HPWH> &hpwhs,std::vector<Rating> &ratings,RATING_PARTS parts = RATE_UEF);
+	/**< rates each model in hpwhs as rate does, in parallel, into ratings, which is resized to match.
+	 * The return value is 0 if every model was rated, HPWH_ABORT otherwise
+	 */
+
+	int runSizingSweep(const SizingGrid &grid,int N,double *inletT_C,double *drawVolume_L,
+		double *tankAmbientT_C,double *heatSourceAmbientT_C,DRMODES *DRstatus,
+		double minDeliveryT_C,double maxUnmetFraction,std::vector<SizingResult> &results) const;
+	/**< Runs a copy of this model with each combination of the values in grid through the same schedule of N steps,
+	 * in parallel. A configuration meets delivery if the draw volume that comes out below minDeliveryT_C is at most
+	 * maxUnmetFraction of the schedule's draw volume. A configuration is pruned, and stops running, as soon as it has
+	 * missed more than that, so undersized ones stop at the first period they cannot keep up with. results has one
+	 * entry per combination, with the setpoint changing fastest, then the resistance capacity, then the compressor
+	 * capacity, then the tank volume. The entries that meet delivery and are not beaten in every measure by another are
+	 * marked as the Pareto front.
+	 *
+	 * The return value is 0 for successful completion, HPWH_ABORT on bad inputs or if a simulation fails
+	 */
+
+	static int writeSizingSummary(FILE* outFILE,const std::vector<SizingResult> &results,int options = CSVOPT_NONE);
+	/**< writes results as a CSV table with a heading row, in IP units with CSVOPT_IPUNITS */
+
+	int calibrate(const std::vector<CalibrationGoal> &goals,std::vector<double> &values,Rating &rating,int maxSweeps = 10);
+	/**< Tunes one parameter of this model for each goal until each rating is within its tolerance of its target.
+	 * The parameters are left at the values found, which also go in values, and rating is the rating there.
+	 * Each goal is solved in turn with the other parameters held. A round rates several values across the
+	 * goal's bracket in parallel, then narrows the bracket to where the rating crosses the target. The goals
+	 * are swept again until they all hold, each starting from a narrow bracket around its last value. The
+	 * ratings stop at the last part the metrics need.
+	 * A simulated rating jumps where a heat source cycle moves across a step, by up to about 0.1 in UEF and
+	 * 1 gal in FHR. The tolerances should be wider than that.
+	 *
+	 * The return value is 0 for successful completion. It is HPWH_ABORT if a rating fails, a range does not
+	 * cross its target, a rating jumps across its target, or the goals do not all hold after maxSweeps sweeps.
+	 * It is also HPWH_ABORT for a CALIBRATE_COP_SCALE goal on a compressor with a performance grid.
+	 */
+
+	int warmStart(const std::string &cacheDirectory,int N,double *inletT_C,double *drawVolume_L,
+		double *tankAmbientT_C,double *heatSourceAmbientT_C,DRMODES *DRstatus,int numSpinUpRuns = 1);
+	/**< Puts the model in the state a run reaches after its spin-up: from a tank at setpoint with the heat sources
+	 * off and unlocked, the schedule of N steps run numSpinUpRuns times. The state is read from a file in
+	 * cacheDirectory if a spin-up with the same key is stored there, and is simulated and stored there otherwise.
+	 * The key covers the tank, the heat sources and their logics, the setpoint, the simulation options, the
+	 * version of HPWHsim and every value of the schedule, so a change to any of them makes a new spin-up.
+	 * The state is that of runRepeatedDays; the outputs of the spin-up steps are not part of it, and a
+	 * thermocline tank fits its zones to the restored nodes.
+	 *
+	 * The return value is 0 for successful completion, HPWH_ABORT if the spin-up fails. A cached file that
+	 * cannot be read is simulated again, and one that cannot be written is only reported.
+	 */
+
+	bool wasWarmStartCached() const;
+	/**< returns whether the last warmStart read its state from the cache */
+
+	static std::vector<DrawEventType> getResidentialDrawEvents(double numOccupants);
+	/**< returns the showers, baths, sinks, clothes washers and dishwashers of a household of numOccupants,
+	 * for generateDraws  */
+
+	static int generateDraws(const std::vector<DrawEventType> &eventTypes,int numDays,unsigned long long seed,int trial,
+		std::vector<double> &drawVolume_L);
+	/**< Fills drawVolume_L with numDays days of one minute draw volumes made at random from eventTypes. Each event
+	 * starts in an hour picked by the weights of its type, draws its volume at the flow rate of its type, and adds
+	 * to any other event running at the same time. An event still running at the end of a day carries over into
+	 * the next. The draws are the same for the same seed and trial wherever they are made, and those of
+	 * different trials are independent, so trial k of runMonteCarloDraws is generateDraws with trial k.
+	 *
+	 * The return value is 0 for successful completion, HPWH_ABORT on bad inputs
+	 */
+
+	int runMonteCarloDraws(const std::vector<DrawEventType> &eventTypes,int numTrials,int numDays,
+		unsigned long long seed,double inletT_C,double ambientT_C,double useT_C,
+		std::vector<DrawTrialResult> &trials,DrawStatistics &statistics) const;
+	/**< Runs numTrials copies of this model, in parallel, each through numDays days of its own draws from
+	 * generateDraws, in one minute steps at a fixed inlet and ambient temperature. The draws are made a day at
+	 * a time as a trial runs, with no schedule held or read. A draw delivered below useT_C is a shortfall.
+	 * trials has the results of each trial, and statistics those over all of them. Trial k gives the same
+	 * result however many threads run the trials.
+	 *
+	 * The return value is 0 for successful completion, HPWH_ABORT on bad inputs, if the model does not take
+	 * one minute steps, or if a simulation fails
+	 */
+
 	 /** Setters for the what are typically input variables  */
 	void setInletT(double newInletT_C) { member_inletT_C = newInletT_C; };
 	void setMinutesPerStep(double newMinutesPerStep);
@@ -496,6 +793,18 @@ public:
 	/**< sets the verbosity to the specified level  */
 	void setMessageCallback(void (*callbackFunc)(const std::string message,void* pContext),void* pContext);
 	/**< sets the function to be used for message passing  */
+	int setAsyncMessages(bool doAsync,int capacity = 1024,MESSAGE_OVERFLOW overflow = MESSAGES_BLOCK,
+		bool flushEachStep = false);
+	/**< Hands messages to a writer thread instead of formatting and passing them out as they are made, default
+	 * is off. A message is copied as its format and arguments into a ring buffer of capacity messages, and the
+	 * writer formats it and passes it to the message callback or cout in the order they were made. When the
+	 * buffer is full the message waits or is dropped, as overflow says. The buffer is flushed by flushMessages,
+	 * when this model is destroyed or its settings changed, and after every runOneStep if flushEachStep.
+	 * The message callback is called from the writer thread. Copies of this model write through their own. */
+	void flushMessages() const;
+	/**< waits until every message made so far has been passed out  */
+	long long getNumDroppedMessages() const;
+	/**< returns the number of messages dropped since setAsyncMessages  */
 	void printHeatSourceInfo();
 	/**< this prints out the heat source info, nicely formatted
 		specifically input/output energy/power, and runtime
@@ -544,6 +853,55 @@ public:
 	/** Returns State of Charge calculated from the heating logics if this hpwh uses SoC logics. */
 	double getSoCFraction() const;
 
+	int setDoSoCCrossCheck(bool doCheck);
+	/**< This is a simple setter for checking the incrementally tracked state of charge against a full recalculation
+		after every update, default is false. Mismatches are reported and the full value is used. */
+
+	int setEnergyBalanceCheck(bool doCheck,double maxResidualFraction = 0.);
+	/**< Keeps an energy balance of the tank in runOneStep, default is off: the heat put in by the heat sources and
+	 * extra heat, less the standby losses and the heat the draw carries out, against the change in the tank's heat
+	 * content. A step whose residual is more than maxResidualFraction of the tank's heat content is flagged, and 0
+	 * flags none. Setting the check clears the cumulative residual and the count of flagged steps. */
+
+	int setRecirculationLoop(double UA_kJperHrC,double flowRate_Lper_min,double loopAmbientT_C,
+		const std::vector<double> &hourlyPumpFractions = std::vector<double>(),double startMinuteOfDay = 0.);
+	/**< Adds a recirculation loop, default is none. Its pump takes water from the top of the tank and returns it
+	 * through the second inlet, at the height set by setInlet2ByFraction. While the pump runs, flowRate_Lper_min
+	 * goes around the loop and comes back at the steady return temperature of a pipe of UA_kJperHrC in
+	 * loopAmbientT_C. The water leaves at the mean temperature of the volume the step draws off the top of the tank,
+	 * and the loss is the heat of that water down to the return temperature. runOneStep adds
+	 * the loop's volume and loss for the whole step to the draw and the second inlet, mixed with any flow the host
+	 * passes there, so steps of any length take the loop without substeps. The pump runs the fraction of each hour
+	 * of the day given in hourlyPumpFractions, or all the time if it is empty, on a clock that starts at
+	 * startMinuteOfDay and moves with each step.
+	 * The return value is 0 for success, HPWH_ABORT for a negative UA or flow, or pump fractions that are not
+	 * 24 values from 0 to 1 */
+	void clearRecirculationLoop();
+	/**< removes the recirculation loop */
+	bool hasRecirculationLoop() const;
+
+	int setCompressorStages(int numStages,
+		const std::vector<std::shared_ptr<HeatingLogic>> &stageOnLogics = std::vector<std::shared_ptr<HeatingLogic>>(),
+		const std::vector<std::shared_ptr<HeatingLogic>> &stageOffLogics = std::vector<std::shared_ptr<HeatingLogic>>(),
+		bool rotateLead = true);
+	/**< Runs the compressor as numStages identical modules, default is one, e.g. a plant of Colmac or Nyle units
+	 * on one tank. Each stage is a copy of the compressor as it is set up when this is called, with a heat source of
+	 * its own right after the compressor's, so the heat source outputs report each stage. The lead stage comes on by
+	 * the compressor's logic. Lag stage k, from 1 to numStages - 1, comes on while the stages ahead of it run and
+	 * stageOnLogics[k - 1] holds, and goes off when stageOffLogics[k - 1] holds, or with the lead once the tank is
+	 * heated if there are no stage-off logics. The logics are made with this HPWH's logic functions, e.g. bottomThird
+	 * for staging by tank temperature, or turnOnSoC for staging by state of charge under switchToSoCControls. With
+	 * rotateLead the next stage leads each heating cycle, so the stages share the run time. Setting one stage
+	 * removes the staging.
+	 * The return value is 0 for success, HPWH_ABORT for a model without a compressor, fewer than one stage, or
+	 * missing or invalid logics */
+	int getNumCompressorStages() const;
+	/**< returns the number of compressor stages, 1 for an unstaged compressor and 0 for none */
+	int getCompressorStageIndex(int stage) const;
+	/**< returns the index in the heat sources of a compressor stage, or HPWH_ABORT for a stage that does not exist */
+	int getLeadCompressorStage() const;
+	/**< returns the stage that leads the next heating cycle */
+
 	double getMinOperatingTemp(UNITS units = UNITS_C) const;
 	/**< a function to return the minimum operating temperature of the compressor  */
 
@@ -584,6 +942,46 @@ public:
 	int setDoConduction(bool doCondu);
 	/**< This is a simple setter for doing internal conduction and nodal heatloss, default is true*/
 
+	int setFastHeatDistribution(bool doFast);
+	/**< Spreads the heat of wrapped condensers with an approximate logistic function instead of exp, which is
+	 * within 3e-10 of it, relative. The distributions can differ from the default where a node's share is near
+	 * the cutoff for a share of no heat. Default is false. */
+
+	STEP_TOPOLOGY getStepTopology() const;
+	/**< returns the topology found at init, from the configuration of the compressor if there is one */
+
+	int setClosedFormSinglePass(bool doClosedForm,double capacityDeltaT_C = 0.5);
+	/**< Heats with an external single pass heat pump for a whole step in one pass, instead of one node at a time,
+	 * and takes its capacity again only when the condenser inlet has changed by more than capacityDeltaT_C since
+	 * it was last taken. The results differ from the default by the capacity threshold and by where the tank
+	 * mixes out inversions. Default is false. */
+
+	int setClosedFormMultipass(bool doClosedForm,double capacityDeltaT_C = 0.5);
+	/**< Heats with an external multipass heat pump as a mixed tank that warms by the same amount each time the loop
+	 * passes a node, instead of moving the nodes once a pass. The capacity is taken again only when the tank has
+	 * warmed by more than capacityDeltaT_C since it was last taken, and the shut off logics are checked where it is.
+	 * Default is false. */
+
+	int setAdaptiveNodeGrid(bool doGrid,int maxRefinement = 3,double refineDeltaT_C = 1.);
+	/**< Turns on a finer grid under the tank nodes for draws, conduction, standby losses and inversion mixing.
+	 * Each node is split in halves up to maxRefinement times where the temperature changes by more than
+	 * refineDeltaT_C across it or its neighbors, and merged back where the profile flattens out. Heat sources,
+	 * logics and the node getters keep working on the nodes, which hold the average of their part of the grid.
+	 * Default is off. */
+
+	int getNumGridNodes() const;
+	/**< returns the number of grid nodes under the tank nodes, or the number of nodes with the grid off */
+
+	int setTankModel(TANK_MODEL model);
+	/**< Chooses the engine for draws, conduction and standby losses. TANK_MODEL_THERMOCLINE reduces the tank to
+	 * a cold zone, a hot zone and a thermocline of finite thickness between them. Submerged and wrapped heat
+	 * sources heat the zones, and the logics read them; the tank nodes are set from the zones only when
+	 * something asks for them. External heat sources heat the nodes, and the zones are refit to the result.
+	 * Both inlets feed the bottom of the tank and the adaptive grid has no effect. Default is TANK_MODEL_NODAL. */
+
+	TANK_MODEL getTankModel() const;
+	/**< returns the engine chosen with setTankModel */
+
 	int setUA(double UA,UNITS units = UNITS_kJperHrC);
 	/**< This is a setter for the UA, with or without units specified - default is metric, kJperHrC */
 
@@ -654,14 +1052,12 @@ public:
 
 	int getCompressorIndex() const;
 	/**< returns the index of the compressor in the heat source array.
-	Note only supports HPWHs with one compressor, if multiple will return the last index
-	of a compressor */
+	With compressor stages this is the first stage. */
 
 	double getCompressorCapacity(double airTemp = 19.722,double inletTemp = 14.444,double outTemp = 57.222,
 		UNITS pwrUnit = UNITS_KW,UNITS tempUnit = UNITS_C);
 	/**< Returns the heating output capacity of the compressor for the current HPWH model.
-	Note only supports HPWHs with one compressor, if multiple will return the last index
-	of a compressor. Outlet temperatures greater than the max allowable setpoints will return an error, but
+	With compressor stages this is the capacity of one stage. Outlet temperatures greater than the max allowable setpoints will return an error, but
 	for compressors with a fixed setpoint the */
 
 	int setCompressorOutputCapacity(double newCapacity,double airTemp = 19.722,double inletTemp = 14.444,double outTemp = 57.222,
@@ -670,8 +1066,7 @@ public:
 	For multi-pass models the capacity is set as the average between the inletTemp and outTemp since multi-pass models will increase
 	the water temperature only a few degrees at a time (i.e. maybe 10 degF) until the tank reaches the outTemp, the capacity at
 	inletTemp might not be accurate for the entire heating cycle.
-	Note only supports HPWHs with one compressor, if multiple will return the last index
-	of a compressor */
+	Set the compressor up before setCompressorStages, which copies it to each stage. */
 
 	int setScaleHPWHCapacityCOP(double scaleCapacity = 1.,double scaleCOP = 1.);
 	/**< Scales the heatpump water heater input capacity and COP*/
@@ -718,6 +1113,11 @@ public:
 		returns HPWH_ABORT for N out of bounds  */
 	HEATSOURCE_TYPE getNthHeatSourceType(int N) const;
 	/**< returns the enum value for what type of heat source the Nth heat source is  */
+	double getNthCompressorStageEnergyInput(int N,UNITS units = UNITS_KWH) const;
+	double getNthCompressorStageEnergyOutput(int N,UNITS units = UNITS_KWH) const;
+	double getNthCompressorStageRunTime(int N) const;
+	/**< return the energy input, energy output and run time of the Nth compressor stage in the last step, as the
+	  heat source getters do, with HPWH_ABORT for N out of bounds or incorrect units  */
 
 
 	double getOutletTemp(UNITS units = UNITS_C) const;
@@ -751,6 +1151,28 @@ public:
 	/**< get the heat content of the tank, relative to zero celsius
 	 * returns using kilojoules */
 
+	double getEnergyBalanceResidual(UNITS units = UNITS_KWH) const;
+	/**< get the energy balance residual of the last step in specified units, see setEnergyBalanceCheck:
+	  the heat put in, less the heat taken out, less the gain in the tank's heat content
+	  returns HPWH_ABORT for incorrect units  */
+	double getCumulativeEnergyBalanceResidual(UNITS units = UNITS_KWH) const;
+	/**< get the sum of the energy balance residuals since the check was set, in specified units
+	  returns HPWH_ABORT for incorrect units  */
+	bool isEnergyBalanceFlagged() const;
+	/**< returns whether the residual of the last step was over the threshold of setEnergyBalanceCheck */
+	int getNumEnergyBalanceFlags() const;
+	/**< returns the number of steps flagged since the check was set */
+	double getExtraHeatEnergy(UNITS units = UNITS_KWH) const;
+	/**< get the extra heat put into the tank in the last step through nodePowerExtra_W, in specified units
+	  returns HPWH_ABORT for incorrect units  */
+	double getRecirculationLoss(UNITS units = UNITS_KWH) const;
+	/**< get the heat the recirculation loop lost in the last step, in specified units
+	  returns HPWH_ABORT for incorrect units  */
+	double getRecirculationVolume_L() const;
+	/**< returns the volume the recirculation pump moved in the last step */
+	double getRecirculationReturnT_C() const;
+	/**< returns the temperature the loop returned at in the last step, averaged over its volume, 0 if the pump did not run */
+
 	int getHPWHModel() const;
 	/**< get the model number of the HPWHsim model number of the hpwh */
 
@@ -803,14 +1225,183 @@ public:
 
 private:
 	class HeatSource;
+	class MessageSink;
+
+	struct TankModel {
+	public:
+		TankModel(HPWH *hpwh_in): hpwh(hpwh_in) {};
+		virtual ~TankModel() {};
+
+		/**< processes the draw, conduction and standby losses of a step */
+		virtual void updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,
+			double inletVol2_L,double inletT2_C) = 0;
+		/**< adds the heat at each node to the water at and above that node, the way a submerged or wrapped
+			heat source does, and returns the heat that is left over */
+		virtual double addHeatAboveNodes(HeatSource &heatSource,const std::vector<double> &nodeCap_kJ) = 0;
+		/**< runs an external heat source for minutesToRun, and returns the time it ran */
+		virtual double addHeatExternal(HeatSource &heatSource,double externalT_C,double minutesToRun,
+			double &cap_BTUperHr,double &input_BTUperHr,double &cop) = 0;
+		/**< the temperature of a tank node */
+		virtual double getNodeT_C(int nodeNum) = 0;
+		/**< sets each of sectionTemps_C to the average temperature of its equal share of the tank, from the bottom up */
+		virtual void getSectionTemps(std::vector<double> &sectionTemps_C) = 0;
+		/**< the tank nodes, up to date with the engine */
+		virtual const std::vector<tankReal_t> &getTankTemps() = 0;
+		/**< the tank nodes, for the caller to change; the engine takes up the changes at its next update */
+		virtual std::vector<tankReal_t> &editTankTemps() = 0;
+		/**< which of the TANK_MODEL engines this is */
+		virtual TANK_MODEL getType() const = 0;
+		/**< makes a copy of this engine that works on the tank of hpwh_in */
+		virtual std::shared_ptr<TankModel> clone(HPWH *hpwh_in) const = 0;
+
+	protected:
+		HPWH* hpwh;
+	};
+
+	struct NodalTankModel: TankModel {
+	public:
+		NodalTankModel(HPWH *hpwh_in): TankModel(hpwh_in) {};
+
+		void updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,
+			double inletVol2_L,double inletT2_C);
+		double addHeatAboveNodes(HeatSource &heatSource,const std::vector<double> &nodeCap_kJ);
+		double addHeatExternal(HeatSource &heatSource,double externalT_C,double minutesToRun,
+			double &cap_BTUperHr,double &input_BTUperHr,double &cop);
+		double getNodeT_C(int nodeNum);
+		void getSectionTemps(std::vector<double> &sectionTemps_C);
+		const std::vector<tankReal_t> &getTankTemps();
+		std::vector<tankReal_t> &editTankTemps();
+		TANK_MODEL getType() const;
+		std::shared_ptr<TankModel> clone(HPWH *hpwh_in) const;
+	};
+
+	struct ThermoclineTankModel: TankModel {
+	public:
+		ThermoclineTankModel(HPWH *hpwh_in): TankModel(hpwh_in),
+			hotT_C(0.),coldT_C(0.),thermoclineFraction(0.5),thicknessFraction(0.),zonesCurrent(false),nodesCurrent(true),
+			sectionsCurrent(false)
+		{};
+
+		void updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,
+			double inletVol2_L,double inletT2_C);
+		double addHeatAboveNodes(HeatSource &heatSource,const std::vector<double> &nodeCap_kJ);
+		double addHeatExternal(HeatSource &heatSource,double externalT_C,double minutesToRun,
+			double &cap_BTUperHr,double &input_BTUperHr,double &cop);
+		double getNodeT_C(int nodeNum);
+		void getSectionTemps(std::vector<double> &sectionTemps_C);
+		const std::vector<tankReal_t> &getTankTemps();
+		std::vector<tankReal_t> &editTankTemps();
+		TANK_MODEL getType() const;
+		std::shared_ptr<TankModel> clone(HPWH *hpwh_in) const;
+
+	private:
+		void fitToTank();
+		/**< sets the zones from the tank nodes, keeping the tank's heat content */
+		void renderToTank();
+		/**< sets each tank node to the average of the zones over its volume */
+		void syncZones();
+		/**< refits the zones if the tank nodes were changed since they were last set */
+		void zonesChanged();
+		/**< marks the tank nodes as behind the zones */
+		double integral(double fraction) const;
+		/**< the integral of the temperature from the bottom of the tank up to a fraction of its volume */
+		double temperatureAt(double fraction) const;
+		/**< the temperature at a fraction of the tank volume from the bottom */
+		double averageBetween(double lowerFraction,double upperFraction) const;
+		/**< the mean temperature between two fractions of the tank volume, exact for a slice within one zone */
+		void limitThickness();
+		/**< keeps the thermocline inside the tank, narrowing it about its middle */
+
+		double hotT_C;
+		double coldT_C;
+		double thermoclineFraction;
+		/**< the fraction of the tank volume below the middle of the thermocline  */
+		double thicknessFraction;
+		/**< the fraction of the tank volume in the thermocline  */
+		bool zonesCurrent;
+		/**< whether the zones hold the tank as it is, false after the tank nodes were changed from outside  */
+		bool nodesCurrent;
+		/**< whether the tank nodes hold the zones, false until they are rendered after the zones change  */
+		std::vector<double> cachedSectionTemps_C;
+		/**< the last section temperatures taken from the zones, which the logics ask for many times a step  */
+		bool sectionsCurrent;
+		/**< whether cachedSectionTemps_C holds the zones as they are  */
+	};
 
 	void setAllDefaults(); /**< sets all the defaults default */
 
 	void updateTankTemps(double draw,double inletT,double ambientT,double inletVol2_L,double inletT2_L);
+	/**< processes the draw, conduction and standby losses of a step with the chosen tank model  */
+	template<typename Real>
+	double updateConductionAndLosses(std::vector<Real> &temps_C,std::vector<Real> &nextTemps_C,double tau,double tankAmbientT_C,
+		Real *balanceT_C = nullptr);
+	/**< one pass that does the conduction and the standby losses of the nodes temps_C, using nextTemps_C
+	 * as the buffer for the new temperatures, see updateNodalTankTemps; it also copies the new temperatures
+	 * into balanceT_C when that is given, and returns their sum */
+	void updateNodalTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,double inletVol2_L,double inletT2_C);
+	/**< updateTankTemps on the tank nodes  */
 	void mixTankInversions();
 	/**< Mixes the any temperature inversions in the tank after all the temperature calculations  */
+	template<typename Real>
+	void mixTankInversions(std::vector<Real> &temps_C);
+	/**< mixTankInversions on the nodes temps_C  */
+	void updateTankTempsOnGrid(double drawVolume_L,double inletT_C,double tankAmbientT_C,double inletVol2_L,double inletT2_C);
+	/**< updateTankTemps on the adaptive grid, with the results averaged back into the tank nodes */
+	void syncTankGrid();
+	/**< carries changes made to the tank nodes since the last grid update, e.g. by heat sources, into the grid */
+	void regridTank();
+	/**< splits the grid where the tank is steep and merges it where it is flat */
+	void mixGridInversions();
+	/**< mixTankInversions on the grid */
 	void updateSoCIfNecessary();
 
+	struct StepState {
+		std::vector<tankReal_t> tankTemps_C;
+		std::vector<bool> heatSourceIsOn;
+		std::vector<bool> heatSourceLockedOut;
+		bool isHeating;
+		DRMODES prevDRstatus;
+		double timerTOT;
+		double locationTemperature_C;
+		double currentSoCFraction;
+		std::vector<int> tankGridSplits;
+		std::vector<double> tankGridTemps_C;
+		std::vector<double> tankGridNodeT_C;
+		double cumulativeBalanceResidual_kJ = 0.;
+		int numEnergyBalanceFlags = 0;
+		double recircMinuteOfDay = 0.;
+		int leadCompressorStage = 0;
+	};
+	void saveStepState(StepState &state) const;
+	void restoreStepState(const StepState &state);
+	/**< save and restore the state carried between steps, so runAdaptiveStep can retry a step with a shorter length */
+	void markNodesChanged(int nodeBegin,int nodeEnd);
+	/**< records that the tank nodes in [nodeBegin, nodeEnd) have changed temperature since the last SoC update
+	 * and the last energy balance */
+	double updateBalanceTankHeatContent();
+	/**< brings the tank's heat content for the energy balance up to date, summing only the nodes that changed */
+	void checkEnergyBalance(double startTankHeatContent_kJ,double drawVolume_L,double inletVol2_L,double inletT2_C);
+	/**< balances the energy of the step just run, which started with startTankHeatContent_kJ in the tank */
+	void addRecirculationFlow(double &drawVolume_L,double &inletVol2_L,double &inletT2_C);
+	/**< adds the flow of the recirculation loop this step to the draw and the second inlet, and sets its volume and
+	 * return temperature */
+	bool stageCompressors(DRMODES DRstatus);
+	/**< engages the lag compressor stages the staging logics call for behind the lead, and disengages the rest,
+	 * returning whether any stage runs */
+
+	int rateFirstHour(Rating &rating);
+	/**< runs the first-hour rating test of rate on this model, and picks the draw pattern from it  */
+	int rateDay(Rating &rating,RATING_PARTS parts);
+	/**< runs the 24 hour simulated-use test of rate on this model with rating.drawPattern  */
+	void setCalibrationParameter(CALIBRATION_PARAMETER parameter,double value,const HPWH &base);
+	/**< sets a parameter of calibrate on this copy of base, with the scale factors taken from base  */
+	std::string getWarmStartKey(int N,double *inletT_C,double *drawVolume_L,double *tankAmbientT_C,
+		double *heatSourceAmbientT_C,DRMODES *DRstatus,int numSpinUpRuns) const;
+	/**< hashes everything the spin-up of warmStart depends on into 16 hex digits */
+	bool readWarmStartFile(const std::string &path,const std::string &key,StepState &state) const;
+	bool writeWarmStartFile(const std::string &path,const std::string &key,const StepState &state) const;
+	/**< read and write the state of a warmStart spin-up, returning whether the whole file was read or written */
+
 	bool areAllHeatSourcesOff() const;
 	/**< test if all the heat sources are off  */
 	void turnAllHeatSourcesOff();
@@ -851,6 +1442,10 @@ private:
 	otherwise do nothing  */
 	void msg(const char* fmt,...) const;
 	void msgV(const char* fmt,va_list ap=NULL) const;
+	void pushMessage(const char* fmt,va_list ap) const;
+	/**< copies a message into the ring buffer of setAsyncMessages  */
+	void startMessageSink();
+	/**< starts the writer of setAsyncMessages with the current settings and message callback  */
 
 	bool simHasFailed;
 	/**< did an internal error cause the simulation to fail?  */
@@ -875,6 +1470,13 @@ private:
 	void* messageCallbackContextPtr;
 	/**< caller context pointer for external message processing  */
 
+	std::shared_ptr<MessageSink> messageSink;
+	/**< the ring buffer and writer thread of setAsyncMessages, or null to pass messages out as they are made  */
+	int messageCapacity;
+	MESSAGE_OVERFLOW messageOverflow;
+	bool flushMessagesEachStep;
+	/**< the settings of setAsyncMessages  */
+
 
 
 	MODELS hpwhModel;
@@ -930,14 +1532,95 @@ private:
 	double currentSoCFraction;
 	/**< the current state of charge according to the logic */
 
+	std::vector<double> socNodeCharge;
+	/**< the charge of each node at the last SoC update, so only changed nodes need to be recalculated. The
+	 * standby losses change every node, so the update after the draw and losses of a step is still a whole
+	 * tank; the updates the heat sources make within the step are the ones that are incremental */
+	double socChargeSum;
+	/**< the sum of socNodeCharge */
+	double socMainsT_C;
+	double socMinUsefulT_C;
+	/**< the mains and minimum useful temperatures socNodeCharge was calculated with */
+	bool socCacheValid;
+	/**< false when socNodeCharge must be rebuilt from the whole tank */
+	int socChangedBegin;
+	int socChangedEnd;
+	/**< the range of nodes [begin, end) changed since the last SoC update */
+	bool doSoCCrossCheck;
+	/**< check the incremental state of charge against the full calculation */
+
+	bool doEnergyBalance;
+	double maxBalanceResidualFraction;
+	/**< whether runOneStep keeps an energy balance, and the fraction of the tank's heat content that flags a step */
+	double balanceResidual_kJ;
+	double cumulativeBalanceResidual_kJ;
+	/**< the energy balance residual of the last step, and the sum since the check was set */
+	bool energyBalanceFlagged;
+	int numEnergyBalanceFlags;
+	/**< whether the last step was flagged, and the number of steps flagged since the check was set */
+	double balanceTankHeatContent_kJ;
+	bool balanceTankHeatContentValid;
+	/**< the tank's heat content at the last energy balance, and whether balanceNodeT_C and its sum still hold the
+	 * tank apart from the changed nodes, which they do not once the tank was set or resized, or the check was set */
+	std::vector<tankReal_t> balanceNodeT_C;
+	double balanceNodeTSum_C;
+	/**< the node temperatures balanceTankHeatContent_kJ was summed from, and their sum */
+	int balanceChangedBegin;
+	int balanceChangedEnd;
+	/**< the range of nodes [begin, end) changed since the last energy balance */
+
+	bool hasRecircLoop;
+	double recircUA_kJperHrC;
+	double recircFlowRate_Lper_min;
+	double recircLoopAmbientT_C;
+	std::vector<double> recircPumpFractions;
+	/**< the recirculation loop of setRecirculationLoop, with its pump schedule by hour or empty to run always */
+	double recircMinuteOfDay;
+	/**< the time of day on the clock of the pump schedule */
+
+	std::vector<int> compressorStageIndices;
+	/**< the heat source of each compressor stage, the compressor's first, or empty for an unstaged compressor */
+	std::vector<std::shared_ptr<HeatingLogic>> compressorStageOnLogics;
+	std::vector<std::shared_ptr<HeatingLogic>> compressorStageOffLogics;
+	/**< the logics that bring each lag stage on and take it off, see setCompressorStages */
+	bool rotateCompressorLead;
+	int leadCompressorStage;
+	/**< whether the lead passes on after each heating cycle, and the stage that leads */
+
 	double setpoint_C;
 	/**< the setpoint of the tank  */
 
 	/**< holds the temperature of each node - 0 is the bottom node  */
-	std::vector<double> tankTemps_C;
+	std::vector<tankReal_t> tankTemps_C;
 
 	/**< holds the future temperature of each node for the conduction calculation - 0 is the bottom node  */
-	std::vector<double> nextTankTemps_C;
+	std::vector<tankReal_t> nextTankTemps_C;
+
+	std::shared_ptr<TankModel> tankModel;
+	/**< the engine for draws, conduction and standby losses, see setTankModel  */
+
+	bool doAdaptiveGrid;
+	/**< whether the tank is updated on the adaptive grid, see setAdaptiveNodeGrid  */
+	int maxGridRefinement;
+	/**< the number of times a node can be split in halves  */
+	double gridRefineDeltaT_C;
+	/**< the temperature difference across a node or its neighbors above which it is split  */
+	std::vector<int> tankGridSplits;
+	/**< the number of grid nodes in each tank node, empty until the grid is first used  */
+	std::vector<double> tankGridTemps_C;
+	/**< holds the temperature of each grid node - 0 is the bottom node  */
+	std::vector<double> tankGridNodeT_C;
+	/**< the tank node temperatures as last averaged from the grid  */
+	std::vector<double> nextTankGridTemps_C;
+	std::vector<double> regridTemps_C;
+	std::vector<double> tankGridVolumes_N;
+	std::vector<double> tankGridVolumes_L;
+	std::vector<double> tankGridHeights_m;
+	std::vector<int> tankGridFirstNode;
+	std::vector<double> tankGridInletVolume_L;
+	std::vector<double> tankGridInletTVolume_CL;
+	std::vector<double> tankGridUpVolume_L;
+	/**< scratch for the grid updates, reserved for the finest grid when the grid starts  */
 
 	DRMODES prevDRstatus;
 	/**< the DRstatus of the tank in the previous time step and at the end of runOneStep */
@@ -949,6 +1632,21 @@ private:
 
 	bool usesSoCLogic;
 
+	double adaptiveTankEnergyTol_kJ;
+	/**< allowed difference in tank heat content between one and two internal steps in runAdaptiveStep */
+	double adaptiveOutletTTol_C;
+	/**< allowed difference in average outlet temperature between one and two internal steps in runAdaptiveStep */
+	double adaptiveMinSubstep_min;
+	/**< the shortest internal step runAdaptiveStep will take */
+	int numAdaptiveSubsteps;
+	/**< the number of internal steps taken by the last runAdaptiveStep */
+	int numPararealIterations;
+	/**< the number of parallel passes taken by the last runNStepsParallel */
+	int numSkippedDays;
+	/**< the number of days the last runRepeatedDays repeated instead of simulating */
+	bool warmStartWasCached;
+	/**< whether the last warmStart read its state from the cache */
+
 	// Some outputs
 	double outletTemp_C;
 	/**< the temperature of the outlet water - taken from top of tank, 0 if no flow  */
@@ -964,6 +1662,12 @@ private:
 	/**< the total energy removed from the environment, to heat the water  */
 	double standbyLosses_kWh;
 	/**< the amount of heat lost to standby  */
+	double extraHeat_kWh;
+	/**< the extra heat put into the tank through nodePowerExtra_W  */
+	double recircLoss_kWh;
+	double recircVolume_L;
+	double recircReturnT_C;
+	/**< the heat lost in the recirculation loop, the volume its pump moved, and the temperature it returned at  */
 
   // special variables for adding abilities
 	bool tankMixesOnDraw;
@@ -992,6 +1696,20 @@ private:
 	bool doConduction;
 	/**<  If and only if true will model conduction between the internal nodes of the tank  */
 
+	bool doFastHeatDist;
+	/**<  whether wrapped condensers use the approximate logistic function, see setFastHeatDistribution  */
+
+	STEP_TOPOLOGY stepTopology;
+	/**<  set in calcDerivedHeatingValues, see getStepTopology  */
+
+	bool doClosedFormSP;
+	double closedFormSPDeltaT_C;
+	/**<  whether single pass heat pumps heat a step in one pass, and their capacity threshold, see setClosedFormSinglePass  */
+
+	bool doClosedFormMP;
+	double closedFormMPDeltaT_C;
+	/**<  whether multipass heat pumps heat a mixed tank pass by pass, and their capacity threshold, see setClosedFormMultipass  */
+
 	struct resPoint {
 		int index;
 		int position;
@@ -1009,13 +1727,14 @@ class HPWH::HeatSource {
 public:
 	friend class HPWH;
 
-	HeatSource(){}  /**< default constructor, does not create a useful HeatSource */
+	HeatSource(): perfRGI(NULL) {}  /**< default constructor, does not create a useful HeatSource */
 	HeatSource(HPWH *parentHPWH);
 	/**< constructor assigns a pointer to the hpwh that owns this heat source  */
 	HeatSource(const HeatSource &hSource);  ///copy constructor
 	HeatSource& operator=(const HeatSource &hSource); ///assignment operator
-	/**< the copy constructor and assignment operator basically just checks if there
-		are backup/companion pointers - these can't be copied */
+	/**< the copy constructor and assignment operator copy the backup/companion/followedBy pointers as they are,
+		the HPWH that owns the copy has to point them at its own heat sources */
+	~HeatSource();
 
 	void setupAsResistiveElement(int node,double Watts,int condensitySize = CONDENSITY_SIZE);
 	/**< configure the heat source to be a resisive element, positioned at the
@@ -1161,7 +1880,7 @@ private:
 	/**< The values for input power and cop use matching to the grid. Should be long format with { { inputPower_W }, { COP } }. */
 
 	class Btwxt::RegularGridInterpolator *perfRGI;
-	/**< The grid interpolator used for mapping performance*/
+	/**< The grid interpolator used for mapping performance, owned by the heat source and copied with it*/
 
 	bool useBtwxtGrid;
 
@@ -1264,12 +1983,28 @@ private:
 
 	// some private functions, mostly used for heating the water with the addHeat function
 
-	double addHeatAboveNode(double cap_kJ,int node);
-	/**< adds heat to the set of nodes that are at the same temperature, above the
-		specified node number */
+	template<typename Real>
+	double addHeatAboveNodes(std::vector<Real> &tankTemps_C,const std::vector<double> &nodeCap_kJ);
+	/**< adds the heat at each node to the set of nodes that are at the same temperature, above
+		that node, and returns the heat that is left over */
 	double addHeatExternal(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop);
 	/**<  Add heat from a source outside of the tank. Assume the condensity is where
 		the water is drawn from and hot water is put at the top of the tank. */
+	double addHeatExternalToNodes(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop);
+	/**< heats the tank nodes with addHeatExternal, or with the closed form chosen for this heat source */
+
+	template<bool isCompressor>
+	double addHeatInTank(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop);
+	/**< adds the heat of a submerged or wrapped heat source by its heat distribution, and returns the runtime */
+	double addHeatExternalSPClosedForm(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop);
+	/**< addHeatExternal for a single pass heat source, for a whole step in one pass, see setClosedFormSinglePass */
+	double addHeatExternalMPClosedForm(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop);
+	/**< addHeatExternal for a multipass heat source, as a mixed tank, see setClosedFormMultipass */
+	void moveExternalNodes(double nodeFrac,double targetTemp_C,double timeUsed_min);
+	/**< moves the nodes between the external outlet and inlet down by nodeFrac of a node, and puts water at
+		targetTemp_C in at the inlet */
+	double averageExternalOutputs(double minutesToRun,double timeRemaining_min,double &cap_BTUperHr,double &input_BTUperHr,double &cop);
+	/**< divides the time-weighted outputs of an external heat source by the time it ran, and returns that time */
 
 		/**  I wrote some methods to help with the add heat interface - MJL  */
 	void getCapacity(double externalT_C,double condenserTemp_C,double setpointTemp_C,double &input_BTUperHr,double &cap_BTUperHr,double &cop);
@@ -1284,7 +2019,9 @@ private:
 	double calcMPOutletTemperature(double heatingCapacity_KW);
 	/**< returns the temperature of outlet of a external multipass hpwh */
 
-	void calcHeatDist(std::vector<double> &heatDistribution);
+	template<typename Real>
+	void calcHeatDist(const std::vector<Real> &tankTemps_C,std::vector<double> &heatDistribution);
+	/**< the share of the heat that goes into each node of the tank tankTemps_C */
 
 	double getTankTemp() const;
 	/**< returns the tank temperature weighted by the condensity for this heat source */
@@ -1294,10 +2031,76 @@ private:
 
 	/**<  A few helper functions */
 	double expitFunc(double x,double offset);
+	double fastExpitFunc(double x,double offset);
+	/**< expitFunc within 3e-10, relative, without calling exp; see setFastHeatDistribution */
 	void normalize(std::vector<double> &distribution);
 
 };  // end of HeatSource class
 
+/** Several HPWH tanks plumbed together and run as one water heater, as for a central plant.  The plant is a
+ * chain of stages in series, each the inlet of the next; a stage is one tank, or a bank of tanks in parallel
+ * that split its flow.  A primary bank with a swing tank after it is two stages.  */
+class HPWHPlant {
+public:
+	HPWHPlant();
+
+	int addStage(const std::vector<HPWH> &tanks,const std::vector<double> &flowFractions = std::vector<double>());
+	/**< Adds a stage after the last one, of copies of tanks in parallel.  The flow through the stage is split
+	 * among them by flowFractions, which are scaled to add up to 1, or by tank volume if it is empty.
+	 * The return value is 0 for success, HPWH_ABORT if there are no tanks or the fractions do not match them
+	 */
+	int initSwingTank(const HPWH &primaryTank,int numPrimaryTanks,const HPWH &swingTank);
+	/**< Replaces the stages with a bank of numPrimaryTanks copies of primaryTank, sharing the flow evenly, and
+	 * swingTank after it
+	 */
+
+	int runOneStep(double inletT_C,double drawVolume_L,double tankAmbientT_C,double heatSourceAmbientT_C,
+		HPWH::DRMODES DRstatus);
+	/**< Runs every tank one step, the stages in order, each with the draw split among its tanks and the mixed
+	 * outlet of the stage before as its inlet.  A stage with no draw passes inletT_C on as its outlet.
+	 * The return value is 0 for successful simulation run, HPWH_ABORT otherwise
+	 */
+
+	int runNSteps(int N,double *inletT_C,double *drawVolume_L,double *tankAmbientT_C,double *heatSourceAmbientT_C,
+		HPWH::DRMODES *DRstatus,double *outletT_C = NULL);
+	/**< Runs N steps as N calls of runOneStep would, with the same results, but a stage at a time: nothing
+	 * downstream feeds back, so each stage runs through all N steps before the next, with the tanks of a bank
+	 * run at once on the hardware threads.  outletT_C, if given, gets the outlet temperature of each step.
+	 * The calculated values are summed or averaged as in HPWH::runNSteps.
+	 * The return value is 0 for successful simulation run, HPWH_ABORT otherwise
+	 */
+
+	int getNumStages() const;
+	int getNumTanks(int stage) const;
+	/**< returns the number of tanks in a stage, or HPWH_ABORT if there is no such stage */
+	HPWH &getTank(int stage,int tank);
+	const HPWH &getTank(int stage,int tank) const;
+	/**< the tanks of the plant, to set up or read one by one; stage and tank must exist */
+
+	double getOutletTemp() const;
+	/**< the temperature delivered by the last stage, averaged over the draw volume after runNSteps */
+	double getEnergyInput_kWh() const;
+	double getEnergyOutput_kWh() const;
+	double getEnergyRemovedFromEnvironment_kWh() const;
+	double getStandbyLosses_kWh() const;
+	/**< summed over the heat sources or tanks of every stage */
+	double getTankHeatContent_kJ() const;
+	/**< the heat content of all the tanks */
+
+private:
+	struct Stage {
+		std::vector<HPWH> tanks;
+		std::vector<double> flowFractions;
+	};
+	std::vector<Stage> stages;
+
+	double outletTemp_C;
+	double energyInput_kWh;
+	double energyOutput_kWh;
+	double energyRemovedFromEnvironment_kWh;
+	double standbyLosses_kWh;
+};
+
 // a few extra functions for unit converesion
 inline double dF_TO_dC(double temperature) { return (temperature*5.0/9.0); }
 inline double F_TO_C(double temperature) { return ((temperature - 32.0)*5.0/9.0); }
@@ -1330,10 +2133,13 @@ inline HPWH::DRMODES operator|(HPWH::DRMODES a,HPWH::DRMODES b)
 
 template< typename T> inline bool aboutEqual(T a,T b) { return fabs(a - b) < HPWH::TOL_MINVALUE; }
 
-// resampling utility functions
-double getResampledValue(const std::vector<double> &values,double beginFraction,double endFraction);
-bool resample(std::vector<double> &values,const std::vector<double> &sampleValues);
-inline bool resampleIntensive(std::vector<double> &values,const std::vector<double> &sampleValues)
+// resampling utility functions, for vectors of float or double
+template<typename Sample>
+double getResampledValue(const std::vector<Sample> &values,double beginFraction,double endFraction);
+template<typename Value,typename Sample>
+bool resample(std::vector<Value> &values,const std::vector<Sample> &sampleValues);
+template<typename Value,typename Sample>
+inline bool resampleIntensive(std::vector<Value> &values,const std::vector<Sample> &sampleValues)
 {
 	return resample(values,sampleValues);
 }
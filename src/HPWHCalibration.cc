@@ -0,0 +1,241 @@
+/*
+ * Calibration: tunes model parameters until the simulated ratings hit their targets
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "HPWH.hh"
+
+namespace {
+
+// the values of a goal rated at once in each round of its search
+const int pointsPerRound = 8;
+// a sweep after the first searches this fraction of each range around the last value first
+const double warmStartFraction = 0.125;
+// the rounds a goal may take to hit its target in one sweep
+const int maxRoundsPerGoal = 30;
+// a bracket narrowed to this fraction of its range holds a jump in the rating, not a root
+const double minBracketFraction = 1.e-6;
+
+double ratingMetric(const HPWH::Rating &rating,HPWH::RATING_METRIC metric) {
+	if(metric == HPWH::METRIC_UEF) {
+		return rating.UEF;
+	} else if(metric == HPWH::METRIC_RE) {
+		return rating.recoveryEfficiency;
+	}
+	return rating.firstHourRating_L;
+}
+
+/** a value of the parameter of a goal, and how far its rating misses the target */
+struct CalibrationPoint {
+	double value;
+	double miss;
+};
+
+}
+
+void HPWH::setCalibrationParameter(CALIBRATION_PARAMETER parameter,double value,const HPWH &base) {
+	if(parameter == CALIBRATE_UA) {
+		tankUA_kJperHrC = value;
+	} else if(parameter == CALIBRATE_COP_SCALE) {
+		for(int i = 0; i < getNumHeatSources(); i++) {
+			if(heatSources[i].isACompressor()) {
+				for(std::size_t j = 0; j < heatSources[i].perfMap.size(); j++) {
+					for(std::size_t k = 0; k < heatSources[i].perfMap[j].COP_coeffs.size(); k++) {
+						heatSources[i].perfMap[j].COP_coeffs[k] = base.heatSources[i].perfMap[j].COP_coeffs[k] * value;
+					}
+				}
+			}
+		}
+	} else if(parameter == CALIBRATE_RESISTANCE_SCALE) {
+		for(int i = 0; i < getNumHeatSources(); i++) {
+			if(heatSources[i].isAResistance()) {
+				heatSources[i].changeResistanceWatts(base.heatSources[i].perfMap[0].inputPower_coeffs[0] * value);
+			}
+		}
+	}
+}
+
+int HPWH::calibrate(const std::vector<CalibrationGoal> &goals,std::vector<double> &values,Rating &rating,
+	int maxSweeps /*=10*/) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	if(goals.empty() || maxSweeps < 1) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("calibrate needs at least one goal and one sweep.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	RATING_PARTS parts = RATE_FHR;
+	for(std::size_t g = 0; g < goals.size(); g++) {
+		const CalibrationGoal &goal = goals[g];
+		bool isScale = (goal.parameter == CALIBRATE_COP_SCALE || goal.parameter == CALIBRATE_RESISTANCE_SCALE);
+		if(!(goal.minValue < goal.maxValue) || goal.minValue < 0. || (isScale && goal.minValue == 0.) ||
+			!(goal.tolerance > 0.)) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("Calibration goal %d needs a positive range and tolerance.  \n",static_cast<int>(g));
+			}
+			return HPWH_ABORT;
+		}
+		for(std::size_t h = 0; h < g; h++) {
+			if(goals[h].parameter == goal.parameter) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("Calibration goals %d and %d tune the same parameter.  \n",static_cast<int>(h),static_cast<int>(g));
+				}
+				return HPWH_ABORT;
+			}
+		}
+		if((goal.parameter == CALIBRATE_COP_SCALE && !hasACompressor()) ||
+			(goal.parameter == CALIBRATE_RESISTANCE_SCALE && getNumResistanceElements() == 0)) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("Calibration goal %d tunes a heat source the model does not have.  \n",static_cast<int>(g));
+			}
+			return HPWH_ABORT;
+		}
+		if(goal.parameter == CALIBRATE_COP_SCALE) {
+			// a performance grid has no COP curves to scale
+			for(int i = 0; i < getNumHeatSources(); i++) {
+				if(heatSources[i].isACompressor() && heatSources[i].useBtwxtGrid) {
+					if(hpwhVerbosity >= VRB_reluctant) {
+						msg("Calibration goal %d scales the COP curves, and the compressor uses a performance grid.  \n",static_cast<int>(g));
+					}
+					return HPWH_ABORT;
+				}
+			}
+		}
+		if(goal.metric == METRIC_UEF) {
+			parts = RATE_UEF;
+		} else if(goal.metric == METRIC_RE && parts == RATE_FHR) {
+			parts = RATE_RE;
+		}
+	}
+
+	// rates a copy of the model for each value of goal g, with the other parameters held
+	const HPWH base(*this);
+	std::vector<double> trialValues(goals.size());
+	for(std::size_t g = 0; g < goals.size(); g++) {
+		trialValues[g] = (goals[g].minValue + goals[g].maxValue) / 2.;
+	}
+	auto rateValues = [&](std::size_t g,const std::vector<double> &valuesOfG,std::vector<Rating> &ratings) {
+		std::vector<HPWH> variants(valuesOfG.size(),base);
+		for(std::size_t i = 0; i < valuesOfG.size(); i++) {
+			for(std::size_t h = 0; h < goals.size(); h++) {
+				variants[i].setCalibrationParameter(goals[h].parameter,(h == g) ? valuesOfG[i] : trialValues[h],base);
+			}
+		}
+		return rateModels(variants,ratings,parts);
+	};
+
+	Rating trialRating;
+	for(int sweep = 0; sweep < maxSweeps; sweep++) {
+		for(std::size_t g = 0; g < goals.size(); g++) {
+			const CalibrationGoal &goal = goals[g];
+			double width = warmStartFraction * (goal.maxValue - goal.minValue);
+			bool isWarmStart = (sweep > 0);
+			double lo = isWarmStart ? std::max(goal.minValue,trialValues[g] - width) : goal.minValue;
+			double hi = isWarmStart ? std::min(goal.maxValue,trialValues[g] + width) : goal.maxValue;
+
+			// the first round rates the ends of the bracket and values between them
+			std::vector<double> roundValues;
+			for(int i = 0; i < pointsPerRound; i++) {
+				roundValues.push_back(lo + (hi - lo) * i / (pointsPerRound - 1));
+			}
+			std::vector<CalibrationPoint> bracket;
+			bool isHit = false;
+			for(int round = 0; round < maxRoundsPerGoal; round++) {
+				std::vector<Rating> ratings;
+				if(rateValues(g,roundValues,ratings) == HPWH_ABORT) {
+					if(hpwhVerbosity >= VRB_reluctant) {
+						msg("A rating failed in calibrate.  \n");
+					}
+					return HPWH_ABORT;
+				}
+				std::vector<double> misses(roundValues.size());
+				std::size_t best = 0;
+				for(std::size_t i = 0; i < roundValues.size(); i++) {
+					misses[i] = ratingMetric(ratings[i],goal.metric) - goal.target;
+					bracket.push_back({roundValues[i],misses[i]});
+					if(fabs(misses[i]) < fabs(misses[best])) {
+						best = i;
+					}
+				}
+				if(fabs(misses[best]) <= goal.tolerance) {
+					trialValues[g] = roundValues[best];
+					trialRating = ratings[best];
+					isHit = true;
+					break;
+				}
+
+				// narrow the bracket to the first pair of values the rating crosses the target between
+				std::sort(bracket.begin(),bracket.end(),
+					[](const CalibrationPoint &a,const CalibrationPoint &b) { return a.value < b.value; });
+				std::size_t cross = bracket.size();
+				for(std::size_t i = 0; i + 1 < bracket.size(); i++) {
+					if(bracket[i].miss * bracket[i + 1].miss <= 0.) {
+						cross = i;
+						break;
+					}
+				}
+				if(cross == bracket.size()) {
+					if(isWarmStart) {
+						// the target moved out of the warm start bracket, so search the whole range
+						isWarmStart = false;
+						lo = goal.minValue;
+						hi = goal.maxValue;
+						bracket.clear();
+						for(int i = 0; i < pointsPerRound; i++) {
+							roundValues[i] = lo + (hi - lo) * i / (pointsPerRound - 1);
+						}
+						continue;
+					}
+					if(hpwhVerbosity >= VRB_reluctant) {
+						msg("The rating of calibration goal %d does not cross its target over its range.  \n",static_cast<int>(g));
+					}
+					return HPWH_ABORT;
+				}
+				CalibrationPoint low = bracket[cross],high = bracket[cross + 1];
+				bracket = {low,high};
+				if(high.value - low.value <= minBracketFraction * (goal.maxValue - goal.minValue)) {
+					// a heat source cycle or a draw moved across a step, which changes the rating by a finite amount
+					break;
+				}
+
+				// the next round rates the false position of the crossing and values spread across the bracket
+				roundValues.clear();
+				roundValues.push_back(low.value - low.miss * (high.value - low.value) / (high.miss - low.miss));
+				for(int i = 1; i < pointsPerRound; i++) {
+					roundValues.push_back(low.value + (high.value - low.value) * i / pointsPerRound);
+				}
+			}
+			if(!isHit) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("The rating of calibration goal %d jumps across its target near %g, or takes too long to find it.  \n",
+						static_cast<int>(g),bracket.front().value);
+				}
+				return HPWH_ABORT;
+			}
+		}
+
+		// trialRating holds every parameter at its latest value
+		bool allHit = true;
+		for(const CalibrationGoal &goal: goals) {
+			if(fabs(ratingMetric(trialRating,goal.metric) - goal.target) > goal.tolerance) {
+				allHit = false;
+			}
+		}
+		if(allHit) {
+			for(std::size_t g = 0; g < goals.size(); g++) {
+				setCalibrationParameter(goals[g].parameter,trialValues[g],base);
+			}
+			values = trialValues;
+			rating = trialRating;
+			return 0;
+		}
+	}
+
+	if(hpwhVerbosity >= VRB_reluctant) {
+		msg("The calibration goals do not all hold after %d sweeps.  \n",maxSweeps);
+	}
+	return HPWH_ABORT;
+}
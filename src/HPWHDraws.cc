@@ -0,0 +1,313 @@
+/*
+ * Stochastic draws: generates draw events at random and runs Monte Carlo trials of them for delivery statistics
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "HPWH.hh"
+
+namespace {
+
+// the start of the stream of a trial, mixed from the seed and the trial by the splitmix64 finalizer so that
+// neighboring trials start far apart
+unsigned long long trialStreamSeed(unsigned long long seed,int trial) {
+	unsigned long long z = seed + 0x9E3779B97F4A7C15ULL * (static_cast<unsigned long long>(trial) + 1ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// the draws of one trial a day at a time. The engine is fully specified by the standard, and the samples are
+// made from its bits here rather than with the library's distributions, whose algorithms are not, so the
+// draws are the same with every compiler
+class DrawStream {
+public:
+	DrawStream(const std::vector<HPWH::DrawEventType> &types,unsigned long long seed,int trial):
+		eventTypes(types),engine(trialStreamSeed(seed,trial)),pending_L(MINUTES_PER_DAY,0.) {}
+
+	// fills the next day of draws into day_L, of MINUTES_PER_DAY values
+	void nextDay(double *day_L) {
+		for(const HPWH::DrawEventType &eventType: eventTypes) {
+			if(eventType.eventsPerDay <= 0.) {
+				continue;
+			}
+			// the arrivals of a Poisson process over one day
+			for(double time_day = exponential(eventType.eventsPerDay); time_day < 1.;
+				time_day += exponential(eventType.eventsPerDay)) {
+				addEvent(eventType);
+			}
+		}
+		std::copy(pending_L.begin(),pending_L.begin() + MINUTES_PER_DAY,day_L);
+		pending_L.erase(pending_L.begin(),pending_L.begin() + MINUTES_PER_DAY);
+		pending_L.resize(std::max(pending_L.size(),static_cast<std::size_t>(MINUTES_PER_DAY)),0.);
+	}
+
+private:
+	static const int MINUTES_PER_DAY = 1440;
+
+	const std::vector<HPWH::DrawEventType> &eventTypes;
+	std::mt19937_64 engine;
+	std::vector<double> pending_L;	// the draws of today, and those of events that carry over past it
+
+	// in (0, 1]
+	double uniform() {
+		return (static_cast<double>(engine() >> 11) + 1.) * 0x1.0p-53;
+	}
+
+	double exponential(double rate) {
+		return -std::log(uniform()) / rate;
+	}
+
+	double standardNormal() {
+		return std::sqrt(-2. * std::log(uniform())) * std::cos(2. * 3.14159265358979323846 * uniform());
+	}
+
+	void addEvent(const HPWH::DrawEventType &eventType) {
+		int hour = 0;
+		if(!eventType.hourlyWeights.empty()) {
+			double totalWeight = 0.;
+			for(double weight: eventType.hourlyWeights) {
+				totalWeight += weight;
+			}
+			double pick = uniform() * totalWeight;
+			for(hour = 0; hour < 23; hour++) {
+				pick -= eventType.hourlyWeights[hour];
+				if(pick <= 0. && eventType.hourlyWeights[hour] > 0.) {
+					break;
+				}
+			}
+			while(eventType.hourlyWeights[hour] <= 0.) {
+				hour--;
+			}
+		} else {
+			hour = std::min(static_cast<int>(uniform() * 24.),23);
+		}
+		int minute = 60 * hour + std::min(static_cast<int>(uniform() * 60.),59);
+
+		double volume_L = eventType.meanVolume_L;
+		if(eventType.sdVolume_L > 0.) {
+			double logVariance = std::log(1. + (eventType.sdVolume_L * eventType.sdVolume_L)
+				/ (eventType.meanVolume_L * eventType.meanVolume_L));
+			volume_L = std::exp(std::log(eventType.meanVolume_L) - logVariance / 2.
+				+ std::sqrt(logVariance) * standardNormal());
+		}
+		for(; volume_L > 0.; minute++) {
+			if(minute >= static_cast<int>(pending_L.size())) {
+				pending_L.resize(minute + 1,0.);
+			}
+			double stepVolume_L = std::min(eventType.flowRate_Lper_min,volume_L);
+			pending_L[minute] += stepVolume_L;
+			volume_L -= stepVolume_L;
+		}
+	}
+};
+
+}
+
+std::vector<HPWH::DrawEventType> HPWH::getResidentialDrawEvents(double numOccupants) {
+	// morning and evening peaks for the people, and the day and evening for the appliances
+	const std::vector<double> showerWeights = {0.5,0.3,0.2,0.2,0.5,2.,6.,9.,7.,4.,2.5,1.5,
+		1.,1.,1.,1.,1.5,2.5,4.,5.,5.5,5.,3.,1.5};
+	const std::vector<double> sinkWeights = {0.5,0.3,0.2,0.2,0.3,1.,3.,5.,5.,4.,3.5,3.5,
+		4.,3.5,3.,3.,3.5,4.5,6.,6.5,5.5,4.5,3.,1.5};
+	const std::vector<double> applianceWeights = {0.2,0.1,0.1,0.1,0.1,0.3,1.,2.,3.,4.,4.,3.5,
+		3.,3.,3.,3.,3.,3.5,4.,5.,5.,4.,2.,1.};
+
+	std::vector<DrawEventType> eventTypes(5);
+	DrawEventType &shower = eventTypes[0];
+	shower.eventsPerDay = 0.65 * numOccupants;
+	shower.meanVolume_L = 45.;
+	shower.sdVolume_L = 20.;
+	shower.flowRate_Lper_min = 6.;
+	shower.hourlyWeights = showerWeights;
+
+	DrawEventType &bath = eventTypes[1];
+	bath.eventsPerDay = 0.05 * numOccupants;
+	bath.meanVolume_L = 80.;
+	bath.sdVolume_L = 20.;
+	bath.flowRate_Lper_min = 12.;
+	bath.hourlyWeights = showerWeights;
+
+	DrawEventType &sink = eventTypes[2];
+	sink.eventsPerDay = 6. * numOccupants;
+	sink.meanVolume_L = 2.;
+	sink.sdVolume_L = 2.;
+	sink.flowRate_Lper_min = 3.;
+	sink.hourlyWeights = sinkWeights;
+
+	DrawEventType &clothesWasher = eventTypes[3];
+	clothesWasher.eventsPerDay = 0.1 + 0.15 * numOccupants;
+	clothesWasher.meanVolume_L = 25.;
+	clothesWasher.sdVolume_L = 10.;
+	clothesWasher.flowRate_Lper_min = 10.;
+	clothesWasher.hourlyWeights = applianceWeights;
+
+	DrawEventType &dishwasher = eventTypes[4];
+	dishwasher.eventsPerDay = 0.1 + 0.1 * numOccupants;
+	dishwasher.meanVolume_L = 20.;
+	dishwasher.sdVolume_L = 5.;
+	dishwasher.flowRate_Lper_min = 6.;
+	dishwasher.hourlyWeights = applianceWeights;
+
+	return eventTypes;
+}
+
+// whether every event type can make events, so the inputs of generateDraws and runMonteCarloDraws are good
+static bool areDrawEventTypesValid(const std::vector<HPWH::DrawEventType> &eventTypes) {
+	for(const HPWH::DrawEventType &eventType: eventTypes) {
+		if(!(eventType.eventsPerDay >= 0.) || !(eventType.meanVolume_L > 0.) || !(eventType.sdVolume_L >= 0.)
+			|| !(eventType.flowRate_Lper_min > 0.)) {
+			return false;
+		}
+		if(!eventType.hourlyWeights.empty()) {
+			if(eventType.hourlyWeights.size() != 24) {
+				return false;
+			}
+			double totalWeight = 0.;
+			for(double weight: eventType.hourlyWeights) {
+				if(!(weight >= 0.)) {
+					return false;
+				}
+				totalWeight += weight;
+			}
+			if(!(totalWeight > 0.)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int HPWH::generateDraws(const std::vector<DrawEventType> &eventTypes,int numDays,unsigned long long seed,int trial,
+	std::vector<double> &drawVolume_L) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	drawVolume_L.clear();
+	if(numDays <= 0 || trial < 0 || !areDrawEventTypesValid(eventTypes)) {
+		return HPWH_ABORT;
+	}
+	drawVolume_L.resize(static_cast<std::size_t>(numDays) * 1440);
+	DrawStream stream(eventTypes,seed,trial);
+	for(int day = 0; day < numDays; day++) {
+		stream.nextDay(&drawVolume_L[static_cast<std::size_t>(day) * 1440]);
+	}
+	return 0;
+}
+
+int HPWH::runMonteCarloDraws(const std::vector<DrawEventType> &eventTypes,int numTrials,int numDays,
+	unsigned long long seed,double inletT_C,double ambientT_C,double useT_C,
+	std::vector<DrawTrialResult> &trials,DrawStatistics &statistics) const {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	trials.clear();
+	statistics = DrawStatistics();
+	if(numTrials <= 0 || numDays <= 0) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runMonteCarloDraws needs positive numbers of trials and days.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	if(!areDrawEventTypesValid(eventTypes)) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The draw event types need a non-negative rate, a positive mean volume and flow rate, a non-negative volume deviation, and either no hourly weights or 24 non-negative ones that are not all 0.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	if(minutesPerStep != 1.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runMonteCarloDraws generates draws in one minute steps, and the model takes steps of %.2f minutes.  \n",minutesPerStep);
+		}
+		return HPWH_ABORT;
+	}
+	if(simHasFailed) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("simHasFailed is set, aborting.  \n");
+		}
+		return HPWH_ABORT;
+	}
+
+	trials.assign(numTrials,DrawTrialResult());
+	std::vector<int> runResults(numTrials,0);
+	parallelFor(0,numTrials,[&](int k) {
+		DrawTrialResult &result = trials[k];
+		HPWH hpwh(*this);
+		DrawStream stream(eventTypes,seed,k);
+		double day_L[1440];
+		double outletTVolume_CL = 0.;
+		bool hasDrawn = false;
+		for(int day = 0; day < numDays; day++) {
+			stream.nextDay(day_L);
+			for(int i = 0; i < 1440; i++) {
+				if(hpwh.runOneStep(inletT_C,day_L[i],ambientT_C,ambientT_C,DR_ALLOW) != 0) {
+					runResults[k] = HPWH_ABORT;
+					return;
+				}
+				for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+					result.energyInput_kWh += hpwh.heatSources[j].energyInput_kWh;
+				}
+				if(day_L[i] <= 0.) {
+					continue;
+				}
+				result.drawVolume_L += day_L[i];
+				outletTVolume_CL += hpwh.outletTemp_C * day_L[i];
+				result.minOutletT_C = hasDrawn ? std::min(result.minOutletT_C,hpwh.outletTemp_C) : hpwh.outletTemp_C;
+				hasDrawn = true;
+				if(hpwh.outletTemp_C < useT_C) {
+					result.unmetDrawVolume_L += day_L[i];
+					result.shortfallEnergy_kWh += KJ_TO_KWH(DENSITYWATER_kgperL * CPWATER_kJperkgC * day_L[i]
+						* (useT_C - hpwh.outletTemp_C));
+					result.numShortfallSteps++;
+				}
+			}
+		}
+		if(hasDrawn) {
+			result.meanOutletT_C = outletTVolume_CL / result.drawVolume_L;
+		}
+	});
+	for(int k = 0; k < numTrials; k++) {
+		if(runResults[k] != 0) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("The simulation of draw trial %d failed.  \n",k);
+			}
+			trials.clear();
+			return HPWH_ABORT;
+		}
+	}
+
+	std::vector<double> unmetFractions(numTrials,0.);
+	double totalDrawVolume_L = 0.,outletTVolume_CL = 0.;
+	bool hasDrawn = false;
+	statistics.numTrials = numTrials;
+	for(int k = 0; k < numTrials; k++) {
+		const DrawTrialResult &result = trials[k];
+		if(result.unmetDrawVolume_L > 0.) {
+			statistics.shortfallProbability += 1.;
+		}
+		if(result.drawVolume_L > 0.) {
+			unmetFractions[k] = result.unmetDrawVolume_L / result.drawVolume_L;
+			totalDrawVolume_L += result.drawVolume_L;
+			outletTVolume_CL += result.meanOutletT_C * result.drawVolume_L;
+			statistics.minOutletT_C = hasDrawn ? std::min(statistics.minOutletT_C,result.minOutletT_C) : result.minOutletT_C;
+			hasDrawn = true;
+		}
+		statistics.meanUnmetFraction += unmetFractions[k];
+		statistics.meanShortfallEnergy_kWh += result.shortfallEnergy_kWh;
+		statistics.meanEnergyInput_kWh += result.energyInput_kWh;
+	}
+	statistics.shortfallProbability /= numTrials;
+	statistics.meanUnmetFraction /= numTrials;
+	statistics.meanShortfallEnergy_kWh /= numTrials;
+	statistics.meanEnergyInput_kWh /= numTrials;
+	if(hasDrawn) {
+		statistics.meanOutletT_C = outletTVolume_CL / totalDrawVolume_L;
+	}
+
+	// the nearest-rank percentile
+	std::sort(unmetFractions.begin(),unmetFractions.end());
+	int p95Rank = static_cast<int>(std::ceil(0.95 * numTrials));
+	statistics.p95UnmetFraction = unmetFractions[std::max(p95Rank,1) - 1];
+	statistics.maxUnmetFraction = unmetFractions.back();
+	return 0;
+}
@@ -3,6 +3,8 @@
  */
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <regex>
 
  // vendor
@@ -13,16 +15,20 @@
 //public HPWH::HeatSource functions
 HPWH::HeatSource::HeatSource(HPWH *parentInput)
 	:hpwh(parentInput),isOn(false),lockedOut(false),doDefrost(false),backupHeatSource(NULL),companionHeatSource(NULL),
-	followedByHeatSource(NULL),minT(-273.15),maxT(100),hysteresis_dC(0),airflowFreedom(1.0),maxSetpoint_C(100.),
+	followedByHeatSource(NULL),perfRGI(NULL),minT(-273.15),maxT(100),hysteresis_dC(0),airflowFreedom(1.0),maxSetpoint_C(100.),
 	typeOfHeatSource(TYPE_none),extrapolationMethod(EXTRAP_LINEAR),maxOut_at_LowT{100,-273.15},standbyLogic(NULL),
 	isMultipass(true),mpFlowRate_LPS(0.),externalInletHeight(-1),externalOutletHeight(-1),useBtwxtGrid(false),
 	secondaryHeatExchanger{0.,0.,0.}
 {}
 
-HPWH::HeatSource::HeatSource(const HeatSource &hSource) {
+HPWH::HeatSource::HeatSource(const HeatSource &hSource): perfRGI(NULL) {
 	*this = hSource;
 }
 
+HPWH::HeatSource::~HeatSource() {
+	delete perfRGI;
+}
+
 HPWH::HeatSource& HPWH::HeatSource::operator=(const HeatSource &hSource) {
 	if(this == &hSource) {
 		return *this;
@@ -39,16 +45,10 @@ HPWH::HeatSource& HPWH::HeatSource::operator=(const HeatSource &hSource) {
 
 	isVIP = hSource.isVIP;
 
-	if(hSource.backupHeatSource != NULL || hSource.companionHeatSource != NULL || hSource.followedByHeatSource != NULL) {
-		hpwh->simHasFailed = true;
-		if(hpwh->hpwhVerbosity >= VRB_reluctant) {
-			hpwh->msg("HeatSources cannot be copied if they contain pointers to other HeatSources\n");
-		}
-	} else {
-		companionHeatSource = NULL;
-		backupHeatSource = NULL;
-		followedByHeatSource = NULL;
-	}
+	// these still point into the heat sources of hSource's HPWH, see HPWH::operator=
+	backupHeatSource = hSource.backupHeatSource;
+	companionHeatSource = hSource.companionHeatSource;
+	followedByHeatSource = hSource.followedByHeatSource;
 
 	condensity = hSource.condensity;
 
@@ -58,7 +58,9 @@ HPWH::HeatSource& HPWH::HeatSource::operator=(const HeatSource &hSource) {
 
 	perfGrid = hSource.perfGrid;
 	perfGridValues = hSource.perfGridValues;
-	perfRGI = hSource.perfRGI;
+	// each heat source keeps its own interpolator so copies can run on separate threads
+	delete perfRGI;
+	perfRGI = (hSource.perfRGI != NULL) ? new Btwxt::RegularGridInterpolator(*hSource.perfRGI) : NULL;
 	useBtwxtGrid = hSource.useBtwxtGrid;
 
 	defrostMap = hSource.defrostMap;
@@ -312,10 +314,11 @@ bool HPWH::HeatSource::shouldHeat() const {
 bool HPWH::HeatSource::shutsOff() const {
 	bool shutOff = false;
 
-	if(hpwh->tankTemps_C[0] >= hpwh->setpoint_C) {
+	double bottomNodeT_C = hpwh->tankModel->getNodeT_C(0);
+	if(bottomNodeT_C >= hpwh->setpoint_C) {
 		shutOff = true;
 		if(hpwh->hpwhVerbosity >= VRB_emetic) {
-			hpwh->msg("shutsOff  bottom node hot: %.2d C  \n returns true",hpwh->tankTemps_C[0]);
+			hpwh->msg("shutsOff  bottom node hot: %.2d C  \n returns true",bottomNodeT_C);
 		}
 		return shutOff;
 	}
@@ -349,7 +352,7 @@ bool HPWH::HeatSource::maxedOut() const {
 
 	// If the heat source can't produce water at the setpoint and the control logics are saying to shut off
 	if(hpwh->setpoint_C > maxSetpoint_C){
-		if(hpwh->tankTemps_C[0] >= maxSetpoint_C || shutsOff()) {
+		if(hpwh->tankModel->getNodeT_C(0) >= maxSetpoint_C || shutsOff()) {
 			maxed = true;
 		}
 	}
@@ -374,66 +377,22 @@ double HPWH::HeatSource::fractToMeetComparisonExternal() const {
 }
 
 void HPWH::HeatSource::addHeat(double externalT_C,double minutesToRun) {
-	double input_BTUperHr = 0.,cap_BTUperHr = 0.,cop = 0.,captmp_kJ = 0.;
-	double leftoverCap_kJ = 0.0;
-	// set the leftover capacity of the Heat Source to 0, so the first round of
-	// passing it on works
+	double input_BTUperHr = 0.,cap_BTUperHr = 0.,cop = 0.;
 
 	switch(configuration) {
 	case CONFIG_SUBMERGED:
 	case CONFIG_WRAPPED:
-	{
-		static std::vector<double> heatDistribution(hpwh->getNumNodes());
-		//calcHeatDist takes care of the swooping for wrapped configurations
-		calcHeatDist(heatDistribution);
-
 		if(isACompressor()) {
-			hpwh->condenserInlet_C = getTankTemp();
-			getCapacity(externalT_C,getTankTemp(),input_BTUperHr,cap_BTUperHr,cop);
-		}
-		else {
-			getCapacity(externalT_C,getTankTemp(),input_BTUperHr,cap_BTUperHr,cop);
-
-		}
-		// calculate capacity btu/hr, input btu/hr, and cop
-
-		//some outputs for debugging
-		if(hpwh->hpwhVerbosity >= VRB_typical) {
-			hpwh->msg("capacity_kWh %.2lf \t\t cap_BTUperHr %.2lf \n",BTU_TO_KWH(cap_BTUperHr)*(minutesToRun) / 60.0,cap_BTUperHr);
-		}
-		if(hpwh->hpwhVerbosity >= VRB_emetic) {
-			hpwh->msg("heatDistribution: %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf \n",heatDistribution[0],heatDistribution[1],heatDistribution[2],heatDistribution[3],heatDistribution[4],heatDistribution[5],heatDistribution[6],heatDistribution[7],heatDistribution[8],heatDistribution[9],heatDistribution[10],heatDistribution[11]);
-		}
-		//the loop over nodes here is intentional - essentially each node that has
-		//some amount of heatDistribution acts as a separate resistive element
-		//maybe start from the top and go down?  test this with graphs
-		for(int i = hpwh->getNumNodes() - 1; i >= 0; i--) {
-			//for(int i = 0; i < hpwh->numNodes; i++){
-			captmp_kJ = BTU_TO_KJ(cap_BTUperHr * minutesToRun / 60.0 * heatDistribution[i]);
-			if(captmp_kJ != 0) {
-				//add leftoverCap to the next run, and keep passing it on
-				leftoverCap_kJ = addHeatAboveNode(captmp_kJ + leftoverCap_kJ,i);
-			}
-		}
-
-		if(isACompressor()) { // outlet temperature is the condenser temperature after heat has been added
-			hpwh->condenserOutlet_C = getTankTemp();
+			this->runtime_min = addHeatInTank<true>(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
+		} else {
+			this->runtime_min = addHeatInTank<false>(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
 		}
-
-		//after you've done everything, any leftover capacity is time that didn't run
-		this->runtime_min = (1.0 - (leftoverCap_kJ / BTU_TO_KJ(cap_BTUperHr * minutesToRun / 60.0))) * minutesToRun;
-#if 1	// error check, 1-22-2017
-		if(runtime_min < -0.001)
-			if(hpwh->hpwhVerbosity >= VRB_reluctant)
-				hpwh->msg("Internal error: Negative runtime = %0.3f min\n",runtime_min);
-#endif
-	}
-	break;
+		break;
 
 	case CONFIG_EXTERNAL:
 		//Else the heat source is external. SANCO2 system is only current example
 		//capacity is calculated internal to this function, and cap/input_BTUperHr, cop are outputs
-		this->runtime_min = addHeatExternal(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
+		this->runtime_min = hpwh->tankModel->addHeatExternal(*this,externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
 		break;
 	}
 
@@ -442,6 +401,63 @@ void HPWH::HeatSource::addHeat(double externalT_C,double minutesToRun) {
 	energyOutput_kWh = BTU_TO_KWH(cap_BTUperHr * runtime_min / 60.0);
 }
 
+double HPWH::HeatSource::addHeatExternalToNodes(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop) {
+	if(isMultipass && hpwh->doClosedFormMP) {
+		return addHeatExternalMPClosedForm(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
+	} else if(!isMultipass && hpwh->doClosedFormSP) {
+		return addHeatExternalSPClosedForm(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
+	}
+	return addHeatExternal(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
+}
+
+template<bool isCompressor>
+double HPWH::HeatSource::addHeatInTank(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop) {
+	std::vector<double> heatDistribution(hpwh->getNumNodes());
+	//calcHeatDist takes care of the swooping for wrapped configurations, which are the ones that need the tank nodes
+	if(configuration == CONFIG_WRAPPED) {
+		calcHeatDist(hpwh->tankModel->getTankTemps(),heatDistribution);
+	} else {
+		calcHeatDist(hpwh->tankTemps_C,heatDistribution);
+	}
+
+	// calculate capacity btu/hr, input btu/hr, and cop
+	if(isCompressor) {
+		hpwh->condenserInlet_C = getTankTemp();
+	}
+	getCapacity(externalT_C,getTankTemp(),input_BTUperHr,cap_BTUperHr,cop);
+
+	//some outputs for debugging
+	if(hpwh->hpwhVerbosity >= VRB_typical) {
+		hpwh->msg("capacity_kWh %.2lf \t\t cap_BTUperHr %.2lf \n",BTU_TO_KWH(cap_BTUperHr)*(minutesToRun) / 60.0,cap_BTUperHr);
+	}
+	if(hpwh->hpwhVerbosity >= VRB_emetic) {
+		hpwh->msg("heatDistribution: %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf %4.3lf \n",heatDistribution[0],heatDistribution[1],heatDistribution[2],heatDistribution[3],heatDistribution[4],heatDistribution[5],heatDistribution[6],heatDistribution[7],heatDistribution[8],heatDistribution[9],heatDistribution[10],heatDistribution[11]);
+	}
+	//each node that has some amount of heatDistribution acts as a separate resistive element
+	std::vector<double> nodeCap_kJ(hpwh->getNumNodes());
+	for(int i = 0; i < hpwh->getNumNodes(); i++) {
+		nodeCap_kJ[i] = BTU_TO_KJ(cap_BTUperHr * minutesToRun / 60.0 * heatDistribution[i]);
+	}
+	double leftoverCap_kJ = hpwh->tankModel->addHeatAboveNodes(*this,nodeCap_kJ);
+
+	if(isCompressor) { // outlet temperature is the condenser temperature after heat has been added
+		hpwh->condenserOutlet_C = getTankTemp();
+	}
+
+	//after you've done everything, any leftover capacity is time that didn't run
+	//an element set to no power, e.g. with setResistanceCapacity(0.), does not run at all
+	double runtime = 0.;
+	if(cap_BTUperHr != 0.) {
+		runtime = (1.0 - (leftoverCap_kJ / BTU_TO_KJ(cap_BTUperHr * minutesToRun / 60.0))) * minutesToRun;
+	}
+#if 1	// error check, 1-22-2017
+	if(runtime < -0.001)
+		if(hpwh->hpwhVerbosity >= VRB_reluctant)
+			hpwh->msg("Internal error: Negative runtime = %0.3f min\n",runtime);
+#endif
+	return runtime;
+}
+
 // private HPWH::HeatSource functions
 void HPWH::HeatSource::sortPerformanceMap() {
 	std::sort(perfMap.begin(),perfMap.end(),
@@ -456,6 +472,24 @@ double HPWH::HeatSource::expitFunc(double x,double offset) {
 	return val;
 }
 
+double HPWH::HeatSource::fastExpitFunc(double x,double offset) {
+	// exp(y) = 2^k exp(r) with |r| <= ln(2)/2, and exp(r) from its Taylor series up to r^8, which is within 3e-10
+	// of exp(r), relative. There are no branches or calls, so a loop over the nodes vectorizes: y is clamped to
+	// +-700 with fabs, and adding 1.5 * 2^52 rounds y / ln(2) to k and leaves k in the low bits.
+	const double roundingShift = 6755399441055744.;
+	double y = 0.5 * (fabs(x - offset + 700.) - fabs(x - offset - 700.));
+	double shiftedK = y * 1.4426950408889634 + roundingShift;
+	double r = y - (shiftedK - roundingShift) * 0.6931471805599453;
+	double expR = 1. + r * (1. + r * (1. / 2. + r * (1. / 6. + r * (1. / 24. + r * (1. / 120. + r * (1. / 720.
+		+ r * (1. / 5040. + r * (1. / 40320.))))))));
+	uint64_t scaleBits;
+	std::memcpy(&scaleBits,&shiftedK,sizeof(scaleBits));
+	scaleBits = (scaleBits + 1023) << 52;
+	double scale;
+	std::memcpy(&scale,&scaleBits,sizeof(scale));
+	return 1. / (1. + expR * scale);
+}
+
 void HPWH::HeatSource::normalize(std::vector<double> &distribution) {
 	double sum_tmp = 0.0;
 	size_t N = distribution.size();
@@ -479,7 +513,7 @@ void HPWH::HeatSource::normalize(std::vector<double> &distribution) {
 double HPWH::HeatSource::getTankTemp() const{
 
 	std::vector<double> resampledTankTemps(getCondensitySize());
-	resample(resampledTankTemps, hpwh->tankTemps_C);
+	hpwh->tankModel->getSectionTemps(resampledTankTemps);
 
 	double tankTemp_C = 0.;
 
@@ -733,90 +767,177 @@ void HPWH::HeatSource::btwxtInterp(double& input_BTUperHr,double& cop,std::vecto
 	cop = result[1];
 }
 
-void HPWH::HeatSource::calcHeatDist(std::vector<double> &heatDistribution) {
+template<typename Real>
+void HPWH::HeatSource::calcHeatDist(const std::vector<Real> &tankTemps_C,std::vector<double> &heatDistribution) {
 
 	// Populate the vector of heat distribution
 	if(configuration == CONFIG_SUBMERGED) {
 		resampleExtensive(heatDistribution, condensity);
 	}
 	else if(configuration == CONFIG_WRAPPED) { // Wrapped around the tank, send through the logistic function
-		for(int i = 0; i < hpwh->getNumNodes(); i++) {
-			double dist = 0.;
-			if(i >= lowestNode){
-				double Toffset_C = 5.0 / 1.8; // 5 degF
-				double offset = Toffset_C / 1.; // should be dimensionless; guessing the denominator should have been Tshrinkage_C
-				dist = expitFunc((hpwh->tankTemps_C[i] - hpwh->tankTemps_C[lowestNode]) / Tshrinkage_C,offset);
-				dist *= (hpwh->setpoint_C - hpwh->tankTemps_C[i]);
-				if(dist < 0.) // SETPOINT_FIX
-					dist = 0.;
+		// Nodes below lowestNode get no heat. The rest are weighted in one pass that also sums them, and normalized
+		// in a second pass; this gives the same distribution as weighting every node and then calling normalize().
+		const int numNodes = static_cast<int>(tankTemps_C.size());
+		const Real *T = tankTemps_C.data();
+		double *dist = heatDistribution.data();
+		const double lowestNodeT_C = T[lowestNode];
+		const double setpoint_C = hpwh->setpoint_C;
+		const double Toffset_C = 5.0 / 1.8; // 5 degF
+		const double offset = Toffset_C / 1.; // should be dimensionless; guessing the denominator should have been Tshrinkage_C
+
+		std::fill(dist,dist + lowestNode,0.);
+		if(hpwh->doFastHeatDist) {
+			for(int i = lowestNode; i < numNodes; i++) {
+				dist[i] = fastExpitFunc((T[i] - lowestNodeT_C) / Tshrinkage_C,offset);
+			}
+		} else {
+			for(int i = lowestNode; i < numNodes; i++) {
+				dist[i] = expitFunc((T[i] - lowestNodeT_C) / Tshrinkage_C,offset);
 			}
-			heatDistribution[i] = dist;
 		}
-		normalize(heatDistribution);
-	}
-}
-
-double HPWH::HeatSource::addHeatAboveNode(double cap_kJ,int node) {
-	double Q_kJ,deltaT_C,targetTemp_C;
-	int setPointNodeNum;
-
-	double volumePerNode_L = hpwh->tankVolume_L / hpwh->getNumNodes();
-	double maxTargetTemp_C = std::min(maxSetpoint_C,hpwh->setpoint_C);
-
-	if(hpwh->hpwhVerbosity >= VRB_emetic) {
-		hpwh->msg("node %2d   cap_kwh %.4lf \n",node,KJ_TO_KWH(cap_kJ));
-	}
 
-	// find the first node (from the bottom) that does not have the same temperature as the one above it
-	// if they all have the same temp., use the top node, hpwh->numNodes-1
-	setPointNodeNum = node;
-	for(int i = node; i < hpwh->getNumNodes() - 1; i++) {
-		if(hpwh->tankTemps_C[i] != hpwh->tankTemps_C[i + 1]) {
-			break;
-		} else {
-			setPointNodeNum = i + 1;
+		double distSum = 0.;
+		for(int i = lowestNode; i < numNodes; i++) {
+			dist[i] *= (setpoint_C - T[i]);
+			if(dist[i] < 0.) // SETPOINT_FIX
+				dist[i] = 0.;
+			distSum += dist[i];
+		}
+		for(int i = lowestNode; i < numNodes; i++) {
+			dist[i] = (distSum > 0.) ? dist[i] / distSum : 0.;
+			if(dist[i] < TOL_MINVALUE) {
+				dist[i] = 0.;
+			}
 		}
 	}
-
-	// maximum heat deliverable in this timestep
-	while(cap_kJ > 0 && setPointNodeNum < hpwh->getNumNodes()) {
-		// if the whole tank is at the same temp, the target temp is the setpoint
-		if(setPointNodeNum == (hpwh->getNumNodes() - 1)) {
-			targetTemp_C = maxTargetTemp_C;
+}
+template void HPWH::HeatSource::calcHeatDist(const std::vector<float> &tankTemps_C,std::vector<double> &heatDistribution);
+template void HPWH::HeatSource::calcHeatDist(const std::vector<double> &tankTemps_C,std::vector<double> &heatDistribution);
+
+template<typename Real>
+double HPWH::HeatSource::addHeatAboveNodes(std::vector<Real> &tankTemps_C,const std::vector<double> &nodeCap_kJ) {
+	// Each node with some capacity heats, from the top node down, the set of nodes at the same temperature above it.
+	// The tank from the current node up is kept as runs of equal-temperature nodes, runs.front() at the top and
+	// runs.back() holding the current node. Raising a run to the temperature above it merges the two, so each run
+	// is made and merged once and a step is linear in the number of nodes.
+	// The run temperatures are kept in Real, so they compare equal to the nodes they are written to.
+	struct NodeRun {
+		int begin,end;
+		Real T_C;
+		Real minT_C; // the coldest of this run and the runs above it
+	};
+	const int numNodes = static_cast<int>(tankTemps_C.size());
+	const double volumePerNode_L = hpwh->tankVolume_L / numNodes;
+	const double maxTargetTemp_C = std::min(maxSetpoint_C,hpwh->setpoint_C);
+
+	std::vector<NodeRun> runs;
+	runs.reserve(numNodes);
+	auto setMinT = [&runs](std::size_t iRun) {
+		runs[iRun].minT_C = (iRun == 0) ? runs[iRun].T_C : std::min(runs[iRun].T_C,runs[iRun - 1].minT_C);
+	};
+
+	double leftoverCap_kJ = 0.;
+	int changedBegin = numNodes,changedEnd = 0;
+	for(int node = numNodes - 1; node >= 0; node--) {
+		if(!runs.empty() && runs.back().T_C == tankTemps_C[node]) {
+			runs.back().begin = node;
+		} else {
+			runs.push_back({node,node + 1,tankTemps_C[node],Real(0.)});
+			setMinT(runs.size() - 1);
 		}
-		//otherwise the target temp is the first non-equal-temp node
-		else {
-			targetTemp_C = hpwh->tankTemps_C[setPointNodeNum + 1];
+		if(nodeCap_kJ[node] == 0) {
+			continue;
 		}
-		// With DR tomfoolery make sure the target temperature doesn't exceed the setpoint.
-		if(targetTemp_C > maxTargetTemp_C) {
-			targetTemp_C = maxTargetTemp_C;
+
+		//add leftoverCap to the next run, and keep passing it on
+		double cap_kJ = nodeCap_kJ[node] + leftoverCap_kJ;
+		if(hpwh->hpwhVerbosity >= VRB_emetic) {
+			hpwh->msg("node %2d   cap_kwh %.4lf \n",node,KJ_TO_KWH(cap_kJ));
 		}
 
-		deltaT_C = targetTemp_C - hpwh->tankTemps_C[setPointNodeNum];
+		// the nodes being heated are runs[top] down to runs.back()
+		std::size_t top = runs.size() - 1;
+		while(cap_kJ > 0) {
+			int setPointNodeNum = runs[top].end - 1;
+			double targetTemp_C;
+			// if the whole tank is at the same temp, the target temp is the setpoint
+			if(setPointNodeNum == numNodes - 1) {
+				targetTemp_C = maxTargetTemp_C;
+			}
+			//otherwise the target temp is the first non-equal-temp node
+			else {
+				targetTemp_C = runs[top - 1].T_C;
+			}
+			// With DR tomfoolery make sure the target temperature doesn't exceed the setpoint.
+			if(targetTemp_C > maxTargetTemp_C) {
+				targetTemp_C = maxTargetTemp_C;
+			}
+
+			double deltaT_C = targetTemp_C - runs[top].T_C;
 
-		//heat needed to bring all equal temp. nodes up to the temp of the next node. kJ
-		Q_kJ = CPWATER_kJperkgC * volumePerNode_L * DENSITYWATER_kgperL * (setPointNodeNum + 1 - node) * deltaT_C;
+			//heat needed to bring all equal temp. nodes up to the temp of the next node. kJ
+			double Q_kJ = CPWATER_kJperkgC * volumePerNode_L * DENSITYWATER_kgperL * (setPointNodeNum + 1 - node) * deltaT_C;
 
-		//Running the rest of the time won't recover
-		if(Q_kJ > cap_kJ) {
-			for(int j = node; j <= setPointNodeNum; j++) {
-				hpwh->tankTemps_C[j] += cap_kJ / CPWATER_kJperkgC / volumePerNode_L / DENSITYWATER_kgperL / (setPointNodeNum + 1 - node);
+			//Running the rest of the time won't recover
+			if(Q_kJ > cap_kJ) {
+				double heatedT_C = cap_kJ / CPWATER_kJperkgC / volumePerNode_L / DENSITYWATER_kgperL / (setPointNodeNum + 1 - node);
+				for(std::size_t iRun = top; iRun < runs.size(); iRun++) {
+					runs[iRun].T_C += heatedT_C;
+				}
+				// keep the runs apart only where the temperatures still differ
+				for(std::size_t iRun = runs.size() - 1; iRun >= top && iRun > 0; iRun--) {
+					if(runs[iRun].T_C == runs[iRun - 1].T_C) {
+						runs[iRun - 1].begin = runs[iRun].begin;
+						runs.erase(runs.begin() + iRun);
+					}
+				}
+				for(std::size_t iRun = (top > 0) ? top - 1 : 0; iRun < runs.size(); iRun++) {
+					setMinT(iRun);
+				}
+				cap_kJ = 0;
+			}
+			else if(Q_kJ > 0.) // SETPOINT_FIX
+			{	// temp will recover by/before end of timestep
+				runs[top].T_C = targetTemp_C;
+				runs[top].begin = node;
+				runs.resize(top + 1);
+				setMinT(top);
+				cap_kJ -= Q_kJ;
+			}
+			if(Q_kJ > 0.) {
+				changedBegin = std::min(changedBegin,node);
+				changedEnd = std::max(changedEnd,setPointNodeNum + 1);
+			}
+			if(setPointNodeNum == numNodes - 1) {
+				break;
+			}
+
+			// take in the run above
+			if(top == runs.size() - 1 && runs[top - 1].T_C == runs[top].T_C) {
+				runs[top - 1].begin = runs[top].begin;
+				runs.pop_back();
+			}
+			top--;
+			// nothing above is below the target temperature
+			if(runs[top].minT_C >= maxTargetTemp_C) {
+				break;
 			}
-			cap_kJ = 0;
-		}
-		else if(Q_kJ > 0.) // SETPOINT_FIX
-		{	// temp will recover by/before end of timestep
-			for(int j = node; j <= setPointNodeNum; j++)
-				hpwh->tankTemps_C[j] = targetTemp_C;
-			cap_kJ -= Q_kJ;
 		}
-		setPointNodeNum++;
+		leftoverCap_kJ = cap_kJ;
+	}
+
+	for(auto &run: runs) {
+		std::fill(tankTemps_C.begin() + run.begin,tankTemps_C.begin() + run.end,run.T_C);
+	}
+	if(changedBegin < changedEnd) {
+		hpwh->markNodesChanged(changedBegin,changedEnd);
 	}
 
 	//return the unused capacity
-	return cap_kJ;
+	return leftoverCap_kJ;
 }
+template double HPWH::HeatSource::addHeatAboveNodes(std::vector<float> &tankTemps_C,const std::vector<double> &nodeCap_kJ);
+template double HPWH::HeatSource::addHeatAboveNodes(std::vector<double> &tankTemps_C,const std::vector<double> &nodeCap_kJ);
 bool HPWH::HeatSource::isACompressor() const {
 	return this->typeOfHeatSource == TYPE_compressor;
 }
@@ -912,22 +1033,7 @@ double HPWH::HeatSource::addHeatExternal(double externalT_C,double minutesToRun,
 			timeRemaining_min = 0.;
 		}
 
-		// Track the condenser temperature if this is a compressor before moving the nodes
-		if(isACompressor()) {
-			hpwh->condenserInlet_C += hpwh->tankTemps_C[externalOutletHeight] * timeUsed_min;
-			hpwh->condenserOutlet_C += targetTemp_C * timeUsed_min;
-		}
-
-		// Moving the nodes down
-		// move all nodes down, mixing if less than a full node
-		for(int n = externalOutletHeight; n < externalInletHeight; n++) {
-			hpwh->tankTemps_C[n] = hpwh->tankTemps_C[n] * (1 - nodeFrac) + hpwh->tankTemps_C[n + 1] * nodeFrac;
-		}
-		//add water to top node, heated to setpoint
-		hpwh->tankTemps_C[externalInletHeight] = hpwh->tankTemps_C[externalInletHeight] * (1. - nodeFrac) + targetTemp_C * nodeFrac;
-
-		hpwh->mixTankInversions();
-		hpwh->updateSoCIfNecessary();
+		moveExternalNodes(nodeFrac,targetTemp_C,timeUsed_min);
 
 		// track outputs - weight by the time ran
 		// Add in pump power to approximate a secondary heat exchange in line with the compressor
@@ -935,12 +1041,258 @@ double HPWH::HeatSource::addHeatExternal(double externalT_C,double minutesToRun,
 		cap_BTUperHr += capTemp_BTUperHr * timeUsed_min;
 		cop += copTemp * timeUsed_min;
 
-		hpwh->externalVolumeHeated_L += nodeFrac * volumePerNode_LperNode;
-
 		//if there's still time remaining and you haven't heated to the cutoff
 		//specified in shutsOff logic, keep heating
 	} while(timeRemaining_min > 0 && shutsOff() != true);
 
+	return averageExternalOutputs(minutesToRun,timeRemaining_min,cap_BTUperHr,input_BTUperHr,cop);
+}
+
+double HPWH::HeatSource::addHeatExternalSPClosedForm(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop) {
+	const double nodeCp_kJperC = hpwh->tankVolume_L / hpwh->getNumNodes() * DENSITYWATER_kgperL * CPWATER_kJperkgC;
+	const double targetTemp_C = std::min(maxSetpoint_C,hpwh->setpoint_C);
+	input_BTUperHr = 0;
+	cap_BTUperHr = 0;
+	cop = 0;
+
+	// the water that passes the condenser this step: the nodes from the outlet up to the inlet, and then the
+	// water the condenser heated, so the loop after k nodes and a fraction f of the next is the mix of the
+	// water k and k + 1 nodes along
+	const int numLoopNodes = externalInletHeight - externalOutletHeight + 1;
+	std::vector<double> loopT_C(hpwh->tankTemps_C.begin() + externalOutletHeight,hpwh->tankTemps_C.begin() + externalInletHeight + 1);
+	auto passingT_C = [&](int k) { return (k < numLoopNodes) ? loopT_C[k] : targetTemp_C; };
+	auto moveLoop = [&](int k,double f) {
+		for(int n = 0; n < numLoopNodes; n++) {
+			hpwh->tankTemps_C[externalOutletHeight + n] = passingT_C(n + k) * (1. - f) + passingT_C(n + k + 1) * f;
+		}
+		hpwh->markNodesChanged(externalOutletHeight,externalInletHeight + 1);
+		hpwh->updateSoCIfNecessary();
+	};
+
+	// heat the passing nodes one after the other until the step runs out, taking the capacity again only when
+	// the condenser inlet has moved more than closedFormSPDeltaT_C from where it was last taken
+	struct NodePass {
+		double inletT_C,nodeTime_min,time_min,nodeFrac,input_BTUperHr,cap_BTUperHr,cop;
+	};
+	std::vector<NodePass> passes;
+	double inputTemp_BTUperHr = 0,capTemp_BTUperHr = 0,copTemp = 0,capacityT_C = 0.;
+	double timeRemaining_min = minutesToRun;
+	for(int k = 0; timeRemaining_min > 0.; k++) {
+		double inletT_C = passingT_C(k);
+		if(k == 0 || fabs(inletT_C - capacityT_C) > hpwh->closedFormSPDeltaT_C) {
+			getCapacity(externalT_C,inletT_C,inputTemp_BTUperHr,capTemp_BTUperHr,copTemp);
+			capacityT_C = inletT_C;
+		}
+		double nodeHeat_kJ = nodeCp_kJperC * (targetTemp_C - inletT_C);
+		double nodeTime_min = nodeHeat_kJ / BTU_TO_KJ(capTemp_BTUperHr / 60.0);
+
+		NodePass pass = {inletT_C,nodeTime_min,nodeTime_min,1.,inputTemp_BTUperHr,capTemp_BTUperHr,copTemp};
+		if(nodeHeat_kJ <= 0.) { // the heated water came around, so the rest of the step heats nothing
+			pass.time_min = timeRemaining_min;
+			pass.nodeFrac = 0.;
+		} else if(nodeTime_min > timeRemaining_min) {
+			pass.time_min = timeRemaining_min;
+			pass.nodeFrac = timeRemaining_min / nodeTime_min;
+		}
+		passes.push_back(pass);
+		timeRemaining_min -= pass.time_min;
+		if(pass.nodeFrac < 1.) {
+			break;
+		}
+	}
+
+	int wholeNodes = static_cast<int>(passes.size()) - ((passes.back().nodeFrac < 1.) ? 1 : 0);
+	double partNode = (wholeNodes < static_cast<int>(passes.size())) ? passes.back().nodeFrac : 0.;
+	moveLoop(wholeNodes,partNode);
+
+	// if the shut off logics trip, find the fewest whole nodes after which they do, and let the logics cut the
+	// node before that, as the iterative loop would
+	if(shutsOff()) {
+		int lo = 0,hi = wholeNodes + 1; // they trip after hi whole nodes, or after the part node if hi > wholeNodes
+		while(lo < hi) {
+			int mid = (lo + hi) / 2;
+			moveLoop(mid,0.);
+			if(shutsOff()) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		int cutNode = 0;
+		double cutFrac = 0.;
+		if(lo > 0) { // they trip during node lo - 1
+			cutNode = lo - 1;
+			moveLoop(cutNode,0.);
+			double availableFrac = (cutNode < wholeNodes) ? 1. : partNode;
+			cutFrac = std::min(std::max(fractToMeetComparisonExternal(),0.),availableFrac);
+		}
+
+		passes.resize(cutNode + 1);
+		passes[cutNode].nodeFrac = cutFrac;
+		passes[cutNode].time_min = (cutFrac > 0.) ? cutFrac * passes[cutNode].nodeTime_min : 0.;
+		wholeNodes = cutNode;
+		partNode = cutFrac;
+		moveLoop(wholeNodes,partNode);
+
+		timeRemaining_min = minutesToRun;
+		for(const NodePass &pass: passes) {
+			timeRemaining_min -= pass.time_min;
+		}
+	}
+
+	hpwh->mixTankInversions();
+	hpwh->updateSoCIfNecessary();
+
+	for(const NodePass &pass: passes) {
+		if(isACompressor()) {
+			hpwh->condenserInlet_C += pass.inletT_C * pass.time_min;
+			hpwh->condenserOutlet_C += targetTemp_C * pass.time_min;
+		}
+		input_BTUperHr += (pass.input_BTUperHr + W_TO_BTUperH(secondaryHeatExchanger.extraPumpPower_W)) * pass.time_min;
+		cap_BTUperHr += pass.cap_BTUperHr * pass.time_min;
+		cop += pass.cop * pass.time_min;
+	}
+	hpwh->externalVolumeHeated_L += (wholeNodes + partNode) * (hpwh->tankVolume_L / hpwh->getNumNodes());
+
+	return averageExternalOutputs(minutesToRun,timeRemaining_min,cap_BTUperHr,input_BTUperHr,cop);
+}
+
+double HPWH::HeatSource::addHeatExternalMPClosedForm(double externalT_C,double minutesToRun,double &cap_BTUperHr,double &input_BTUperHr,double &cop) {
+	const int numNodes = hpwh->getNumNodes();
+	const double volumePerNode_LperNode = hpwh->tankVolume_L / numNodes;
+	const double passTime_min = volumePerNode_LperNode / (mpFlowRate_LPS * 60.); // the time the loop takes to pass a node
+	const double pumpInput_BTUperHr = W_TO_BTUperH(secondaryHeatExchanger.extraPumpPower_W);
+	input_BTUperHr = 0;
+	cap_BTUperHr = 0;
+	cop = 0;
+
+	// the loop mixes the tank, and each pass puts a node of it back through the inlet, warmer by the rise across the heat
+	// pump, so the mixed tank warms by rise / numNodes a pass; setTank leaves the tank as a pass leaves it, before the
+	// loop mixes it again
+	hpwh->mixTankNodes(0,numNodes,1.0);
+	double tankT_C = hpwh->tankTemps_C[externalOutletHeight];
+	auto setTank = [&](double T_C,double inletRiseT_C) {
+		std::fill(hpwh->tankTemps_C.begin(),hpwh->tankTemps_C.end(),T_C);
+		hpwh->tankTemps_C[externalInletHeight] += inletRiseT_C;
+		hpwh->markNodesChanged(0,numNodes);
+		hpwh->mixTankInversions();
+		hpwh->updateSoCIfNecessary();
+	};
+
+	// runs of passes that share one capacity, until the tank has warmed by closedFormMPDeltaT_C, the step ends, or the
+	// shut off logics trip after a pass
+	double inputTemp_BTUperHr = 0,capTemp_BTUperHr = 0,copTemp = 0;
+	double timeRemaining_min = minutesToRun,passesRun = 0.;
+	bool stepEnds = false;
+	while(!stepEnds) {
+		getCapacityMP(externalT_C,tankT_C,inputTemp_BTUperHr,capTemp_BTUperHr,copTemp);
+		const double riseT_C = BTUperH_TO_KW(capTemp_BTUperHr) / (mpFlowRate_LPS * DENSITYWATER_kgperL * CPWATER_kJperkgC);
+		const double passRiseT_C = riseT_C / numNodes;
+
+		int wholePasses = 0;
+		double partPass = 0.;
+		if(riseT_C <= 0.) { // nothing to heat for the rest of the step
+			setTank(tankT_C,0.);
+			stepEnds = true;
+		} else {
+			int maxPasses = std::max(1,static_cast<int>(std::min(hpwh->closedFormMPDeltaT_C / passRiseT_C,1.e6)));
+			double passesLeft = timeRemaining_min / passTime_min;
+			if(passesLeft > maxPasses) {
+				wholePasses = maxPasses;
+				setTank(tankT_C + (wholePasses - 1) * passRiseT_C,riseT_C);
+			} else {
+				wholePasses = static_cast<int>(ceil(passesLeft)) - 1;
+				partPass = passesLeft - wholePasses;
+				setTank(tankT_C + wholePasses * passRiseT_C,partPass * riseT_C);
+				stepEnds = true;
+			}
+
+			if(shutsOff()) {
+				// the logics trip after the first whole pass they trip after, or else after the part pass
+				stepEnds = true;
+				int lo = 1,hi = wholePasses + 1;
+				while(lo < hi) {
+					int mid = (lo + hi) / 2;
+					setTank(tankT_C + (mid - 1) * passRiseT_C,riseT_C);
+					if(shutsOff()) {
+						hi = mid;
+					} else {
+						lo = mid + 1;
+					}
+				}
+				if(lo <= wholePasses) {
+					wholePasses = lo;
+					partPass = 0.;
+					setTank(tankT_C + (wholePasses - 1) * passRiseT_C,riseT_C);
+				} else if(wholePasses > 0 && partPass > 0.) {
+					setTank(tankT_C + wholePasses * passRiseT_C,partPass * riseT_C);
+				}
+			}
+		}
+
+		// the outputs, weighted by the time ran, with the outlet water warming from pass to pass; a step that runs
+		// to its end uses all of the time left
+		double time_min = (wholePasses + partPass) * passTime_min;
+		if(partPass > 0. || riseT_C <= 0.) {
+			time_min = timeRemaining_min;
+		}
+		double meanOutletT_C = tankT_C;
+		if(wholePasses + partPass > 0.) {
+			meanOutletT_C += passRiseT_C * (wholePasses * (wholePasses - 1.) / 2. + partPass * wholePasses) / (wholePasses + partPass);
+		}
+		if(isACompressor()) {
+			hpwh->condenserInlet_C += meanOutletT_C * time_min;
+			hpwh->condenserOutlet_C += (meanOutletT_C + riseT_C) * time_min;
+		}
+		input_BTUperHr += (inputTemp_BTUperHr + pumpInput_BTUperHr) * time_min;
+		cap_BTUperHr += capTemp_BTUperHr * time_min;
+		cop += copTemp * time_min;
+		passesRun += wholePasses + partPass;
+		timeRemaining_min -= time_min;
+		tankT_C += wholePasses * passRiseT_C;
+	}
+	hpwh->externalVolumeHeated_L += passesRun * volumePerNode_LperNode;
+
+	return averageExternalOutputs(minutesToRun,timeRemaining_min,cap_BTUperHr,input_BTUperHr,cop);
+}
+
+void HPWH::HeatSource::moveExternalNodes(double nodeFrac,double targetTemp_C,double timeUsed_min) {
+	// Track the condenser temperature if this is a compressor before moving the nodes
+	if(isACompressor()) {
+		hpwh->condenserInlet_C += hpwh->tankTemps_C[externalOutletHeight] * timeUsed_min;
+		hpwh->condenserOutlet_C += targetTemp_C * timeUsed_min;
+	}
+
+	// Moving the nodes down
+	// move all nodes down, mixing if less than a full node
+	// only nodes that differ from the one above actually change, so track those for the SoC update
+	int changedBegin = externalInletHeight + 1,changedEnd = externalOutletHeight;
+	for(int n = externalOutletHeight; n < externalInletHeight; n++) {
+		double newT_C = hpwh->tankTemps_C[n] * (1 - nodeFrac) + hpwh->tankTemps_C[n + 1] * nodeFrac;
+		if(newT_C != hpwh->tankTemps_C[n]) {
+			changedBegin = std::min(changedBegin,n);
+			changedEnd = n + 1;
+		}
+		hpwh->tankTemps_C[n] = newT_C;
+	}
+	//add water to top node, heated to setpoint
+	double newInletT_C = hpwh->tankTemps_C[externalInletHeight] * (1. - nodeFrac) + targetTemp_C * nodeFrac;
+	if(newInletT_C != hpwh->tankTemps_C[externalInletHeight]) {
+		changedBegin = std::min(changedBegin,externalInletHeight);
+		changedEnd = externalInletHeight + 1;
+	}
+	hpwh->tankTemps_C[externalInletHeight] = newInletT_C;
+	if(changedBegin < changedEnd) {
+		hpwh->markNodesChanged(changedBegin,changedEnd);
+	}
+
+	hpwh->mixTankInversions();
+	hpwh->updateSoCIfNecessary();
+
+	hpwh->externalVolumeHeated_L += nodeFrac * (hpwh->tankVolume_L / hpwh->getNumNodes());
+}
+
+double HPWH::HeatSource::averageExternalOutputs(double minutesToRun,double timeRemaining_min,double &cap_BTUperHr,double &input_BTUperHr,double &cop) {
 	// divide outputs by sum of weight - the total time ran
 	// not timeRemaining_min == minutesToRun is possible
 	//   must prevent divide by 0 (added 4-11-2023)
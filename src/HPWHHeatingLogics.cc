@@ -50,6 +50,18 @@ int HPWH::SoCBasedHeatingLogic::setConstantMainsTemperature(double mains_C) {
 	return 0;
 }
 
+std::shared_ptr<HPWH::HeatingLogic> HPWH::SoCBasedHeatingLogic::clone(HPWH *hpwh_in) const {
+	std::shared_ptr<SoCBasedHeatingLogic> logic = std::make_shared<SoCBasedHeatingLogic>(*this);
+	logic->hpwh = hpwh_in;
+	return logic;
+}
+
+void HPWH::SoCBasedHeatingLogic::getParameters(std::vector<double> &parameters) const {
+	// the comparison is a function, so it goes in by how it orders a pair
+	parameters.insert(parameters.end(),{decisionPoint,static_cast<double>(compare(0.,1.)),static_cast<double>(compare(1.,0.)),
+		hysteresisFraction,tempMinUseful_C,static_cast<double>(useCostantMains),constantMains_C});
+}
+
 const double HPWH::SoCBasedHeatingLogic::nodeWeightAvgFract() {
 	return getComparisonValue();
 }
@@ -64,9 +76,10 @@ const double HPWH::SoCBasedHeatingLogic::getFractToMeetComparisonExternal() {
 	}
 
 	// Find the last node greater the min use temp
+	const std::vector<tankReal_t> &tankTemps_C = hpwh->tankModel->getTankTemps();
 	int calcNode = 0;
 	for(int i = hpwh->getNumNodes() - 1; i >= 0; i--) {
-		if(hpwh->tankTemps_C[i] < tempMinUseful_C) {
+		if(tankTemps_C[i] < tempMinUseful_C) {
 			calcNode = i + 1;
 			break;
 		}
@@ -77,15 +90,15 @@ const double HPWH::SoCBasedHeatingLogic::getFractToMeetComparisonExternal() {
 
 	// Find the fraction to heat the calc node to meet the target SoC fraction without heating the node below up to tempMinUseful. 
 	double maxSoC = hpwh->getNumNodes() * hpwh->getChargePerNode(getMainsT_C(),tempMinUseful_C,hpwh->setpoint_C);
-	double targetTemp = deltaSoCFraction * maxSoC + (hpwh->tankTemps_C[calcNode] - getMainsT_C()) / (tempMinUseful_C - getMainsT_C());
+	double targetTemp = deltaSoCFraction * maxSoC + (tankTemps_C[calcNode] - getMainsT_C()) / (tempMinUseful_C - getMainsT_C());
 	targetTemp = targetTemp * (tempMinUseful_C - getMainsT_C()) + getMainsT_C();
 
 	//Catch case where node temperature == setpoint
 	double fractCalcNode;
-	if(hpwh->tankTemps_C[calcNode] >= hpwh->setpoint_C) {
+	if(tankTemps_C[calcNode] >= hpwh->setpoint_C) {
 		fractCalcNode = 1;
 	} else {
-		fractCalcNode = (targetTemp - hpwh->tankTemps_C[calcNode]) / (hpwh->setpoint_C - hpwh->tankTemps_C[calcNode]);
+		fractCalcNode = (targetTemp - tankTemps_C[calcNode]) / (hpwh->setpoint_C - tankTemps_C[calcNode]);
 	}
 
 	// If we're at the bottom node there's not another node to heat so case 2 doesn't apply. 
@@ -94,11 +107,11 @@ const double HPWH::SoCBasedHeatingLogic::getFractToMeetComparisonExternal() {
 	}
 
 	// Fraction to heat next node, where the step change occurs
-	double fractNextNode = (tempMinUseful_C - hpwh->tankTemps_C[calcNode - 1]) / (hpwh->tankTemps_C[calcNode] - hpwh->tankTemps_C[calcNode - 1]);
+	double fractNextNode = (tempMinUseful_C - tankTemps_C[calcNode - 1]) / (tankTemps_C[calcNode] - tankTemps_C[calcNode - 1]);
 	fractNextNode += HPWH::TOL_MINVALUE;
 
 	if(hpwh->hpwhVerbosity >= VRB_emetic) {
-		double smallestSoCChangeWhenHeatingNextNode = 1. / maxSoC * (1. + fractNextNode * (hpwh->setpoint_C - hpwh->tankTemps_C[calcNode]) /
+		double smallestSoCChangeWhenHeatingNextNode = 1. / maxSoC * (1. + fractNextNode * (hpwh->setpoint_C - tankTemps_C[calcNode]) /
 			(tempMinUseful_C - getMainsT_C()));
 		hpwh->msg("fractThisNode %.6f, fractNextNode %.6f,  smallestSoCChangeWithNextNode:  %.6f, deltaSoCFraction: %.6f\n",
 			fractCalcNode,fractNextNode,smallestSoCChangeWhenHeatingNextNode,deltaSoCFraction);
@@ -148,6 +161,20 @@ int HPWH::TempBasedHeatingLogic::setDecisionPoint(double value,bool absolute) {
 	return setDecisionPoint(value);
 }
 
+std::shared_ptr<HPWH::HeatingLogic> HPWH::TempBasedHeatingLogic::clone(HPWH *hpwh_in) const {
+	std::shared_ptr<TempBasedHeatingLogic> logic = std::make_shared<TempBasedHeatingLogic>(*this);
+	logic->hpwh = hpwh_in;
+	return logic;
+}
+
+void HPWH::TempBasedHeatingLogic::getParameters(std::vector<double> &parameters) const {
+	parameters.insert(parameters.end(),{decisionPoint,static_cast<double>(compare(0.,1.)),static_cast<double>(compare(1.,0.)),
+		static_cast<double>(isEnteringWaterHighTempShutoff),static_cast<double>(isAbsolute)});
+	for(const NodeWeight &nodeWeight: nodeWeights) {
+		parameters.insert(parameters.end(),{static_cast<double>(nodeWeight.nodeNum),nodeWeight.weight});
+	}
+}
+
 const double HPWH::TempBasedHeatingLogic::nodeWeightAvgFract() {
 	double logicNode;
 	double calcNodes = 0,totWeight = 0;
@@ -179,8 +206,9 @@ const double HPWH::TempBasedHeatingLogic::getFractToMeetComparisonExternal() {
 	double sum = 0;
 	double totWeight = 0;
 
+	const std::vector<tankReal_t> &tankTemps_C = hpwh->tankModel->getTankTemps();
 	std::vector<double> resampledTankTemps(LOGIC_NODE_SIZE);
-	resample(resampledTankTemps,hpwh->tankTemps_C);
+	resample(resampledTankTemps,tankTemps_C);
 	double comparison = getComparisonValue();
 	comparison += HPWH::TOL_MINVALUE; // Make this possible so we do slightly over heat
 
@@ -190,14 +218,14 @@ const double HPWH::TempBasedHeatingLogic::getFractToMeetComparisonExternal() {
 		// bottom calc node only
 		if(nodeWeight.nodeNum == 0) { // bottom-most tank node only			
 			firstNode = calcNode = 0;
-			double nodeTemp = hpwh->tankTemps_C.front();
+			double nodeTemp = tankTemps_C.front();
 			sum = nodeTemp * nodeWeight.weight;
 			totWeight = nodeWeight.weight;
 		}
 		// top calc node only
 		else if(nodeWeight.nodeNum == LOGIC_NODE_SIZE + 1) { // top-most tank node only
 			calcNode = firstNode = hpwh->getNumNodes() - 1;
-			double nodeTemp = hpwh->tankTemps_C.back();
+			double nodeTemp = tankTemps_C.back();
 			sum = nodeTemp * nodeWeight.weight;
 			totWeight = nodeWeight.weight;
 		} else { // all tank nodes corresponding to logical node
@@ -210,9 +238,9 @@ const double HPWH::TempBasedHeatingLogic::getFractToMeetComparisonExternal() {
 	}
 
 	if(calcNode == hpwh->getNumNodes() - 1) { // top node calc
-		diff = hpwh->getSetpoint() - hpwh->tankTemps_C[firstNode];
+		diff = hpwh->getSetpoint() - tankTemps_C[firstNode];
 	} else {
-		diff = hpwh->tankTemps_C[calcNode + 1] - hpwh->tankTemps_C[firstNode];
+		diff = tankTemps_C[calcNode + 1] - tankTemps_C[firstNode];
 	}
 	// if totWeight * comparison - sum < 0 then the shutoff condition is already true and you shouldn't
 	// be here. Will revaluate shut off condition at the end the do while loop of addHeatExternal, in the
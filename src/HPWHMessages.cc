@@ -0,0 +1,421 @@
+/*
+ * Asynchronous messages: a ring buffer of unformatted messages per model, emptied by a writer thread
+ */
+
+#include <stdarg.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#include "HPWH.hh"
+
+/** A single-producer, single-consumer ring of messages. The model's thread copies each message's format and
+ * arguments into the next free record, and the writer thread formats the records in order and passes them out.
+ * Neither side takes a lock: the model only writes the head, and the writer only the tail.  */
+class HPWH::MessageSink {
+public:
+	MessageSink(int capacity,MESSAGE_OVERFLOW overflow,
+		void (*callbackFunc)(const std::string message,void* contextPtr),void* contextPtr);
+	~MessageSink();
+
+	void push(const char* fmt,va_list ap);
+	void flush();
+	long long getNumDropped() const { return numDropped.load(std::memory_order_relaxed); };
+
+private:
+	static const int maxArgs = 8;
+
+	struct Arg {
+		char kind;		/**< 'i' signed, 'u' unsigned, 'd' floating, 's' string in the text, 'p' pointer  */
+		union {
+			long long i;
+			unsigned long long u;
+			double d;
+			const void *p;
+			struct {
+				unsigned short offset,length;
+			} s;
+		};
+	};
+
+	struct Record {
+		bool isFormatted;	/**< whether text is the message itself, when its arguments could not be copied  */
+		unsigned short fmtLength;
+		unsigned char numArgs;
+		Arg args[maxArgs];
+		char text[MAXOUTSTRING];	/**< the format, followed by the string arguments  */
+	};
+
+	bool copyMessage(Record &record,const char* fmt,va_list ap) const;
+	std::string formatMessage(const Record &record) const;
+	void write();
+	void say(const std::string &message) const;
+
+	std::vector<Record> records;
+	const MESSAGE_OVERFLOW overflow;
+	void (*const messageCallback)(const std::string message,void* contextPtr);
+	void *const messageCallbackContextPtr;
+
+	std::atomic<std::size_t> head;	/**< the number of records pushed  */
+	std::atomic<std::size_t> tail;	/**< the number of records passed out  */
+	std::atomic<long long> numDropped;
+	std::atomic<bool> isStopping;
+	std::thread writer;	/**< started with the first message  */
+};
+
+HPWH::MessageSink::MessageSink(int capacity,MESSAGE_OVERFLOW overflow_in,
+	void (*callbackFunc)(const std::string message,void* contextPtr),void* contextPtr):
+	records(capacity),overflow(overflow_in),messageCallback(callbackFunc),messageCallbackContextPtr(contextPtr),
+	head(0),tail(0),numDropped(0),isStopping(false) {
+}
+
+HPWH::MessageSink::~MessageSink() {
+	flush();
+	isStopping.store(true,std::memory_order_release);
+	if(writer.joinable()) {
+		writer.join();
+	}
+}
+
+void HPWH::MessageSink::push(const char* fmt,va_list ap) {
+	const std::size_t next = head.load(std::memory_order_relaxed);
+	while(next - tail.load(std::memory_order_acquire) >= records.size()) {
+		if(overflow == MESSAGES_DROP) {
+			numDropped.fetch_add(1,std::memory_order_relaxed);
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	Record &record = records[next % records.size()];
+	va_list args;
+	va_copy(args,ap);
+	bool isCopied = copyMessage(record,fmt,args);
+	va_end(args);
+	if(!isCopied) {
+		// a message the writer could not rebuild is formatted here, as msgV does
+		record.isFormatted = true;
+		vsnprintf(record.text,MAXOUTSTRING,fmt,ap);
+		record.fmtLength = static_cast<unsigned short>(strlen(record.text));
+	}
+	head.store(next + 1,std::memory_order_release);
+
+	if(!writer.joinable()) {
+		writer = std::thread(&MessageSink::write,this);
+	}
+}
+
+void HPWH::MessageSink::flush() {
+	if(!writer.joinable()) {
+		return;
+	}
+	while(tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed)) {
+		std::this_thread::yield();
+	}
+}
+
+// Copies the format and the arguments its conversions take, returning false for a conversion the writer
+// cannot pass on as it was given, or a message that does not fit
+bool HPWH::MessageSink::copyMessage(Record &record,const char* fmt,va_list ap) const {
+	record.isFormatted = false;
+	record.numArgs = 0;
+	std::size_t textLength = strlen(fmt);
+	if(textLength >= MAXOUTSTRING) {
+		return false;
+	}
+	memcpy(record.text,fmt,textLength);
+	record.fmtLength = static_cast<unsigned short>(textLength);
+
+	auto addArg = [&record](char kind) -> Arg* {
+		if(record.numArgs == maxArgs) {
+			return NULL;
+		}
+		Arg &arg = record.args[record.numArgs++];
+		arg.kind = kind;
+		return &arg;
+	};
+	for(const char *c = fmt; *c != '\0'; c++) {
+		if(*c != '%') {
+			continue;
+		}
+		c++;
+		if(*c == '%') {
+			continue;
+		}
+		while(*c != '\0' && strchr("-+ #0",*c) != NULL) {
+			c++;
+		}
+		for(int part = 0; part < 2; part++) {
+			// the width, then the precision
+			if(part == 1) {
+				if(*c != '.') {
+					break;
+				}
+				c++;
+			}
+			if(*c == '*') {
+				Arg *arg = addArg('i');
+				if(arg == NULL) {
+					return false;
+				}
+				arg->i = va_arg(ap,int);
+				c++;
+			} else {
+				while(*c >= '0' && *c <= '9') {
+					c++;
+				}
+			}
+		}
+		// the length modifier, as up to two characters
+		char length[3] = {'\0','\0','\0'};
+		for(int n = 0; *c != '\0' && strchr("hlLqjzt",*c) != NULL; n++,c++) {
+			if(n == 2) {
+				return false;
+			}
+			length[n] = *c;
+		}
+		auto isLength = [&length](const char *modifier) {
+			return strcmp(length,modifier) == 0;
+		};
+
+		Arg *arg = NULL;
+		switch(*c) {
+		case 'd': case 'i': case 'c':
+			if((arg = addArg('i')) == NULL || (*c == 'c' && length[0] != '\0')) {
+				return false;
+			}
+			if(isLength("l")) {
+				arg->i = va_arg(ap,long);
+			} else if(isLength("ll")) {
+				arg->i = va_arg(ap,long long);
+			} else if(isLength("j")) {
+				arg->i = va_arg(ap,intmax_t);
+			} else if(isLength("z") || isLength("t")) {
+				arg->i = va_arg(ap,std::ptrdiff_t);
+			} else if(length[0] == '\0' || isLength("h") || isLength("hh")) {
+				arg->i = va_arg(ap,int);
+			} else {
+				return false;
+			}
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			if((arg = addArg('u')) == NULL) {
+				return false;
+			}
+			if(isLength("l")) {
+				arg->u = va_arg(ap,unsigned long);
+			} else if(isLength("ll")) {
+				arg->u = va_arg(ap,unsigned long long);
+			} else if(isLength("j")) {
+				arg->u = va_arg(ap,uintmax_t);
+			} else if(isLength("z") || isLength("t")) {
+				arg->u = va_arg(ap,std::size_t);
+			} else if(length[0] == '\0' || isLength("h") || isLength("hh")) {
+				arg->u = va_arg(ap,unsigned int);
+			} else {
+				return false;
+			}
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			if((arg = addArg('d')) == NULL || !(length[0] == '\0' || isLength("l"))) {
+				return false;
+			}
+			arg->d = va_arg(ap,double);
+			break;
+		case 's': {
+			if((arg = addArg('s')) == NULL || length[0] != '\0') {
+				return false;
+			}
+			const char *value = va_arg(ap,const char*);
+			if(value == NULL) {
+				value = "(null)";
+			}
+			std::size_t stringLength = strlen(value);
+			if(textLength + stringLength > MAXOUTSTRING) {
+				return false;
+			}
+			memcpy(record.text + textLength,value,stringLength);
+			arg->s.offset = static_cast<unsigned short>(textLength);
+			arg->s.length = static_cast<unsigned short>(stringLength);
+			textLength += stringLength;
+			break;
+		}
+		case 'p':
+			if((arg = addArg('p')) == NULL) {
+				return false;
+			}
+			arg->p = va_arg(ap,const void*);
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+// Formats a copied message one conversion at a time, each with the widest argument type of its kind
+std::string HPWH::MessageSink::formatMessage(const Record &record) const {
+	if(record.isFormatted) {
+		return std::string(record.text,record.fmtLength);
+	}
+	std::string message;
+	char piece[MAXOUTSTRING];
+	const char *c = record.text,*end = record.text + record.fmtLength;
+	int iArg = 0;
+	while(c < end) {
+		if(*c != '%') {
+			message += *c++;
+			continue;
+		}
+		if(c[1] == '%') {
+			message += '%';
+			c += 2;
+			continue;
+		}
+		std::string spec(1,*c++);
+		while(strchr("-+ #0",*c) != NULL) {
+			spec += *c++;
+		}
+		for(int part = 0; part < 2; part++) {
+			if(part == 1) {
+				if(*c != '.') {
+					break;
+				}
+				c++;
+			}
+			if(*c == '*') {
+				long long value = record.args[iArg++].i;
+				c++;
+				if(part == 1 && value < 0) {
+					// a negative precision is taken as none
+					continue;
+				}
+				spec += (part == 1 ? "." : "") + std::to_string(value);
+			} else {
+				if(part == 1) {
+					spec += '.';
+				}
+				while(*c >= '0' && *c <= '9') {
+					spec += *c++;
+				}
+			}
+		}
+		while(strchr("hlLqjzt",*c) != NULL) {
+			c++;
+		}
+
+		const Arg &arg = record.args[iArg++];
+		const char conversion = *c++;
+		switch(arg.kind) {
+		case 'i':
+			spec += (conversion == 'c') ? "" : "ll";
+			spec += conversion;
+			if(conversion == 'c') {
+				snprintf(piece,MAXOUTSTRING,spec.c_str(),static_cast<int>(arg.i));
+			} else {
+				snprintf(piece,MAXOUTSTRING,spec.c_str(),arg.i);
+			}
+			break;
+		case 'u':
+			spec += "ll";
+			spec += conversion;
+			snprintf(piece,MAXOUTSTRING,spec.c_str(),arg.u);
+			break;
+		case 'd':
+			spec += conversion;
+			snprintf(piece,MAXOUTSTRING,spec.c_str(),arg.d);
+			break;
+		case 's':
+			spec += conversion;
+			snprintf(piece,MAXOUTSTRING,spec.c_str(),std::string(record.text + arg.s.offset,arg.s.length).c_str());
+			break;
+		default:
+			spec += conversion;
+			snprintf(piece,MAXOUTSTRING,spec.c_str(),arg.p);
+			break;
+		}
+		message += piece;
+	}
+
+	// as long as msgV would have made it
+	if(message.size() > MAXOUTSTRING - 1) {
+		message.resize(MAXOUTSTRING - 1);
+	}
+	return message;
+}
+
+void HPWH::MessageSink::write() {
+	long long numReported = 0;
+	int numIdle = 0;
+	while(true) {
+		const std::size_t next = tail.load(std::memory_order_relaxed);
+		if(next != head.load(std::memory_order_acquire)) {
+			say(formatMessage(records[next % records.size()]));
+			tail.store(next + 1,std::memory_order_release);
+			numIdle = 0;
+			continue;
+		}
+		long long numDroppedNow = numDropped.load(std::memory_order_relaxed);
+		if(numDroppedNow > numReported) {
+			say("HPWH dropped " + std::to_string(numDroppedNow - numReported) + " messages.  \n");
+			numReported = numDroppedNow;
+		}
+		if(isStopping.load(std::memory_order_acquire)) {
+			return;
+		}
+		// stay ready for the next step's messages for a while before sleeping
+		if(numIdle++ < 64) {
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+}
+
+void HPWH::MessageSink::say(const std::string &message) const {
+	if(messageCallback != NULL) {
+		(*messageCallback)(message,messageCallbackContextPtr);
+	} else {
+		std::cout << message;
+	}
+}
+
+int HPWH::setAsyncMessages(bool doAsync,int capacity /*=1024*/,MESSAGE_OVERFLOW overflow /*=MESSAGES_BLOCK*/,
+	bool flushEachStep /*=false*/) {
+	if(doAsync && capacity <= 0) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The message buffer needs room for at least one message.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	messageSink.reset();
+	messageCapacity = capacity;
+	messageOverflow = overflow;
+	flushMessagesEachStep = doAsync && flushEachStep;
+	if(doAsync) {
+		startMessageSink();
+	}
+	return 0;
+}
+
+void HPWH::flushMessages() const {
+	if(messageSink) {
+		messageSink->flush();
+	}
+}
+
+long long HPWH::getNumDroppedMessages() const {
+	return messageSink ? messageSink->getNumDropped() : 0;
+}
+
+void HPWH::pushMessage(const char* fmt,va_list ap) const {
+	messageSink->push(fmt,ap);
+}
+
+void HPWH::startMessageSink() {
+	messageSink = std::make_shared<MessageSink>(messageCapacity,messageOverflow,messageCallback,messageCallbackContextPtr);
+}
@@ -0,0 +1,271 @@
+/*
+ * Parallel-in-time (Parareal) driver for long HPWH simulations
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "HPWH.hh"
+
+namespace {
+
+/** the outputs runNSteps accumulates, kept for one segment of steps */
+struct SegmentOutputs {
+	double energyRemovedFromEnvironment_kWh = 0.;
+	double standbyLosses_kWh = 0.;
+	double outletTempVolume_CL = 0.;
+	double drawVolume_L = 0.;
+	double extraHeat_kWh = 0.;
+	double recircLoss_kWh = 0.;
+	double recircVolume_L = 0.;
+	double recircReturnTVolume_CL = 0.;
+	std::vector<double> runTimes_min;
+	std::vector<double> energyInputs_kWh;
+	std::vector<double> energyOutputs_kWh;
+};
+
+}
+
+void HPWH::parallelFor(int begin,int end,const std::function<void(int)> &fn) {
+	int numThreads = std::min(static_cast<int>(std::max(std::thread::hardware_concurrency(),1u)),end - begin);
+	if(numThreads <= 1) {
+		for(int i = begin; i < end; i++) {
+			fn(i);
+		}
+		return;
+	}
+	std::atomic<int> next(begin);
+	std::vector<std::thread> threads;
+	for(int t = 0; t < numThreads; t++) {
+		threads.emplace_back([&]() {
+			for(int i = next++; i < end; i = next++) {
+				fn(i);
+			}
+		});
+	}
+	for(auto &thread: threads) {
+		thread.join();
+	}
+}
+
+int HPWH::runNStepsParallel(int N,double *inletT_C,double *drawVolume_L,
+	double *tankAmbientT_C,double *heatSourceAmbientT_C,
+	DRMODES *DRstatus,int numSegments,double tankTTol_C /*=0.01*/,int maxIterations /*=0*/) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	if(N <= 0 || numSegments <= 0 || tankTTol_C < 0. || maxIterations < 0) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runNStepsParallel needs positive numbers of steps and segments and a non-negative tolerance.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	if(simHasFailed) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("simHasFailed is set, aborting.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	numSegments = std::min(numSegments,N);
+	if(maxIterations == 0) {
+		maxIterations = numSegments;
+	}
+
+	if(hpwhVerbosity >= VRB_typical) {
+		msg("Begin runNStepsParallel.  \n");
+	}
+
+	// the segments split the steps as evenly as possible
+	std::vector<int> segmentStart(numSegments + 1);
+	for(int k = 0; k <= numSegments; k++) {
+		segmentStart[k] = static_cast<int>((static_cast<long long>(N) * k) / numSegments);
+	}
+
+	// The coarse propagator runs each hour as one adaptive step with loose tolerances
+	const int stepsPerCoarseStep = std::max(1,static_cast<int>(60. / minutesPerStep + 0.5));
+	auto runCoarse = [&](HPWH &hpwh,int k) {
+		hpwh.setAdaptiveStepTolerance(10. * adaptiveTankEnergyTol_kJ,10. * adaptiveOutletTTol_C,
+			std::max(adaptiveMinSubstep_min,15.));
+		for(int i = segmentStart[k]; i < segmentStart[k + 1]; i += stepsPerCoarseStep) {
+			int iEnd = std::min(i + stepsPerCoarseStep,segmentStart[k + 1]);
+			double draw_L = 0.,inletTVolume_CL = 0.,inletT_sum = 0.,tankAmbientT_sum = 0.,heatSourceAmbientT_sum = 0.;
+			for(int j = i; j < iEnd; j++) {
+				draw_L += drawVolume_L[j];
+				inletTVolume_CL += inletT_C[j] * drawVolume_L[j];
+				inletT_sum += inletT_C[j];
+				tankAmbientT_sum += tankAmbientT_C[j];
+				heatSourceAmbientT_sum += heatSourceAmbientT_C[j];
+			}
+			double numSteps = static_cast<double>(iEnd - i);
+			double coarseInletT_C = (draw_L > 0.) ? inletTVolume_CL / draw_L : inletT_sum / numSteps;
+			if(hpwh.runAdaptiveStep(numSteps * minutesPerStep,coarseInletT_C,draw_L,tankAmbientT_sum / numSteps,
+				heatSourceAmbientT_sum / numSteps,DRstatus[i]) != 0) {
+				return HPWH_ABORT;
+			}
+		}
+		hpwh.setAdaptiveStepTolerance(adaptiveTankEnergyTol_kJ,adaptiveOutletTTol_C,adaptiveMinSubstep_min);
+		return 0;
+	};
+
+	// The fine propagator is the full model, step by step
+	auto runFine = [&](HPWH &hpwh,int k,SegmentOutputs &outputs) {
+		outputs = SegmentOutputs();
+		outputs.runTimes_min.assign(getNumHeatSources(),0.);
+		outputs.energyInputs_kWh.assign(getNumHeatSources(),0.);
+		outputs.energyOutputs_kWh.assign(getNumHeatSources(),0.);
+		for(int i = segmentStart[k]; i < segmentStart[k + 1]; i++) {
+			if(hpwh.runOneStep(inletT_C[i],drawVolume_L[i],tankAmbientT_C[i],heatSourceAmbientT_C[i],DRstatus[i]) != 0) {
+				return HPWH_ABORT;
+			}
+			outputs.energyRemovedFromEnvironment_kWh += hpwh.energyRemovedFromEnvironment_kWh;
+			outputs.standbyLosses_kWh += hpwh.standbyLosses_kWh;
+			outputs.outletTempVolume_CL += hpwh.outletTemp_C * drawVolume_L[i];
+			outputs.drawVolume_L += drawVolume_L[i];
+			outputs.extraHeat_kWh += hpwh.extraHeat_kWh;
+			outputs.recircLoss_kWh += hpwh.recircLoss_kWh;
+			outputs.recircVolume_L += hpwh.recircVolume_L;
+			outputs.recircReturnTVolume_CL += hpwh.recircReturnT_C * hpwh.recircVolume_L;
+			for(int j = 0; j < getNumHeatSources(); j++) {
+				outputs.runTimes_min[j] += hpwh.heatSources[j].runtime_min;
+				outputs.energyInputs_kWh[j] += hpwh.heatSources[j].energyInput_kWh;
+				outputs.energyOutputs_kWh[j] += hpwh.heatSources[j].energyOutput_kWh;
+			}
+		}
+		return 0;
+	};
+
+	// start[k] is the state at the start of segment k, coarseEnd[k] and fineEnd[k] the coarse and fine states at its end
+	std::vector<HPWH> start(numSegments),coarseEnd(numSegments),fineEnd(numSegments);
+	std::vector<SegmentOutputs> fineOutputs(numSegments);
+	std::vector<int> fineReturn(numSegments,0);
+
+	// initial guess, sequentially with the coarse propagator
+	start[0] = *this;
+	for(int k = 0; k < numSegments; k++) {
+		coarseEnd[k] = start[k];
+		if(runCoarse(coarseEnd[k],k) != 0) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("runNStepsParallel failed in the coarse run of segment %d.  \n",k);
+			}
+			return HPWH_ABORT;
+		}
+		if(k + 1 < numSegments) {
+			start[k + 1] = coarseEnd[k];
+		}
+	}
+
+	// Segments below firstInexact start from the sequential result. Each iteration reruns the others with the
+	// full model and corrects the following starts: start = coarse(new start) + fine(old start) - coarse(old start).
+	int firstInexact = 1;
+	numPararealIterations = 0;
+	while(true) {
+		int firstRun = std::max(firstInexact - 1,0);
+		parallelFor(firstRun,numSegments,[&](int k) {
+			fineEnd[k] = start[k];
+			fineReturn[k] = runFine(fineEnd[k],k,fineOutputs[k]);
+		});
+		numPararealIterations++;
+		for(int k = firstRun; k < numSegments; k++) {
+			if(fineReturn[k] != 0) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("runNStepsParallel failed in segment %d.  \n",k);
+				}
+				return HPWH_ABORT;
+			}
+		}
+
+		// how far each segment's end is from the start of the next, as the tank model has them
+		double maxMismatch_C = 0.;
+		for(int k = firstInexact; k < numSegments; k++) {
+			const std::vector<tankReal_t> &endT_C = fineEnd[k - 1].tankModel->getTankTemps();
+			const std::vector<tankReal_t> &startT_C = start[k].tankModel->getTankTemps();
+			for(int n = 0; n < getNumNodes(); n++) {
+				maxMismatch_C = std::max(maxMismatch_C,fabs(endT_C[n] - startT_C[n]));
+			}
+		}
+		if(hpwhVerbosity >= VRB_typical) {
+			msg("Parareal iteration %d, largest segment mismatch %.4lf C.  \n",numPararealIterations,maxMismatch_C);
+		}
+		if(maxMismatch_C <= tankTTol_C || firstInexact >= numSegments) {
+			break;
+		}
+		if(numPararealIterations >= maxIterations) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("runNStepsParallel did not converge in %d iterations, largest segment mismatch %.4lf C.  \n",
+					numPararealIterations,maxMismatch_C);
+			}
+			break;
+		}
+
+		// correction sweep; the first inexact start becomes exact
+		start[firstInexact] = fineEnd[firstInexact - 1];
+		for(int k = firstInexact; k + 1 < numSegments; k++) {
+			HPWH newCoarseEnd = start[k];
+			if(runCoarse(newCoarseEnd,k) != 0) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("runNStepsParallel failed in the coarse run of segment %d.  \n",k);
+				}
+				return HPWH_ABORT;
+			}
+			// the discrete state (heat sources on, lockouts, timers) comes from the fine run
+			start[k + 1] = fineEnd[k];
+			const std::vector<tankReal_t> &newCoarseT_C = newCoarseEnd.tankModel->getTankTemps();
+			const std::vector<tankReal_t> &oldCoarseT_C = coarseEnd[k].tankModel->getTankTemps();
+			std::vector<tankReal_t> &startT_C = start[k + 1].tankModel->editTankTemps();
+			for(int n = 0; n < getNumNodes(); n++) {
+				startT_C[n] += newCoarseT_C[n] - oldCoarseT_C[n];
+			}
+			start[k + 1].mixTankInversions();
+			start[k + 1].markNodesChanged(0,getNumNodes());
+			start[k + 1].balanceTankHeatContentValid = false;
+			coarseEnd[k] = newCoarseEnd;
+		}
+		firstInexact++;
+	}
+
+	// the end of the last segment is the new state, with the outputs summed or averaged as in runNSteps
+	int iterations = numPararealIterations;
+	*this = fineEnd[numSegments - 1];
+	numPararealIterations = iterations;
+
+	SegmentOutputs total;
+	total.runTimes_min.assign(getNumHeatSources(),0.);
+	total.energyInputs_kWh.assign(getNumHeatSources(),0.);
+	total.energyOutputs_kWh.assign(getNumHeatSources(),0.);
+	for(auto &outputs: fineOutputs) {
+		total.energyRemovedFromEnvironment_kWh += outputs.energyRemovedFromEnvironment_kWh;
+		total.standbyLosses_kWh += outputs.standbyLosses_kWh;
+		total.outletTempVolume_CL += outputs.outletTempVolume_CL;
+		total.drawVolume_L += outputs.drawVolume_L;
+		total.extraHeat_kWh += outputs.extraHeat_kWh;
+		total.recircLoss_kWh += outputs.recircLoss_kWh;
+		total.recircVolume_L += outputs.recircVolume_L;
+		total.recircReturnTVolume_CL += outputs.recircReturnTVolume_CL;
+		for(int j = 0; j < getNumHeatSources(); j++) {
+			total.runTimes_min[j] += outputs.runTimes_min[j];
+			total.energyInputs_kWh[j] += outputs.energyInputs_kWh[j];
+			total.energyOutputs_kWh[j] += outputs.energyOutputs_kWh[j];
+		}
+	}
+	energyRemovedFromEnvironment_kWh = total.energyRemovedFromEnvironment_kWh;
+	standbyLosses_kWh = total.standbyLosses_kWh;
+	outletTemp_C = (total.drawVolume_L > 0.) ? total.outletTempVolume_CL / total.drawVolume_L : 0.;
+	extraHeat_kWh = total.extraHeat_kWh;
+	recircLoss_kWh = total.recircLoss_kWh;
+	recircVolume_L = total.recircVolume_L;
+	recircReturnT_C = (total.recircVolume_L > 0.) ? total.recircReturnTVolume_CL / total.recircVolume_L : 0.;
+	for(int j = 0; j < getNumHeatSources(); j++) {
+		heatSources[j].runtime_min = total.runTimes_min[j];
+		heatSources[j].energyInput_kWh = total.energyInputs_kWh[j];
+		heatSources[j].energyOutput_kWh = total.energyOutputs_kWh[j];
+	}
+
+	if(hpwhVerbosity >= VRB_typical) {
+		msg("Ending runNStepsParallel after %d iterations.  \n\n\n\n",numPararealIterations);
+	}
+	return 0;
+}
+
+int HPWH::getNumPararealIterations() const {
+	return numPararealIterations;
+}
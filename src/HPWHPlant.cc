@@ -0,0 +1,216 @@
+/*
+ * Plants: several tanks in series and parallel stages, run as one water heater
+ */
+
+#include <algorithm>
+
+#include "HPWH.hh"
+
+HPWHPlant::HPWHPlant():
+	outletTemp_C(0.),energyInput_kWh(0.),energyOutput_kWh(0.),energyRemovedFromEnvironment_kWh(0.),standbyLosses_kWh(0.)
+{}
+
+int HPWHPlant::addStage(const std::vector<HPWH> &tanks,
+	const std::vector<double> &flowFractions /*=std::vector<double>()*/) {
+	if(tanks.empty() || (!flowFractions.empty() && flowFractions.size() != tanks.size())) {
+		return HPWH::HPWH_ABORT;
+	}
+	Stage stage;
+	stage.tanks = tanks;
+	stage.flowFractions = flowFractions;
+	if(stage.flowFractions.empty()) {
+		for(const HPWH &tank: tanks) {
+			stage.flowFractions.push_back(tank.getTankSize());
+		}
+	}
+	double totalFraction = 0.;
+	for(double fraction: stage.flowFractions) {
+		if(!(fraction > 0.)) {
+			return HPWH::HPWH_ABORT;
+		}
+		totalFraction += fraction;
+	}
+	for(double &fraction: stage.flowFractions) {
+		fraction /= totalFraction;
+	}
+	stages.push_back(stage);
+	return 0;
+}
+
+int HPWHPlant::initSwingTank(const HPWH &primaryTank,int numPrimaryTanks,const HPWH &swingTank) {
+	if(numPrimaryTanks <= 0) {
+		return HPWH::HPWH_ABORT;
+	}
+	stages.clear();
+	addStage(std::vector<HPWH>(numPrimaryTanks,primaryTank),std::vector<double>(numPrimaryTanks,1.));
+	addStage(std::vector<HPWH>(1,swingTank));
+	return 0;
+}
+
+int HPWHPlant::runOneStep(double inletT_C,double drawVolume_L,double tankAmbientT_C,double heatSourceAmbientT_C,
+	HPWH::DRMODES DRstatus) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	if(stages.empty()) {
+		return HPWH::HPWH_ABORT;
+	}
+	outletTemp_C = 0.;
+	energyInput_kWh = 0.;
+	energyOutput_kWh = 0.;
+	energyRemovedFromEnvironment_kWh = 0.;
+	standbyLosses_kWh = 0.;
+
+	double stageInletT_C = inletT_C;
+	for(Stage &stage: stages) {
+		double stageOutletT_C = 0.;
+		for(std::size_t j = 0; j < stage.tanks.size(); j++) {
+			HPWH &tank = stage.tanks[j];
+			if(tank.runOneStep(stageInletT_C,stage.flowFractions[j] * drawVolume_L,tankAmbientT_C,heatSourceAmbientT_C,
+				DRstatus) != 0) {
+				return HPWH::HPWH_ABORT;
+			}
+			stageOutletT_C += stage.flowFractions[j] * tank.getOutletTemp();
+			for(int k = 0; k < tank.getNumHeatSources(); k++) {
+				energyInput_kWh += tank.getNthHeatSourceEnergyInput(k);
+				energyOutput_kWh += tank.getNthHeatSourceEnergyOutput(k);
+			}
+			energyRemovedFromEnvironment_kWh += tank.getEnergyRemovedFromEnvironment();
+			standbyLosses_kWh += tank.getStandbyLosses();
+		}
+		stageInletT_C = (drawVolume_L > 0.) ? stageOutletT_C : inletT_C;
+	}
+	if(drawVolume_L > 0.) {
+		outletTemp_C = stageInletT_C;
+	}
+	return 0;
+}
+
+int HPWHPlant::runNSteps(int N,double *inletT_C,double *drawVolume_L,double *tankAmbientT_C,double *heatSourceAmbientT_C,
+	HPWH::DRMODES *DRstatus,double *outletT_C /*=NULL*/) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	if(N <= 0 || stages.empty()) {
+		return HPWH::HPWH_ABORT;
+	}
+
+	// the sums of one tank over the steps
+	struct TankSums {
+		double energyInput_kWh = 0.;
+		double energyOutput_kWh = 0.;
+		double energyRemovedFromEnvironment_kWh = 0.;
+		double standbyLosses_kWh = 0.;
+	};
+
+	std::vector<double> stageInletT_C(inletT_C,inletT_C + N);
+	std::vector<double> stageOutletT_C(N);
+	double plantEnergyInput_kWh = 0.,plantEnergyOutput_kWh = 0.;
+	double plantEnergyRemovedFromEnvironment_kWh = 0.,plantStandbyLosses_kWh = 0.;
+	for(Stage &stage: stages) {
+		const int numTanks = static_cast<int>(stage.tanks.size());
+		std::vector<std::vector<double>> tankOutletT_C(numTanks,std::vector<double>(N));
+		std::vector<TankSums> tankSums(numTanks);
+		std::vector<int> runResults(numTanks,0);
+		HPWH::parallelFor(0,numTanks,[&](int j) {
+			HPWH &tank = stage.tanks[j];
+			TankSums &sums = tankSums[j];
+			for(int i = 0; i < N; i++) {
+				if(tank.runOneStep(stageInletT_C[i],stage.flowFractions[j] * drawVolume_L[i],tankAmbientT_C[i],
+					heatSourceAmbientT_C[i],DRstatus[i]) != 0) {
+					runResults[j] = HPWH::HPWH_ABORT;
+					return;
+				}
+				tankOutletT_C[j][i] = tank.getOutletTemp();
+				for(int k = 0; k < tank.getNumHeatSources(); k++) {
+					sums.energyInput_kWh += tank.getNthHeatSourceEnergyInput(k);
+					sums.energyOutput_kWh += tank.getNthHeatSourceEnergyOutput(k);
+				}
+				sums.energyRemovedFromEnvironment_kWh += tank.getEnergyRemovedFromEnvironment();
+				sums.standbyLosses_kWh += tank.getStandbyLosses();
+			}
+		});
+		for(int j = 0; j < numTanks; j++) {
+			if(runResults[j] != 0) {
+				return HPWH::HPWH_ABORT;
+			}
+			plantEnergyInput_kWh += tankSums[j].energyInput_kWh;
+			plantEnergyOutput_kWh += tankSums[j].energyOutput_kWh;
+			plantEnergyRemovedFromEnvironment_kWh += tankSums[j].energyRemovedFromEnvironment_kWh;
+			plantStandbyLosses_kWh += tankSums[j].standbyLosses_kWh;
+		}
+
+		// the mix of the bank's outlets, in the order runOneStep adds them
+		for(int i = 0; i < N; i++) {
+			double mixedT_C = 0.;
+			for(int j = 0; j < numTanks; j++) {
+				mixedT_C += stage.flowFractions[j] * tankOutletT_C[j][i];
+			}
+			stageOutletT_C[i] = (drawVolume_L[i] > 0.) ? mixedT_C : inletT_C[i];
+		}
+		std::swap(stageInletT_C,stageOutletT_C);
+	}
+
+	double outletTempVolume_CL = 0.,totalDrawVolume_L = 0.;
+	for(int i = 0; i < N; i++) {
+		double stepOutletT_C = (drawVolume_L[i] > 0.) ? stageInletT_C[i] : 0.;
+		if(outletT_C != NULL) {
+			outletT_C[i] = stepOutletT_C;
+		}
+		outletTempVolume_CL += stepOutletT_C * drawVolume_L[i];
+		totalDrawVolume_L += drawVolume_L[i];
+	}
+	outletTemp_C = (totalDrawVolume_L > 0.) ? outletTempVolume_CL / totalDrawVolume_L : 0.;
+	energyInput_kWh = plantEnergyInput_kWh;
+	energyOutput_kWh = plantEnergyOutput_kWh;
+	energyRemovedFromEnvironment_kWh = plantEnergyRemovedFromEnvironment_kWh;
+	standbyLosses_kWh = plantStandbyLosses_kWh;
+	return 0;
+}
+
+int HPWHPlant::getNumStages() const {
+	return static_cast<int>(stages.size());
+}
+
+int HPWHPlant::getNumTanks(int stage) const {
+	if(stage < 0 || stage >= getNumStages()) {
+		return HPWH::HPWH_ABORT;
+	}
+	return static_cast<int>(stages[stage].tanks.size());
+}
+
+HPWH &HPWHPlant::getTank(int stage,int tank) {
+	return stages[stage].tanks[tank];
+}
+
+const HPWH &HPWHPlant::getTank(int stage,int tank) const {
+	return stages[stage].tanks[tank];
+}
+
+double HPWHPlant::getOutletTemp() const {
+	return outletTemp_C;
+}
+
+double HPWHPlant::getEnergyInput_kWh() const {
+	return energyInput_kWh;
+}
+
+double HPWHPlant::getEnergyOutput_kWh() const {
+	return energyOutput_kWh;
+}
+
+double HPWHPlant::getEnergyRemovedFromEnvironment_kWh() const {
+	return energyRemovedFromEnvironment_kWh;
+}
+
+double HPWHPlant::getStandbyLosses_kWh() const {
+	return standbyLosses_kWh;
+}
+
+double HPWHPlant::getTankHeatContent_kJ() const {
+	double heatContent_kJ = 0.;
+	for(const Stage &stage: stages) {
+		for(const HPWH &tank: stage.tanks) {
+			heatContent_kJ += tank.getTankHeatContent_kJ();
+		}
+	}
+	return heatContent_kJ;
+}
@@ -0,0 +1,272 @@
+/*
+ * Rating engine: the DOE first-hour rating, recovery efficiency and uniform energy factor
+ */
+
+#include <algorithm>
+
+#include "HPWH.hh"
+
+namespace {
+
+/** one draw of a 24 hour draw pattern */
+struct RatingDraw {
+	double start_min;
+	double volume_gal;
+	double flow_gpm;
+};
+
+/** the draw patterns of the 24 hour simulated-use test, in the order of DRAW_PATTERN */
+const std::vector<RatingDraw> drawPatterns[] = {
+	// very small
+	{{0.,2.,1.},{60.,1.,1.},{65.,0.5,1.},{70.,0.5,1.},{75.,0.5,1.},{480.,1.,1.},{495.,2.,1.},
+	 {540.,1.5,1.},{555.,1.,1.}},
+	// low
+	{{0.,15.,1.7},{30.,2.,1.},{60.,1.,1.},{630.,6.,1.7},{690.,4.,1.7},{720.,1.,1.},{765.,1.,1.},
+	 {770.,1.,1.},{975.,2.,1.},{1005.,2.,1.7},{1020.,3.,1.7}},
+	// medium
+	{{0.,15.,1.7},{30.,2.,1.},{100.,9.,1.7},{630.,9.,1.7},{690.,5.,1.7},{720.,1.,1.},{765.,1.,1.},
+	 {770.,1.,1.},{960.,1.,1.},{975.,2.,1.},{1005.,2.,1.7},{1020.,7.,1.7}},
+	// high
+	{{0.,27.,3.},{30.,2.,1.},{40.,1.,1.},{100.,9.,1.7},{630.,15.,3.},{690.,5.,1.7},{720.,1.,1.},
+	 {765.,1.,1.},{770.,1.,1.},{960.,2.,1.},{975.,2.,1.},{990.,2.,1.7},{1005.,2.,1.7},{1020.,14.,3.}}
+};
+
+// the test conditions
+const double ratingSetpoint_F = 125.;
+const double ratingInletT_F = 58.;
+const double ratingAmbientT_F = 67.5;
+
+// the first-hour rating draws at 3 gpm until the outlet is 15 F below the warmest water of the draw
+const double firstHourFlow_gpm = 3.;
+const double firstHourCutoff_dF = 15.;
+// a heater that keeps up with the draw ends it here
+const double maxFirstHourTest_min = 120.;
+
+}
+
+int HPWH::rate(Rating &rating,RATING_PARTS parts /*=RATE_UEF*/) const {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	rating = Rating();
+	if(simHasFailed) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("simHasFailed is set, aborting.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	// extra heat sources only carry heat the caller puts in
+	bool canHeat = false;
+	for(int i = 0; i < getNumHeatSources(); i++) {
+		if(heatSources[i].typeOfHeatSource != TYPE_extra) {
+			canHeat = true;
+		}
+	}
+	if(!canHeat) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("A model without heat sources of its own cannot be rated.  \n");
+		}
+		return HPWH_ABORT;
+	}
+
+	// both tests start from a tank at the setpoint with the heat sources off
+	HPWH firstHourTest(*this);
+	firstHourTest.setMinutesPerStep(1.);
+	double maxSetpoint_C;
+	std::string why;
+	if(!isSetpointFixed() && isNewSetpointPossible(F_TO_C(ratingSetpoint_F),maxSetpoint_C,why)) {
+		firstHourTest.setpoint_C = F_TO_C(ratingSetpoint_F);
+	}
+	firstHourTest.resetTankToSetpoint();
+	firstHourTest.turnAllHeatSourcesOff();
+	firstHourTest.resetTopOffTimer();
+	HPWH dayTest(firstHourTest);
+
+	if(firstHourTest.rateFirstHour(rating) == HPWH_ABORT) {
+		return HPWH_ABORT;
+	}
+	if(parts == RATE_FHR) {
+		return 0;
+	}
+	return dayTest.rateDay(rating,parts);
+}
+
+int HPWH::rateModels(const std::vector<HPWH> &hpwhs,std::vector<Rating> &ratings,RATING_PARTS parts /*=RATE_UEF*/) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	ratings.assign(hpwhs.size(),Rating());
+	std::vector<int> results(hpwhs.size(),0);
+	parallelFor(0,static_cast<int>(hpwhs.size()),[&](int i) {
+		results[i] = hpwhs[i].rate(ratings[i],parts);
+	});
+	for(int result: results) {
+		if(result != 0) {
+			return HPWH_ABORT;
+		}
+	}
+	return 0;
+}
+
+int HPWH::rateFirstHour(Rating &rating) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	const double inletT_C = F_TO_C(ratingInletT_F);
+	const double ambientT_C = F_TO_C(ratingAmbientT_F);
+	const double stepDraw_L = GAL_TO_L(firstHourFlow_gpm) * minutesPerStep;
+
+	// Each draw counts the volume delivered. A draw still running at the hour runs to its cutoff and counts
+	// in full. Otherwise a final draw starts at the hour, and it counts in proportion to how far its mean
+	// outlet temperature is above the lowest outlet temperature of the draw before it, against how far the
+	// mean of the draw before it was.
+	double firstHourRating_L = 0.;
+	double minute = 0.;
+	bool isFinalDraw = false;
+	double previousMeanT_C = 0.,previousMinT_C = 0.;
+	StepState beforeStep;
+	while(!isFinalDraw) {
+		// a draw that starts at or after the hour is the last one, and the only one that is prorated
+		isFinalDraw = (minute >= 60.);
+		const bool isProrated = isFinalDraw;
+		double drawVolume_L = 0.,drawTVolume_CL = 0.;
+		double maxOutletT_C = -273.15,minOutletT_C = 0.,lastOutletT_C = 0.;
+		bool drawEnds = false;
+		while(!drawEnds) {
+			saveStepState(beforeStep);
+			if(runOneStep(inletT_C,stepDraw_L,ambientT_C,ambientT_C,DR_ALLOW) == HPWH_ABORT) {
+				return HPWH_ABORT;
+			}
+			double volume_L = stepDraw_L;
+			double outletT_C = outletTemp_C;
+			maxOutletT_C = std::max(maxOutletT_C,outletT_C);
+			double cutoffT_C = maxOutletT_C - dF_TO_dC(firstHourCutoff_dF);
+			if(outletT_C < cutoffT_C) {
+				// The outlet fell through the cutoff in this step. Taking each step's mean outlet temperature at the
+				// middle of the step, redo the step with the water drawn before the crossing.
+				double stepFraction = 0.;
+				if(drawVolume_L > 0.) {
+					stepFraction = (lastOutletT_C - cutoffT_C) / (lastOutletT_C - outletT_C) - 0.5;
+					stepFraction = std::min(std::max(stepFraction,0.),1.);
+				}
+				restoreStepState(beforeStep);
+				volume_L = stepDraw_L * stepFraction;
+				if(runOneStep(inletT_C,volume_L,ambientT_C,ambientT_C,DR_ALLOW) == HPWH_ABORT) {
+					return HPWH_ABORT;
+				}
+				outletT_C = outletTemp_C;
+				drawEnds = true;
+			}
+			minute += minutesPerStep;
+			if(volume_L > 0.) {
+				minOutletT_C = (drawVolume_L > 0.) ? std::min(minOutletT_C,outletT_C) : outletT_C;
+				drawVolume_L += volume_L;
+				drawTVolume_CL += outletT_C * volume_L;
+				lastOutletT_C = outletT_C;
+			}
+			if(minute >= 60.) {
+				// a draw still running at the hour is the last one
+				isFinalDraw = true;
+			}
+			if(minute >= maxFirstHourTest_min) {
+				drawEnds = true;
+			}
+		}
+		if(drawVolume_L > 0.) {
+			double meanT_C = drawTVolume_CL / drawVolume_L;
+			if(!isProrated) {
+				firstHourRating_L += drawVolume_L;
+			} else if(previousMeanT_C > previousMinT_C) {
+				firstHourRating_L += drawVolume_L * std::max(meanT_C - previousMinT_C,0.) / (previousMeanT_C - previousMinT_C);
+			}
+			previousMeanT_C = meanT_C;
+			previousMinT_C = minOutletT_C;
+		}
+
+		// the next draw starts when the heat sources cut out, or at the hour
+		while(!isFinalDraw && !areAllHeatSourcesOff()) {
+			if(runOneStep(inletT_C,0.,ambientT_C,ambientT_C,DR_ALLOW) == HPWH_ABORT) {
+				return HPWH_ABORT;
+			}
+			minute += minutesPerStep;
+			if(minute >= 60.) {
+				break;
+			}
+		}
+	}
+
+	rating.firstHourRating_L = firstHourRating_L;
+	double firstHourRating_gal = L_TO_GAL(firstHourRating_L);
+	if(firstHourRating_gal < 18.) {
+		rating.drawPattern = DRAW_PATTERN_VERYSMALL;
+	} else if(firstHourRating_gal < 51.) {
+		rating.drawPattern = DRAW_PATTERN_LOW;
+	} else if(firstHourRating_gal < 75.) {
+		rating.drawPattern = DRAW_PATTERN_MEDIUM;
+	} else {
+		rating.drawPattern = DRAW_PATTERN_HIGH;
+	}
+	return 0;
+}
+
+int HPWH::rateDay(Rating &rating,RATING_PARTS parts) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	const std::vector<RatingDraw> &draws = drawPatterns[rating.drawPattern];
+	const double inletT_C = F_TO_C(ratingInletT_F);
+	const double ambientT_C = F_TO_C(ratingAmbientT_F);
+	const double nominalRise_C = dF_TO_dC(ratingSetpoint_F - ratingInletT_F);
+	const double startHeat_kJ = getTankHeatContent_kJ();
+
+	double energyInput_kJ = 0.,deliveredHeat_kJ = 0.,drawVolume_L = 0.;
+	bool inFirstRecovery = true,hasStartedHeating = false;
+	const int numSteps = static_cast<int>(24. * 60. / minutesPerStep + 0.5);
+	for(int i = 0; i < numSteps; i++) {
+		// the volume of each draw that falls in this step
+		double stepStart_min = i * minutesPerStep;
+		double stepDraw_gal = 0.;
+		for(const RatingDraw &draw: draws) {
+			double drawEnd_min = draw.start_min + draw.volume_gal / draw.flow_gpm;
+			double overlap_min = std::min(drawEnd_min,stepStart_min + minutesPerStep) - std::max(draw.start_min,stepStart_min);
+			if(overlap_min > 0.) {
+				stepDraw_gal += overlap_min * draw.flow_gpm;
+			}
+		}
+		double stepDraw_L = GAL_TO_L(stepDraw_gal);
+
+		if(runOneStep(inletT_C,stepDraw_L,ambientT_C,ambientT_C,DR_ALLOW) == HPWH_ABORT) {
+			return HPWH_ABORT;
+		}
+		for(int j = 0; j < getNumHeatSources(); j++) {
+			energyInput_kJ += KWH_TO_KJ(heatSources[j].energyInput_kWh);
+		}
+		if(stepDraw_L > 0.) {
+			deliveredHeat_kJ += stepDraw_L * DENSITYWATER_kgperL * CPWATER_kJperkgC * (outletTemp_C - inletT_C);
+			drawVolume_L += stepDraw_L;
+		}
+
+		// the first recovery runs from the first draw until the heat sources cut out
+		if(inFirstRecovery) {
+			if(!areAllHeatSourcesOff()) {
+				hasStartedHeating = true;
+			} else if(hasStartedHeating) {
+				inFirstRecovery = false;
+				rating.recoveryEfficiency = (deliveredHeat_kJ + getTankHeatContent_kJ() - startHeat_kJ) / energyInput_kJ;
+				if(parts == RATE_RE) {
+					return 0;
+				}
+			}
+		}
+	}
+	if(inFirstRecovery) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The heat sources did not recover from the first draw of the 24 hour test.  \n");
+		}
+		return HPWH_ABORT;
+	}
+
+	// adjust the energy input for the change in stored heat and for the delivered heat missing the nominal
+	const double nominalHeat_kJ = drawVolume_L * DENSITYWATER_kgperL * CPWATER_kJperkgC * nominalRise_C;
+	double adjustedEnergy_kJ = energyInput_kJ - (getTankHeatContent_kJ() - startHeat_kJ) / rating.recoveryEfficiency;
+	adjustedEnergy_kJ += (nominalHeat_kJ - deliveredHeat_kJ) / rating.recoveryEfficiency;
+	rating.adjustedDailyEnergy_kWh = KJ_TO_KWH(adjustedEnergy_kJ);
+	rating.UEF = nominalHeat_kJ / adjustedEnergy_kJ;
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Sizing sweeps: runs a grid of tank and heat source sizes through one schedule and finds the Pareto front
+ */
+
+#include <algorithm>
+
+#include "HPWH.hh"
+
+int HPWH::runSizingSweep(const SizingGrid &grid,int N,double *inletT_C,double *drawVolume_L,
+	double *tankAmbientT_C,double *heatSourceAmbientT_C,DRMODES *DRstatus,
+	double minDeliveryT_C,double maxUnmetFraction,std::vector<SizingResult> &results) const {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	results.clear();
+	if(N <= 0 || maxUnmetFraction < 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("runSizingSweep needs a positive number of steps and a non-negative unmet fraction.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	if(simHasFailed) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("simHasFailed is set, aborting.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	for(const std::vector<double> *values: {&grid.tankVolumes_L,&grid.compressorCapacities_kW,&grid.resistanceCapacities_kW}) {
+		for(double value: *values) {
+			if(!(value > 0.) && !(values == &grid.resistanceCapacities_kW && value == 0.)) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("The tank volumes and compressor capacities of a sizing grid must be positive, and the resistance capacities not negative.  \n");
+				}
+				return HPWH_ABORT;
+			}
+		}
+	}
+
+	double scheduleDrawVolume_L = 0.;
+	for(int i = 0; i < N; i++) {
+		scheduleDrawVolume_L += drawVolume_L[i];
+	}
+	const double maxUnmetDrawVolume_L = maxUnmetFraction * scheduleDrawVolume_L;
+
+	// an empty list counts as one value, the model's own
+	auto numValues = [](const std::vector<double> &values) {
+		return std::max(static_cast<int>(values.size()),1);
+	};
+	const int numConfigurations = numValues(grid.tankVolumes_L) * numValues(grid.compressorCapacities_kW)
+		* numValues(grid.resistanceCapacities_kW) * numValues(grid.setpoints_C);
+	results.assign(numConfigurations,SizingResult());
+	std::vector<int> runResults(numConfigurations,0);
+	parallelFor(0,numConfigurations,[&](int k) {
+		SizingResult &result = results[k];
+		int index = k;
+		int iSetpoint = index % numValues(grid.setpoints_C);
+		index /= numValues(grid.setpoints_C);
+		int iResistance = index % numValues(grid.resistanceCapacities_kW);
+		index /= numValues(grid.resistanceCapacities_kW);
+		int iCompressor = index % numValues(grid.compressorCapacities_kW);
+		index /= numValues(grid.compressorCapacities_kW);
+		int iVolume = index;
+
+		HPWH hpwh(*this);
+		hpwh.setVerbosity(VRB_silent);
+		result.isConfigurable =
+			(grid.tankVolumes_L.empty() || hpwh.setTankSize_adjustUA(grid.tankVolumes_L[iVolume],UNITS_L,true) == 0)
+			&& (grid.compressorCapacities_kW.empty()
+				|| hpwh.setCompressorOutputCapacity(grid.compressorCapacities_kW[iCompressor]) == 0)
+			&& (grid.resistanceCapacities_kW.empty()
+				|| hpwh.setResistanceCapacity(grid.resistanceCapacities_kW[iResistance]) == 0)
+			&& (grid.setpoints_C.empty() || hpwh.setSetpoint(grid.setpoints_C[iSetpoint]) == 0);
+		result.tankVolume_L = hpwh.getTankSize();
+		result.compressorCapacity_kW = hpwh.hasACompressor() ? hpwh.getCompressorCapacity() : 0.;
+		result.resistanceCapacity_kW = (hpwh.getNumResistanceElements() > 0) ? hpwh.getResistanceCapacity() : 0.;
+		result.setpoint_C = hpwh.getSetpoint();
+		if(!result.isConfigurable) {
+			return;
+		}
+		hpwh.setVerbosity(hpwhVerbosity);
+
+		for(int i = 0; i < N; i++) {
+			if(hpwh.runOneStep(inletT_C[i],drawVolume_L[i],tankAmbientT_C[i],heatSourceAmbientT_C[i],DRstatus[i]) != 0) {
+				runResults[k] = HPWH_ABORT;
+				return;
+			}
+			result.numStepsRun++;
+			for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+				result.energyInput_kWh += hpwh.heatSources[j].energyInput_kWh;
+			}
+			if(drawVolume_L[i] > 0. && hpwh.outletTemp_C < minDeliveryT_C) {
+				result.unmetDrawVolume_L += drawVolume_L[i];
+				if(result.unmetDrawVolume_L > maxUnmetDrawVolume_L) {
+					// nothing later in the schedule can make up for it
+					return;
+				}
+			}
+		}
+		result.meetsDelivery = true;
+	});
+	for(int k = 0; k < numConfigurations; k++) {
+		if(runResults[k] != 0) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("The simulation of sizing configuration %d failed.  \n",k);
+			}
+			return HPWH_ABORT;
+		}
+	}
+
+	// the Pareto front of the configurations that meet delivery
+	auto isAtLeastAsGood = [](const SizingResult &a,const SizingResult &b) {
+		return a.energyInput_kWh <= b.energyInput_kWh && a.tankVolume_L <= b.tankVolume_L
+			&& a.compressorCapacity_kW <= b.compressorCapacity_kW && a.resistanceCapacity_kW <= b.resistanceCapacity_kW;
+	};
+	for(SizingResult &result: results) {
+		if(!result.meetsDelivery) {
+			continue;
+		}
+		result.isParetoOptimal = true;
+		for(const SizingResult &other: results) {
+			if(other.meetsDelivery && isAtLeastAsGood(other,result) && !isAtLeastAsGood(result,other)) {
+				result.isParetoOptimal = false;
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+int HPWH::writeSizingSummary(FILE* outFILE,const std::vector<SizingResult> &results,int options /*=CSVOPT_NONE*/) {
+
+	bool doIP = (options & CSVOPT_IPUNITS) != 0;
+
+	fprintf(outFILE,"tankVolume (%s),compressorCapacity (kW),resistanceCapacity (kW),setpoint (%s),",
+		doIP ? "gal" : "L",doIP ? "F" : "C");
+	fprintf(outFILE,"configurable,meetsDelivery,stepsRun,energyInput (kWh),unmetDrawVolume (%s),paretoOptimal\n",
+		doIP ? "gal" : "L");
+	for(const SizingResult &result: results) {
+		fprintf(outFILE,"%0.2f,%0.2f,%0.2f,%0.2f,%d,%d,%d,%0.3f,%0.2f,%d\n",
+			doIP ? L_TO_GAL(result.tankVolume_L) : result.tankVolume_L,result.compressorCapacity_kW,
+			result.resistanceCapacity_kW,doIP ? C_TO_F(result.setpoint_C) : result.setpoint_C,
+			result.isConfigurable,result.meetsDelivery,result.numStepsRun,result.energyInput_kWh,
+			doIP ? L_TO_GAL(result.unmetDrawVolume_L) : result.unmetDrawVolume_L,result.isParetoOptimal);
+	}
+
+	return 0;
+}
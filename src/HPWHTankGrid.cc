@@ -0,0 +1,343 @@
+/*
+ * Adaptive grid under the tank nodes, refined around the thermocline
+ */
+
+#include <algorithm>
+
+#include "HPWH.hh"
+
+int HPWH::setAdaptiveNodeGrid(bool doGrid,int maxRefinement /*=3*/,double refineDeltaT_C /*=1.*/) {
+	if(maxRefinement < 0 || refineDeltaT_C <= 0.) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("The grid refinement must be non-negative and the refinement temperature difference positive.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	doAdaptiveGrid = doGrid;
+	maxGridRefinement = maxRefinement;
+	gridRefineDeltaT_C = refineDeltaT_C;
+	tankGridSplits.clear();
+	return 0;
+}
+
+int HPWH::getNumGridNodes() const {
+	if(!doAdaptiveGrid || static_cast<int>(tankGridSplits.size()) != getNumNodes()) {
+		return getNumNodes();
+	}
+	return static_cast<int>(tankGridTemps_C.size());
+}
+
+void HPWH::syncTankGrid() {
+	// a new or resized tank starts with one grid node per tank node
+	if(static_cast<int>(tankGridSplits.size()) != getNumNodes()) {
+		tankGridSplits.assign(getNumNodes(),1);
+		tankGridTemps_C.assign(tankTemps_C.begin(),tankTemps_C.end());
+		tankGridNodeT_C.assign(tankTemps_C.begin(),tankTemps_C.end());
+
+		// the scratch of the updates is sized for the finest grid once, so the steps do not allocate
+		const std::size_t maxGridNodes = static_cast<std::size_t>(getNumNodes()) << maxGridRefinement;
+		for(std::vector<double> *gridValues: {&tankGridTemps_C,&nextTankGridTemps_C,&regridTemps_C,&tankGridVolumes_N,
+			&tankGridVolumes_L,&tankGridHeights_m,&tankGridInletVolume_L,&tankGridInletTVolume_CL,&tankGridUpVolume_L}) {
+			gridValues->reserve(maxGridNodes);
+		}
+		tankGridFirstNode.reserve(getNumNodes() + 1);
+		return;
+	}
+	// whatever heated or mixed a tank node since the last update heated or mixed its grid nodes evenly
+	auto gridT = tankGridTemps_C.begin();
+	for(int i = 0; i < getNumNodes(); i++) {
+		double dT_C = tankTemps_C[i] - tankGridNodeT_C[i];
+		for(int j = 0; j < tankGridSplits[i]; j++) {
+			*gridT += dT_C;
+			++gridT;
+		}
+	}
+}
+
+void HPWH::regridTank() {
+	// the splits are capped so the conduction stays stable on the finest grid node
+	const double tau1 = KWATER_WpermC / ((CPWATER_kJperkgC * 1000.0) * (DENSITYWATER_kgperL * 1000.0)
+		* (nodeHeight_m * nodeHeight_m)) * secondsPerStep;
+	int maxSplits = 1;
+	for(int level = 0; level < maxGridRefinement; level++) {
+		if(doConduction && 4. * maxSplits * maxSplits * tau1 > 0.4) {
+			break;
+		}
+		maxSplits *= 2;
+	}
+
+	std::vector<double> &newGridTemps_C = regridTemps_C;
+	newGridTemps_C.clear();
+	auto gridT = tankGridTemps_C.cbegin();
+	for(int i = 0; i < getNumNodes(); i++) {
+		int splits = tankGridSplits[i];
+		double minT_C = *std::min_element(gridT,gridT + splits);
+		double maxT_C = *std::max_element(gridT,gridT + splits);
+		double jump_C = 0.;
+		if(i > 0) {
+			jump_C = std::max(jump_C,fabs(tankTemps_C[i] - tankTemps_C[i - 1]));
+		}
+		if(i < getNumNodes() - 1) {
+			jump_C = std::max(jump_C,fabs(tankTemps_C[i + 1] - tankTemps_C[i]));
+		}
+
+		if((maxT_C - minT_C > gridRefineDeltaT_C || jump_C > gridRefineDeltaT_C) && splits < maxSplits) {
+			// split each grid node in two halves at its temperature
+			for(int j = 0; j < splits; j++) {
+				newGridTemps_C.push_back(gridT[j]);
+				newGridTemps_C.push_back(gridT[j]);
+			}
+			tankGridSplits[i] = 2 * splits;
+		} else if(splits > 1 &&
+			((maxT_C - minT_C < gridRefineDeltaT_C / 4. && jump_C < gridRefineDeltaT_C / 2.) || splits > maxSplits)) {
+			// merge pairs of grid nodes, keeping their energy
+			for(int j = 0; j < splits; j += 2) {
+				newGridTemps_C.push_back((gridT[j] + gridT[j + 1]) / 2.);
+			}
+			tankGridSplits[i] = splits / 2;
+		} else {
+			newGridTemps_C.insert(newGridTemps_C.end(),gridT,gridT + splits);
+		}
+		gridT += splits;
+	}
+	tankGridTemps_C.swap(newGridTemps_C);
+}
+
+void HPWH::mixGridInversions() {
+	if(!doAdaptiveGrid || !doInversionMixing) {
+		return;
+	}
+	// the volumes of the grid nodes, in tank nodes
+	std::vector<double> &gridVolumes_N = tankGridVolumes_N;
+	gridVolumes_N.clear();
+	for(int i = 0; i < getNumNodes(); i++) {
+		gridVolumes_N.insert(gridVolumes_N.end(),tankGridSplits[i],1. / tankGridSplits[i]);
+	}
+
+	bool hasInversion;
+	do {
+		hasInversion = false;
+		//Start from the top and check downwards
+		for(int i = static_cast<int>(tankGridTemps_C.size()) - 1; i > 0; i--) {
+			if(tankGridTemps_C[i] < tankGridTemps_C[i - 1]) {
+				hasInversion = true;
+
+				//Mix the inverted grid nodes by volume
+				double TVolumeMixed = 0.;
+				double volumeMixed = 0.;
+				int m;
+				for(m = i; m >= 0; m--) {
+					TVolumeMixed += tankGridTemps_C[m] * gridVolumes_N[m];
+					volumeMixed += gridVolumes_N[m];
+					if((m == 0) || (TVolumeMixed / volumeMixed > tankGridTemps_C[m - 1])) {
+						break;
+					}
+				}
+				double Tmixed = TVolumeMixed / volumeMixed;
+				for(int k = i; k >= m; k--) tankGridTemps_C[k] = Tmixed;
+			}
+		}
+	} while(hasInversion);
+}
+
+void HPWH::updateTankTempsOnGrid(double drawVolume_L,double inletT_C,double tankAmbientT_C,
+	double inletVol2_L,double inletT2_C) {
+
+	syncTankGrid();
+	regridTank();
+
+	const int numGridNodes = static_cast<int>(tankGridTemps_C.size());
+	// the volume and height of each grid node, and the first grid node of each tank node
+	std::vector<double> &gridVolumes_L = tankGridVolumes_L,&gridHeights_m = tankGridHeights_m;
+	std::vector<int> &firstGridNode = tankGridFirstNode;
+	gridVolumes_L.resize(numGridNodes);
+	gridHeights_m.resize(numGridNodes);
+	firstGridNode.resize(getNumNodes() + 1);
+	for(int i = 0,j = 0; i < getNumNodes(); i++) {
+		firstGridNode[i] = j;
+		for(int k = 0; k < tankGridSplits[i]; k++,j++) {
+			gridVolumes_L[j] = nodeVolume_L / tankGridSplits[i];
+			gridHeights_m[j] = nodeHeight_m / tankGridSplits[i];
+		}
+	}
+	firstGridNode[getNumNodes()] = numGridNodes;
+	std::vector<double> &gridT_C = tankGridTemps_C;
+
+	outletTemp_C = 0.;
+
+	/////////////////////////////////////////////////////////////////////////////////////////////////
+	if(drawVolume_L > 0.) {
+
+		if(inletVol2_L > drawVolume_L) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("Volume in inlet 2 is greater than the draw volume.  \n");
+			}
+			simHasFailed = true;
+			return;
+		}
+
+		if(drawVolume_L > tankVolume_L) {
+			// the whole tank is flushed with inlet water
+			double tankTVolume_CL = 0.;
+			for(int j = 0; j < numGridNodes; j++) {
+				tankTVolume_CL += gridT_C[j] * gridVolumes_L[j];
+				gridT_C[j] = (inletT_C * (drawVolume_L - inletVol2_L) + inletT2_C * inletVol2_L) / drawVolume_L;
+			}
+			outletTemp_C = (tankTVolume_CL + gridT_C[0] * (drawVolume_L - tankVolume_L)) / drawVolume_L;
+		} else {
+			// the inlet water enters at the bottom grid node of each inlet's tank node
+			std::vector<double> &inletVolume_L = tankGridInletVolume_L,&inletTVolume_CL = tankGridInletTVolume_CL;
+			inletVolume_L.assign(numGridNodes,0.);
+			inletTVolume_CL.assign(numGridNodes,0.);
+			inletVolume_L[firstGridNode[inletHeight]] += drawVolume_L - inletVol2_L;
+			inletTVolume_CL[firstGridNode[inletHeight]] += (drawVolume_L - inletVol2_L) * inletT_C;
+			inletVolume_L[firstGridNode[inlet2Height]] += inletVol2_L;
+			inletTVolume_CL[firstGridNode[inlet2Height]] += inletVol2_L * inletT2_C;
+
+			// the volume passing up through the top of each grid node over the whole draw
+			std::vector<double> &upVolume_L = tankGridUpVolume_L;
+			upVolume_L.resize(numGridNodes);
+			double cumVolume_L = 0.;
+			double maxDrawPart_L = drawVolume_L;
+			for(int j = 0; j < numGridNodes; j++) {
+				cumVolume_L += inletVolume_L[j];
+				upVolume_L[j] = cumVolume_L;
+				if(cumVolume_L > 0.) {
+					// no grid node may pass on more than its own volume in one part of the draw
+					maxDrawPart_L = std::min(maxDrawPart_L,gridVolumes_L[j] * drawVolume_L / cumVolume_L);
+				}
+			}
+
+			double drawLeft_L = drawVolume_L;
+			while(drawLeft_L > 0.) {
+				double drawPart_L = std::min(drawLeft_L,maxDrawPart_L);
+				double drawFraction = drawPart_L / drawVolume_L;
+
+				outletTemp_C += drawPart_L * gridT_C[numGridNodes - 1];
+
+				// top down, so the node below still holds its old temperature
+				for(int j = numGridNodes - 1; j >= 0; j--) {
+					double TVolumeIn_CL = inletTVolume_CL[j] * drawFraction;
+					if(j > 0) {
+						TVolumeIn_CL += upVolume_L[j - 1] * drawFraction * gridT_C[j - 1];
+					}
+					gridT_C[j] += (TVolumeIn_CL - upVolume_L[j] * drawFraction * gridT_C[j]) / gridVolumes_L[j];
+				}
+
+				drawLeft_L -= drawPart_L;
+				mixGridInversions();
+			}
+
+			//fill in average outlet T - it is a weighted averaged, with weights == volumes drawn
+			outletTemp_C /= drawVolume_L;
+		}
+
+		//Account for mixing at the bottom of the tank
+		if(tankMixesOnDraw) {
+			int mixedBelowNode = (int)(getNumNodes() * mixBelowFractionOnDraw);
+			double TVolume_CL = 0.,volume_L = 0.;
+			for(int j = 0; j < firstGridNode[mixedBelowNode]; j++) {
+				TVolume_CL += gridT_C[j] * gridVolumes_L[j];
+				volume_L += gridVolumes_L[j];
+			}
+			if(volume_L > 0.) {
+				double ave = TVolume_CL / volume_L;
+				for(int j = 0; j < firstGridNode[mixedBelowNode]; j++) {
+					gridT_C[j] += (ave - gridT_C[j]) / 3.0;
+				}
+			}
+		}
+
+	} //end if(draw_volume_L > 0)
+
+	std::vector<double> &nextGridT_C = nextTankGridTemps_C;
+	nextGridT_C.assign(gridT_C.begin(),gridT_C.end());
+	if(doConduction) {
+
+		// tau for the shortest grid node sets the stability condition
+		double minHeight_m = *std::min_element(gridHeights_m.begin(),gridHeights_m.end());
+		const double tauMax = KWATER_WpermC / ((CPWATER_kJperkgC * 1000.0) * (DENSITYWATER_kgperL * 1000.0)
+			* (minHeight_m * minHeight_m)) * secondsPerStep;
+		if(tauMax > 0.5) {
+			if(hpwhVerbosity >= VRB_reluctant) {
+				msg("The stability condition for conduction has failed, these results are going to be interesting!\n");
+			}
+			simHasFailed = true;
+			return;
+		}
+
+		// the finite difference of updateTankTemps, with tau * height^2 per grid node and the distance
+		// between the centers of unequal grid nodes
+		auto tauHeight_m = [&](int j) {
+			return KWATER_WpermC / ((CPWATER_kJperkgC * 1000.0) * (DENSITYWATER_kgperL * 1000.0)
+				* gridHeights_m[j]) * secondsPerStep;
+		};
+		auto conduction = [&](int j,int k) {
+			return tauHeight_m(j) * (gridT_C[k] - gridT_C[j]) / ((gridHeights_m[j] + gridHeights_m[k]) / 2.);
+		};
+
+		// Boundary nodes; outer edge of top and bottom nodes first
+		const int top = numGridNodes - 1;
+		const double bc0 = 2.0 * tauHeight_m(0) * tankUA_kJperHrC * fracAreaTop / KWATER_WpermC;
+		const double bcTop = 2.0 * tauHeight_m(top) * tankUA_kJperHrC * fracAreaTop / KWATER_WpermC;
+		nextGridT_C[0] = (1. - bc0) * gridT_C[0] + bc0 * tankAmbientT_C;
+		nextGridT_C[top] = (1. - bcTop) * gridT_C[top] + bcTop * tankAmbientT_C;
+		if(numGridNodes > 1) { // inner edges of top and bottom nodes
+			nextGridT_C[0] += 2. * conduction(0,1);
+			nextGridT_C[top] += 2. * conduction(top,top - 1);
+		}
+
+		// Internal nodes
+		for(int j = 1; j < top; j++) {
+			nextGridT_C[j] = gridT_C[j] + conduction(j,j + 1) + conduction(j,j - 1);
+		}
+
+		double standbyLosses_kJ = (tankUA_kJperHrC * fracAreaTop * (gridT_C[0] - tankAmbientT_C) * hoursPerStep);
+		standbyLosses_kJ += (tankUA_kJperHrC * fracAreaTop * (gridT_C[top] - tankAmbientT_C) * hoursPerStep);
+		standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
+	} else {
+		// UA losses from the top and bottom come out of the top and bottom grid nodes
+		double standbyLosses_kJ = (tankUA_kJperHrC * fracAreaTop * (gridT_C.front() - tankAmbientT_C) * hoursPerStep);
+		standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
+		nextGridT_C.front() -= standbyLosses_kJ / (nodeCp_kJperC * gridVolumes_L.front() / nodeVolume_L);
+
+		standbyLosses_kJ = (tankUA_kJperHrC * fracAreaTop * (gridT_C.back() - tankAmbientT_C) * hoursPerStep);
+		standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
+		nextGridT_C.back() -= standbyLosses_kJ / (nodeCp_kJperC * gridVolumes_L.back() / nodeVolume_L);
+	}
+
+	//calculate standby losses from the sides of the tank, shared by volume
+	for(int j = 0; j < numGridNodes; j++) {
+		double volumeFraction = gridVolumes_L[j] / tankVolume_L;
+		double standbyLosses_kJ = (tankUA_kJperHrC * fracAreaSide + fittingsUA_kJperHrC) * volumeFraction
+			* (gridT_C[j] - tankAmbientT_C) * hoursPerStep;
+		standbyLosses_kWh += KJ_TO_KWH(standbyLosses_kJ);
+		nextGridT_C[j] -= standbyLosses_kJ / (nodeCp_kJperC * gridVolumes_L[j] / nodeVolume_L);
+	}
+
+	gridT_C.swap(nextGridT_C);
+	mixGridInversions();
+
+	// the tank nodes hold the average of their grid nodes, which the energy balance takes from the same pass
+	const bool refreshBalance = doEnergyBalance && balanceTankHeatContentValid
+		&& static_cast<int>(balanceNodeT_C.size()) == getNumNodes();
+	double balanceSumT_C = 0.;
+	for(int i = 0; i < getNumNodes(); i++) {
+		double sum_C = 0.;
+		for(int j = firstGridNode[i]; j < firstGridNode[i + 1]; j++) {
+			sum_C += gridT_C[j];
+		}
+		tankTemps_C[i] = sum_C / tankGridSplits[i];
+		if(refreshBalance) {
+			balanceNodeT_C[i] = tankTemps_C[i];
+			balanceSumT_C += tankTemps_C[i];
+		}
+	}
+	tankGridNodeT_C.assign(tankTemps_C.begin(),tankTemps_C.end());
+	markNodesChanged(0,getNumNodes());
+	if(refreshBalance) {
+		balanceNodeTSum_C = balanceSumT_C;
+		balanceChangedBegin = getNumNodes();
+		balanceChangedEnd = 0;
+	}
+}
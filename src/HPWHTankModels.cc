@@ -0,0 +1,409 @@
+/*
+ * Tank models: the engines for draws, conduction and standby losses
+ */
+
+#include <algorithm>
+
+#include "HPWH.hh"
+
+int HPWH::setTankModel(TANK_MODEL model) {
+	if(model == TANK_MODEL_NODAL) {
+		tankModel = std::make_shared<NodalTankModel>(this);
+	} else if(model == TANK_MODEL_THERMOCLINE) {
+		tankModel = std::make_shared<ThermoclineTankModel>(this);
+	} else {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("Unknown tank model.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	return 0;
+}
+
+HPWH::TANK_MODEL HPWH::getTankModel() const {
+	return tankModel->getType();
+}
+
+/* Nodal Tank Model */
+void HPWH::NodalTankModel::updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,
+	double inletVol2_L,double inletT2_C) {
+	if(hpwh->doAdaptiveGrid) {
+		hpwh->updateTankTempsOnGrid(drawVolume_L,inletT_C,tankAmbientT_C,inletVol2_L,inletT2_C);
+	} else {
+		hpwh->updateNodalTankTemps(drawVolume_L,inletT_C,tankAmbientT_C,inletVol2_L,inletT2_C);
+	}
+}
+
+double HPWH::NodalTankModel::addHeatAboveNodes(HeatSource &heatSource,const std::vector<double> &nodeCap_kJ) {
+	return heatSource.addHeatAboveNodes(hpwh->tankTemps_C,nodeCap_kJ);
+}
+
+double HPWH::NodalTankModel::addHeatExternal(HeatSource &heatSource,double externalT_C,double minutesToRun,
+	double &cap_BTUperHr,double &input_BTUperHr,double &cop) {
+	return heatSource.addHeatExternalToNodes(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
+}
+
+double HPWH::NodalTankModel::getNodeT_C(int nodeNum) {
+	return hpwh->tankTemps_C[nodeNum];
+}
+
+void HPWH::NodalTankModel::getSectionTemps(std::vector<double> &sectionTemps_C) {
+	resample(sectionTemps_C,hpwh->tankTemps_C);
+}
+
+const std::vector<HPWH::tankReal_t> &HPWH::NodalTankModel::getTankTemps() {
+	return hpwh->tankTemps_C;
+}
+
+std::vector<HPWH::tankReal_t> &HPWH::NodalTankModel::editTankTemps() {
+	return hpwh->tankTemps_C;
+}
+
+HPWH::TANK_MODEL HPWH::NodalTankModel::getType() const {
+	return TANK_MODEL_NODAL;
+}
+
+std::shared_ptr<HPWH::TankModel> HPWH::NodalTankModel::clone(HPWH *hpwh_in) const {
+	return std::make_shared<NodalTankModel>(hpwh_in);
+}
+
+/* Thermocline Tank Model */
+void HPWH::ThermoclineTankModel::updateTankTemps(double drawVolume_L,double inletT_C,double tankAmbientT_C,
+	double inletVol2_L,double inletT2_C) {
+	syncZones();
+
+	hpwh->outletTemp_C = 0.;
+	const double numNodes = static_cast<double>(hpwh->getNumNodes());
+
+	if(drawVolume_L > 0.) {
+		if(inletVol2_L > drawVolume_L) {
+			if(hpwh->hpwhVerbosity >= VRB_reluctant) {
+				hpwh->msg("Volume in inlet 2 is greater than the draw volume.  \n");
+			}
+			hpwh->simHasFailed = true;
+			return;
+		}
+
+		// both inlets feed the cold zone
+		double mixedInletT_C = (inletT_C * (drawVolume_L - inletVol2_L) + inletT2_C * inletVol2_L) / drawVolume_L;
+		double drawFraction = drawVolume_L / hpwh->tankVolume_L;
+
+		if(drawFraction >= 1.) {
+			hpwh->outletTemp_C = (integral(1.) + mixedInletT_C * (drawFraction - 1.)) / drawFraction;
+			hotT_C = coldT_C = mixedInletT_C;
+			thermoclineFraction = 0.5;
+			thicknessFraction = 0.;
+		} else {
+			// plug flow: the top of the profile leaves and everything else moves up
+			double remainingFraction = 1. - drawFraction;
+			hpwh->outletTemp_C = (integral(1.) - integral(remainingFraction)) / drawFraction;
+			double meanT_C = integral(remainingFraction) + mixedInletT_C * drawFraction;
+
+			double bottomFraction = thermoclineFraction - thicknessFraction / 2.;
+			double topFraction = thermoclineFraction + thicknessFraction / 2.;
+			if(bottomFraction >= remainingFraction) {
+				// only the cold zone is left, and it sits on the inlet water
+				hotT_C = coldT_C;
+				coldT_C = mixedInletT_C;
+				thermoclineFraction = drawFraction;
+				thicknessFraction = 0.;
+			} else {
+				if(topFraction > remainingFraction) {
+					// the top of the thermocline left the tank, so the hot zone is what reached the top
+					hotT_C = coldT_C + (hotT_C - coldT_C) * (remainingFraction - bottomFraction) / thicknessFraction;
+					bottomFraction += drawFraction;
+					thicknessFraction = 1. - bottomFraction;
+					thermoclineFraction = (bottomFraction + 1.) / 2.;
+				} else {
+					thermoclineFraction += drawFraction;
+				}
+				if(hotT_C - coldT_C < coldT_C - mixedInletT_C) {
+					// the cold zone is closer to the hot zone than to the inlet water, so it becomes part of a thermocline
+					// that runs from the inlet water at the bottom up to the hot zone
+					coldT_C = mixedInletT_C;
+					thermoclineFraction = (hotT_C - meanT_C) / (hotT_C - coldT_C);
+					thicknessFraction = 2. * thermoclineFraction;
+				} else {
+					// the inlet water mixes into the cold zone
+					coldT_C = (meanT_C - hotT_C * (1. - thermoclineFraction)) / thermoclineFraction;
+				}
+			}
+
+			// widen the thermocline as much as the draw through the nodes does
+			double drawNodes = drawFraction * numNodes;
+			double partNode = drawNodes - floor(drawNodes);
+			thicknessFraction = sqrt(thicknessFraction * thicknessFraction + 2. * 3.14159 * partNode * (1. - partNode) / (numNodes * numNodes));
+			limitThickness();
+
+			// the bottom of the tank mixes on a draw as the nodes do, a third of the way to its average temperature;
+			// the cold zone takes the mixing, and the thermocline moves up to keep the heat content
+			if(hpwh->tankMixesOnDraw && hotT_C > coldT_C) {
+				double mixFraction = floor(numNodes * hpwh->mixBelowFractionOnDraw) / numNodes;
+				double mixedT_C = integral(mixFraction) / mixFraction;
+				if(mixedT_C > coldT_C) {
+					meanT_C = integral(1.);
+					coldT_C += (mixedT_C - coldT_C) / 3.;
+					thermoclineFraction = (hotT_C - meanT_C) / (hotT_C - coldT_C);
+				}
+			}
+		}
+	}
+
+	if(hpwh->doConduction) {
+		// a conducting step widens a linear thermocline by 4 pi alpha t in its square
+		const double tankHeight_m = hpwh->nodeHeight_m * numNodes;
+		const double alpha_m2pers = KWATER_WpermC / ((CPWATER_kJperkgC * 1000.0) * (DENSITYWATER_kgperL * 1000.0));
+		thicknessFraction = sqrt(thicknessFraction * thicknessFraction
+			+ 4. * 3.14159 * alpha_m2pers * hpwh->secondsPerStep / (tankHeight_m * tankHeight_m));
+	}
+	limitThickness();
+
+	// standby losses: the bottom and the cold zone's share of the sides come out of the cold zone, the rest out of the hot zone
+	{
+		const double topUA_kJperHrC = hpwh->tankUA_kJperHrC * hpwh->fracAreaTop;
+		const double sideUA_kJperHrC = hpwh->tankUA_kJperHrC * hpwh->fracAreaSide + hpwh->fittingsUA_kJperHrC;
+		const double tankCp_kJperC = hpwh->nodeCp_kJperC * numNodes;
+		double coldLosses_kJ = (sideUA_kJperHrC * thermoclineFraction + topUA_kJperHrC) * (coldT_C - tankAmbientT_C) * hpwh->hoursPerStep;
+		double hotLosses_kJ = (sideUA_kJperHrC * (1. - thermoclineFraction) + topUA_kJperHrC) * (hotT_C - tankAmbientT_C) * hpwh->hoursPerStep;
+		hpwh->standbyLosses_kWh += KJ_TO_KWH(coldLosses_kJ + hotLosses_kJ);
+
+		// a zone thinner than half a node passes its losses to the other zone
+		const double minZoneFraction = 0.5 / numNodes;
+		if(thermoclineFraction < minZoneFraction) {
+			hotT_C -= (coldLosses_kJ + hotLosses_kJ) / (tankCp_kJperC * (1. - thermoclineFraction));
+		} else if(1. - thermoclineFraction < minZoneFraction) {
+			coldT_C -= (coldLosses_kJ + hotLosses_kJ) / (tankCp_kJperC * thermoclineFraction);
+		} else {
+			coldT_C -= coldLosses_kJ / (tankCp_kJperC * thermoclineFraction);
+			hotT_C -= hotLosses_kJ / (tankCp_kJperC * (1. - thermoclineFraction));
+		}
+	}
+
+	// an inverted tank mixes out
+	if(coldT_C > hotT_C && hpwh->doInversionMixing) {
+		hotT_C = coldT_C = integral(1.);
+		thermoclineFraction = 0.5;
+		thicknessFraction = 0.;
+	}
+
+	zonesChanged();
+}
+
+double HPWH::ThermoclineTankModel::addHeatAboveNodes(HeatSource &heatSource,const std::vector<double> &nodeCap_kJ) {
+	syncZones();
+	if(coldT_C > hotT_C) {
+		// an inverted tank has no thermocline to heat, so the nodes take the heat
+		return heatSource.addHeatAboveNodes(editTankTemps(),nodeCap_kJ);
+	}
+
+	// As on the nodes, the heat at each height raises the coldest water above it, and so levels the profile
+	// above it from below. The zones keep their temperatures, and the thermocline moves down to hold the heat,
+	// unless the level passes the hot zone, which then takes the level.
+	const int numNodes = hpwh->getNumNodes();
+	const double tankCp_kJperC = hpwh->nodeCp_kJperC * numNodes;
+	const double maxTargetT_C = std::min(heatSource.maxSetpoint_C,hpwh->setpoint_C);
+	double leftoverCap_kJ = 0.;
+	double addedHeat_kJ = 0.;
+	for(int node = numNodes - 1; node >= 0; node--) {
+		if(nodeCap_kJ[node] == 0) {
+			continue;
+		}
+		double cap_kJ = nodeCap_kJ[node] + leftoverCap_kJ;
+		leftoverCap_kJ = 0.;
+
+		// up to the hot zone, the heat to level the profile above the node at lowT_C + rise is
+		// tankCp * (coldFraction * rise + rampFactor * rise^2)
+		const double fraction = static_cast<double>(node) / numNodes;
+		const double bottomFraction = thermoclineFraction - thicknessFraction / 2.;
+		const double lowT_C = temperatureAt(fraction);
+		const double coldFraction = std::max(bottomFraction - fraction,0.);
+		const double rampFactor = (hotT_C > coldT_C) ? thicknessFraction / (2. * (hotT_C - coldT_C)) : 0.;
+		auto levelHeat_kJ = [&](double levelT_C) {
+			double rise = std::min(levelT_C,hotT_C) - lowT_C;
+			double heat_kJ = (rise > 0.) ? tankCp_kJperC * (coldFraction * rise + rampFactor * rise * rise) : 0.;
+			if(levelT_C > hotT_C) {
+				heat_kJ += tankCp_kJperC * (1. - fraction) * (levelT_C - hotT_C);
+			}
+			return heat_kJ;
+		};
+
+		double maxHeat_kJ = levelHeat_kJ(maxTargetT_C);
+		if(maxHeat_kJ <= 0.) {
+			leftoverCap_kJ = cap_kJ;
+			continue;
+		}
+		double levelT_C;
+		if(cap_kJ >= maxHeat_kJ) {
+			levelT_C = maxTargetT_C;
+			leftoverCap_kJ = cap_kJ - maxHeat_kJ;
+			cap_kJ = maxHeat_kJ;
+		} else if(maxTargetT_C > hotT_C && cap_kJ >= levelHeat_kJ(hotT_C)) {
+			levelT_C = hotT_C + (cap_kJ - levelHeat_kJ(hotT_C)) / (tankCp_kJperC * (1. - fraction));
+		} else {
+			double heat = cap_kJ / tankCp_kJperC;
+			levelT_C = lowT_C + 2. * heat / (coldFraction + sqrt(coldFraction * coldFraction + 4. * rampFactor * heat));
+		}
+
+		double meanT_C = integral(1.) + cap_kJ / tankCp_kJperC;
+		addedHeat_kJ += cap_kJ;
+		if(levelT_C > hotT_C) {
+			hotT_C = levelT_C;
+		}
+		if(hotT_C - meanT_C > 1.e-12 && hotT_C > coldT_C) {
+			thermoclineFraction = (hotT_C - meanT_C) / (hotT_C - coldT_C);
+		} else {
+			// the water above the node was all there was to heat
+			coldT_C = hotT_C = meanT_C;
+			thermoclineFraction = 0.5;
+			thicknessFraction = 0.;
+		}
+		limitThickness();
+	}
+
+	if(addedHeat_kJ > 0.) {
+		zonesChanged();
+	}
+	return leftoverCap_kJ;
+}
+
+double HPWH::ThermoclineTankModel::addHeatExternal(HeatSource &heatSource,double externalT_C,double minutesToRun,
+	double &cap_BTUperHr,double &input_BTUperHr,double &cop) {
+	// the external loop moves water node by node, so it runs on the nodes, and the zones are refit to the result
+	editTankTemps();
+	return heatSource.addHeatExternalToNodes(externalT_C,minutesToRun,cap_BTUperHr,input_BTUperHr,cop);
+}
+
+double HPWH::ThermoclineTankModel::getNodeT_C(int nodeNum) {
+	if(nodesCurrent) {
+		return hpwh->tankTemps_C[nodeNum];
+	}
+	const double numNodes = static_cast<double>(hpwh->getNumNodes());
+	return averageBetween(nodeNum / numNodes,(nodeNum + 1) / numNodes);
+}
+
+void HPWH::ThermoclineTankModel::getSectionTemps(std::vector<double> &sectionTemps_C) {
+	if(nodesCurrent) {
+		resample(sectionTemps_C,hpwh->tankTemps_C);
+		return;
+	}
+	if(!sectionsCurrent || cachedSectionTemps_C.size() != sectionTemps_C.size()) {
+		const double numSections = static_cast<double>(sectionTemps_C.size());
+		cachedSectionTemps_C.resize(sectionTemps_C.size());
+		for(std::size_t i = 0; i < sectionTemps_C.size(); i++) {
+			cachedSectionTemps_C[i] = averageBetween(i / numSections,(i + 1) / numSections);
+		}
+		sectionsCurrent = true;
+	}
+	sectionTemps_C = cachedSectionTemps_C;
+}
+
+const std::vector<HPWH::tankReal_t> &HPWH::ThermoclineTankModel::getTankTemps() {
+	if(!nodesCurrent) {
+		renderToTank();
+		nodesCurrent = true;
+	}
+	return hpwh->tankTemps_C;
+}
+
+std::vector<HPWH::tankReal_t> &HPWH::ThermoclineTankModel::editTankTemps() {
+	getTankTemps();
+	zonesCurrent = false;
+	return hpwh->tankTemps_C;
+}
+
+HPWH::TANK_MODEL HPWH::ThermoclineTankModel::getType() const {
+	return TANK_MODEL_THERMOCLINE;
+}
+
+std::shared_ptr<HPWH::TankModel> HPWH::ThermoclineTankModel::clone(HPWH *hpwh_in) const {
+	auto copy = std::make_shared<ThermoclineTankModel>(*this);
+	copy->hpwh = hpwh_in;
+	return copy;
+}
+
+void HPWH::ThermoclineTankModel::fitToTank() {
+	const std::vector<tankReal_t> &tankTemps_C = hpwh->tankTemps_C;
+	double meanT_C = 0.;
+	for(double T: tankTemps_C) {
+		meanT_C += T;
+	}
+	meanT_C /= tankTemps_C.size();
+	hotT_C = *std::max_element(tankTemps_C.begin(),tankTemps_C.end());
+	coldT_C = *std::min_element(tankTemps_C.begin(),tankTemps_C.end());
+
+	// the thermocline sits where the zones hold the tank's heat content
+	if(hotT_C - coldT_C > 1.e-9) {
+		thermoclineFraction = (hotT_C - meanT_C) / (hotT_C - coldT_C);
+	} else {
+		hotT_C = coldT_C = meanT_C;
+		thermoclineFraction = 0.5;
+	}
+	limitThickness();
+}
+
+void HPWH::ThermoclineTankModel::renderToTank() {
+	std::vector<tankReal_t> &tankTemps_C = hpwh->tankTemps_C;
+	const double numNodes = static_cast<double>(tankTemps_C.size());
+	// a rounding step down between nodes would read as an inversion and send the draw through the mixing loop,
+	// so a stratified profile is kept monotone
+	const bool stratified = hotT_C >= coldT_C;
+	double belowT_C = coldT_C;
+	for(std::size_t i = 0; i < tankTemps_C.size(); i++) {
+		double nodeT_C = averageBetween(i / numNodes,(i + 1) / numNodes);
+		if(stratified) {
+			nodeT_C = std::min(std::max(nodeT_C,belowT_C),hotT_C);
+		}
+		tankTemps_C[i] = static_cast<tankReal_t>(nodeT_C);
+		belowT_C = tankTemps_C[i];
+	}
+}
+
+void HPWH::ThermoclineTankModel::syncZones() {
+	if(!zonesCurrent) {
+		fitToTank();
+		zonesCurrent = true;
+	}
+}
+
+void HPWH::ThermoclineTankModel::zonesChanged() {
+	nodesCurrent = false;
+	sectionsCurrent = false;
+	hpwh->markNodesChanged(0,hpwh->getNumNodes());
+}
+
+double HPWH::ThermoclineTankModel::integral(double fraction) const {
+	double bottomFraction = thermoclineFraction - thicknessFraction / 2.;
+	double topFraction = thermoclineFraction + thicknessFraction / 2.;
+	if(fraction <= bottomFraction) {
+		return coldT_C * fraction;
+	} else if(fraction < topFraction) {
+		return coldT_C * fraction + (hotT_C - coldT_C) * (fraction - bottomFraction) * (fraction - bottomFraction) / (2. * thicknessFraction);
+	} else {
+		return coldT_C * fraction + (hotT_C - coldT_C) * (fraction - thermoclineFraction);
+	}
+}
+
+double HPWH::ThermoclineTankModel::temperatureAt(double fraction) const {
+	double bottomFraction = thermoclineFraction - thicknessFraction / 2.;
+	if(fraction <= bottomFraction) {
+		return coldT_C;
+	} else if(fraction < bottomFraction + thicknessFraction) {
+		return coldT_C + (hotT_C - coldT_C) * (fraction - bottomFraction) / thicknessFraction;
+	} else {
+		return hotT_C;
+	}
+}
+
+double HPWH::ThermoclineTankModel::averageBetween(double lowerFraction,double upperFraction) const {
+	double bottomFraction = thermoclineFraction - thicknessFraction / 2.;
+	if(upperFraction <= bottomFraction) {
+		return coldT_C;
+	} else if(lowerFraction >= bottomFraction + thicknessFraction) {
+		return hotT_C;
+	}
+	return (integral(upperFraction) - integral(lowerFraction)) / (upperFraction - lowerFraction);
+}
+
+void HPWH::ThermoclineTankModel::limitThickness() {
+	thicknessFraction = std::min(thicknessFraction,2. * std::min(thermoclineFraction,1. - thermoclineFraction));
+}
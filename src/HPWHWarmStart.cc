@@ -0,0 +1,320 @@
+/*
+ * Warm starts: spin-ups of a schedule run once and kept in an on-disk cache for later runs
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "HPWH.hh"
+
+namespace {
+
+const char warmStartMagic[8] = {'H','P','W','H','W','A','R','M'};
+// changes whenever the layout of the file or the state in it changes
+const int warmStartFormat = 2;
+// no vector in a state file is longer than this, so a damaged size is caught before it is allocated
+const std::uint64_t maxStoredSize = 1 << 24;
+
+/** 64 bit FNV-1a, enough to tell spin-ups apart but not meant to resist a deliberate collision */
+class KeyHash {
+public:
+	void add(const void *data,std::size_t size) {
+		const unsigned char *bytes = static_cast<const unsigned char*>(data);
+		for(std::size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+	}
+	void addValues(const std::vector<double> &values) {
+		std::uint64_t size = values.size();
+		add(&size,sizeof(size));
+		add(values.data(),values.size() * sizeof(double));
+	}
+	void addText(const std::string &text) {
+		std::uint64_t size = text.size();
+		add(&size,sizeof(size));
+		add(text.data(),text.size());
+	}
+	std::string hex() const {
+		char digits[17];
+		snprintf(digits,sizeof(digits),"%016llx",static_cast<unsigned long long>(hash));
+		return digits;
+	}
+
+private:
+	std::uint64_t hash = 14695981039346656037ULL;
+};
+
+template<typename T>
+void writeValue(std::ostream &out,const T &value) {
+	out.write(reinterpret_cast<const char*>(&value),sizeof(T));
+}
+
+template<typename T>
+void writeVector(std::ostream &out,const std::vector<T> &values) {
+	writeValue(out,static_cast<std::uint64_t>(values.size()));
+	out.write(reinterpret_cast<const char*>(values.data()),values.size() * sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream &in,T &value) {
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(&value),sizeof(T)));
+}
+
+template<typename T>
+bool readVector(std::istream &in,std::vector<T> &values) {
+	std::uint64_t size;
+	if(!readValue(in,size) || size > maxStoredSize) {
+		return false;
+	}
+	values.resize(size);
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(values.data()),size * sizeof(T)));
+}
+
+}
+
+std::string HPWH::getWarmStartKey(int N,double *inletT_C,double *drawVolume_L,double *tankAmbientT_C,
+	double *heatSourceAmbientT_C,DRMODES *DRstatus,int numSpinUpRuns) const {
+
+	KeyHash key;
+	key.addValues({static_cast<double>(HPWHVRSN_MAJOR),static_cast<double>(HPWHVRSN_MINOR),static_cast<double>(HPWHVRSN_PATCH),
+		static_cast<double>(warmStartFormat),static_cast<double>(sizeof(tankReal_t))});
+	key.addText(HPWHVRSN_META);
+
+	// the tank and the options of the simulation
+	key.addValues({static_cast<double>(hpwhModel),static_cast<double>(getNumNodes()),tankVolume_L,tankUA_kJperHrC,
+		fittingsUA_kJperHrC,fracAreaTop,fracAreaSide,nodeHeight_m,setpoint_C,
+		static_cast<double>(inletHeight),static_cast<double>(inlet2Height),minutesPerStep,
+		static_cast<double>(tankMixesOnDraw),mixBelowFractionOnDraw,static_cast<double>(doTempDepression),maxDepression_C,
+		static_cast<double>(doInversionMixing),static_cast<double>(doConduction),static_cast<double>(doFastHeatDist),
+		static_cast<double>(doClosedFormSP),closedFormSPDeltaT_C,
+		static_cast<double>(doClosedFormMP),closedFormMPDeltaT_C,static_cast<double>(tankModel->getType()),
+		static_cast<double>(doAdaptiveGrid),static_cast<double>(maxGridRefinement),gridRefineDeltaT_C,
+		timerLimitTOT,static_cast<double>(usesSoCLogic)});
+	key.addValues({static_cast<double>(hasRecircLoop),recircUA_kJperHrC,recircFlowRate_Lper_min,recircLoopAmbientT_C,
+		recircMinuteOfDay});
+	key.addValues(recircPumpFractions);
+	key.addValues({static_cast<double>(rotateCompressorLead)});
+	for(const std::vector<std::shared_ptr<HeatingLogic>> *logics: {&compressorStageOnLogics,&compressorStageOffLogics}) {
+		key.addValues({static_cast<double>(logics->size())});
+		for(const std::shared_ptr<HeatingLogic> &logic: *logics) {
+			std::vector<double> parameters;
+			logic->getParameters(parameters);
+			key.addText(logic->description);
+			key.addValues(parameters);
+		}
+	}
+
+	// the heat sources, with their links as indices
+	auto indexOf = [this](const HeatSource *heatSource) {
+		return (heatSource == NULL) ? -1. : static_cast<double>(heatSource - heatSources.data());
+	};
+	for(const HeatSource &heatSource: heatSources) {
+		key.addValues({static_cast<double>(heatSource.typeOfHeatSource),static_cast<double>(heatSource.configuration),
+			static_cast<double>(heatSource.isMultipass),static_cast<double>(heatSource.isVIP),
+			indexOf(heatSource.backupHeatSource),indexOf(heatSource.companionHeatSource),
+			indexOf(heatSource.followedByHeatSource),heatSource.Tshrinkage_C,static_cast<double>(heatSource.lowestNode),
+			static_cast<double>(heatSource.useBtwxtGrid),static_cast<double>(heatSource.extrapolationMethod),
+			static_cast<double>(heatSource.doDefrost),heatSource.resDefrost.inputPwr_kW,
+			heatSource.resDefrost.constTempLift_dF,heatSource.resDefrost.onBelowT_F,
+			heatSource.maxOut_at_LowT.outT_C,heatSource.maxOut_at_LowT.airT_C,
+			heatSource.secondaryHeatExchanger.coldSideTemperatureOffest_dC,
+			heatSource.secondaryHeatExchanger.hotSideTemperatureOffset_dC,
+			heatSource.secondaryHeatExchanger.extraPumpPower_W,heatSource.minT,heatSource.maxT,
+			heatSource.maxSetpoint_C,heatSource.hysteresis_dC,static_cast<double>(heatSource.depressesTemperature),
+			heatSource.airflowFreedom,static_cast<double>(heatSource.externalInletHeight),
+			static_cast<double>(heatSource.externalOutletHeight),heatSource.mpFlowRate_LPS});
+		key.addValues(heatSource.condensity);
+		key.addValues({static_cast<double>(heatSource.perfMap.size())});
+		for(const HeatSource::perfPoint &point: heatSource.perfMap) {
+			key.addValues({point.T_F});
+			key.addValues(point.inputPower_coeffs);
+			key.addValues(point.COP_coeffs);
+		}
+		key.addValues({static_cast<double>(heatSource.perfGrid.size())});
+		for(const std::vector<double> &axis: heatSource.perfGrid) {
+			key.addValues(axis);
+		}
+		key.addValues({static_cast<double>(heatSource.perfGridValues.size())});
+		for(const std::vector<double> &values: heatSource.perfGridValues) {
+			key.addValues(values);
+		}
+		key.addValues({static_cast<double>(heatSource.defrostMap.size())});
+		for(const HeatSource::defrostPoint &point: heatSource.defrostMap) {
+			key.addValues({point.T_F,point.derate_fraction});
+		}
+
+		std::vector<std::shared_ptr<HeatingLogic>> standbyLogics;
+		if(heatSource.standbyLogic != NULL) {
+			standbyLogics.push_back(heatSource.standbyLogic);
+		}
+		const std::vector<std::shared_ptr<HeatingLogic>> *logicSets[] =
+			{&heatSource.turnOnLogicSet,&heatSource.shutOffLogicSet,&standbyLogics};
+		for(const std::vector<std::shared_ptr<HeatingLogic>> *logics: logicSets) {
+			key.addValues({static_cast<double>(logics->size())});
+			for(const std::shared_ptr<HeatingLogic> &logic: *logics) {
+				std::vector<double> parameters;
+				logic->getParameters(parameters);
+				key.addText(logic->description);
+				key.addValues(parameters);
+			}
+		}
+	}
+
+	// the schedule of the spin-up
+	key.addValues({static_cast<double>(N),static_cast<double>(numSpinUpRuns)});
+	for(const double *values: {inletT_C,drawVolume_L,tankAmbientT_C,heatSourceAmbientT_C}) {
+		key.add(values,N * sizeof(double));
+	}
+	key.add(DRstatus,N * sizeof(DRMODES));
+
+	return key.hex();
+}
+
+bool HPWH::readWarmStartFile(const std::string &path,const std::string &key,StepState &state) const {
+	std::ifstream in(path,std::ios::binary);
+	if(!in) {
+		return false;
+	}
+	char magic[sizeof(warmStartMagic)];
+	int format;
+	std::vector<char> storedKey;
+	if(!in.read(magic,sizeof(magic)) || !std::equal(magic,magic + sizeof(magic),warmStartMagic) ||
+		!readValue(in,format) || format != warmStartFormat ||
+		!readVector(in,storedKey) || std::string(storedKey.begin(),storedKey.end()) != key) {
+		return false;
+	}
+
+	std::vector<char> heatSourceIsOn,heatSourceLockedOut;
+	char isHeatingStored;
+	if(!readVector(in,state.tankTemps_C) || !readVector(in,heatSourceIsOn) || !readVector(in,heatSourceLockedOut) ||
+		!readValue(in,isHeatingStored) || !readValue(in,state.prevDRstatus) || !readValue(in,state.timerTOT) ||
+		!readValue(in,state.locationTemperature_C) || !readValue(in,state.currentSoCFraction) ||
+		!readVector(in,state.tankGridSplits) || !readVector(in,state.tankGridTemps_C) || !readVector(in,state.tankGridNodeT_C) ||
+		!readValue(in,state.leadCompressorStage) || !in.read(magic,sizeof(magic)) || !std::equal(magic,magic + sizeof(magic),warmStartMagic)) {
+		return false;
+	}
+	if(static_cast<int>(state.tankTemps_C.size()) != getNumNodes() ||
+		static_cast<int>(heatSourceIsOn.size()) != getNumHeatSources() ||
+		static_cast<int>(heatSourceLockedOut.size()) != getNumHeatSources() ||
+		state.leadCompressorStage < 0 || state.leadCompressorStage >= std::max(getNumCompressorStages(),1)) {
+		return false;
+	}
+	state.heatSourceIsOn.assign(heatSourceIsOn.begin(),heatSourceIsOn.end());
+	state.heatSourceLockedOut.assign(heatSourceLockedOut.begin(),heatSourceLockedOut.end());
+	state.isHeating = (isHeatingStored != 0);
+	return true;
+}
+
+bool HPWH::writeWarmStartFile(const std::string &path,const std::string &key,const StepState &state) const {
+	// runs that share the cache may store the same spin-up at once, from other threads or other processes,
+	// so each writes its own file and renames it
+#ifdef _WIN32
+	const long processId = static_cast<long>(_getpid());
+#else
+	const long processId = static_cast<long>(getpid());
+#endif
+	std::string tempPath = path + ".tmp" + std::to_string(processId) + "_"
+		+ std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		std::ofstream out(tempPath,std::ios::binary | std::ios::trunc);
+		out.write(warmStartMagic,sizeof(warmStartMagic));
+		writeValue(out,warmStartFormat);
+		writeVector(out,std::vector<char>(key.begin(),key.end()));
+		writeVector(out,state.tankTemps_C);
+		writeVector(out,std::vector<char>(state.heatSourceIsOn.begin(),state.heatSourceIsOn.end()));
+		writeVector(out,std::vector<char>(state.heatSourceLockedOut.begin(),state.heatSourceLockedOut.end()));
+		writeValue(out,static_cast<char>(state.isHeating));
+		writeValue(out,state.prevDRstatus);
+		writeValue(out,state.timerTOT);
+		writeValue(out,state.locationTemperature_C);
+		writeValue(out,state.currentSoCFraction);
+		writeVector(out,state.tankGridSplits);
+		writeVector(out,state.tankGridTemps_C);
+		writeVector(out,state.tankGridNodeT_C);
+		writeValue(out,state.leadCompressorStage);
+		out.write(warmStartMagic,sizeof(warmStartMagic));
+		if(!out.flush()) {
+			out.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+	if(std::rename(tempPath.c_str(),path.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+int HPWH::warmStart(const std::string &cacheDirectory,int N,double *inletT_C,double *drawVolume_L,
+	double *tankAmbientT_C,double *heatSourceAmbientT_C,DRMODES *DRstatus,int numSpinUpRuns /*=1*/) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+
+	warmStartWasCached = false;
+	if(N <= 0 || numSpinUpRuns < 1) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("warmStart needs positive numbers of steps and spin-up runs.  \n");
+		}
+		return HPWH_ABORT;
+	}
+	if(simHasFailed) {
+		if(hpwhVerbosity >= VRB_reluctant) {
+			msg("simHasFailed is set, aborting.  \n");
+		}
+		return HPWH_ABORT;
+	}
+
+	const std::string key = getWarmStartKey(N,inletT_C,drawVolume_L,tankAmbientT_C,heatSourceAmbientT_C,DRstatus,numSpinUpRuns);
+	const std::string path = cacheDirectory + "/hpwh_warmstart_" + key + ".bin";
+	StepState state;
+	if(readWarmStartFile(path,key,state)) {
+		// the pump clock is not stored, it is where the spin-up leaves it
+		state.recircMinuteOfDay = hasRecircLoop ?
+			fmod(recircMinuteOfDay + N * numSpinUpRuns * minutesPerStep,1440.) : recircMinuteOfDay;
+		restoreStepState(state);
+		warmStartWasCached = true;
+		return 0;
+	}
+
+	setTankToTemperature(setpoint_C);
+	turnAllHeatSourcesOff();
+	for(int i = 0; i < getNumHeatSources(); i++) {
+		heatSources[i].unlockHeatSource();
+	}
+	prevDRstatus = DR_ALLOW;
+	timerTOT = 0.;
+	leadCompressorStage = 0;
+	locationTemperature_C = UNINITIALIZED_LOCATIONTEMP;
+	// step by step, as the outputs of the spin-up are thrown away rather than summed or printed
+	for(int run = 0; run < numSpinUpRuns; run++) {
+		for(int i = 0; i < N; i++) {
+			if(runOneStep(inletT_C[i],drawVolume_L[i],tankAmbientT_C[i],heatSourceAmbientT_C[i],DRstatus[i]) == HPWH_ABORT) {
+				if(hpwhVerbosity >= VRB_reluctant) {
+					msg("The spin-up of warmStart failed on step %d of run %d.  \n",i + 1,run + 1);
+				}
+				return HPWH_ABORT;
+			}
+		}
+	}
+
+	// the spin-up's share of the energy balance goes with its outputs, as it does from the cache
+	cumulativeBalanceResidual_kJ = 0.;
+	numEnergyBalanceFlags = 0;
+	saveStepState(state);
+	if(!writeWarmStartFile(path,key,state) && hpwhVerbosity >= VRB_reluctant) {
+		msg("warmStart could not store its spin-up in %s.  \n",path.c_str());
+	}
+	return 0;
+}
+
+bool HPWH::wasWarmStartCached() const {
+	return warmStartWasCached;
+}
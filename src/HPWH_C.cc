@@ -0,0 +1,258 @@
+/*
+ * The C interface: opaque handles over HPWH, and batched stepping of many models through many steps
+ */
+
+#include <algorithm>
+#include <memory>
+
+#include "HPWH.hh"
+#include "HPWH_C.h"
+
+struct HPWH_Handle {
+	HPWH hpwh;
+};
+
+static_assert(HPWH_C_ABORT == HPWH::HPWH_ABORT,"HPWH_C_ABORT must match HPWH::HPWH_ABORT");
+
+// A C++ exception must not unwind into a C host, so each entry point runs its body through guarded, which turns any
+// exception, e.g. a std::bad_alloc or a btwxt error reading a model, into the failure value of the function
+template<typename T,typename Body>
+static T guarded(T failure,Body body) {
+	try {
+		return body();
+	} catch(...) {
+		return failure;
+	}
+}
+
+int hpwh_get_abi_version(void) {
+	return HPWH_C_ABI_VERSION;
+}
+
+const char *hpwh_get_version(void) {
+	return guarded<const char *>(NULL,[]() {
+		static const std::string version = HPWH::getVersion();
+		return version.c_str();
+	});
+}
+
+HPWH_Handle *hpwh_create_preset(int presetNumber) {
+	return guarded<HPWH_Handle *>(NULL,[&]() -> HPWH_Handle * {
+		std::unique_ptr<HPWH_Handle> handle(new HPWH_Handle());
+		if(handle->hpwh.HPWHinit_presets(static_cast<HPWH::MODELS>(presetNumber)) != 0) {
+			return NULL;
+		}
+		return handle.release();
+	});
+}
+
+HPWH_Handle *hpwh_create_file(const char *configFile) {
+#ifndef HPWH_ABRIDGED
+	return guarded<HPWH_Handle *>(NULL,[&]() -> HPWH_Handle * {
+		if(configFile == NULL) {
+			return NULL;
+		}
+		std::unique_ptr<HPWH_Handle> handle(new HPWH_Handle());
+		if(handle->hpwh.HPWHinit_file(configFile) != 0) {
+			return NULL;
+		}
+		return handle.release();
+	});
+#else
+	return NULL;
+#endif
+}
+
+HPWH_Handle *hpwh_copy(const HPWH_Handle *hpwh) {
+	return guarded<HPWH_Handle *>(NULL,[&]() {
+		return (hpwh == NULL) ? NULL : new HPWH_Handle(*hpwh);
+	});
+}
+
+void hpwh_destroy(HPWH_Handle *hpwh) {
+	delete hpwh;
+}
+
+int hpwh_set_verbosity(HPWH_Handle *hpwh,int verbosity) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		if(hpwh == NULL) {
+			return HPWH_C_ABORT;
+		}
+		hpwh->hpwh.setVerbosity(static_cast<HPWH::VERBOSITY>(verbosity));
+		return HPWH_C_OK;
+	});
+}
+
+int hpwh_set_minutes_per_step(HPWH_Handle *hpwh,double minutesPerStep) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		if(hpwh == NULL || !(minutesPerStep > 0.)) {
+			return HPWH_C_ABORT;
+		}
+		hpwh->hpwh.setMinutesPerStep(minutesPerStep);
+		return HPWH_C_OK;
+	});
+}
+
+int hpwh_set_setpoint_C(HPWH_Handle *hpwh,double setpoint_C) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setSetpoint(setpoint_C);
+	});
+}
+
+int hpwh_set_tank_size_L(HPWH_Handle *hpwh,double volume_L,int forceChange) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setTankSize(volume_L,HPWH::UNITS_L,forceChange != 0);
+	});
+}
+
+int hpwh_set_UA_kJperHrC(HPWH_Handle *hpwh,double UA_kJperHrC) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setUA(UA_kJperHrC);
+	});
+}
+
+int hpwh_set_tank_to_temperature_C(HPWH_Handle *hpwh,double temperature_C) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setTankToTemperature(temperature_C);
+	});
+}
+
+int hpwh_set_inlet_by_fraction(HPWH_Handle *hpwh,double fractionalHeight) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setInletByFraction(fractionalHeight);
+	});
+}
+
+int hpwh_set_inlet2_by_fraction(HPWH_Handle *hpwh,double fractionalHeight) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setInlet2ByFraction(fractionalHeight);
+	});
+}
+
+int hpwh_set_do_temp_depression(HPWH_Handle *hpwh,int doTempDepression) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setDoTempDepression(doTempDepression != 0);
+	});
+}
+
+int hpwh_set_target_SoC_fraction(HPWH_Handle *hpwh,double target) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setTargetSoCFraction(target);
+	});
+}
+
+int hpwh_set_energy_balance_check(HPWH_Handle *hpwh,int doCheck,double maxResidualFraction) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.setEnergyBalanceCheck(doCheck != 0,maxResidualFraction);
+	});
+}
+
+int hpwh_get_num_nodes(const HPWH_Handle *hpwh) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.getNumNodes();
+	});
+}
+
+int hpwh_get_num_heat_sources(const HPWH_Handle *hpwh) {
+	return guarded(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.getNumHeatSources();
+	});
+}
+
+double hpwh_get_setpoint_C(const HPWH_Handle *hpwh) {
+	return guarded<double>(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.getSetpoint();
+	});
+}
+
+double hpwh_get_tank_size_L(const HPWH_Handle *hpwh) {
+	return guarded<double>(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.getTankSize();
+	});
+}
+
+double hpwh_get_tank_node_temp_C(const HPWH_Handle *hpwh,int nodeNumber) {
+	return guarded<double>(HPWH_C_ABORT,[&]() {
+		return (hpwh == NULL) ? HPWH_C_ABORT : hpwh->hpwh.getTankNodeTemp(nodeNumber);
+	});
+}
+
+int hpwh_run_steps(HPWH_Handle *const *hpwhs,int numInstances,int numSteps,
+	const HPWH_StepInputs *inputs,const HPWH_StepOutputs *outputs) {
+	//returns 0 on successful completion, HPWH_ABORT on failure
+	return guarded(HPWH_C_ABORT,[&]() {
+		if(hpwhs == NULL || numInstances <= 0 || numSteps <= 0 || inputs == NULL || outputs == NULL
+			|| inputs->inletT_C == NULL || inputs->drawVolume_L == NULL || inputs->tankAmbientT_C == NULL
+			|| inputs->heatSourceAmbientT_C == NULL || (inputs->inletVol2_L == NULL) != (inputs->inletT2_C == NULL)
+			|| outputs->numHeatSourceValues < 0) {
+			return HPWH_C_ABORT;
+		}
+		for(int k = 0; k < numInstances; k++) {
+			if(hpwhs[k] == NULL) {
+				return HPWH_C_ABORT;
+			}
+		}
+
+		std::vector<int> runResults(numInstances,HPWH_C_OK);
+		HPWH::parallelFor(0,numInstances,[&](int k) {
+			// an exception on a worker thread would end the host, so it fails only its own model
+			runResults[k] = guarded(HPWH_C_ABORT,[&]() {
+				HPWH &hpwh = hpwhs[k]->hpwh;
+				const int numHeatSources = hpwh.getNumHeatSources();
+				const int numHeatSourceValues = outputs->numHeatSourceValues;
+				for(int i = 0; i < numSteps; i++) {
+					const std::size_t n = static_cast<std::size_t>(k) * numSteps + i;
+					HPWH::DRMODES DRstatus = (inputs->DRstatus == NULL) ? HPWH::DR_ALLOW : static_cast<HPWH::DRMODES>(inputs->DRstatus[n]);
+					double inletVol2_L = (inputs->inletVol2_L == NULL) ? 0. : inputs->inletVol2_L[n];
+					double inletT2_C = (inputs->inletT2_C == NULL) ? 0. : inputs->inletT2_C[n];
+					if(hpwh.runOneStep(inputs->inletT_C[n],inputs->drawVolume_L[n],inputs->tankAmbientT_C[n],
+						inputs->heatSourceAmbientT_C[n],DRstatus,inletVol2_L,inletT2_C) != 0) {
+						return HPWH_C_ABORT;
+					}
+
+					double energyInput_kWh = 0.,energyOutput_kWh = 0.;
+					for(int j = 0; j < numHeatSources; j++) {
+						energyInput_kWh += hpwh.getNthHeatSourceEnergyInput(j);
+						energyOutput_kWh += hpwh.getNthHeatSourceEnergyOutput(j);
+					}
+					if(outputs->outletT_C != NULL) {
+						outputs->outletT_C[n] = hpwh.getOutletTemp();
+					}
+					if(outputs->energyInput_kWh != NULL) {
+						outputs->energyInput_kWh[n] = energyInput_kWh;
+					}
+					if(outputs->energyOutput_kWh != NULL) {
+						outputs->energyOutput_kWh[n] = energyOutput_kWh;
+					}
+					if(outputs->energyRemovedFromEnvironment_kWh != NULL) {
+						outputs->energyRemovedFromEnvironment_kWh[n] = hpwh.getEnergyRemovedFromEnvironment();
+					}
+					if(outputs->standbyLosses_kWh != NULL) {
+						outputs->standbyLosses_kWh[n] = hpwh.getStandbyLosses();
+					}
+					if(outputs->tankHeatContent_kJ != NULL) {
+						outputs->tankHeatContent_kJ[n] = hpwh.getTankHeatContent_kJ();
+					}
+					for(int j = 0; j < numHeatSourceValues; j++) {
+						bool hasHeatSource = (j < numHeatSources);
+						if(outputs->heatSourceEnergyInput_kWh != NULL) {
+							outputs->heatSourceEnergyInput_kWh[n * numHeatSourceValues + j] =
+								hasHeatSource ? hpwh.getNthHeatSourceEnergyInput(j) : 0.;
+						}
+						if(outputs->heatSourceRunTime_min != NULL) {
+							outputs->heatSourceRunTime_min[n * numHeatSourceValues + j] =
+								hasHeatSource ? hpwh.getNthHeatSourceRunTime(j) : 0.;
+						}
+					}
+				}
+				return HPWH_C_OK;
+			});
+		});
+		for(int k = 0; k < numInstances; k++) {
+			if(runResults[k] != HPWH_C_OK) {
+				return HPWH_C_ABORT;
+			}
+		}
+		return HPWH_C_OK;
+	});
+}
@@ -0,0 +1,108 @@
+#ifndef HPWH_C_h
+#define HPWH_C_h
+
+/*
+ * A C interface to HPWHsim, for hosts that are not written in C++.
+ * Models are held through opaque handles, and hpwh_run_steps advances any number of them through any number
+ * of steps in one call, reading its inputs from arrays and writing its outputs to arrays.  Units are fixed:
+ * temperatures in C, volumes in L, energies in kWh unless named otherwise, times in minutes.  No C++ exception
+ * leaves the library: a function that meets one returns its failure value, NULL or HPWH_C_ABORT.
+ */
+
+#ifdef _WIN32
+#ifdef HPWH_C_EXPORTS
+#define HPWH_C_API __declspec(dllexport)
+#else
+#define HPWH_C_API __declspec(dllimport)
+#endif
+#else
+#define HPWH_C_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HPWH_C_ABI_VERSION 1
+/**< the version of this interface, raised whenever a function or struct below changes in a way that would break
+ * a host built against an older one  */
+
+#define HPWH_C_OK 0
+#define HPWH_C_ABORT -274000
+/**< the values the int functions return, the second matching HPWH::HPWH_ABORT  */
+
+typedef struct HPWH_Handle HPWH_Handle;
+
+typedef struct HPWH_StepInputs {
+	const double *inletT_C;
+	const double *drawVolume_L;
+	const double *tankAmbientT_C;
+	const double *heatSourceAmbientT_C;
+	const int *DRstatus;			/**< the HPWH::DRMODES bits, or NULL to allow everything  */
+	const double *inletVol2_L;		/**< NULL for no draw through the second inlet  */
+	const double *inletT2_C;		/**< NULL for no draw through the second inlet  */
+} HPWH_StepInputs;
+/**< the inputs of hpwh_run_steps, each an array of numInstances * numSteps values with the steps of an instance
+ * together: the input of step i of instance k is at [k * numSteps + i]  */
+
+typedef struct HPWH_StepOutputs {
+	double *outletT_C;
+	double *energyInput_kWh;			/**< summed over the heat sources  */
+	double *energyOutput_kWh;			/**< summed over the heat sources  */
+	double *energyRemovedFromEnvironment_kWh;
+	double *standbyLosses_kWh;
+	double *tankHeatContent_kJ;
+	double *heatSourceEnergyInput_kWh;	/**< numHeatSourceValues values per step, by heat source  */
+	double *heatSourceRunTime_min;		/**< numHeatSourceValues values per step, by heat source  */
+	int numHeatSourceValues;			/**< heat sources past this many are left out, and missing ones written as 0  */
+} HPWH_StepOutputs;
+/**< the outputs of hpwh_run_steps, laid out as its inputs, with numHeatSourceValues values per step in the heat
+ * source arrays.  Outputs left NULL are not written  */
+
+HPWH_C_API int hpwh_get_abi_version(void);
+/**< returns the HPWH_C_ABI_VERSION the library was built with, which a host should check against its own  */
+HPWH_C_API const char *hpwh_get_version(void);
+/**< returns the version of HPWHsim, as HPWH::getVersion  */
+
+HPWH_C_API HPWH_Handle *hpwh_create_preset(int presetNumber);
+/**< returns a new model made from the preset with the given HPWH::MODELS number, or NULL if there is none  */
+HPWH_C_API HPWH_Handle *hpwh_create_file(const char *configFile);
+/**< returns a new model read from a model file, or NULL if it cannot be read  */
+HPWH_C_API HPWH_Handle *hpwh_copy(const HPWH_Handle *hpwh);
+/**< returns a new model in the same state as hpwh  */
+HPWH_C_API void hpwh_destroy(HPWH_Handle *hpwh);
+/**< frees a model, which may be NULL  */
+
+HPWH_C_API int hpwh_set_minutes_per_step(HPWH_Handle *hpwh,double minutesPerStep);
+/**< sets the length of the steps of hpwh_run_steps, as HPWH::setMinutesPerStep, returning HPWH_C_ABORT unless it is
+ * positive  */
+HPWH_C_API int hpwh_set_verbosity(HPWH_Handle *hpwh,int verbosity);
+HPWH_C_API int hpwh_set_setpoint_C(HPWH_Handle *hpwh,double setpoint_C);
+HPWH_C_API int hpwh_set_tank_size_L(HPWH_Handle *hpwh,double volume_L,int forceChange);
+HPWH_C_API int hpwh_set_UA_kJperHrC(HPWH_Handle *hpwh,double UA_kJperHrC);
+HPWH_C_API int hpwh_set_tank_to_temperature_C(HPWH_Handle *hpwh,double temperature_C);
+HPWH_C_API int hpwh_set_inlet_by_fraction(HPWH_Handle *hpwh,double fractionalHeight);
+HPWH_C_API int hpwh_set_inlet2_by_fraction(HPWH_Handle *hpwh,double fractionalHeight);
+HPWH_C_API int hpwh_set_do_temp_depression(HPWH_Handle *hpwh,int doTempDepression);
+HPWH_C_API int hpwh_set_target_SoC_fraction(HPWH_Handle *hpwh,double target);
+HPWH_C_API int hpwh_set_energy_balance_check(HPWH_Handle *hpwh,int doCheck,double maxResidualFraction);
+/**< the setters of the HPWH functions of the same names, returning HPWH_C_OK or HPWH_C_ABORT  */
+
+HPWH_C_API int hpwh_get_num_nodes(const HPWH_Handle *hpwh);
+HPWH_C_API int hpwh_get_num_heat_sources(const HPWH_Handle *hpwh);
+HPWH_C_API double hpwh_get_setpoint_C(const HPWH_Handle *hpwh);
+HPWH_C_API double hpwh_get_tank_size_L(const HPWH_Handle *hpwh);
+HPWH_C_API double hpwh_get_tank_node_temp_C(const HPWH_Handle *hpwh,int nodeNumber);
+/**< the getters of the HPWH functions of the same names  */
+
+HPWH_C_API int hpwh_run_steps(HPWH_Handle *const *hpwhs,int numInstances,int numSteps,
+	const HPWH_StepInputs *inputs,const HPWH_StepOutputs *outputs);
+/**< runs each of numInstances models through numSteps steps of runOneStep, the models at once on the hardware
+ * threads.  The models must be distinct.  Returns HPWH_C_ABORT if any model fails, with the outputs written up
+ * to the step that failed  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
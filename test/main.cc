@@ -289,6 +289,9 @@ int main(int argc, char *argv[])
 	  hpwh.WriteCSVHeading(outputFile, header.c_str(), nTestTCouples, 0);
   }
 
+  // Check the energy balance of each step as it runs
+  hpwh.setEnergyBalanceCheck(true, EBALTHRESHOLD);
+
   // ------------------------------------- Simulate --------------------------------------- //
   cout << "Now Simulating " << minutesToRun << " Minutes of the Test\n";
 
@@ -308,8 +311,6 @@ int main(int argc, char *argv[])
 		  airTemp2 = allSchedules[2][i];
 	  }
 
-	  double tankHCStart = hpwh.getTankHeatContent_kJ();
-
 	  // Process the dr status
 	  drStatus = static_cast<HPWH::DRMODES>(int(allSchedules[4][i]));
 
@@ -344,25 +345,8 @@ int main(int argc, char *argv[])
 		  vectptr);
 
 	  // Check energy balance accounting. 
-	  double hpwhElect = 0;
-	  for (int iHS = 0; iHS < hpwh.getNumHeatSources(); iHS++) {
-		  hpwhElect += hpwh.getNthHeatSourceEnergyInput(iHS, HPWH::UNITS_KJ);
-	  }
-	  double hpwhqHW = GAL_TO_L(allSchedules[1][i]) * (hpwh.getOutletTemp() - allSchedules[0][i]) 
-				* HPWH::DENSITYWATER_kgperL
-				* HPWH::CPWATER_kJperkgC;
-	  double hpwhqEnv = hpwh.getEnergyRemovedFromEnvironment(HPWH::UNITS_KJ);
-	  double hpwhqLoss = hpwh.getStandbyLosses(HPWH::UNITS_KJ);
-	  double deltaHC = hpwh.getTankHeatContent_kJ() - tankHCStart;
-	  double qBal = hpwhqEnv// HP energy extracted from surround
-		  - hpwhqLoss		// tank loss to environment
-		  + hpwhElect		// electricity in from heat sources
-		  - hpwhqHW			// hot water energy from flows in and out
-		  - deltaHC;		// change in tank stored energy
-
-	  double fBal = fabs(qBal) / std::max(tankHCStart, 1.);
-	  if (fBal > EBALTHRESHOLD){
-		  cout << "WARNING: On minute " << i << " HPWH has an energy balance error " << qBal << "kJ, " << 100*fBal << "%"<< "\n";
+	  if (hpwh.isEnergyBalanceFlagged()) {
+		  cout << "WARNING: On minute " << i << " HPWH has an energy balance error " << hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ) << "kJ" << "\n";
 	  }
 	  // Check timing
 	  for (int iHS = 0; iHS < hpwh.getNumHeatSources(); iHS++) {
@@ -0,0 +1,168 @@
+/*
+ * unit tests for the adaptive node grid
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+void testGridWithoutRefinementMatchesNodes();
+void testGridConservesEnergy();
+void testGridSharpensThermocline();
+void testGridWithHeatSources(string input);
+void testGridInputs();
+
+const double inletT_C = 15.;
+const double ambientT_C = 20.;
+const HPWH::DRMODES heatingOff = static_cast<HPWH::DRMODES>(HPWH::DR_LOC | HPWH::DR_LOR);
+const string fineModelFile = "RheemHB50_192Nodes.txt";
+
+int main()
+{
+	// a finer copy of a file model as the reference for the thermocline
+	std::ifstream modelFile("RheemHB50.txt");
+	std::ofstream fineModel(fineModelFile);
+	string line;
+	while(std::getline(modelFile,line)) {
+		fineModel << (line.rfind("numNodes",0) == 0 ? "numNodes 192" : line) << "\n";
+	}
+	fineModel.close();
+
+	testGridWithoutRefinementMatchesNodes();
+	testGridConservesEnergy();
+	testGridSharpensThermocline();
+	testGridWithHeatSources("AOSmithHPTU50");
+	testGridWithHeatSources("Rheem2020Prem50");
+	testGridInputs();
+
+	std::remove(fineModelFile.c_str());
+	//Made it through the gauntlet
+	return 0;
+}
+
+// a tank that is cold below and hot above
+void setStratifiedTank(HPWH &hpwh) {
+	std::vector<double> layers(12,25.);
+	for(int i = 6; i < 12; i++) {
+		layers[i] = 55.;
+	}
+	hpwh.setTankLayerTemperatures(layers);
+}
+
+// short draws every half hour for four hours, with the heat sources off
+void runDraws(HPWH &hpwh,std::vector<double> &outletT_C) {
+	outletT_C.clear();
+	for(int minute = 0; minute < 240; minute++) {
+		double drawVolume_L = (minute % 30 < 6) ? 4. : 0.;
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,heatingOff) == 0);
+		if(drawVolume_L > 0.) {
+			outletT_C.push_back(hpwh.getOutletTemp());
+		}
+	}
+}
+
+void testGridWithoutRefinementMatchesNodes() {
+	HPWH hpwhNodes,hpwhGrid;
+	getHPWHObject(hpwhNodes,"AOSmithHPTU50");
+	getHPWHObject(hpwhGrid,"AOSmithHPTU50");
+	ASSERTTRUE(hpwhGrid.setAdaptiveNodeGrid(true,0) == 0);
+
+	for(int minute = 0; minute < 1440; minute++) {
+		double drawVolume_L = (minute % 120 < 20) ? 8. : 0.;
+		hpwhNodes.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW);
+		hpwhGrid.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW);
+		ASSERTTRUE(cmpd(hpwhGrid.getOutletTemp(),hpwhNodes.getOutletTemp(),tankTolerance(1.e-9,1.e3)));
+	}
+	ASSERTTRUE(hpwhGrid.getNumGridNodes() == hpwhGrid.getNumNodes());
+	ASSERTTRUE(cmpd(hpwhGrid.getTankHeatContent_kJ(),hpwhNodes.getTankHeatContent_kJ(),
+		tankTolerance(1.e-6,1.e2 * hpwhNodes.getTankHeatContent_kJ())));
+}
+
+void testGridConservesEnergy() {
+	HPWH hpwh;
+	ASSERTTRUE(hpwh.HPWHinit_file("RheemHB50.txt") == 0);
+	ASSERTTRUE(hpwh.setAdaptiveNodeGrid(true) == 0);
+	hpwh.setDoConduction(false);
+	setStratifiedTank(hpwh);
+
+	// the heat content only changes by what is drawn and what is lost
+	double startHeatContent_kJ = hpwh.getTankHeatContent_kJ();
+	double drawnAndLost_kJ = 0.;
+	for(int minute = 0; minute < 240; minute++) {
+		double drawVolume_L = (minute % 30 < 6) ? 4. : 0.;
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,heatingOff) == 0);
+		drawnAndLost_kJ += drawVolume_L * HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC * (hpwh.getOutletTemp() - inletT_C);
+		drawnAndLost_kJ += KWH_TO_KJ(hpwh.getStandbyLosses());
+	}
+	ASSERTTRUE(hpwh.getNumGridNodes() > hpwh.getNumNodes());
+	ASSERTTRUE(cmpd(startHeatContent_kJ - hpwh.getTankHeatContent_kJ(),drawnAndLost_kJ,tankTolerance(1.e-6,startHeatContent_kJ)));
+}
+
+void testGridSharpensThermocline() {
+	HPWH hpwhNodes,hpwhGrid,hpwhFine;
+	ASSERTTRUE(hpwhNodes.HPWHinit_file("RheemHB50.txt") == 0);
+	ASSERTTRUE(hpwhGrid.HPWHinit_file("RheemHB50.txt") == 0);
+	ASSERTTRUE(hpwhFine.HPWHinit_file(fineModelFile) == 0);
+	ASSERTTRUE(hpwhGrid.setAdaptiveNodeGrid(true) == 0);
+	setStratifiedTank(hpwhNodes);
+	setStratifiedTank(hpwhGrid);
+	setStratifiedTank(hpwhFine);
+
+	std::vector<double> outletNodes_C,outletGrid_C,outletFine_C;
+	runDraws(hpwhNodes,outletNodes_C);
+	runDraws(hpwhGrid,outletGrid_C);
+	runDraws(hpwhFine,outletFine_C);
+
+	// the grid follows the outlet temperature of the fine tank far more closely than the nodes do
+	double maxErrorNodes_C = 0.,maxErrorGrid_C = 0.;
+	for(std::size_t i = 0; i < outletFine_C.size(); i++) {
+		maxErrorNodes_C = std::max(maxErrorNodes_C,fabs(outletNodes_C[i] - outletFine_C[i]));
+		maxErrorGrid_C = std::max(maxErrorGrid_C,fabs(outletGrid_C[i] - outletFine_C[i]));
+	}
+	ASSERTTRUE(maxErrorGrid_C < maxErrorNodes_C / 4.);
+	ASSERTTRUE(hpwhGrid.getNumGridNodes() < hpwhFine.getNumNodes());
+}
+
+void testGridWithHeatSources(string input) {
+	HPWH hpwhNodes,hpwhGrid;
+	getHPWHObject(hpwhNodes,input);
+	getHPWHObject(hpwhGrid,input);
+	ASSERTTRUE(hpwhGrid.setAdaptiveNodeGrid(true) == 0);
+
+	// the heat sources see the same tank to within the better resolved draws
+	double inputNodes_kWh = 0.,inputGrid_kWh = 0.;
+	for(int minute = 0; minute < 1440; minute++) {
+		double drawVolume_L = (minute % 120 < 20) ? 8. : 0.;
+		ASSERTTRUE(hpwhNodes.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(hpwhGrid.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int i = 0; i < hpwhNodes.getNumHeatSources(); i++) {
+			inputNodes_kWh += hpwhNodes.getNthHeatSourceEnergyInput(i);
+			inputGrid_kWh += hpwhGrid.getNthHeatSourceEnergyInput(i);
+		}
+	}
+	ASSERTTRUE(relcmpd(inputGrid_kWh,inputNodes_kWh,0.1));
+}
+
+void testGridInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+
+	ASSERTTRUE(hpwh.setAdaptiveNodeGrid(true,-1) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setAdaptiveNodeGrid(true,3,0.) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getNumGridNodes() == hpwh.getNumNodes());
+
+	// setting the tank temperatures starts the grid over
+	ASSERTTRUE(hpwh.setAdaptiveNodeGrid(true) == 0);
+	setStratifiedTank(hpwh);
+	hpwh.runOneStep(inletT_C,10.,ambientT_C,ambientT_C,heatingOff);
+	ASSERTTRUE(hpwh.getNumGridNodes() > hpwh.getNumNodes());
+	hpwh.setTankToTemperature(50.);
+	ASSERTTRUE(hpwh.getNumGridNodes() == hpwh.getNumNodes());
+}
@@ -0,0 +1,104 @@
+/*
+ * unit tests for runAdaptiveStep
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+void testAdaptiveStepIdleTank(string input);
+void testAdaptiveStepMatchesMinuteSteps(string input);
+void testAdaptiveStepInputs();
+
+const double inletT_C = F_TO_C(50.);
+const double ambientT_C = 20.;
+// liters drawn in each hour of the day
+const double hourlyDraw_L[24] = {0.,0.,0.,0.,0.,20.,80.,120.,60.,20.,10.,10.,
+	30.,10.,0.,10.,20.,40.,60.,80.,40.,20.,10.,0.};
+
+int main()
+{
+	const string models[] = {"AOSmithHPTU50", "Rheem2020Prem50", "ColmacCxV_5_SP", "Sanden80"};
+	for(const string &model: models) {
+		testAdaptiveStepIdleTank(model);
+		testAdaptiveStepMatchesMinuteSteps(model);
+	}
+	testAdaptiveStepInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+void testAdaptiveStepIdleTank(string input) {
+	HPWH hpwhAdaptive,hpwhMinutes;
+	getHPWHObject(hpwhAdaptive,input);
+	getHPWHObject(hpwhMinutes,input);
+	hpwhAdaptive.setVerbosity(HPWH::VRB_silent);
+
+	// a standing tank only loses heat, so an hour should take far fewer than sixty steps
+	ASSERTTRUE(hpwhAdaptive.runAdaptiveStep(60.,inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	for(int i = 0; i < 60; i++) {
+		hpwhMinutes.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW);
+	}
+	ASSERTTRUE(hpwhAdaptive.getNumAdaptiveSubsteps() < 60);
+	ASSERTTRUE(cmpd(hpwhAdaptive.getTankHeatContent_kJ(),hpwhMinutes.getTankHeatContent_kJ(),36.));
+	ASSERTTRUE(cmpd(hpwhAdaptive.getStandbyLosses(),hpwhMinutes.getStandbyLosses() * 60.,0.02));
+}
+
+void testAdaptiveStepMatchesMinuteSteps(string input) {
+	HPWH hpwhAdaptive,hpwhMinutes;
+	getHPWHObject(hpwhAdaptive,input);
+	getHPWHObject(hpwhMinutes,input);
+	hpwhAdaptive.setVerbosity(HPWH::VRB_silent);
+
+	double inputAdaptive_kWh = 0.,inputMinutes_kWh = 0.;
+	double outletAdaptive_CL = 0.,outletMinutes_CL = 0.,totalDraw_L = 0.;
+	int totalSubsteps = 0;
+	for(int hour = 0; hour < 24; hour++) {
+		ASSERTTRUE(hpwhAdaptive.runAdaptiveStep(60.,inletT_C,hourlyDraw_L[hour],ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		totalSubsteps += hpwhAdaptive.getNumAdaptiveSubsteps();
+		for(int i = 0; i < hpwhAdaptive.getNumHeatSources(); i++) {
+			inputAdaptive_kWh += hpwhAdaptive.getNthHeatSourceEnergyInput(i);
+		}
+		outletAdaptive_CL += hpwhAdaptive.getOutletTemp() * hourlyDraw_L[hour];
+
+		for(int minute = 0; minute < 60; minute++) {
+			hpwhMinutes.runOneStep(inletT_C,hourlyDraw_L[hour] / 60.,ambientT_C,ambientT_C,HPWH::DR_ALLOW);
+			for(int i = 0; i < hpwhMinutes.getNumHeatSources(); i++) {
+				inputMinutes_kWh += hpwhMinutes.getNthHeatSourceEnergyInput(i);
+			}
+			outletMinutes_CL += hpwhMinutes.getOutletTemp() * hourlyDraw_L[hour] / 60.;
+		}
+		totalDraw_L += hourlyDraw_L[hour];
+	}
+
+	ASSERTTRUE(totalSubsteps < 24 * 60);
+	ASSERTTRUE(relcmpd(inputAdaptive_kWh,inputMinutes_kWh,0.02));
+	ASSERTTRUE(relcmpd(hpwhAdaptive.getTankHeatContent_kJ(),hpwhMinutes.getTankHeatContent_kJ(),0.01));
+	ASSERTTRUE(cmpd(outletAdaptive_CL / totalDraw_L,outletMinutes_CL / totalDraw_L,0.5));
+}
+
+void testAdaptiveStepInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+
+	ASSERTTRUE(hpwh.runAdaptiveStep(0.,inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setAdaptiveStepTolerance(0.,0.5) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setAdaptiveStepTolerance(36.,0.5,0.) == HPWH::HPWH_ABORT);
+
+	// a minimum step as long as the host step runs the host step as one step
+	ASSERTTRUE(hpwh.setAdaptiveStepTolerance(36.,0.5,60.) == 0);
+	ASSERTTRUE(hpwh.runAdaptiveStep(60.,inletT_C,10.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(hpwh.getNumAdaptiveSubsteps() == 1);
+
+	// temperature depression only works with whole minute steps
+	hpwh.setDoTempDepression(true);
+	ASSERTTRUE(hpwh.runAdaptiveStep(2.5,inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runAdaptiveStep(5.,inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(hpwh.getNumAdaptiveSubsteps() == 5);
+}
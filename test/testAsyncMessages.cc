@@ -0,0 +1,179 @@
+/*
+ * unit tests for the asynchronous messages of setAsyncMessages
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+struct Messages {
+	string text;
+	long long numMessages = 0;
+	long long numDroppedReported = 0;
+	bool isSlow = false;
+};
+
+void collectMessage(const string message,void *contextPtr);
+
+void testAsyncMatchesSync(string input);
+void testAsyncFlushEachStep();
+void testAsyncDrops();
+void testAsyncCopyAndCallback();
+void testAsyncInputs();
+
+void runDay(HPWH &hpwh,int numSteps = 1440);
+
+int main()
+{
+	testAsyncMatchesSync("AOSmithHPTU50");
+	testAsyncMatchesSync("Sanden80");
+	testAsyncFlushEachStep();
+	testAsyncDrops();
+	testAsyncCopyAndCallback();
+	testAsyncInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// the writer passes out the same messages, in the same order, as they are passed out when made
+void testAsyncMatchesSync(string input) {
+	Messages sync,async;
+	HPWH syncHPWH,asyncHPWH;
+	getHPWHObject(syncHPWH,input);
+	getHPWHObject(asyncHPWH,input);
+	for(HPWH *hpwh: {&syncHPWH,&asyncHPWH}) {
+		hpwh->setVerbosity(HPWH::VRB_emetic);
+	}
+	syncHPWH.setMessageCallback(collectMessage,&sync);
+	asyncHPWH.setMessageCallback(collectMessage,&async);
+	ASSERTTRUE(asyncHPWH.setAsyncMessages(true,256) == 0);
+
+	runDay(syncHPWH);
+	runDay(asyncHPWH);
+	asyncHPWH.flushMessages();
+	ASSERTTRUE(sync.numMessages > 10000);
+	ASSERTTRUE(async.numMessages == sync.numMessages);
+	ASSERTTRUE(async.text == sync.text);
+	ASSERTTRUE(asyncHPWH.getNumDroppedMessages() == 0);
+}
+
+// each step's messages are out by the end of the step
+void testAsyncFlushEachStep() {
+	Messages sync,async;
+	HPWH syncHPWH,asyncHPWH;
+	getHPWHObject(syncHPWH,"Rheem2020Prem50");
+	getHPWHObject(asyncHPWH,"Rheem2020Prem50");
+	for(HPWH *hpwh: {&syncHPWH,&asyncHPWH}) {
+		hpwh->setVerbosity(HPWH::VRB_typical);
+	}
+	syncHPWH.setMessageCallback(collectMessage,&sync);
+	asyncHPWH.setMessageCallback(collectMessage,&async);
+	ASSERTTRUE(asyncHPWH.setAsyncMessages(true,64,HPWH::MESSAGES_BLOCK,true) == 0);
+	for(int i = 0; i < 200; i++) {
+		double drawVolume_L = (i % 60 < 5) ? 10. : 0.;
+		ASSERTTRUE(syncHPWH.runOneStep(10.,drawVolume_L,19.,19.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(asyncHPWH.runOneStep(10.,drawVolume_L,19.,19.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(async.numMessages == sync.numMessages);
+	}
+	ASSERTTRUE(async.text == sync.text);
+}
+
+// a full buffer drops new messages, and the writer counts them out
+void testAsyncDrops() {
+	Messages sync,async;
+	long long numDropped = 0;
+	async.isSlow = true;
+	{
+		HPWH syncHPWH,asyncHPWH;
+		getHPWHObject(syncHPWH,"AOSmithHPTU50");
+		getHPWHObject(asyncHPWH,"AOSmithHPTU50");
+		for(HPWH *hpwh: {&syncHPWH,&asyncHPWH}) {
+			hpwh->setVerbosity(HPWH::VRB_emetic);
+		}
+		syncHPWH.setMessageCallback(collectMessage,&sync);
+		asyncHPWH.setMessageCallback(collectMessage,&async);
+		ASSERTTRUE(asyncHPWH.setAsyncMessages(true,4,HPWH::MESSAGES_DROP) == 0);
+		runDay(syncHPWH,20);
+		runDay(asyncHPWH,20);
+		numDropped = asyncHPWH.getNumDroppedMessages();
+	}
+	// every message is either passed out or counted as dropped
+	ASSERTTRUE(numDropped > 0);
+	ASSERTTRUE(async.numMessages + numDropped == sync.numMessages);
+	ASSERTTRUE(async.numDroppedReported == numDropped);
+}
+
+// a copy writes through a writer of its own, and a new callback takes the messages made after it is set
+void testAsyncCopyAndCallback() {
+	Messages sync,async,copied,later;
+	HPWH syncHPWH,asyncHPWH;
+	getHPWHObject(syncHPWH,"Sanden80");
+	getHPWHObject(asyncHPWH,"Sanden80");
+	for(HPWH *hpwh: {&syncHPWH,&asyncHPWH}) {
+		hpwh->setVerbosity(HPWH::VRB_typical);
+	}
+	syncHPWH.setMessageCallback(collectMessage,&sync);
+	asyncHPWH.setMessageCallback(collectMessage,&async);
+	ASSERTTRUE(asyncHPWH.setAsyncMessages(true) == 0);
+
+	HPWH copy = asyncHPWH;
+	copy.setMessageCallback(collectMessage,&copied);
+	runDay(syncHPWH);
+	runDay(copy);
+	copy.flushMessages();
+	ASSERTTRUE(copied.text == sync.text);
+	ASSERTTRUE(async.numMessages == 0);
+
+	runDay(asyncHPWH,720);
+	asyncHPWH.setMessageCallback(collectMessage,&later);
+	long long numEarlier = async.numMessages;
+	ASSERTTRUE(numEarlier > 0);
+	for(int i = 720; i < 1440; i++) {
+		ASSERTTRUE(asyncHPWH.runOneStep(10.,(i % 60 < 5) ? 10. : 0.,19.,19.,HPWH::DR_ALLOW) == 0);
+	}
+	asyncHPWH.flushMessages();
+	ASSERTTRUE(async.numMessages == numEarlier);
+	ASSERTTRUE(async.text + later.text == sync.text);
+
+	// turned off, the messages are passed out as they are made
+	ASSERTTRUE(asyncHPWH.setAsyncMessages(false) == 0);
+	long long numLater = later.numMessages;
+	ASSERTTRUE(asyncHPWH.runOneStep(10.,0.,19.,19.,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(later.numMessages > numLater);
+}
+
+void testAsyncInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwh.setAsyncMessages(true,0) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getNumDroppedMessages() == 0);
+	hpwh.flushMessages();
+}
+
+void collectMessage(const string message,void *contextPtr) {
+	Messages *messages = static_cast<Messages*>(contextPtr);
+	if(message.compare(0,13,"HPWH dropped ") == 0) {
+		messages->numDroppedReported += std::stoll(message.substr(13));
+		return;
+	}
+	if(messages->isSlow) {
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+	}
+	messages->text += message;
+	messages->numMessages++;
+}
+
+void runDay(HPWH &hpwh,int numSteps /*=1440*/) {
+	for(int i = 0; i < numSteps; i++) {
+		ASSERTTRUE(hpwh.runOneStep(10.,(i % 60 < 5) ? 10. : 0.,19.,19.,HPWH::DR_ALLOW) == 0);
+	}
+}
@@ -0,0 +1,237 @@
+/*
+ * unit tests for the C interface
+ */
+#include "HPWH.hh"
+#include "HPWH_C.h"
+#include "testUtilityFcts.cc"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testBatchMatchesRunOneStep();
+void testCreateAndSet();
+void testBatchInputs();
+void testMinutesPerStep();
+void testNoExceptionLeaves();
+
+const int N = 1440;
+
+int main()
+{
+	ASSERTTRUE(hpwh_get_abi_version() == HPWH_C_ABI_VERSION);
+	ASSERTTRUE(string(hpwh_get_version()) == HPWH::getVersion());
+
+	testBatchMatchesRunOneStep();
+	testCreateAndSet();
+	testBatchInputs();
+	testMinutesPerStep();
+	testNoExceptionLeaves();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// three models run together through a day each, with a schedule of their own, match the same models run alone
+void testBatchMatchesRunOneStep() {
+	const std::vector<HPWH::MODELS> presets = {HPWH::MODELS_AOSmithHPTU50,HPWH::MODELS_Sanden80,HPWH::MODELS_restankRealistic};
+	const int numInstances = static_cast<int>(presets.size());
+	const int numHeatSourceValues = 2;
+
+	std::vector<double> inletT_C(numInstances * N),drawVolume_L(numInstances * N,0.),ambientT_C(numInstances * N);
+	std::vector<double> inletVol2_L(numInstances * N,0.),inletT2_C(numInstances * N,20.);
+	std::vector<int> DRstatus(numInstances * N,HPWH::DR_ALLOW);
+	for(int k = 0; k < numInstances; k++) {
+		for(int i = 0; i < N; i++) {
+			int n = k * N + i;
+			inletT_C[n] = 8. + k;
+			ambientT_C[n] = 15. + 5. * k;
+			if(i >= 420 + 60 * k && i < 450 + 60 * k) {
+				drawVolume_L[n] = GAL_TO_L(1.5);
+				inletVol2_L[n] = 0.2 * drawVolume_L[n];
+			}
+			if(i >= 1000 && i < 1060) {
+				DRstatus[n] = HPWH::DR_LOC;
+			}
+		}
+	}
+
+	std::vector<HPWH_Handle *> handles;
+	for(HPWH::MODELS preset: presets) {
+		handles.push_back(hpwh_create_preset(preset));
+		ASSERTTRUE(handles.back() != NULL);
+	}
+	HPWH_StepInputs inputs = {inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),DRstatus.data(),
+		inletVol2_L.data(),inletT2_C.data()};
+	std::vector<double> outletT_C(numInstances * N),energyInput_kWh(numInstances * N),energyOutput_kWh(numInstances * N);
+	std::vector<double> standbyLosses_kWh(numInstances * N),tankHeatContent_kJ(numInstances * N);
+	std::vector<double> heatSourceEnergyInput_kWh(numInstances * N * numHeatSourceValues);
+	std::vector<double> heatSourceRunTime_min(numInstances * N * numHeatSourceValues);
+	HPWH_StepOutputs outputs = {outletT_C.data(),energyInput_kWh.data(),energyOutput_kWh.data(),NULL,
+		standbyLosses_kWh.data(),tankHeatContent_kJ.data(),heatSourceEnergyInput_kWh.data(),heatSourceRunTime_min.data(),
+		numHeatSourceValues};
+	ASSERTTRUE(hpwh_run_steps(handles.data(),numInstances,N,&inputs,&outputs) == HPWH_C_OK);
+
+	for(int k = 0; k < numInstances; k++) {
+		HPWH hpwh;
+		ASSERTTRUE(hpwh.HPWHinit_presets(presets[k]) == 0);
+		for(int i = 0; i < N; i++) {
+			int n = k * N + i;
+			ASSERTTRUE(hpwh.runOneStep(inletT_C[n],drawVolume_L[n],ambientT_C[n],ambientT_C[n],
+				static_cast<HPWH::DRMODES>(DRstatus[n]),inletVol2_L[n],inletT2_C[n]) == 0);
+			ASSERTTRUE(outletT_C[n] == hpwh.getOutletTemp());
+			ASSERTTRUE(standbyLosses_kWh[n] == hpwh.getStandbyLosses());
+			ASSERTTRUE(tankHeatContent_kJ[n] == hpwh.getTankHeatContent_kJ());
+			double sumInput_kWh = 0.,sumOutput_kWh = 0.;
+			for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+				sumInput_kWh += hpwh.getNthHeatSourceEnergyInput(j);
+				sumOutput_kWh += hpwh.getNthHeatSourceEnergyOutput(j);
+			}
+			ASSERTTRUE(energyInput_kWh[n] == sumInput_kWh);
+			ASSERTTRUE(energyOutput_kWh[n] == sumOutput_kWh);
+
+			// the heat sources past the values asked for are left out, and the missing ones are 0
+			for(int j = 0; j < numHeatSourceValues; j++) {
+				bool hasHeatSource = (j < hpwh.getNumHeatSources());
+				ASSERTTRUE(heatSourceEnergyInput_kWh[n * numHeatSourceValues + j]
+					== (hasHeatSource ? hpwh.getNthHeatSourceEnergyInput(j) : 0.));
+				ASSERTTRUE(heatSourceRunTime_min[n * numHeatSourceValues + j]
+					== (hasHeatSource ? hpwh.getNthHeatSourceRunTime(j) : 0.));
+			}
+		}
+		for(int j = 0; j < hpwh.getNumNodes(); j++) {
+			ASSERTTRUE(hpwh_get_tank_node_temp_C(handles[k],j) == hpwh.getTankNodeTemp(j));
+		}
+		hpwh_destroy(handles[k]);
+	}
+}
+
+void testCreateAndSet() {
+	ASSERTTRUE(hpwh_create_preset(-1) == NULL);
+	ASSERTTRUE(hpwh_create_file("noSuchModel.txt") == NULL);
+
+	HPWH_Handle *fromFile = hpwh_create_file("Sanden80.txt");
+	ASSERTTRUE(fromFile != NULL);
+	HPWH reference;
+	ASSERTTRUE(reference.HPWHinit_file("Sanden80.txt") == 0);
+	ASSERTTRUE(hpwh_get_num_nodes(fromFile) == reference.getNumNodes());
+	ASSERTTRUE(hpwh_get_num_heat_sources(fromFile) == reference.getNumHeatSources());
+	ASSERTTRUE(hpwh_get_tank_size_L(fromFile) == reference.getTankSize());
+
+	// the setters reach the model, and a setting it cannot take is refused
+	HPWH_Handle *hpwh = hpwh_create_preset(HPWH::MODELS_AOSmithHPTU50);
+	ASSERTTRUE(hpwh_set_verbosity(hpwh,HPWH::VRB_silent) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_set_setpoint_C(hpwh,50.) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_get_setpoint_C(hpwh) == 50.);
+	ASSERTTRUE(hpwh_set_setpoint_C(hpwh,200.) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_set_tank_size_L(hpwh,GAL_TO_L(80.),1) == HPWH_C_OK);
+	ASSERTTRUE(relcmpd(hpwh_get_tank_size_L(hpwh),GAL_TO_L(80.)));
+	ASSERTTRUE(hpwh_set_UA_kJperHrC(hpwh,10.) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_set_inlet_by_fraction(hpwh,0.) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_set_inlet2_by_fraction(hpwh,0.5) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_set_do_temp_depression(hpwh,0) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_set_energy_balance_check(hpwh,1,0.005) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_set_target_SoC_fraction(hpwh,0.8) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_set_tank_to_temperature_C(hpwh,40.) == HPWH_C_OK);
+	ASSERTTRUE(hpwh_get_tank_node_temp_C(hpwh,0) == 40.);
+
+	// a copy goes on as the original does
+	HPWH_Handle *copy = hpwh_copy(hpwh);
+	HPWH_Handle *pair[2] = {hpwh,copy};
+	std::vector<double> inletT_C(2 * N,10.),drawVolume_L(2 * N,0.5),ambientT_C(2 * N,20.),outletT_C(2 * N);
+	HPWH_StepInputs inputs = {inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),NULL,NULL,NULL};
+	HPWH_StepOutputs outputs = {outletT_C.data(),NULL,NULL,NULL,NULL,NULL,NULL,NULL,0};
+	ASSERTTRUE(hpwh_run_steps(pair,2,N,&inputs,&outputs) == HPWH_C_OK);
+	for(int i = 0; i < N; i++) {
+		ASSERTTRUE(outletT_C[i] == outletT_C[N + i]);
+	}
+
+	hpwh_destroy(copy);
+	hpwh_destroy(hpwh);
+	hpwh_destroy(fromFile);
+	hpwh_destroy(NULL);
+}
+
+void testBatchInputs() {
+	HPWH_Handle *hpwh = hpwh_create_preset(HPWH::MODELS_AOSmithHPTU50);
+	hpwh_set_verbosity(hpwh,HPWH::VRB_silent);
+	std::vector<double> inletT_C(N,10.),drawVolume_L(N,0.),ambientT_C(N,20.),inletVol2_L(N,0.);
+	HPWH_StepInputs inputs = {inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),NULL,NULL,NULL};
+	HPWH_StepOutputs outputs = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,0};
+
+	ASSERTTRUE(hpwh_run_steps(&hpwh,1,0,&inputs,&outputs) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_run_steps(&hpwh,0,N,&inputs,&outputs) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_run_steps(&hpwh,1,N,NULL,&outputs) == HPWH_C_ABORT);
+	HPWH_Handle *missing = NULL;
+	ASSERTTRUE(hpwh_run_steps(&missing,1,N,&inputs,&outputs) == HPWH_C_ABORT);
+	// the second inlet takes both a volume and a temperature
+	inputs.inletVol2_L = inletVol2_L.data();
+	ASSERTTRUE(hpwh_run_steps(&hpwh,1,N,&inputs,&outputs) == HPWH_C_ABORT);
+	inputs.inletVol2_L = NULL;
+	outputs.numHeatSourceValues = -1;
+	ASSERTTRUE(hpwh_run_steps(&hpwh,1,N,&inputs,&outputs) == HPWH_C_ABORT);
+	outputs.numHeatSourceValues = 0;
+	ASSERTTRUE(hpwh_run_steps(&hpwh,1,N,&inputs,&outputs) == HPWH_C_OK);
+
+	ASSERTTRUE(hpwh_set_setpoint_C(NULL,50.) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_get_num_nodes(NULL) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_copy(NULL) == NULL);
+	hpwh_destroy(hpwh);
+}
+
+// steps of another length run as the same steps through runOneStep, and a length that is not positive is refused
+void testMinutesPerStep() {
+	const int numSteps = N / 5;
+	HPWH_Handle *hpwh = hpwh_create_preset(HPWH::MODELS_AOSmithHPTU50);
+	ASSERTTRUE(hpwh_set_minutes_per_step(hpwh,0.) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_set_minutes_per_step(hpwh,-1.) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_set_minutes_per_step(NULL,5.) == HPWH_C_ABORT);
+	ASSERTTRUE(hpwh_set_minutes_per_step(hpwh,5.) == HPWH_C_OK);
+
+	std::vector<double> inletT_C(numSteps,10.),drawVolume_L(numSteps,0.),ambientT_C(numSteps,20.);
+	std::vector<double> outletT_C(numSteps),energyInput_kWh(numSteps);
+	for(int i = 84; i < 96; i++) {
+		drawVolume_L[i] = GAL_TO_L(7.5);
+	}
+	HPWH_StepInputs inputs = {inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),NULL,NULL,NULL};
+	HPWH_StepOutputs outputs = {outletT_C.data(),energyInput_kWh.data(),NULL,NULL,NULL,NULL,NULL,NULL,0};
+	ASSERTTRUE(hpwh_run_steps(&hpwh,1,numSteps,&inputs,&outputs) == HPWH_C_OK);
+
+	HPWH reference;
+	ASSERTTRUE(reference.HPWHinit_presets(HPWH::MODELS_AOSmithHPTU50) == 0);
+	reference.setMinutesPerStep(5.);
+	double sumInput_kWh = 0.;
+	for(int i = 0; i < numSteps; i++) {
+		ASSERTTRUE(reference.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(outletT_C[i] == reference.getOutletTemp());
+		sumInput_kWh += energyInput_kWh[i];
+	}
+	ASSERTTRUE(sumInput_kWh > 0.);
+	hpwh_destroy(hpwh);
+}
+
+// an exception in the library comes back to a C host as the failure value, here from a model file whose first line
+// is blank, which HPWHinit_file meets as a std::out_of_range
+void testNoExceptionLeaves() {
+	const string badFile = "testCInterfaceBlankFirstLine.txt";
+	{
+		std::ifstream in("Sanden80.txt");
+		std::ofstream out(badFile);
+		out << "\n" << in.rdbuf();
+	}
+	bool threw = false;
+	try {
+		HPWH hpwh;
+		hpwh.HPWHinit_file(badFile);
+	} catch(...) {
+		threw = true;
+	}
+	ASSERTTRUE(threw);
+	ASSERTTRUE(hpwh_create_file(badFile.c_str()) == NULL);
+	std::remove(badFile.c_str());
+}
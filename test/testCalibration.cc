@@ -0,0 +1,139 @@
+/*
+ * unit tests for calibrate
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testCalibrateCOPToUEF();
+void testCalibrateTwoGoals();
+void testCalibrateStopsEarly();
+void testCalibrateInputs();
+void testCalibrateGridModel();
+
+void ratingsMatch(const HPWH::Rating &a,const HPWH::Rating &b);
+
+int main()
+{
+	testCalibrateCOPToUEF();
+	testCalibrateTwoGoals();
+	testCalibrateStopsEarly();
+	testCalibrateInputs();
+	testCalibrateGridModel();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// the generic heat pump rates well under the UEF it was made from, so calibrate its COP up to it
+void testCalibrateCOPToUEF() {
+	HPWH hpwh;
+	ASSERTTRUE(hpwh.HPWHinit_genericHPWH(GAL_TO_L(50.),3.0,dF_TO_dC(30.)) == 0);
+	HPWH::Rating before;
+	ASSERTTRUE(hpwh.rate(before) == 0);
+	ASSERTTRUE(before.UEF < 2.9);
+
+	std::vector<double> values;
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_COP_SCALE,0.5,1.5,HPWH::METRIC_UEF,3.0,0.005}},values,rating) == 0);
+	ASSERTTRUE(values.size() == 1);
+	ASSERTTRUE(values[0] > 1. && values[0] < 1.5);
+	ASSERTTRUE(fabs(rating.UEF - 3.0) <= 0.005);
+
+	// the model keeps the calibrated COP
+	HPWH::Rating after;
+	ASSERTTRUE(hpwh.rate(after) == 0);
+	ratingsMatch(after,rating);
+}
+
+// the tank UA sets the UEF of a resistance tank, and the element power its first-hour rating
+void testCalibrateTwoGoals() {
+	HPWH hpwh;
+	ASSERTTRUE(hpwh.HPWHinit_resTank(GAL_TO_L(50.),0.95,4500.,4500.) == 0);
+
+	std::vector<double> values;
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.calibrate({
+		{HPWH::CALIBRATE_UA,0.5,20.,HPWH::METRIC_UEF,0.92,0.002},
+		{HPWH::CALIBRATE_RESISTANCE_SCALE,0.5,2.,HPWH::METRIC_FHR_L,GAL_TO_L(62.),GAL_TO_L(1.5)}},values,rating) == 0);
+	ASSERTTRUE(values.size() == 2);
+	ASSERTTRUE(fabs(rating.UEF - 0.92) <= 0.002);
+	ASSERTTRUE(fabs(rating.firstHourRating_L - GAL_TO_L(62.)) <= GAL_TO_L(1.5));
+
+	double UA;
+	ASSERTTRUE(hpwh.getUA(UA) == 0);
+	ASSERTTRUE(UA == values[0]);
+	ASSERTTRUE(relcmpd(hpwh.getResistanceCapacity(-1,HPWH::UNITS_KW),9. * values[1]));
+	HPWH::Rating after;
+	ASSERTTRUE(hpwh.rate(after) == 0);
+	ratingsMatch(after,rating);
+}
+
+// a recovery efficiency target needs no more than the first recovery of the 24 hour test
+void testCalibrateStopsEarly() {
+	HPWH hpwh;
+	ASSERTTRUE(hpwh.HPWHinit_genericHPWH(GAL_TO_L(50.),3.0,dF_TO_dC(30.)) == 0);
+	std::vector<double> values;
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_COP_SCALE,0.5,1.5,HPWH::METRIC_RE,3.3,0.02}},values,rating) == 0);
+	ASSERTTRUE(fabs(rating.recoveryEfficiency - 3.3) <= 0.02);
+	ASSERTTRUE(rating.UEF == 0.);
+}
+
+// a performance grid has no COP curves to scale, so the COP goal is refused, even for a target the model
+// already meets
+void testCalibrateGridModel() {
+	HPWH hpwh,reference;
+	getHPWHObject(hpwh,"NyleC60A_MP");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	reference = hpwh;
+	HPWH::Rating expected;
+	ASSERTTRUE(reference.rate(expected,HPWH::RATE_FHR) == 0);
+
+	std::vector<double> values;
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_COP_SCALE,0.5,1.5,HPWH::METRIC_FHR_L,expected.firstHourRating_L,GAL_TO_L(5.)}},
+		values,rating) == HPWH::HPWH_ABORT);
+	HPWH::Rating after;
+	ASSERTTRUE(hpwh.rate(after,HPWH::RATE_FHR) == 0);
+	ratingsMatch(after,expected);
+}
+
+void testCalibrateInputs() {
+	HPWH hpwh,reference;
+	ASSERTTRUE(hpwh.HPWHinit_resTank(GAL_TO_L(50.),0.95,4500.,4500.) == 0);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	reference = hpwh;
+	std::vector<double> values;
+	HPWH::Rating rating;
+
+	ASSERTTRUE(hpwh.calibrate({},values,rating) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_UA,20.,0.5,HPWH::METRIC_UEF,0.92,0.002}},values,rating) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_UA,0.5,20.,HPWH::METRIC_UEF,0.92,0.}},values,rating) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_RESISTANCE_SCALE,0.,2.,HPWH::METRIC_FHR_L,200.,5.}},values,rating) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_UA,0.5,20.,HPWH::METRIC_UEF,0.92,0.002},
+		{HPWH::CALIBRATE_UA,0.5,20.,HPWH::METRIC_RE,0.98,0.002}},values,rating) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_COP_SCALE,0.5,1.5,HPWH::METRIC_UEF,0.92,0.002}},values,rating) == HPWH::HPWH_ABORT);
+	// no tank UA makes a resistance tank that good
+	ASSERTTRUE(hpwh.calibrate({{HPWH::CALIBRATE_UA,0.5,20.,HPWH::METRIC_UEF,1.5,0.002}},values,rating) == HPWH::HPWH_ABORT);
+
+	// a calibration that fails leaves the model as it was
+	HPWH::Rating after,expected;
+	ASSERTTRUE(hpwh.rate(after) == 0);
+	ASSERTTRUE(reference.rate(expected) == 0);
+	ratingsMatch(after,expected);
+}
+
+void ratingsMatch(const HPWH::Rating &a,const HPWH::Rating &b) {
+	ASSERTTRUE(a.firstHourRating_L == b.firstHourRating_L);
+	ASSERTTRUE(a.drawPattern == b.drawPattern);
+	ASSERTTRUE(a.recoveryEfficiency == b.recoveryEfficiency);
+	ASSERTTRUE(a.UEF == b.UEF);
+	ASSERTTRUE(a.adjustedDailyEnergy_kWh == b.adjustedDailyEnergy_kWh);
+}
@@ -0,0 +1,86 @@
+/*
+ * unit tests for heating with external multipass heat pumps as a mixed tank
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+void testClosedFormMatchesLoop(string input,double tankSize_gal,double capacityDeltaT_C,double tolerance);
+void testClosedFormIsCopied();
+void testBadCapacityThreshold();
+
+const double inletT_C = 10.;
+const double ambientT_C = 20.;
+
+int main()
+{
+	// with no capacity threshold, the mixed tank takes the same capacities as the loop
+	testClosedFormMatchesLoop("ColmacCxV_5_MP",0.,0.,1.e-9);
+	testClosedFormMatchesLoop("NyleC250A_MP",0.,0.,1.e-9);
+	// fast loops on small tanks pass many nodes a step
+	testClosedFormMatchesLoop("ColmacCxA_30_MP",80.,0.,1.e-9);
+	testClosedFormMatchesLoop("Scalable_MP",80.,0.,1.e-9);
+	// a step that ends on a whole pass can leave the loop one mix of the tank apart from the mixed tank, which moves
+	// when the logics switch the heat pump
+	testClosedFormMatchesLoop("NyleC90A_MP",0.,0.5,1.e-2);
+	testClosedFormMatchesLoop("Scalable_MP",80.,0.5,1.e-2);
+
+	testClosedFormIsCopied();
+	testBadCapacityThreshold();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// runs five days of a steady draw and two large draws a day, and returns the heat source input energy
+double runDays(HPWH &hpwh) {
+	const double tankVolume_L = hpwh.getTankSize();
+	double energyInput_kWh = 0.;
+	for(int i = 0; i < 5 * 1440; i++) {
+		double drawVolume_L = tankVolume_L * ((i % 720 < 10) ? 0.03 : 0.002);
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+			energyInput_kWh += hpwh.getNthHeatSourceEnergyInput(j);
+		}
+	}
+	return energyInput_kWh;
+}
+
+void testClosedFormMatchesLoop(string input,double tankSize_gal,double capacityDeltaT_C,double tolerance) {
+	HPWH loop,closedForm;
+	getHPWHObject(loop,input);
+	getHPWHObject(closedForm,input);
+	if(tankSize_gal > 0.) {
+		ASSERTTRUE(loop.setTankSize(tankSize_gal,HPWH::UNITS_GAL) == 0);
+		ASSERTTRUE(closedForm.setTankSize(tankSize_gal,HPWH::UNITS_GAL) == 0);
+	}
+	ASSERTTRUE(closedForm.setClosedFormMultipass(true,capacityDeltaT_C) == 0);
+
+	double loopInput_kWh = runDays(loop);
+	double closedFormInput_kWh = runDays(closedForm);
+	ASSERTTRUE(loopInput_kWh > 0.);
+	// a float tank rounds the small rise of each pass of the loop, so the loop drifts from the closed form
+	ASSERTTRUE(relcmpd(closedFormInput_kWh,loopInput_kWh,tankTolerance(tolerance,2.e4)));
+}
+
+void testClosedFormIsCopied() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Scalable_MP");
+	hpwh.setTankSize(80.,HPWH::UNITS_GAL);
+	hpwh.setClosedFormMultipass(true);
+	HPWH copy = hpwh;
+
+	double input_kWh = runDays(hpwh);
+	ASSERTTRUE(runDays(copy) == input_kWh);
+}
+
+void testBadCapacityThreshold() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"ColmacCxV_5_MP");
+	ASSERTTRUE(hpwh.setClosedFormMultipass(true,-1.) == HPWH::HPWH_ABORT);
+}
@@ -0,0 +1,84 @@
+/*
+ * unit tests for heating with external single pass heat pumps a whole step at a time
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+void testClosedFormMatchesLoop(string input,double tankSize_gal,double capacityDeltaT_C,double tolerance);
+void testClosedFormIsCopied();
+void testBadCapacityThreshold();
+
+const double inletT_C = 10.;
+const double ambientT_C = 20.;
+
+int main()
+{
+	// with no capacity threshold, the closed form only differs from the loop where it mixes out inversions
+	testClosedFormMatchesLoop("Sanden80",0.,0.,1.e-9);
+	testClosedFormMatchesLoop("NyleC90A_SP",0.,0.,1.e-9);
+	testClosedFormMatchesLoop("ColmacCxV_5_SP",0.,0.,1.e-4);
+	// big heat pumps on small tanks heat many nodes a step
+	testClosedFormMatchesLoop("QAHV_N136TAU_HPB_SP",80.,0.,1.e-9);
+	testClosedFormMatchesLoop("ColmacCxA_30_SP",80.,0.,1.e-9);
+	testClosedFormMatchesLoop("QAHV_N136TAU_HPB_SP",80.,0.5,1.e-3);
+	testClosedFormMatchesLoop("NyleC250A_SP",80.,0.5,1.e-3);
+
+	testClosedFormIsCopied();
+	testBadCapacityThreshold();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// runs five days of a steady draw and two large draws a day, and returns the heat source input energy
+double runDays(HPWH &hpwh) {
+	const double tankVolume_L = hpwh.getTankSize();
+	double energyInput_kWh = 0.;
+	for(int i = 0; i < 5 * 1440; i++) {
+		double drawVolume_L = tankVolume_L * ((i % 720 < 10) ? 0.03 : 0.002);
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+			energyInput_kWh += hpwh.getNthHeatSourceEnergyInput(j);
+		}
+	}
+	return energyInput_kWh;
+}
+
+void testClosedFormMatchesLoop(string input,double tankSize_gal,double capacityDeltaT_C,double tolerance) {
+	HPWH loop,closedForm;
+	getHPWHObject(loop,input);
+	getHPWHObject(closedForm,input);
+	if(tankSize_gal > 0.) {
+		ASSERTTRUE(loop.setTankSize(tankSize_gal,HPWH::UNITS_GAL) == 0);
+		ASSERTTRUE(closedForm.setTankSize(tankSize_gal,HPWH::UNITS_GAL) == 0);
+	}
+	ASSERTTRUE(closedForm.setClosedFormSinglePass(true,capacityDeltaT_C) == 0);
+
+	double loopInput_kWh = runDays(loop);
+	double closedFormInput_kWh = runDays(closedForm);
+	ASSERTTRUE(loopInput_kWh > 0.);
+	ASSERTTRUE(relcmpd(closedFormInput_kWh,loopInput_kWh,tolerance));
+}
+
+void testClosedFormIsCopied() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"QAHV_N136TAU_HPB_SP");
+	hpwh.setTankSize(80.,HPWH::UNITS_GAL);
+	hpwh.setClosedFormSinglePass(true);
+	HPWH copy = hpwh;
+
+	double input_kWh = runDays(hpwh);
+	ASSERTTRUE(runDays(copy) == input_kWh);
+}
+
+void testBadCapacityThreshold() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Sanden80");
+	ASSERTTRUE(hpwh.setClosedFormSinglePass(true,-1.) == HPWH::HPWH_ABORT);
+}
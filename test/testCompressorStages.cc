@@ -0,0 +1,260 @@
+/*
+ * unit tests for compressor stages
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testOneStageUnchanged();
+void testStagesHeatTogether();
+void testStagingLogics();
+void testLeadRotation();
+void testSoCStaging();
+void testStageInputs();
+
+typedef std::vector<std::shared_ptr<HPWH::HeatingLogic>> Logics;
+
+const string plantModel = "ColmacCxA_15_SP";
+const double inletT_C = 10.;
+const double ambientT_C = 20.;
+
+int main()
+{
+	testOneStageUnchanged();
+	testStagesHeatTogether();
+	testStagingLogics();
+	testLeadRotation();
+	testSoCStaging();
+	testStageInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+double drawAt(int i) {
+	return (i % 30 == 0) ? 100. : 0.;
+}
+
+// the lag stages come on one after another as the bottom third of the tank gets colder
+Logics bottomThirdStages(HPWH &hpwh,int numStages) {
+	Logics logics;
+	for(int k = 1; k < numStages; k++) {
+		logics.push_back(hpwh.bottomThird(dF_TO_dC(20. * k)));
+	}
+	return logics;
+}
+
+// one stage is the compressor as it was
+void testOneStageUnchanged() {
+	HPWH hpwh,staged;
+	getHPWHObject(hpwh,plantModel);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	staged = hpwh;
+	ASSERTTRUE(staged.setCompressorStages(1) == 0);
+	ASSERTTRUE(staged.getNumHeatSources() == hpwh.getNumHeatSources());
+	ASSERTTRUE(staged.getNumCompressorStages() == 1);
+	ASSERTTRUE(staged.getCompressorStageIndex(0) == staged.getCompressorIndex());
+
+	hpwh.setTankToTemperature(30.);
+	staged.setTankToTemperature(30.);
+	for(int i = 0; i < 600; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(staged.runOneStep(inletT_C,drawAt(i),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(staged.getOutletTemp() == hpwh.getOutletTemp());
+		ASSERTTRUE(staged.getNthCompressorStageEnergyInput(0) == hpwh.getNthHeatSourceEnergyInput(hpwh.getCompressorIndex()));
+	}
+	for(int j = 0; j < hpwh.getNumNodes(); j++) {
+		ASSERTTRUE(staged.getTankNodeTemp(j) == hpwh.getTankNodeTemp(j));
+	}
+}
+
+// in a cold tank every stage runs, each as the single compressor would, and the tank recovers that much faster
+void testStagesHeatTogether() {
+	HPWH hpwh,staged;
+	getHPWHObject(hpwh,plantModel);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	staged = hpwh;
+	const int numStages = 4;
+	ASSERTTRUE(staged.setCompressorStages(numStages,bottomThirdStages(staged,numStages)) == 0);
+	ASSERTTRUE(staged.getNumCompressorStages() == numStages);
+	ASSERTTRUE(staged.getNumHeatSources() == hpwh.getNumHeatSources() + numStages - 1);
+	for(int k = 0; k < numStages; k++) {
+		ASSERTTRUE(staged.getNthHeatSourceType(staged.getCompressorStageIndex(k)) == HPWH::TYPE_compressor);
+	}
+
+	hpwh.setTankToTemperature(20.);
+	staged.setTankToTemperature(20.);
+	double startHeatContent_kJ = hpwh.getTankHeatContent_kJ();
+	ASSERTTRUE(hpwh.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(staged.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	const double singleInput_kWh = hpwh.getNthHeatSourceEnergyInput(hpwh.getCompressorIndex());
+	for(int k = 0; k < numStages; k++) {
+		ASSERTTRUE(staged.getNthCompressorStageEnergyInput(k) == staged.getNthHeatSourceEnergyInput(staged.getCompressorStageIndex(k)));
+		ASSERTTRUE(staged.getNthCompressorStageEnergyOutput(k,HPWH::UNITS_KJ) ==
+			staged.getNthHeatSourceEnergyOutput(staged.getCompressorStageIndex(k),HPWH::UNITS_KJ));
+		ASSERTTRUE(staged.getNthCompressorStageRunTime(k) == 1.);
+		ASSERTTRUE(relcmpd(staged.getNthCompressorStageEnergyInput(k),singleInput_kWh,0.01));
+	}
+	ASSERTTRUE(relcmpd(staged.getTankHeatContent_kJ() - startHeatContent_kJ,
+		numStages * (hpwh.getTankHeatContent_kJ() - startHeatContent_kJ),0.02));
+
+	int singleSteps = 1,stagedSteps = 1;
+	while(hpwh.isNthHeatSourceRunning(hpwh.getCompressorIndex()) == 1) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		singleSteps++;
+	}
+	while(staged.isNthHeatSourceRunning(staged.getCompressorStageIndex(staged.getLeadCompressorStage())) == 1) {
+		ASSERTTRUE(staged.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		stagedSteps++;
+	}
+	ASSERTTRUE(stagedSteps < singleSteps / 2);
+}
+
+// lags come on by their stage-on logics only behind the lead, and go off by their stage-off logics
+void testStagingLogics() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,plantModel);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	const int numStages = 3;
+	ASSERTTRUE(hpwh.setCompressorStages(numStages,bottomThirdStages(hpwh,numStages)) == 0);
+
+	// cold enough for the lead and the first lag, not the second
+	HPWH partLoad(hpwh);
+	partLoad.setTankToTemperature(partLoad.getSetpoint() - dF_TO_dC(30.));
+	ASSERTTRUE(partLoad.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(partLoad.getNthCompressorStageRunTime(0) > 0.);
+	ASSERTTRUE(partLoad.getNthCompressorStageRunTime(1) > 0.);
+	ASSERTTRUE(partLoad.getNthCompressorStageRunTime(2) == 0.);
+
+	// too warm for the lead, so no lag runs either
+	HPWH warm(hpwh);
+	warm.setTankToTemperature(warm.getSetpoint() - dF_TO_dC(10.));
+	ASSERTTRUE(warm.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	for(int k = 0; k < numStages; k++) {
+		ASSERTTRUE(warm.getNthCompressorStageRunTime(k) == 0.);
+	}
+
+	// stage-off logics that always hold leave the lead on its own
+	Logics offLogics;
+	std::vector<HPWH::NodeWeight> bottomNode(1,HPWH::NodeWeight(1));
+	for(int k = 1; k < numStages; k++) {
+		offLogics.push_back(std::make_shared<HPWH::TempBasedHeatingLogic>("always off",bottomNode,200.,&hpwh,false,
+			std::greater<double>()));
+	}
+	ASSERTTRUE(hpwh.setCompressorStages(numStages,bottomThirdStages(hpwh,numStages),offLogics) == 0);
+	ASSERTTRUE(hpwh.getNumCompressorStages() == numStages);
+	hpwh.setTankToTemperature(20.);
+	for(int i = 0; i < 60; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(hpwh.getNthCompressorStageRunTime(0) == 1.);
+		for(int k = 1; k < numStages; k++) {
+			ASSERTTRUE(hpwh.getNthCompressorStageRunTime(k) == 0.);
+		}
+	}
+
+	// a copy stages on its own tank
+	HPWH copy(hpwh);
+	for(int i = 0; i < 60; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(copy.runOneStep(inletT_C,drawAt(i),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int k = 0; k < numStages; k++) {
+			ASSERTTRUE(copy.getNthCompressorStageEnergyInput(k) == hpwh.getNthCompressorStageEnergyInput(k));
+		}
+	}
+}
+
+// a rotating lead shares the run time among the stages, a fixed lead runs the most
+void testLeadRotation() {
+	const int numStages = 3;
+	for(bool rotateLead: {true,false}) {
+		HPWH hpwh;
+		getHPWHObject(hpwh,plantModel);
+		hpwh.setVerbosity(HPWH::VRB_silent);
+		ASSERTTRUE(hpwh.setCompressorStages(numStages,bottomThirdStages(hpwh,numStages),Logics(),rotateLead) == 0);
+		ASSERTTRUE(hpwh.getLeadCompressorStage() == 0);
+
+		std::vector<double> runTime_min(numStages,0.);
+		std::vector<bool> led(numStages,false);
+		for(int i = 0; i < 1440; i++) {
+			led[hpwh.getLeadCompressorStage()] = true;
+			ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+			for(int k = 0; k < numStages; k++) {
+				runTime_min[k] += hpwh.getNthCompressorStageRunTime(k);
+			}
+		}
+		for(int k = 0; k < numStages; k++) {
+			ASSERTTRUE(led[k] == (rotateLead || k == 0));
+			ASSERTTRUE(runTime_min[k] > 0.);
+			if(!rotateLead) {
+				ASSERTTRUE(runTime_min[0] >= runTime_min[k]);
+			}
+		}
+	}
+}
+
+// with state of charge controls the lags stage by the state of charge
+void testSoCStaging() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,plantModel);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwh.switchToSoCControls(0.85,0.05,43.333,true,inletT_C) == 0);
+	ASSERTTRUE(hpwh.setCompressorStages(2,{hpwh.turnOnSoC("lag on",0.5,0.,43.333,true,inletT_C)}) == 0);
+
+	HPWH low(hpwh),high(hpwh);
+	low.setTankToTemperature(30.);
+	ASSERTTRUE(low.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(low.getNthCompressorStageRunTime(0) > 0.);
+	ASSERTTRUE(low.getNthCompressorStageRunTime(1) > 0.);
+
+	// below the target but above the lag's, so the lead heats alone
+	high.setTankToTemperature(high.getSetpoint());
+	double drawVolume_L = 0.3 * high.getTankSize();
+	ASSERTTRUE(high.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(high.getSoCFraction() > 0.5 && high.getSoCFraction() < 0.85);
+	ASSERTTRUE(high.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(high.getNthCompressorStageRunTime(0) > 0.);
+	ASSERTTRUE(high.getNthCompressorStageRunTime(1) == 0.);
+
+	// switching the controls again keeps the lag on its staging logic
+	ASSERTTRUE(hpwh.switchToSoCControls(0.85,0.05,43.333,true,inletT_C) == 0);
+	HPWH again(hpwh);
+	again.setTankToTemperature(again.getSetpoint());
+	ASSERTTRUE(again.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(again.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(again.getNthCompressorStageRunTime(0) > 0.);
+	ASSERTTRUE(again.getNthCompressorStageRunTime(1) == 0.);
+}
+
+void testStageInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,plantModel);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwh.setCompressorStages(0) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setCompressorStages(3,bottomThirdStages(hpwh,2)) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setCompressorStages(3,bottomThirdStages(hpwh,3),bottomThirdStages(hpwh,2)) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setCompressorStages(2,Logics(1)) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setCompressorStages(2,{hpwh.turnOnSoC("lag on",0.5,0.,43.333,true,inletT_C)}) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getNumCompressorStages() == 1);
+	ASSERTTRUE(hpwh.getCompressorStageIndex(1) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getNthCompressorStageEnergyInput(1) == HPWH::HPWH_ABORT);
+
+	// staging again replaces the stages, and one stage removes them
+	const int numHeatSources = hpwh.getNumHeatSources();
+	ASSERTTRUE(hpwh.setCompressorStages(4,bottomThirdStages(hpwh,4)) == 0);
+	ASSERTTRUE(hpwh.setCompressorStages(2,bottomThirdStages(hpwh,2)) == 0);
+	ASSERTTRUE(hpwh.getNumHeatSources() == numHeatSources + 1);
+	ASSERTTRUE(hpwh.setCompressorStages(1) == 0);
+	ASSERTTRUE(hpwh.getNumHeatSources() == numHeatSources);
+
+	HPWH resistance;
+	getHPWHObject(resistance,"restankRealistic");
+	resistance.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(resistance.getNumCompressorStages() == 0);
+	ASSERTTRUE(resistance.setCompressorStages(1) == HPWH::HPWH_ABORT);
+}
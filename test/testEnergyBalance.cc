@@ -0,0 +1,239 @@
+/*
+ * unit tests for the energy balance kept in runOneStep
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testBalanceMatchesOutputs(string input,double drawScale);
+void testBalanceExtraHeat();
+void testBalanceAfterSettingTank();
+void testBalanceAfterToggling(bool adaptiveGrid);
+void testBalanceFlags();
+void testBalanceAdaptiveStep();
+void testBalanceCopy();
+void testBalanceInputs();
+
+const double inletT_C = 10.;
+const double inlet2T_C = 12.;
+const double ambientT_C = 19.;
+
+double drawAt(int i,double drawScale);
+
+int main()
+{
+	testBalanceMatchesOutputs("AOSmithHPTU50",1.);
+	testBalanceMatchesOutputs("Sanden80",1.);
+	testBalanceMatchesOutputs("restankRealistic",1.);
+	testBalanceMatchesOutputs("TamScalable_SP",20.);
+	testBalanceMatchesOutputs("Scalable_MP",20.);
+	testBalanceExtraHeat();
+	testBalanceAfterSettingTank();
+	testBalanceAfterToggling(false);
+	testBalanceAfterToggling(true);
+	testBalanceFlags();
+	testBalanceAdaptiveStep();
+	testBalanceCopy();
+	testBalanceInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// two days with a morning draw, part of it through the second inlet
+void testBalanceMatchesOutputs(string input,double drawScale) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.005) == 0);
+
+	double cumulativeResidual_kJ = 0.;
+	for(int i = 0; i < 2880; i++) {
+		double drawVolume_L = drawAt(i,drawScale);
+		double startHeatContent_kJ = hpwh.getTankHeatContent_kJ();
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW,
+			0.3 * drawVolume_L,inlet2T_C) == 0);
+
+		// the same balance from the outputs of the step
+		double heatIn_kJ = hpwh.getEnergyRemovedFromEnvironment(HPWH::UNITS_KJ) - hpwh.getStandbyLosses(HPWH::UNITS_KJ);
+		for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+			heatIn_kJ += hpwh.getNthHeatSourceEnergyInput(j,HPWH::UNITS_KJ);
+		}
+		double drawHeat_kJ = (drawVolume_L * hpwh.getOutletTemp() - 0.7 * drawVolume_L * inletT_C - 0.3 * drawVolume_L * inlet2T_C)
+			* HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC;
+		double residual_kJ = heatIn_kJ - drawHeat_kJ - (hpwh.getTankHeatContent_kJ() - startHeatContent_kJ);
+		ASSERTTRUE(fabs(hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ) - residual_kJ) < 0.01);
+		ASSERTTRUE(!hpwh.isEnergyBalanceFlagged());
+
+		cumulativeResidual_kJ += hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ);
+	}
+	ASSERTTRUE(relcmpd(hpwh.getCumulativeEnergyBalanceResidual(HPWH::UNITS_KJ),cumulativeResidual_kJ));
+	ASSERTTRUE(relcmpd(hpwh.getCumulativeEnergyBalanceResidual(),KJ_TO_KWH(cumulativeResidual_kJ)));
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == 0);
+}
+
+// the heat given through nodePowerExtra_W is in the balance, and reported
+void testBalanceExtraHeat() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"StorageTank");
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.005) == 0);
+	// a short run from a full tank, with the draw cooling only the bottom, where the extra heat goes
+	ASSERTTRUE(hpwh.setSetpoint(60.) == 0);
+	ASSERTTRUE(hpwh.setTankToTemperature(60.) == 0);
+	std::vector<double> extra_W(hpwh.getNumNodes(),0.);
+	for(int i = 0; i < 30; i++) {
+		double drawVolume_L = (i < 10) ? GAL_TO_L(2.) : 0.;
+		extra_W[0] = (i % 2 == 0) ? 1000. : 0.;
+		double startHeatContent_kJ = hpwh.getTankHeatContent_kJ();
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW,0.,0.,&extra_W) == 0);
+		ASSERTTRUE(relcmpd(hpwh.getExtraHeatEnergy(HPWH::UNITS_KJ),extra_W[0] * 60. / 1000.) || extra_W[0] == 0.);
+		ASSERTTRUE(extra_W[0] > 0. || hpwh.getExtraHeatEnergy() == 0.);
+
+		double drawHeat_kJ = drawVolume_L * (hpwh.getOutletTemp() - inletT_C) * HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC;
+		double residual_kJ = hpwh.getExtraHeatEnergy(HPWH::UNITS_KJ) - hpwh.getStandbyLosses(HPWH::UNITS_KJ) - drawHeat_kJ
+			- (hpwh.getTankHeatContent_kJ() - startHeatContent_kJ);
+		ASSERTTRUE(fabs(hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ) - residual_kJ) < 0.01);
+	}
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == 0);
+}
+
+// a tank set between steps starts the next balance from its new heat content
+void testBalanceAfterSettingTank() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.005) == 0);
+	for(int i = 0; i < 10; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	}
+	ASSERTTRUE(hpwh.setTankLayerTemperatures({30.,40.,50.}) == 0);
+	ASSERTTRUE(hpwh.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(!hpwh.isEnergyBalanceFlagged());
+	ASSERTTRUE(fabs(hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ)) < 1.);
+
+	ASSERTTRUE(hpwh.setTankSize(GAL_TO_L(80.),HPWH::UNITS_L,true) == 0);
+	ASSERTTRUE(hpwh.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(!hpwh.isEnergyBalanceFlagged());
+	ASSERTTRUE(fabs(hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ)) < 1.);
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == 0);
+}
+
+// a check turned back on starts from the tank as it is, not as it was when the check was turned off
+void testBalanceAfterToggling(bool adaptiveGrid) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	ASSERTTRUE(hpwh.setAdaptiveNodeGrid(adaptiveGrid) == 0);
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.005) == 0);
+	for(int i = 0; i < 420; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	}
+
+	// the morning draw, with the heat pump coming on, runs while the check is off
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(false) == 0);
+	for(int i = 420; i < 480; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	}
+
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.005) == 0);
+	for(int i = 480; i < 600; i++) {
+		double startHeatContent_kJ = hpwh.getTankHeatContent_kJ();
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(!hpwh.isEnergyBalanceFlagged());
+		ASSERTTRUE(fabs(hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ)) < 1.);
+
+		// the heat content kept from step to step is the one summed over the nodes
+		double heatIn_kJ = hpwh.getEnergyRemovedFromEnvironment(HPWH::UNITS_KJ) - hpwh.getStandbyLosses(HPWH::UNITS_KJ);
+		for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+			heatIn_kJ += hpwh.getNthHeatSourceEnergyInput(j,HPWH::UNITS_KJ);
+		}
+		double drawHeat_kJ = drawAt(i,1.) * (hpwh.getOutletTemp() - inletT_C) * HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC;
+		double residual_kJ = heatIn_kJ - drawHeat_kJ - (hpwh.getTankHeatContent_kJ() - startHeatContent_kJ);
+		ASSERTTRUE(fabs(hpwh.getEnergyBalanceResidual(HPWH::UNITS_KJ) - residual_kJ) < 0.01);
+	}
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == 0);
+}
+
+// any residual at all is over a threshold that small, and turning the check off clears the outputs
+void testBalanceFlags() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Sanden80");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,1.e-12) == 0);
+	int numFlagged = 0;
+	for(int i = 0; i < 1440; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		numFlagged += hpwh.isEnergyBalanceFlagged();
+	}
+	ASSERTTRUE(numFlagged > 0);
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == numFlagged);
+
+	// a threshold of 0 keeps the balance and flags nothing
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true) == 0);
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == 0);
+	ASSERTTRUE(hpwh.getCumulativeEnergyBalanceResidual() == 0.);
+	for(int i = 0; i < 1440; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(!hpwh.isEnergyBalanceFlagged());
+	}
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == 0);
+	ASSERTTRUE(hpwh.getCumulativeEnergyBalanceResidual() != 0.);
+
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(false) == 0);
+	ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(450,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(hpwh.getEnergyBalanceResidual() == 0.);
+	ASSERTTRUE(hpwh.getCumulativeEnergyBalanceResidual() == 0.);
+	ASSERTTRUE(!hpwh.isEnergyBalanceFlagged());
+}
+
+// the residual of a host step is the sum over its internal steps
+void testBalanceAdaptiveStep() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.005) == 0);
+	double lastCumulative_kWh = 0.;
+	for(int hour = 0; hour < 24; hour++) {
+		ASSERTTRUE(hpwh.runAdaptiveStep(60.,inletT_C,(hour == 7) ? GAL_TO_L(40.) : 0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(relcmpd(hpwh.getEnergyBalanceResidual(),hpwh.getCumulativeEnergyBalanceResidual() - lastCumulative_kWh,1.e-6)
+			|| fabs(hpwh.getEnergyBalanceResidual()) < 1.e-12);
+		ASSERTTRUE(!hpwh.isEnergyBalanceFlagged());
+		lastCumulative_kWh = hpwh.getCumulativeEnergyBalanceResidual();
+	}
+}
+
+// a copy carries the balance on as the original does
+void testBalanceCopy() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Rheem2020Prem50");
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.005) == 0);
+	for(int i = 0; i < 500; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	}
+	HPWH copy = hpwh;
+	ASSERTTRUE(copy.getCumulativeEnergyBalanceResidual() == hpwh.getCumulativeEnergyBalanceResidual());
+	for(int i = 500; i < 1440; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(copy.runOneStep(inletT_C,drawAt(i,1.),ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(copy.getEnergyBalanceResidual() == hpwh.getEnergyBalanceResidual());
+	}
+	ASSERTTRUE(copy.getCumulativeEnergyBalanceResidual() == hpwh.getCumulativeEnergyBalanceResidual());
+}
+
+void testBalanceInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,-0.01) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getEnergyBalanceResidual(HPWH::UNITS_F) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getCumulativeEnergyBalanceResidual(HPWH::UNITS_F) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getExtraHeatEnergy(HPWH::UNITS_F) == HPWH::HPWH_ABORT);
+}
+
+double drawAt(int i,double drawScale) {
+	int minute = i % 1440;
+	return (minute > 420 && minute < 480) ? drawScale * GAL_TO_L(2.) : 0.;
+}
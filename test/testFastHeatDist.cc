@@ -0,0 +1,73 @@
+/*
+ * unit tests for the approximate heat distribution of wrapped condensers
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+void testFastHeatDistMatchesExact(string input);
+void testFastHeatDistIsCopied();
+
+const int stepsPerDay = 1440;
+const double inletT_C = F_TO_C(50.);
+const double ambientT_C = 15.;
+
+int main()
+{
+	testFastHeatDistMatchesExact("AOSmithHPTU50");
+	testFastHeatDistMatchesExact("RheemHB50");
+	testFastHeatDistMatchesExact("GE502014");
+	testFastHeatDistMatchesExact("Stiebel220E");
+	testFastHeatDistIsCopied();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// runs a week of 10 minute draws every four hours and returns the heat source input energy
+double runWeek(HPWH &hpwh) {
+	double energyInput_kWh = 0.;
+	for(int i = 0; i < 7 * stepsPerDay; i++) {
+		double drawVolume_L = (i % 240 < 10) ? 5. : 0.;
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+			energyInput_kWh += hpwh.getNthHeatSourceEnergyInput(j);
+		}
+	}
+	return energyInput_kWh;
+}
+
+void testFastHeatDistMatchesExact(string input) {
+	HPWH exact,fast;
+	getHPWHObject(exact,input);
+	getHPWHObject(fast,input);
+	ASSERTTRUE(fast.setFastHeatDistribution(true) == 0);
+
+	double exactInput_kWh = runWeek(exact);
+	double fastInput_kWh = runWeek(fast);
+	ASSERTTRUE(relcmpd(fastInput_kWh,exactInput_kWh,1.e-6));
+	for(int i = 0; i < exact.getNumNodes(); i++) {
+		ASSERTTRUE(cmpd(fast.getTankNodeTemp(i),exact.getTankNodeTemp(i),1.e-6));
+	}
+}
+
+void testFastHeatDistIsCopied() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setFastHeatDistribution(true);
+	HPWH copy = hpwh;
+	HPWH exact;
+	getHPWHObject(exact,"AOSmithHPTU50");
+
+	double input_kWh = runWeek(hpwh);
+	ASSERTTRUE(runWeek(copy) == input_kWh);
+#ifndef HPWH_FLOAT_TANK
+	// a float tank rounds away the difference between the two distributions
+	ASSERTTRUE(runWeek(exact) != input_kWh);
+#endif
+}
@@ -0,0 +1,114 @@
+/*
+ * unit tests for heating tanks with many nodes
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+void testHeatingConservesEnergy(int numNodes);
+void testHeatingMatchesCoarseTank(int numNodes);
+
+const double ambientT_C = 20.;
+
+string nodeModelFile(int numNodes,bool submerged = false) {
+	return "RheemHB50_" + std::to_string(numNodes) + (submerged ? "NodesSubmerged.txt" : "Nodes.txt");
+}
+
+// a copy of a file model with numNodes nodes, and with the wrapped condenser in the tank if submerged
+void writeNodeModel(int numNodes,bool submerged) {
+	std::ifstream modelFile("RheemHB50.txt");
+	std::ofstream nodeModel(nodeModelFile(numNodes,submerged));
+	string line;
+	while(std::getline(modelFile,line)) {
+		if(line.rfind("numNodes",0) == 0) {
+			line = "numNodes " + std::to_string(numNodes);
+		} else if(submerged && line == "heatsource 2 coilConfig wrapped") {
+			line = "heatsource 2 coilConfig submerged";
+		}
+		nodeModel << line << "\n";
+	}
+}
+
+int main()
+{
+	const int numNodesList[] = {12,240,2000};
+	for(int numNodes: numNodesList) {
+		writeNodeModel(numNodes,false);
+		writeNodeModel(numNodes,true);
+	}
+
+	for(int numNodes: numNodesList) {
+		testHeatingConservesEnergy(numNodes);
+	}
+	testHeatingMatchesCoarseTank(240);
+	testHeatingMatchesCoarseTank(2000);
+
+	for(int numNodes: numNodesList) {
+		std::remove(nodeModelFile(numNodes,false).c_str());
+		std::remove(nodeModelFile(numNodes,true).c_str());
+	}
+	//Made it through the gauntlet
+	return 0;
+}
+
+// a tank that is cold below and warm above, so the heat climbs over several runs of nodes
+void setStratifiedTank(HPWH &hpwh) {
+	ASSERTTRUE(hpwh.setTankLayerTemperatures({15.,15.,15.,18.,22.,27.,33.,38.,42.,45.,47.,48.}) == 0);
+}
+
+void testHeatingConservesEnergy(int numNodes) {
+	HPWH hpwh;
+	ASSERTTRUE(hpwh.HPWHinit_file(nodeModelFile(numNodes,true)) == 0);
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	hpwh.setDoConduction(false);
+	ASSERTTRUE(hpwh.setUA(0.) == 0);
+	setStratifiedTank(hpwh);
+
+	double startHeatContent_kJ = hpwh.getTankHeatContent_kJ();
+	double heatIn_kJ = 0.;
+	for(int minute = 0; minute < 180; minute++) {
+		ASSERTTRUE(hpwh.runOneStep(15.,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int i = 0; i < hpwh.getNumHeatSources(); i++) {
+			heatIn_kJ += KWH_TO_KJ(hpwh.getNthHeatSourceEnergyOutput(i));
+		}
+		// the heat never pushes a node past the setpoint or below the node under it
+		for(int node = 0; node < numNodes; node++) {
+			ASSERTTRUE(hpwh.getTankNodeTemp(node) <= hpwh.getSetpoint() + tankTolerance(1.e-9,hpwh.getSetpoint()));
+			ASSERTTRUE(node == 0 || hpwh.getTankNodeTemp(node) >= hpwh.getTankNodeTemp(node - 1));
+		}
+	}
+	ASSERTTRUE(heatIn_kJ > 0.);
+	// the kJ and kWh conversions of BTU differ in the fifth digit
+	ASSERTTRUE(relcmpd(hpwh.getTankHeatContent_kJ() - startHeatContent_kJ,heatIn_kJ,1.e-4));
+}
+
+// a finer tank takes about the same heat as the 12 node tank
+void testHeatingMatchesCoarseTank(int numNodes) {
+	HPWH hpwhCoarse,hpwhFine;
+	ASSERTTRUE(hpwhCoarse.HPWHinit_file(nodeModelFile(12)) == 0);
+	ASSERTTRUE(hpwhFine.HPWHinit_file(nodeModelFile(numNodes)) == 0);
+	for(HPWH *hpwh: {&hpwhCoarse,&hpwhFine}) {
+		hpwh->setVerbosity(HPWH::VRB_silent);
+		hpwh->setDoConduction(false);
+		setStratifiedTank(*hpwh);
+	}
+
+	double coarseIn_kWh = 0.,fineIn_kWh = 0.;
+	for(int minute = 0; minute < 180; minute++) {
+		ASSERTTRUE(hpwhCoarse.runOneStep(15.,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(hpwhFine.runOneStep(15.,0.,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int i = 0; i < hpwhCoarse.getNumHeatSources(); i++) {
+			coarseIn_kWh += hpwhCoarse.getNthHeatSourceEnergyInput(i);
+			fineIn_kWh += hpwhFine.getNthHeatSourceEnergyInput(i);
+		}
+	}
+	ASSERTTRUE(relcmpd(fineIn_kWh,coarseIn_kWh,0.05));
+	ASSERTTRUE(cmpd(hpwhFine.getTankHeatContent_kJ(),hpwhCoarse.getTankHeatContent_kJ(),0.01 * hpwhCoarse.getTankHeatContent_kJ()));
+}
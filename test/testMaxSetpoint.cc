@@ -226,6 +226,21 @@ void testResampling() {
 	// Check some expected values.
 	ASSERTTRUE(relcmpd(values[1], 20.)); //
 	ASSERTTRUE(relcmpd(values[5], 60.)); //
+
+// test the common node counts, which resample with tables made at compile time
+	std::vector<double> nodeValues24(24),nodeValues12(12),nodeValues96(96);
+	for(std::size_t i = 0; i < nodeValues24.size(); i++) {
+		nodeValues24[i] = static_cast<double>(i);
+	}
+	ASSERTTRUE(resampleIntensive(nodeValues12, nodeValues24));
+	ASSERTTRUE(relcmpd(nodeValues12[0], 0.5));
+	ASSERTTRUE(relcmpd(nodeValues12[11], 22.5));
+	ASSERTTRUE(resampleIntensive(nodeValues96, nodeValues12));
+	ASSERTTRUE(nodeValues96[0] == nodeValues12[0] && nodeValues96[8] == nodeValues12[1]);
+	ASSERTTRUE(nodeValues96[95] == nodeValues12[11]);
+	ASSERTTRUE(resampleExtensive(nodeValues24, nodeValues96));
+	ASSERTTRUE(relcmpd(nodeValues24[0], 4. * 0.5));
+	ASSERTTRUE(relcmpd(nodeValues24[23], 4. * 22.5));
 }
 
 void testSetTankTemps() {
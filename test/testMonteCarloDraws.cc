@@ -0,0 +1,218 @@
+/*
+ * unit tests for generateDraws and runMonteCarloDraws
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testGenerateDraws();
+void testTrialsMatchRunOneStep(string input);
+void testStatistics();
+void testMonteCarloInputs();
+
+const unsigned long long seed = 20240611ULL;
+const double inletT_C = F_TO_C(50.);
+const double ambientT_C = 19.;
+const double useT_C = F_TO_C(105.);
+
+int main()
+{
+	testGenerateDraws();
+	testTrialsMatchRunOneStep("AOSmithHPTU50");
+	testTrialsMatchRunOneStep("Sanden80");
+	testStatistics();
+	testMonteCarloInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// the draws are reproducible by seed and trial, follow the hourly weights and average out to the event rates
+void testGenerateDraws() {
+	const std::vector<HPWH::DrawEventType> household = HPWH::getResidentialDrawEvents(3.);
+	std::vector<double> first,again,otherTrial,otherSeed;
+	ASSERTTRUE(HPWH::generateDraws(household,7,seed,0,first) == 0);
+	ASSERTTRUE(HPWH::generateDraws(household,7,seed,0,again) == 0);
+	ASSERTTRUE(HPWH::generateDraws(household,7,seed,1,otherTrial) == 0);
+	ASSERTTRUE(HPWH::generateDraws(household,7,seed + 1,0,otherSeed) == 0);
+	ASSERTTRUE(first.size() == 7 * 1440);
+	ASSERTTRUE(first == again);
+	ASSERTTRUE(first != otherTrial);
+	ASSERTTRUE(first != otherSeed);
+
+	// the first days of a longer run are the days of a shorter one
+	std::vector<double> longer;
+	ASSERTTRUE(HPWH::generateDraws(household,14,seed,0,longer) == 0);
+	ASSERTTRUE(std::equal(first.begin(),first.end(),longer.begin()));
+
+	// fixed 10 L events at 4 L/min, only starting from 7 to 8 am, take three minutes each
+	std::vector<HPWH::DrawEventType> morning(1);
+	morning[0].eventsPerDay = 2.;
+	morning[0].meanVolume_L = 10.;
+	morning[0].flowRate_Lper_min = 4.;
+	morning[0].hourlyWeights.assign(24,0.);
+	morning[0].hourlyWeights[7] = 1.;
+	const int numDays = 2000;
+	std::vector<double> drawVolume_L;
+	ASSERTTRUE(HPWH::generateDraws(morning,numDays,seed,3,drawVolume_L) == 0);
+	double totalVolume_L = 0.;
+	for(int i = 0; i < numDays * 1440; i++) {
+		int minute = i % 1440;
+		if(minute < 7 * 60 || minute >= 8 * 60 + 2) {
+			ASSERTTRUE(drawVolume_L[i] == 0.);
+		}
+		totalVolume_L += drawVolume_L[i];
+	}
+	ASSERTTRUE(fabs(totalVolume_L / numDays / 20. - 1.) < 0.05);
+
+	// lognormal volumes keep their mean, and events that run past midnight carry over
+	std::vector<HPWH::DrawEventType> late(1);
+	late[0].eventsPerDay = 1.;
+	late[0].meanVolume_L = 100.;
+	late[0].sdVolume_L = 50.;
+	late[0].flowRate_Lper_min = 2.;
+	late[0].hourlyWeights.assign(24,0.);
+	late[0].hourlyWeights[23] = 1.;
+	ASSERTTRUE(HPWH::generateDraws(late,numDays,seed,4,drawVolume_L) == 0);
+	double earlyVolume_L = 0.;
+	totalVolume_L = 0.;
+	for(int i = 0; i < numDays * 1440; i++) {
+		if(i % 1440 < 60) {
+			earlyVolume_L += drawVolume_L[i];
+		}
+		totalVolume_L += drawVolume_L[i];
+	}
+	ASSERTTRUE(earlyVolume_L > 0.);
+	ASSERTTRUE(fabs(totalVolume_L / numDays / 100. - 1.) < 0.05);
+}
+
+// each trial is the model run through the draws generateDraws makes for it
+void testTrialsMatchRunOneStep(string input) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	const std::vector<HPWH::DrawEventType> household = HPWH::getResidentialDrawEvents(4.);
+	const int numTrials = 3,numDays = 2;
+	std::vector<HPWH::DrawTrialResult> trials;
+	HPWH::DrawStatistics statistics;
+	ASSERTTRUE(hpwh.runMonteCarloDraws(household,numTrials,numDays,seed,inletT_C,ambientT_C,useT_C,trials,statistics) == 0);
+	ASSERTTRUE(static_cast<int>(trials.size()) == numTrials);
+	ASSERTTRUE(statistics.numTrials == numTrials);
+
+	for(int k = 0; k < numTrials; k++) {
+		HPWH trialHPWH(hpwh);
+		std::vector<double> drawVolume_L;
+		ASSERTTRUE(HPWH::generateDraws(household,numDays,seed,k,drawVolume_L) == 0);
+		double totalDrawVolume_L = 0.,unmetDrawVolume_L = 0.,energyInput_kWh = 0.,minOutletT_C = 1000.;
+		for(double volume_L: drawVolume_L) {
+			ASSERTTRUE(trialHPWH.runOneStep(inletT_C,volume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+			for(int j = 0; j < trialHPWH.getNumHeatSources(); j++) {
+				energyInput_kWh += trialHPWH.getNthHeatSourceEnergyInput(j);
+			}
+			if(volume_L > 0.) {
+				totalDrawVolume_L += volume_L;
+				minOutletT_C = std::min(minOutletT_C,trialHPWH.getOutletTemp());
+				if(trialHPWH.getOutletTemp() < useT_C) {
+					unmetDrawVolume_L += volume_L;
+				}
+			}
+		}
+		ASSERTTRUE(trials[k].drawVolume_L == totalDrawVolume_L);
+		ASSERTTRUE(trials[k].unmetDrawVolume_L == unmetDrawVolume_L);
+		ASSERTTRUE(trials[k].energyInput_kWh == energyInput_kWh);
+		ASSERTTRUE(trials[k].minOutletT_C == minOutletT_C);
+		ASSERTTRUE(trials[k].meanOutletT_C >= minOutletT_C);
+	}
+
+	// the same trials come out of another run
+	std::vector<HPWH::DrawTrialResult> again;
+	HPWH::DrawStatistics againStatistics;
+	ASSERTTRUE(hpwh.runMonteCarloDraws(household,numTrials,numDays,seed,inletT_C,ambientT_C,useT_C,again,againStatistics) == 0);
+	for(int k = 0; k < numTrials; k++) {
+		ASSERTTRUE(again[k].unmetDrawVolume_L == trials[k].unmetDrawVolume_L);
+		ASSERTTRUE(again[k].energyInput_kWh == trials[k].energyInput_kWh);
+	}
+	ASSERTTRUE(againStatistics.meanEnergyInput_kWh == statistics.meanEnergyInput_kWh);
+}
+
+// a small tank for a large household falls short more often and further than a large one for a small household
+void testStatistics() {
+	HPWH small,large;
+	getHPWHObject(small,"restankRealistic");
+	getHPWHObject(large,"Sanden80");
+	small.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(small.setTankSize(GAL_TO_L(20.),HPWH::UNITS_L,true) == 0);
+	const int numTrials = 20,numDays = 2;
+
+	std::vector<HPWH::DrawTrialResult> trials;
+	HPWH::DrawStatistics smallStatistics,largeStatistics;
+	ASSERTTRUE(small.runMonteCarloDraws(HPWH::getResidentialDrawEvents(6.),numTrials,numDays,seed,inletT_C,ambientT_C,useT_C,
+		trials,smallStatistics) == 0);
+	ASSERTTRUE(smallStatistics.shortfallProbability > 0.5);
+	ASSERTTRUE(smallStatistics.meanUnmetFraction > 0.);
+	ASSERTTRUE(smallStatistics.p95UnmetFraction >= smallStatistics.meanUnmetFraction);
+	ASSERTTRUE(smallStatistics.maxUnmetFraction >= smallStatistics.p95UnmetFraction);
+	ASSERTTRUE(smallStatistics.meanShortfallEnergy_kWh > 0.);
+	ASSERTTRUE(smallStatistics.minOutletT_C < useT_C);
+
+	double shortfallProbability = 0.;
+	for(const HPWH::DrawTrialResult &trial: trials) {
+		if(trial.unmetDrawVolume_L > 0.) {
+			shortfallProbability += 1. / numTrials;
+			ASSERTTRUE(trial.numShortfallSteps > 0);
+		}
+		ASSERTTRUE(trial.minOutletT_C >= smallStatistics.minOutletT_C);
+	}
+	ASSERTTRUE(cmpd(shortfallProbability,smallStatistics.shortfallProbability));
+
+	ASSERTTRUE(large.runMonteCarloDraws(HPWH::getResidentialDrawEvents(1.),numTrials,numDays,seed,inletT_C,ambientT_C,useT_C,
+		trials,largeStatistics) == 0);
+	ASSERTTRUE(largeStatistics.shortfallProbability < smallStatistics.shortfallProbability);
+	ASSERTTRUE(largeStatistics.meanUnmetFraction < smallStatistics.meanUnmetFraction);
+	ASSERTTRUE(largeStatistics.meanOutletT_C > smallStatistics.meanOutletT_C);
+	ASSERTTRUE(largeStatistics.meanEnergyInput_kWh > 0.);
+}
+
+void testMonteCarloInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	const std::vector<HPWH::DrawEventType> household = HPWH::getResidentialDrawEvents(2.);
+	std::vector<HPWH::DrawTrialResult> trials;
+	HPWH::DrawStatistics statistics;
+	std::vector<double> drawVolume_L;
+
+	ASSERTTRUE(hpwh.runMonteCarloDraws(household,0,1,seed,inletT_C,ambientT_C,useT_C,trials,statistics) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runMonteCarloDraws(household,1,0,seed,inletT_C,ambientT_C,useT_C,trials,statistics) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(HPWH::generateDraws(household,0,seed,0,drawVolume_L) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(HPWH::generateDraws(household,1,seed,-1,drawVolume_L) == HPWH::HPWH_ABORT);
+
+	std::vector<HPWH::DrawEventType> bad = household;
+	bad[0].flowRate_Lper_min = 0.;
+	ASSERTTRUE(HPWH::generateDraws(bad,1,seed,0,drawVolume_L) == HPWH::HPWH_ABORT);
+	bad = household;
+	bad[0].hourlyWeights.resize(12);
+	ASSERTTRUE(hpwh.runMonteCarloDraws(bad,1,1,seed,inletT_C,ambientT_C,useT_C,trials,statistics) == HPWH::HPWH_ABORT);
+	bad = household;
+	bad[0].hourlyWeights.assign(24,0.);
+	ASSERTTRUE(HPWH::generateDraws(bad,1,seed,0,drawVolume_L) == HPWH::HPWH_ABORT);
+
+	// the draws are made in one minute steps
+	hpwh.setMinutesPerStep(10.);
+	ASSERTTRUE(hpwh.runMonteCarloDraws(household,1,1,seed,inletT_C,ambientT_C,useT_C,trials,statistics) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(trials.empty());
+
+	// no events make no draws
+	std::vector<HPWH::DrawEventType> none(1);
+	none[0].meanVolume_L = 1.;
+	none[0].flowRate_Lper_min = 1.;
+	ASSERTTRUE(HPWH::generateDraws(none,2,seed,0,drawVolume_L) == 0);
+	for(double volume_L: drawVolume_L) {
+		ASSERTTRUE(volume_L == 0.);
+	}
+}
@@ -0,0 +1,154 @@
+/*
+ * unit tests for copying HPWH objects and runNStepsParallel
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testCopyRunsIndependently(string input);
+void testParallelMatchesSequential(string input);
+void testParallelThermocline(string input);
+void testParallelInputs();
+
+const int numSteps = 3 * 1440;
+std::vector<double> inletT_C(numSteps,F_TO_C(50.));
+std::vector<double> drawVolume_L(numSteps,0.);
+std::vector<double> ambientT_C(numSteps,20.);
+std::vector<HPWH::DRMODES> drStatus(numSteps,HPWH::DR_ALLOW);
+
+int main()
+{
+	// morning and evening showers plus a small draw every three hours, with a daily swing in ambient temperature
+	for(int i = 0; i < numSteps; i++) {
+		int minute = i % 1440;
+		if((minute >= 420 && minute < 450) || (minute >= 1140 && minute < 1160)) {
+			drawVolume_L[i] = 6.;
+		}
+		if(minute % 180 == 0) {
+			drawVolume_L[i] += 10.;
+		}
+		ambientT_C[i] = 15. + 5. * sin(2. * 3.14159265358979 * minute / 1440.);
+	}
+
+	const string models[] = {"AOSmithHPTU50", "Rheem2020Prem50", "ColmacCxV_5_SP", "Sanden80"};
+	for(const string &model: models) {
+		testCopyRunsIndependently(model);
+		testParallelMatchesSequential(model);
+	}
+	testParallelThermocline("restankRealistic");
+	testParallelInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+double totalEnergyInput(HPWH &hpwh) {
+	double input_kWh = 0.;
+	for(int i = 0; i < hpwh.getNumHeatSources(); i++) {
+		input_kWh += hpwh.getNthHeatSourceEnergyInput(i);
+	}
+	return input_kWh;
+}
+
+double maxTankTDifference(HPWH &hpwh1,HPWH &hpwh2) {
+	std::vector<double> tankT1_C,tankT2_C;
+	hpwh1.getTankTemps(tankT1_C);
+	hpwh2.getTankTemps(tankT2_C);
+	double maxDiff_C = 0.;
+	for(size_t i = 0; i < tankT1_C.size(); i++) {
+		maxDiff_C = std::max(maxDiff_C,fabs(tankT1_C[i] - tankT2_C[i]));
+	}
+	return maxDiff_C;
+}
+
+void testCopyRunsIndependently(string input) {
+	HPWH hpwhOriginal,hpwhReference;
+	getHPWHObject(hpwhOriginal,input);
+	getHPWHObject(hpwhReference,input);
+	for(int i = 0; i < 600; i++) {
+		hpwhOriginal.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]);
+		hpwhReference.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]);
+	}
+
+	// the copy's heat sources and logics must look at the copy, not at the original
+	HPWH hpwhCopy = hpwhOriginal;
+	ASSERTTRUE(hpwhOriginal.setTankToTemperature(inletT_C[0]) == 0);
+	for(int i = 600; i < 1440; i++) {
+		ASSERTTRUE(hpwhCopy.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		hpwhReference.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]);
+		ASSERTTRUE(totalEnergyInput(hpwhCopy) == totalEnergyInput(hpwhReference));
+		ASSERTTRUE(hpwhCopy.getOutletTemp() == hpwhReference.getOutletTemp());
+	}
+	ASSERTTRUE(maxTankTDifference(hpwhCopy,hpwhReference) == 0.);
+}
+
+void testParallelMatchesSequential(string input) {
+	HPWH hpwhSequential,hpwhParallel,hpwhExact;
+	getHPWHObject(hpwhSequential,input);
+	hpwhParallel = hpwhSequential;
+	hpwhExact = hpwhSequential;
+
+	ASSERTTRUE(hpwhSequential.runNSteps(numSteps,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data()) == 0);
+
+	// converged to the default tolerance, the segments agree with the sequential run to well within a degree
+	const int numSegments = 6;
+	ASSERTTRUE(hpwhParallel.runNStepsParallel(numSteps,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data(),numSegments) == 0);
+	ASSERTTRUE(hpwhParallel.getNumPararealIterations() <= numSegments);
+	ASSERTTRUE(relcmpd(totalEnergyInput(hpwhParallel),totalEnergyInput(hpwhSequential),0.01));
+	ASSERTTRUE(maxTankTDifference(hpwhParallel,hpwhSequential) < 0.1);
+
+	// with no tolerance, the iterations end on the sequential result
+	ASSERTTRUE(hpwhExact.runNStepsParallel(numSteps,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data(),numSegments,0.) == 0);
+	ASSERTTRUE(hpwhExact.getNumPararealIterations() <= numSegments);
+	ASSERTTRUE(relcmpd(totalEnergyInput(hpwhExact),totalEnergyInput(hpwhSequential),1.e-9));
+	ASSERTTRUE(maxTankTDifference(hpwhExact,hpwhSequential) == 0.);
+	ASSERTTRUE(cmpd(hpwhExact.getStandbyLosses(),hpwhSequential.getStandbyLosses(),1.e-9));
+	ASSERTTRUE(cmpd(hpwhExact.getOutletTemp(),hpwhSequential.getOutletTemp(),1.e-9));
+}
+
+void testParallelThermocline(string input) {
+	HPWH hpwhSequential,hpwhParallel;
+	getHPWHObject(hpwhSequential,input);
+	hpwhSequential.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwhSequential.setTankModel(HPWH::TANK_MODEL_THERMOCLINE) == 0);
+	hpwhParallel = hpwhSequential;
+
+	ASSERTTRUE(hpwhSequential.runNSteps(numSteps,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data()) == 0);
+
+	// the corrections go through the tank model, so they converge well before the segments have all been rerun in turn
+	const int numSegments = 6;
+	ASSERTTRUE(hpwhParallel.runNStepsParallel(numSteps,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data(),numSegments) == 0);
+	ASSERTTRUE(hpwhParallel.getNumPararealIterations() <= numSegments / 2);
+	ASSERTTRUE(relcmpd(totalEnergyInput(hpwhParallel),totalEnergyInput(hpwhSequential),0.01));
+	ASSERTTRUE(maxTankTDifference(hpwhParallel,hpwhSequential) < 0.1);
+}
+
+void testParallelInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+
+	ASSERTTRUE(hpwh.runNStepsParallel(0,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data(),4) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runNStepsParallel(numSteps,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data(),0) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runNStepsParallel(numSteps,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data(),4,-1.) == HPWH::HPWH_ABORT);
+
+	// one segment is just the sequential run
+	ASSERTTRUE(hpwh.runNStepsParallel(60,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),
+		ambientT_C.data(),drStatus.data(),1) == 0);
+	ASSERTTRUE(hpwh.getNumPararealIterations() == 1);
+}
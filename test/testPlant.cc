@@ -0,0 +1,209 @@
+/*
+ * unit tests for HPWHPlant
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testSingleTank(string input);
+void testSeries();
+void testParallel();
+void testRunNStepsMatchesRunOneStep();
+void testSwingTank();
+void testPlantInputs();
+
+const int N = 1440 * 2;
+std::vector<double> inletT_C(N,F_TO_C(50.));
+std::vector<double> drawVolume_L(N,0.);
+std::vector<double> ambientT_C(N,19.);
+std::vector<HPWH::DRMODES> drStatus(N,HPWH::DR_ALLOW);
+
+int main()
+{
+	// morning and evening draws, with an afternoon shed
+	for(int i = 0; i < N; i++) {
+		double hour = (i % 1440) / 60.;
+		if((hour >= 6. && hour < 8.) || (hour >= 18. && hour < 20.5)) {
+			drawVolume_L[i] = 12.;
+		} else if(hour >= 12. && hour < 12.5) {
+			drawVolume_L[i] = 4.;
+		}
+		if(hour >= 15. && hour < 17.) {
+			drStatus[i] = HPWH::DR_LOC;
+		}
+	}
+
+	testSingleTank("AOSmithHPTU50");
+	testSingleTank("Sanden80");
+	testSeries();
+	testParallel();
+	testRunNStepsMatchesRunOneStep();
+	testSwingTank();
+	testPlantInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// a plant of one tank runs as the tank does
+void testSingleTank(string input) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	HPWHPlant plant;
+	ASSERTTRUE(plant.addStage({hpwh}) == 0);
+	for(int i = 0; i < N; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(plant.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(plant.getOutletTemp() == hpwh.getOutletTemp());
+		ASSERTTRUE(plant.getStandbyLosses_kWh() == hpwh.getStandbyLosses());
+		ASSERTTRUE(plant.getTankHeatContent_kJ() == hpwh.getTankHeatContent_kJ());
+	}
+}
+
+// a plant of tanks in series runs as the tanks wired by hand, each fed the outlet of the one before
+void testSeries() {
+	HPWH first,second;
+	getHPWHObject(first,"AOSmithHPTU50");
+	getHPWHObject(second,"restankRealistic");
+	HPWHPlant plant;
+	ASSERTTRUE(plant.addStage({first}) == 0);
+	ASSERTTRUE(plant.addStage({second}) == 0);
+	ASSERTTRUE(plant.getNumStages() == 2);
+	for(int i = 0; i < N; i++) {
+		ASSERTTRUE(first.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		double secondInletT_C = (drawVolume_L[i] > 0.) ? first.getOutletTemp() : inletT_C[i];
+		ASSERTTRUE(second.runOneStep(secondInletT_C,drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(plant.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(plant.getOutletTemp() == second.getOutletTemp());
+		double energyInput_kWh = 0.;
+		for(HPWH *tank: {&first,&second}) {
+			for(int j = 0; j < tank->getNumHeatSources(); j++) {
+				energyInput_kWh += tank->getNthHeatSourceEnergyInput(j);
+			}
+		}
+		ASSERTTRUE(plant.getEnergyInput_kWh() == energyInput_kWh);
+	}
+	for(int j = 0; j < second.getNumNodes(); j++) {
+		ASSERTTRUE(plant.getTank(1,0).getTankNodeTemp(j) == second.getTankNodeTemp(j));
+	}
+}
+
+// a bank of identical tanks sharing the flow evenly delivers as one of them with its share of the flow
+void testParallel() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Rheem2020Prem50");
+	HPWHPlant plant;
+	ASSERTTRUE(plant.addStage({hpwh,hpwh,hpwh}) == 0);
+	ASSERTTRUE(plant.getNumTanks(0) == 3);
+	for(int i = 0; i < N; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C[i],drawVolume_L[i] / 3.,ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(plant.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(cmpd(plant.getOutletTemp(),hpwh.getOutletTemp()));
+		ASSERTTRUE(cmpd(plant.getTankHeatContent_kJ(),3. * hpwh.getTankHeatContent_kJ()));
+	}
+
+	// by default the flow is split by tank volume
+	HPWH larger(hpwh);
+	ASSERTTRUE(larger.setTankSize(2. * hpwh.getTankSize(),HPWH::UNITS_L,true) == 0);
+	HPWHPlant byVolume;
+	ASSERTTRUE(byVolume.addStage({hpwh,larger}) == 0);
+	ASSERTTRUE(byVolume.runOneStep(inletT_C[420],30.,19.,19.,HPWH::DR_ALLOW) == 0);
+	HPWH alone(hpwh),largerAlone(larger);
+	ASSERTTRUE(alone.runOneStep(inletT_C[420],10.,19.,19.,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(largerAlone.runOneStep(inletT_C[420],20.,19.,19.,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(cmpd(byVolume.getTank(0,0).getTankHeatContent_kJ(),alone.getTankHeatContent_kJ()));
+	ASSERTTRUE(cmpd(byVolume.getTank(0,1).getTankHeatContent_kJ(),largerAlone.getTankHeatContent_kJ()));
+}
+
+// running a stage at a time, its bank on threads, gives the steps of runOneStep
+void testRunNStepsMatchesRunOneStep() {
+	HPWH primary,swing;
+	getHPWHObject(primary,"Sanden80");
+	getHPWHObject(swing,"restankRealistic");
+	HPWHPlant stepped;
+	ASSERTTRUE(stepped.addStage({primary,primary},{0.4,0.6}) == 0);
+	ASSERTTRUE(stepped.addStage({swing}) == 0);
+	HPWHPlant batched(stepped);
+
+	std::vector<double> outletT_C(N);
+	ASSERTTRUE(batched.runNSteps(N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),outletT_C.data()) == 0);
+	double energyInput_kWh = 0.,standbyLosses_kWh = 0.,outletTVolume_CL = 0.,totalDrawVolume_L = 0.;
+	for(int i = 0; i < N; i++) {
+		ASSERTTRUE(stepped.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(outletT_C[i] == stepped.getOutletTemp());
+		energyInput_kWh += stepped.getEnergyInput_kWh();
+		standbyLosses_kWh += stepped.getStandbyLosses_kWh();
+		outletTVolume_CL += stepped.getOutletTemp() * drawVolume_L[i];
+		totalDrawVolume_L += drawVolume_L[i];
+	}
+	ASSERTTRUE(relcmpd(batched.getEnergyInput_kWh(),energyInput_kWh));
+	ASSERTTRUE(relcmpd(batched.getStandbyLosses_kWh(),standbyLosses_kWh));
+	ASSERTTRUE(relcmpd(batched.getOutletTemp(),outletTVolume_CL / totalDrawVolume_L));
+	ASSERTTRUE(batched.getTankHeatContent_kJ() == stepped.getTankHeatContent_kJ());
+	for(int stage = 0; stage < stepped.getNumStages(); stage++) {
+		for(int tank = 0; tank < stepped.getNumTanks(stage); tank++) {
+			for(int j = 0; j < stepped.getTank(stage,tank).getNumNodes(); j++) {
+				ASSERTTRUE(batched.getTank(stage,tank).getTankNodeTemp(j) == stepped.getTank(stage,tank).getTankNodeTemp(j));
+			}
+		}
+	}
+}
+
+// a swing tank after a heat pump bank holds the delivery temperature the bank alone lets fall
+void testSwingTank() {
+	HPWH primary,swing;
+	getHPWHObject(primary,"Sanden80");
+	getHPWHObject(swing,"restankRealistic");
+	ASSERTTRUE(swing.setSetpoint(F_TO_C(125.)) == 0);
+	ASSERTTRUE(swing.setTankToTemperature(F_TO_C(125.)) == 0);
+
+	std::vector<double> heavyDrawVolume_L(N);
+	for(int i = 0; i < N; i++) {
+		heavyDrawVolume_L[i] = 3. * drawVolume_L[i];
+	}
+	HPWHPlant bank,plant;
+	ASSERTTRUE(bank.addStage({primary,primary}) == 0);
+	ASSERTTRUE(plant.initSwingTank(primary,2,swing) == 0);
+	ASSERTTRUE(plant.getNumStages() == 2 && plant.getNumTanks(0) == 2 && plant.getNumTanks(1) == 1);
+	std::vector<double> bankOutletT_C(N),plantOutletT_C(N);
+	ASSERTTRUE(bank.runNSteps(N,inletT_C.data(),heavyDrawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),bankOutletT_C.data()) == 0);
+	ASSERTTRUE(plant.runNSteps(N,inletT_C.data(),heavyDrawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),plantOutletT_C.data()) == 0);
+	double minBankOutletT_C = 100.,minPlantOutletT_C = 100.;
+	for(int i = 0; i < N; i++) {
+		if(heavyDrawVolume_L[i] > 0.) {
+			minBankOutletT_C = std::min(minBankOutletT_C,bankOutletT_C[i]);
+			minPlantOutletT_C = std::min(minPlantOutletT_C,plantOutletT_C[i]);
+		}
+	}
+	ASSERTTRUE(minPlantOutletT_C > minBankOutletT_C);
+	ASSERTTRUE(plant.getEnergyInput_kWh() > bank.getEnergyInput_kWh());
+}
+
+void testPlantInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	HPWHPlant plant;
+	ASSERTTRUE(plant.runOneStep(10.,1.,19.,19.,HPWH::DR_ALLOW) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.runNSteps(N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data()) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.addStage({}) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.addStage({hpwh,hpwh},{1.}) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.addStage({hpwh,hpwh},{1.,0.}) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.initSwingTank(hpwh,0,hpwh) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.getNumStages() == 0);
+	ASSERTTRUE(plant.getNumTanks(0) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.addStage({hpwh}) == 0);
+	ASSERTTRUE(plant.runNSteps(0,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data()) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(plant.runOneStep(10.,0.,19.,19.,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(plant.getOutletTemp() == 0.);
+}
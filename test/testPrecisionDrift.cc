@@ -0,0 +1,91 @@
+/*
+ * Measures the drift in annual energy of a float tank build (HPWH_FLOAT_TANK) from the double build
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+const string referenceFile = "ref/precisionDrift.csv";
+const double maxFloatDrift = 0.005; // the allowed drift of a float build from the double build
+
+double annualEnergyInput_kWh(string input);
+
+// Runs each preset in ref/precisionDrift.csv for a year and compares its heat source input energy
+// with the double build's, which is in the file.  "testPrecisionDrift write" remakes the file,
+// and must be run from a double build.
+int main(int argc,char *argv[])
+{
+	if(argc > 1 && string(argv[1]) == "write") {
+		ASSERTTRUE(sizeof(HPWH::tankReal_t) == sizeof(double));
+		std::ifstream oldReference(referenceFile);
+		std::vector<string> models;
+		string line;
+		std::getline(oldReference,line);
+		while(std::getline(oldReference,line)) {
+			models.push_back(line.substr(0,line.find(',')));
+		}
+		oldReference.close();
+
+		std::ofstream reference(referenceFile);
+		reference << "model,annualInput_kWh\n";
+		reference.precision(12);
+		for(string &model: models) {
+			reference << model << "," << annualEnergyInput_kWh(model) << "\n";
+		}
+		return 0;
+	}
+
+	std::ifstream reference(referenceFile);
+	ASSERTTRUE(reference.is_open());
+	string line;
+	std::getline(reference,line);
+	cout << "model, double kWh, " << (sizeof(HPWH::tankReal_t) == sizeof(float) ? "float" : "double") << " kWh, drift\n";
+	while(std::getline(reference,line)) {
+		string model = line.substr(0,line.find(','));
+		double reference_kWh = std::stod(line.substr(line.find(',') + 1));
+		double energyInput_kWh = annualEnergyInput_kWh(model);
+		double drift = (energyInput_kWh - reference_kWh) / reference_kWh;
+		cout << model << ", " << reference_kWh << ", " << energyInput_kWh << ", " << drift * 100. << " %\n";
+
+		if(sizeof(HPWH::tankReal_t) == sizeof(double)) {
+			ASSERTTRUE(relcmpd(energyInput_kWh,reference_kWh,1.e-9));
+		} else {
+			ASSERTTRUE(fabs(drift) < maxFloatDrift);
+		}
+	}
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// a year of the DOE 24 hour draws, with the mains temperature swinging over the seasons
+double annualEnergyInput_kWh(string input) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+
+	const int drawStart_min[] = {0,60,120,180,240,300};
+	const double ambientT_C = 19.7;
+	double energyInput_kWh = 0.;
+	for(int day = 0; day < 365; day++) {
+		double inletT_C = 14. - 5. * cos(2. * 3.14159 * (day - 30) / 365.);
+		for(int minute = 0; minute < 1440; minute++) {
+			double drawVolume_L = 0.;
+			for(int draw = 0; draw < 6; draw++) {
+				if(minute >= drawStart_min[draw] && minute < drawStart_min[draw] + 7) {
+					drawVolume_L = GAL_TO_L(10.7 / 7.);
+				}
+			}
+			ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+			for(int i = 0; i < hpwh.getNumHeatSources(); i++) {
+				energyInput_kWh += hpwh.getNthHeatSourceEnergyInput(i);
+			}
+		}
+	}
+	return energyInput_kWh;
+}
@@ -0,0 +1,224 @@
+/*
+ * unit tests for rate and rateModels
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testRatingResistance();
+void testRatingParts(string input);
+void testRatingLeavesModel(string input);
+void testRatingFixedSetpoint();
+void testRateModelsMatchesRate();
+void testRatingInputs();
+void testRatingPublished(string input,double publishedFHR_gal,double publishedUEF);
+double fileDayUEF(string input);
+
+int main()
+{
+	testRatingResistance();
+	testRatingParts("AOSmithHPTU50");
+	testRatingParts("Sanden80");
+	testRatingLeavesModel("AOSmithHPTU50");
+	testRatingFixedSetpoint();
+	testRateModelsMatchesRate();
+	testRatingInputs();
+	testRatingPublished("AOSmithHPTU50",67.,3.45);
+	testRatingPublished("Rheem2020Prem50",67.,3.75);
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// a resistance tank recovers with all of its input, less the standby losses of the recovery
+void testRatingResistance() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"restankRealistic");
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.rate(rating) == 0);
+	ASSERTTRUE(rating.recoveryEfficiency > 0.95 && rating.recoveryEfficiency <= 1.);
+	ASSERTTRUE(rating.UEF > 0.75 && rating.UEF < rating.recoveryEfficiency);
+	ASSERTTRUE(rating.drawPattern == HPWH::DRAW_PATTERN_MEDIUM);
+	ASSERTTRUE(L_TO_GAL(rating.firstHourRating_L) >= 51. && L_TO_GAL(rating.firstHourRating_L) < 75.);
+}
+
+// stopping early gives the same values as the whole test, and leaves the rest at 0
+void testRatingParts(string input) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	HPWH::Rating all,firstHour,recovery;
+	ASSERTTRUE(hpwh.rate(all) == 0);
+	ASSERTTRUE(hpwh.rate(firstHour,HPWH::RATE_FHR) == 0);
+	ASSERTTRUE(hpwh.rate(recovery,HPWH::RATE_RE) == 0);
+
+	ASSERTTRUE(all.recoveryEfficiency > 1. && all.UEF > 1.);
+	ASSERTTRUE(firstHour.firstHourRating_L == all.firstHourRating_L);
+	ASSERTTRUE(firstHour.drawPattern == all.drawPattern);
+	ASSERTTRUE(firstHour.recoveryEfficiency == 0. && firstHour.UEF == 0.);
+	ASSERTTRUE(recovery.firstHourRating_L == all.firstHourRating_L);
+	ASSERTTRUE(recovery.recoveryEfficiency == all.recoveryEfficiency);
+	ASSERTTRUE(recovery.UEF == 0. && recovery.adjustedDailyEnergy_kWh == 0.);
+}
+
+// rating runs on a copy, so the model goes on from where it was
+void testRatingLeavesModel(string input) {
+	HPWH hpwh,reference;
+	getHPWHObject(hpwh,input);
+	ASSERTTRUE(hpwh.setSetpoint(45.) == 0);
+	for(int i = 0; i < 30; i++) {
+		ASSERTTRUE(hpwh.runOneStep(10.,GAL_TO_L(1.),20.,20.,HPWH::DR_ALLOW) == 0);
+	}
+	reference = hpwh;
+
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.rate(rating) == 0);
+	ASSERTTRUE(hpwh.getSetpoint() == 45.);
+	for(int i = 0; i < 120; i++) {
+		ASSERTTRUE(hpwh.runOneStep(10.,0.,20.,20.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(reference.runOneStep(10.,0.,20.,20.,HPWH::DR_ALLOW) == 0);
+		for(int j = 0; j < hpwh.getNumNodes(); j++) {
+			ASSERTTRUE(hpwh.getTankNodeTemp(j) == reference.getTankNodeTemp(j));
+		}
+	}
+}
+
+// a model with a fixed setpoint is rated at its own setpoint, so a hotter tank rates higher
+void testRatingFixedSetpoint() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Sanden80");
+	ASSERTTRUE(hpwh.isSetpointFixed());
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.rate(rating) == 0);
+	ASSERTTRUE(hpwh.getSetpoint() == 65.);
+	ASSERTTRUE(L_TO_GAL(rating.firstHourRating_L) > 80.);
+	ASSERTTRUE(rating.drawPattern == HPWH::DRAW_PATTERN_HIGH);
+}
+
+// the parallel ratings of a sweep of variants are those of rating each in turn
+void testRateModelsMatchesRate() {
+	std::vector<HPWH> variants;
+	for(string input: {"AOSmithHPTU50","Rheem2020Prem50"}) {
+		for(double size_gal: {40.,50.,65.,80.}) {
+			HPWH hpwh;
+			getHPWHObject(hpwh,input);
+			ASSERTTRUE(hpwh.setTankSize_adjustUA(size_gal,HPWH::UNITS_GAL,true) == 0);
+			variants.push_back(hpwh);
+		}
+	}
+	for(double scale: {0.05,0.1,0.25,0.5}) {
+		HPWH hpwh;
+		getHPWHObject(hpwh,"TamScalable_SP");
+		ASSERTTRUE(hpwh.setScaleHPWHCapacityCOP(scale,1.) == 0);
+		ASSERTTRUE(hpwh.setTankSize_adjustUA(80.,HPWH::UNITS_GAL,true) == 0);
+		variants.push_back(hpwh);
+	}
+
+	std::vector<HPWH::Rating> ratings;
+	ASSERTTRUE(HPWH::rateModels(variants,ratings) == 0);
+	ASSERTTRUE(ratings.size() == variants.size());
+	for(std::size_t i = 0; i < variants.size(); i++) {
+		HPWH::Rating rating;
+		ASSERTTRUE(variants[i].rate(rating) == 0);
+		ASSERTTRUE(ratings[i].firstHourRating_L == rating.firstHourRating_L);
+		ASSERTTRUE(ratings[i].drawPattern == rating.drawPattern);
+		ASSERTTRUE(ratings[i].recoveryEfficiency == rating.recoveryEfficiency);
+		ASSERTTRUE(ratings[i].UEF == rating.UEF);
+		ASSERTTRUE(ratings[i].adjustedDailyEnergy_kWh == rating.adjustedDailyEnergy_kWh);
+	}
+
+	// a bigger tank holds more of the first hour's water
+	ASSERTTRUE(ratings[3].firstHourRating_L > ratings[0].firstHourRating_L);
+}
+
+// The presets are fit to lab measurements rather than to the ratings, and their heat sources recover more
+// slowly in the first hour than the rated units do, so the first-hour rating is checked to 25 % and the
+// UEF to 10 %. Both units are rated on the medium draw pattern.
+void testRatingPublished(string input,double publishedFHR_gal,double publishedUEF) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.rate(rating) == 0);
+	ASSERTTRUE(rating.drawPattern == HPWH::DRAW_PATTERN_MEDIUM);
+	ASSERTTRUE(relcmpd(L_TO_GAL(rating.firstHourRating_L),publishedFHR_gal,0.25));
+	ASSERTTRUE(relcmpd(rating.UEF,publishedUEF,0.10));
+	// the file-based day draws the DOE pattern as measured, a few percent off its nominal volumes and flows
+	ASSERTTRUE(relcmpd(rating.UEF,fileDayUEF(input),0.01));
+}
+
+// the UEF of the draws of the file-based testDOE_24hr50 day, run at the rating conditions and worked out as the DOE test does
+double fileDayUEF(string input) {
+	const double inletT_C = F_TO_C(58.);
+	const double ambientT_C = F_TO_C(67.5);
+	const double nominalRise_C = F_TO_C(125.) - F_TO_C(58.);
+
+	std::vector<double> draws_gal(1440,0.);
+	std::ifstream drawFile("testDOE_24hr50/drawschedule.csv");
+	string line;
+	std::getline(drawFile,line);
+	std::getline(drawFile,line);
+	int minute;
+	char comma;
+	double volume_gal;
+	while(drawFile >> minute >> comma >> volume_gal) {
+		draws_gal[minute] = volume_gal;
+	}
+
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	ASSERTTRUE(hpwh.setSetpoint(F_TO_C(125.)) == 0);
+	ASSERTTRUE(hpwh.resetTankToSetpoint() == 0);
+	const double startHeat_kJ = hpwh.getTankHeatContent_kJ();
+
+	double energyInput_kJ = 0.,deliveredHeat_kJ = 0.,drawVolume_L = 0.,recoveryEfficiency = 0.;
+	bool hasStartedHeating = false;
+	for(minute = 0; minute < 1440; minute++) {
+		double stepDraw_L = GAL_TO_L(draws_gal[minute]);
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,stepDraw_L,ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int i = 0; i < hpwh.getNumHeatSources(); i++) {
+			energyInput_kJ += KWH_TO_KJ(hpwh.getNthHeatSourceEnergyInput(i));
+		}
+		deliveredHeat_kJ += stepDraw_L * HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC * (hpwh.getOutletTemp() - inletT_C);
+		drawVolume_L += stepDraw_L;
+
+		// the recovery efficiency comes from the first recovery, which ends when the heat sources first cut out
+		bool isHeating = false;
+		for(int i = 0; i < hpwh.getNumHeatSources(); i++) {
+			isHeating = isHeating || hpwh.isNthHeatSourceRunning(i);
+		}
+		if(isHeating) {
+			hasStartedHeating = true;
+		} else if(hasStartedHeating && recoveryEfficiency == 0.) {
+			recoveryEfficiency = (deliveredHeat_kJ + hpwh.getTankHeatContent_kJ() - startHeat_kJ) / energyInput_kJ;
+		}
+	}
+	ASSERTTRUE(recoveryEfficiency > 0.);
+
+	const double nominalHeat_kJ = drawVolume_L * HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC * nominalRise_C;
+	double adjustedEnergy_kJ = energyInput_kJ - (hpwh.getTankHeatContent_kJ() - startHeat_kJ) / recoveryEfficiency;
+	adjustedEnergy_kJ += (nominalHeat_kJ - deliveredHeat_kJ) / recoveryEfficiency;
+	return nominalHeat_kJ / adjustedEnergy_kJ;
+}
+
+void testRatingInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"StorageTank");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	HPWH::Rating rating;
+	ASSERTTRUE(hpwh.rate(rating) == HPWH::HPWH_ABORT);
+
+	HPWH uninitialized;
+	uninitialized.setVerbosity(HPWH::VRB_silent);
+	std::vector<HPWH> variants(2);
+	getHPWHObject(variants[0],"AOSmithHPTU50");
+	variants[1] = uninitialized;
+	std::vector<HPWH::Rating> ratings;
+	ASSERTTRUE(HPWH::rateModels(variants,ratings) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(ratings[0].UEF > 1.);
+}
@@ -0,0 +1,271 @@
+/*
+ * unit tests for the recirculation loop of setRecirculationLoop
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testLoopMatchesSecondInlet(string input);
+void testLoopLoss();
+void testPumpSchedule();
+void testLongSteps();
+void testLoopOverManySteps();
+void testLoopInputs();
+
+const double loopFlow_Lper_min = 4.;
+const double loopUA_kJperHrC = 60.;
+const double loopAmbientT_C = 20.;
+
+// the mean temperature of the volume drawn off the top of the tank
+double topVolumeT_C(const HPWH &hpwh,double volume_L) {
+	const double nodeVolume_L = hpwh.getTankSize() / hpwh.getNumNodes();
+	const double suppliedVolume_L = std::min(volume_L,hpwh.getTankSize());
+	double supplyTV_CL = 0.;
+	double volumeLeft_L = suppliedVolume_L;
+	for(int i = hpwh.getNumNodes() - 1; i >= 0 && volumeLeft_L > 0.; i--) {
+		double nodeDraw_L = std::min(nodeVolume_L,volumeLeft_L);
+		supplyTV_CL += hpwh.getTankNodeTemp(i) * nodeDraw_L;
+		volumeLeft_L -= nodeDraw_L;
+	}
+	return supplyTV_CL / suppliedVolume_L;
+}
+
+double drawAt(int i) {
+	int minute = i % 1440;
+	return ((minute >= 420 && minute < 460) || (minute >= 1140 && minute < 1170)) ? 8. : 0.;
+}
+
+int main()
+{
+	testLoopMatchesSecondInlet("AOSmithHPTU50");
+	testLoopMatchesSecondInlet("Sanden80");
+	testLoopLoss();
+	testPumpSchedule();
+	testLongSteps();
+	testLoopOverManySteps();
+	testLoopInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// the loop is what a host did by hand: the loop flow added to the draw and returned through the second inlet
+void testLoopMatchesSecondInlet(string input) {
+	HPWH byHand,withLoop;
+	getHPWHObject(byHand,input);
+	getHPWHObject(withLoop,input);
+	for(HPWH *hpwh: {&byHand,&withLoop}) {
+		ASSERTTRUE(hpwh->setInlet2ByFraction(0.5) == 0);
+	}
+	ASSERTTRUE(withLoop.setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C) == 0);
+	ASSERTTRUE(withLoop.hasRecirculationLoop());
+
+	const double flowCapacity_kJperHrC = loopFlow_Lper_min * 60. * HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC;
+	for(int i = 0; i < 2 * 1440; i++) {
+		double drawVolume_L = drawAt(i);
+		double supplyT_C = topVolumeT_C(byHand,drawVolume_L + loopFlow_Lper_min);
+		double returnT_C = loopAmbientT_C + (supplyT_C - loopAmbientT_C) * exp(-loopUA_kJperHrC / flowCapacity_kJperHrC);
+		ASSERTTRUE(byHand.runOneStep(10.,drawVolume_L + loopFlow_Lper_min,19.,19.,HPWH::DR_ALLOW,
+			loopFlow_Lper_min,returnT_C) == 0);
+		ASSERTTRUE(withLoop.runOneStep(10.,drawVolume_L,19.,19.,HPWH::DR_ALLOW) == 0);
+
+		ASSERTTRUE(withLoop.getRecirculationVolume_L() == loopFlow_Lper_min);
+		ASSERTTRUE(withLoop.getRecirculationReturnT_C() == returnT_C);
+		ASSERTTRUE(withLoop.getOutletTemp() == byHand.getOutletTemp());
+		ASSERTTRUE(withLoop.getRecirculationLoss() == KJ_TO_KWH(HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC
+			* loopFlow_Lper_min * (byHand.getOutletTemp() - returnT_C)));
+		for(int j = 0; j < withLoop.getNumNodes(); j++) {
+			ASSERTTRUE(withLoop.getTankNodeTemp(j) == byHand.getTankNodeTemp(j));
+		}
+	}
+}
+
+// the loop loses what the water loses around it, and the tank's energy balance closes with it
+void testLoopLoss() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Rheem2020Prem50");
+	ASSERTTRUE(hpwh.setEnergyBalanceCheck(true,0.001) == 0);
+	ASSERTTRUE(hpwh.setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C) == 0);
+	double loss_kWh = 0.;
+	for(int i = 0; i < 1440; i++) {
+		double supplyT_C = topVolumeT_C(hpwh,drawAt(i) + loopFlow_Lper_min);
+		ASSERTTRUE(hpwh.runOneStep(10.,drawAt(i),19.,19.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(hpwh.getRecirculationReturnT_C() < supplyT_C);
+		ASSERTTRUE(hpwh.getRecirculationReturnT_C() > loopAmbientT_C);
+		ASSERTTRUE(hpwh.getRecirculationLoss() > 0.);
+		ASSERTTRUE(cmpd(hpwh.getRecirculationLoss(HPWH::UNITS_KJ),KWH_TO_KJ(hpwh.getRecirculationLoss())));
+		loss_kWh += hpwh.getRecirculationLoss();
+	}
+	ASSERTTRUE(hpwh.getNumEnergyBalanceFlags() == 0);
+
+	// the loss keeps the heat pump running longer than without the loop
+	HPWH noLoop;
+	getHPWHObject(noLoop,"Rheem2020Prem50");
+	double energyInput_kWh = 0.,noLoopEnergyInput_kWh = 0.;
+	HPWH withLoop;
+	getHPWHObject(withLoop,"Rheem2020Prem50");
+	ASSERTTRUE(withLoop.setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C) == 0);
+	for(int i = 0; i < 1440; i++) {
+		ASSERTTRUE(noLoop.runOneStep(10.,drawAt(i),19.,19.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(withLoop.runOneStep(10.,drawAt(i),19.,19.,HPWH::DR_ALLOW) == 0);
+		for(int j = 0; j < withLoop.getNumHeatSources(); j++) {
+			energyInput_kWh += withLoop.getNthHeatSourceEnergyInput(j);
+			noLoopEnergyInput_kWh += noLoop.getNthHeatSourceEnergyInput(j);
+		}
+	}
+	ASSERTTRUE(loss_kWh > 1.);
+	ASSERTTRUE(energyInput_kWh > noLoopEnergyInput_kWh);
+}
+
+// the pump runs its fraction of each hour on a clock that starts where it is set and goes on in copies
+void testPumpSchedule() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	std::vector<double> pumpFractions(24,0.);
+	for(int hour = 6; hour < 22; hour++) {
+		pumpFractions[hour] = 1.;
+	}
+	pumpFractions[12] = 0.25;
+	ASSERTTRUE(hpwh.setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C,pumpFractions,5. * 60.) == 0);
+	for(int i = 0; i < 1440; i++) {
+		ASSERTTRUE(hpwh.runOneStep(10.,drawAt(i),19.,19.,HPWH::DR_ALLOW) == 0);
+		int hour = ((i + 300) / 60) % 24;
+		ASSERTTRUE(hpwh.getRecirculationVolume_L() == loopFlow_Lper_min * pumpFractions[hour]);
+		if(pumpFractions[hour] == 0.) {
+			ASSERTTRUE(hpwh.getRecirculationLoss() == 0. && hpwh.getRecirculationReturnT_C() == 0.);
+		}
+		if(i == 700) {
+			HPWH copy(hpwh);
+			ASSERTTRUE(copy.runOneStep(10.,0.,19.,19.,HPWH::DR_ALLOW) == 0);
+			ASSERTTRUE(copy.getRecirculationVolume_L() == loopFlow_Lper_min * pumpFractions[((i + 1 + 300) / 60) % 24]);
+		}
+	}
+
+	// runNSteps sums the loop over its steps
+	HPWH summed;
+	getHPWHObject(summed,"AOSmithHPTU50");
+	summed.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(summed.setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C,pumpFractions) == 0);
+	const int N = 1440;
+	std::vector<double> inletT_C(N,10.),drawVolume_L(N),ambientT_C(N,19.);
+	std::vector<HPWH::DRMODES> drStatus(N,HPWH::DR_ALLOW);
+	for(int i = 0; i < N; i++) {
+		drawVolume_L[i] = drawAt(i);
+	}
+	ASSERTTRUE(summed.runNSteps(N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),drStatus.data()) == 0);
+	ASSERTTRUE(cmpd(summed.getRecirculationVolume_L(),loopFlow_Lper_min * 60. * (15. + 0.25)));
+	ASSERTTRUE(summed.getRecirculationLoss() > 0.);
+
+	ASSERTTRUE(summed.setRecirculationLoop(0.,loopFlow_Lper_min,loopAmbientT_C) == 0);
+	summed.clearRecirculationLoop();
+	ASSERTTRUE(!summed.hasRecirculationLoop());
+	ASSERTTRUE(summed.runOneStep(10.,0.,19.,19.,HPWH::DR_ALLOW) == 0);
+	ASSERTTRUE(summed.getRecirculationVolume_L() == 0.);
+}
+
+// one long step takes the loop of all the minutes in it, near what one minute steps give
+void testLongSteps() {
+	HPWH minutes,hours;
+	getHPWHObject(minutes,"restankRealistic");
+	getHPWHObject(hours,"restankRealistic");
+	for(HPWH *hpwh: {&minutes,&hours}) {
+		ASSERTTRUE(hpwh->setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C) == 0);
+		ASSERTTRUE(hpwh->setInlet2ByFraction(0.6) == 0);
+	}
+	hours.setMinutesPerStep(15.);
+	const double startHeatContent_kJ = minutes.getTankHeatContent_kJ();
+	double minutesLoss_kWh = 0.,hoursLoss_kWh = 0.,minutesInput_kWh = 0.,hoursInput_kWh = 0.;
+	for(int i = 0; i < 1440; i++) {
+		ASSERTTRUE(minutes.runOneStep(10.,0.,19.,19.,HPWH::DR_ALLOW) == 0);
+		minutesLoss_kWh += minutes.getRecirculationLoss();
+		for(int j = 0; j < minutes.getNumHeatSources(); j++) {
+			minutesInput_kWh += minutes.getNthHeatSourceEnergyInput(j);
+		}
+	}
+	for(int i = 0; i < 1440 / 15; i++) {
+		ASSERTTRUE(hours.runOneStep(10.,0.,19.,19.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(hours.getRecirculationVolume_L() == 15. * loopFlow_Lper_min);
+		hoursLoss_kWh += hours.getRecirculationLoss();
+		for(int j = 0; j < hours.getNumHeatSources(); j++) {
+			hoursInput_kWh += hours.getNthHeatSourceEnergyInput(j);
+		}
+	}
+	// the elements cycle at other times with longer steps, so the heat they leave in the tank is counted with their input
+	ASSERTTRUE(fabs(hoursLoss_kWh / minutesLoss_kWh - 1.) < 0.02);
+	double minutesNet_kWh = minutesInput_kWh - KJ_TO_KWH(minutes.getTankHeatContent_kJ() - startHeatContent_kJ);
+	double hoursNet_kWh = hoursInput_kWh - KJ_TO_KWH(hours.getTankHeatContent_kJ() - startHeatContent_kJ);
+	ASSERTTRUE(fabs(hoursNet_kWh / minutesNet_kWh - 1.) < 0.02);
+}
+
+// runRepeatedDays and runNStepsParallel sum the loop over their steps as runNSteps does
+void testLoopOverManySteps() {
+	const int numDays = 2;
+	const int N = 1440;
+	std::vector<double> inletT_C(numDays * N,10.),drawVolume_L(numDays * N),ambientT_C(numDays * N,19.);
+	std::vector<HPWH::DRMODES> drStatus(numDays * N,HPWH::DR_ALLOW);
+	for(int i = 0; i < numDays * N; i++) {
+		drawVolume_L[i] = drawAt(i);
+	}
+	std::vector<double> pumpFractions(24,1.);
+	pumpFractions[3] = 0.;
+	pumpFractions[12] = 0.5;
+
+	HPWH stepped,repeated,parallel;
+	for(HPWH *hpwh: {&stepped,&repeated,&parallel}) {
+		getHPWHObject(*hpwh,"AOSmithHPTU50");
+		hpwh->setVerbosity(HPWH::VRB_silent);
+		ASSERTTRUE(hpwh->setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C,pumpFractions) == 0);
+	}
+	double loss_kWh = 0.,volume_L = 0.,returnTVolume_CL = 0.;
+	for(int i = 0; i < numDays * N; i++) {
+		ASSERTTRUE(stepped.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],HPWH::DR_ALLOW) == 0);
+		loss_kWh += stepped.getRecirculationLoss();
+		volume_L += stepped.getRecirculationVolume_L();
+		returnTVolume_CL += stepped.getRecirculationReturnT_C() * stepped.getRecirculationVolume_L();
+	}
+	ASSERTTRUE(cmpd(volume_L,numDays * loopFlow_Lper_min * 60. * (22. + 0.5)));
+
+	ASSERTTRUE(repeated.runRepeatedDays(numDays,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data()) == 0);
+	// every step ahead of the last has a loss of its own, so the parallel run is taken to the sequential result
+	ASSERTTRUE(parallel.runNStepsParallel(numDays * N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),4,0.) == 0);
+	for(HPWH *hpwh: {&repeated,&parallel}) {
+		ASSERTTRUE(relcmpd(hpwh->getRecirculationLoss(),loss_kWh,1.e-9));
+		ASSERTTRUE(relcmpd(hpwh->getRecirculationVolume_L(),volume_L,1.e-9));
+		ASSERTTRUE(relcmpd(hpwh->getRecirculationReturnT_C(),returnTVolume_CL / volume_L,1.e-9));
+		ASSERTTRUE(hpwh->getExtraHeatEnergy() == 0.);
+	}
+}
+
+void testLoopInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(!hpwh.hasRecirculationLoop());
+	ASSERTTRUE(hpwh.setRecirculationLoop(-1.,loopFlow_Lper_min,loopAmbientT_C) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setRecirculationLoop(loopUA_kJperHrC,-1.,loopAmbientT_C) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C,std::vector<double>(12,1.)) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.setRecirculationLoop(loopUA_kJperHrC,loopFlow_Lper_min,loopAmbientT_C,std::vector<double>(24,1.5)) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(!hpwh.hasRecirculationLoop());
+	ASSERTTRUE(hpwh.getRecirculationLoss(HPWH::UNITS_F) == HPWH::HPWH_ABORT);
+
+	// no flow leaves the tank as it is without a loop
+	HPWH noFlow,noLoop;
+	getHPWHObject(noFlow,"AOSmithHPTU50");
+	getHPWHObject(noLoop,"AOSmithHPTU50");
+	ASSERTTRUE(noFlow.setRecirculationLoop(loopUA_kJperHrC,0.,loopAmbientT_C) == 0);
+	for(int i = 0; i < 1440; i++) {
+		ASSERTTRUE(noFlow.runOneStep(10.,drawAt(i),19.,19.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(noLoop.runOneStep(10.,drawAt(i),19.,19.,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(noFlow.getOutletTemp() == noLoop.getOutletTemp());
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ * unit tests for runRepeatedDays
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testRepeatedDaysMatchesAllDays(string input,bool settles);
+void testRepeatedDaysInputs();
+
+const int stepsPerDay = 1440;
+const int numDays = 14;
+std::vector<double> inletT_C(stepsPerDay * numDays,F_TO_C(58.));
+std::vector<double> drawVolume_L(stepsPerDay * numDays,0.);
+std::vector<double> ambientT_C(stepsPerDay * numDays,19.7);
+std::vector<HPWH::DRMODES> drStatus(stepsPerDay * numDays,HPWH::DR_ALLOW);
+
+int main()
+{
+	// the DOE 24 hour draw pattern, repeated every day
+	const int drawStart_min[] = {0,60,120,180,240,300};
+	for(int day = 0; day < numDays; day++) {
+		for(int draw = 0; draw < 6; draw++) {
+			for(int i = 0; i < 7; i++) {
+				drawVolume_L[day * stepsPerDay + drawStart_min[draw] + i] = GAL_TO_L(10.7 / 7.);
+			}
+		}
+	}
+
+	testRepeatedDaysMatchesAllDays("AOSmithHPTU50",true);
+	testRepeatedDaysMatchesAllDays("Rheem2020Prem50",true);
+	// the Sanden alternates between two end of day states
+	testRepeatedDaysMatchesAllDays("Sanden80",true);
+	// the large Colmac tank does not settle in two weeks, so every day is simulated
+	testRepeatedDaysMatchesAllDays("ColmacCxV_5_SP",false);
+	testRepeatedDaysInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+void testRepeatedDaysMatchesAllDays(string input,bool settles) {
+	HPWH hpwhRepeated,hpwhAllDays;
+	getHPWHObject(hpwhRepeated,input);
+	getHPWHObject(hpwhAllDays,input);
+	hpwhRepeated.setVerbosity(HPWH::VRB_silent);
+	hpwhAllDays.setVerbosity(HPWH::VRB_silent);
+
+	ASSERTTRUE(hpwhRepeated.runRepeatedDays(numDays,stepsPerDay,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data()) == 0);
+	ASSERTTRUE(hpwhAllDays.runNSteps(stepsPerDay * numDays,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data()) == 0);
+
+	// the skipped days cost next to nothing in accuracy
+	ASSERTTRUE((hpwhRepeated.getNumSkippedDays() > 0) == settles);
+	for(int i = 0; i < hpwhRepeated.getNumHeatSources(); i++) {
+		ASSERTTRUE(cmpd(hpwhRepeated.getNthHeatSourceEnergyInput(i),hpwhAllDays.getNthHeatSourceEnergyInput(i),0.1));
+		ASSERTTRUE(cmpd(hpwhRepeated.getNthHeatSourceEnergyOutput(i),hpwhAllDays.getNthHeatSourceEnergyOutput(i),0.1));
+	}
+	ASSERTTRUE(relcmpd(hpwhRepeated.getStandbyLosses(),hpwhAllDays.getStandbyLosses(),0.01));
+	ASSERTTRUE(cmpd(hpwhRepeated.getOutletTemp(),hpwhAllDays.getOutletTemp(),0.05));
+	ASSERTTRUE(cmpd(hpwhRepeated.getTankHeatContent_kJ(),hpwhAllDays.getTankHeatContent_kJ(),50.));
+}
+
+void testRepeatedDaysInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+
+	ASSERTTRUE(hpwh.runRepeatedDays(0,stepsPerDay,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data()) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runRepeatedDays(numDays,0,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data()) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runRepeatedDays(numDays,stepsPerDay,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data(),-1.) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runRepeatedDays(numDays,stepsPerDay,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data(),0.01,0) == HPWH::HPWH_ABORT);
+
+	// a two day cycle is missed when only one day is looked back on
+	HPWH hpwhOneDay;
+	getHPWHObject(hpwhOneDay,"Sanden80");
+	hpwhOneDay.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwhOneDay.runRepeatedDays(numDays,stepsPerDay,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data(),0.01,1) == 0);
+	ASSERTTRUE(hpwhOneDay.getNumSkippedDays() == 0);
+
+	// with no tolerance every day is simulated unless the cycle repeats exactly
+	HPWH hpwhExact;
+	getHPWHObject(hpwhExact,"AOSmithHPTU50");
+	hpwhExact.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwhExact.runRepeatedDays(2,stepsPerDay,inletT_C.data(),drawVolume_L.data(),
+		ambientT_C.data(),ambientT_C.data(),drStatus.data(),0.) == 0);
+	ASSERTTRUE(hpwhExact.getNumSkippedDays() == 0);
+}
@@ -0,0 +1,159 @@
+/*
+ * unit tests for runSizingSweep
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testSweepMatchesSingleRuns(string input);
+void testSweepInputs();
+
+const int numDays = 3;
+const int N = 1440 * numDays;
+const double minDeliveryT_C = F_TO_C(105.);
+const double maxUnmetFraction = 0.005;
+std::vector<double> inletT_C(N,F_TO_C(50.));
+std::vector<double> drawVolume_L(N,0.);
+std::vector<double> ambientT_C(N,15.);
+std::vector<HPWH::DRMODES> drStatus(N,HPWH::DR_ALLOW);
+
+int main()
+{
+	// 2000 gal a day for a multifamily building, with morning and evening peaks
+	for(int i = 0; i < N; i++) {
+		double hour = (i % 1440) / 60.;
+		if(hour >= 6. && hour < 9.) {
+			drawVolume_L[i] = GAL_TO_L(2000. * 0.35 / 180.);
+		} else if(hour >= 18. && hour < 22.) {
+			drawVolume_L[i] = GAL_TO_L(2000. * 0.35 / 240.);
+		} else {
+			drawVolume_L[i] = GAL_TO_L(2000. * 0.30 / 1020.);
+		}
+	}
+
+	testSweepMatchesSingleRuns("TamScalable_SP");
+	testSweepMatchesSingleRuns("Scalable_MP");
+	testSweepInputs();
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+void testSweepMatchesSingleRuns(string input) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	HPWH::SizingGrid grid;
+	grid.tankVolumes_L = {GAL_TO_L(300.),GAL_TO_L(900.)};
+	grid.compressorCapacities_kW = {10.,20.,40.};
+	grid.resistanceCapacities_kW = {0.,15.};
+	std::vector<HPWH::SizingResult> results;
+	ASSERTTRUE(hpwh.runSizingSweep(grid,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),minDeliveryT_C,maxUnmetFraction,results) == 0);
+	ASSERTTRUE(results.size() == 12);
+
+	double scheduleDrawVolume_L = 0.;
+	for(double volume_L: drawVolume_L) {
+		scheduleDrawVolume_L += volume_L;
+	}
+	int numPruned = 0,numMeeting = 0;
+	for(std::size_t k = 0; k < results.size(); k++) {
+		const HPWH::SizingResult &result = results[k];
+		ASSERTTRUE(result.isConfigurable);
+		ASSERTTRUE(relcmpd(result.tankVolume_L,grid.tankVolumes_L[k / 6]));
+		ASSERTTRUE(relcmpd(result.compressorCapacity_kW,grid.compressorCapacities_kW[(k / 2) % 3]));
+		ASSERTTRUE(cmpd(result.resistanceCapacity_kW,2. * grid.resistanceCapacities_kW[k % 2]));
+		ASSERTTRUE(result.setpoint_C == hpwh.getSetpoint());
+
+		// the same configuration run on its own, through the whole schedule
+		HPWH single;
+		getHPWHObject(single,input);
+		ASSERTTRUE(single.setTankSize_adjustUA(grid.tankVolumes_L[k / 6],HPWH::UNITS_L,true) == 0);
+		ASSERTTRUE(single.setCompressorOutputCapacity(grid.compressorCapacities_kW[(k / 2) % 3]) == 0);
+		ASSERTTRUE(single.setResistanceCapacity(grid.resistanceCapacities_kW[k % 2]) == 0);
+		double energyInput_kWh = 0.,unmetDrawVolume_L = 0.;
+		for(int i = 0; i < N; i++) {
+			ASSERTTRUE(single.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+			for(int j = 0; j < single.getNumHeatSources(); j++) {
+				energyInput_kWh += single.getNthHeatSourceEnergyInput(j);
+			}
+			if(drawVolume_L[i] > 0. && single.getOutletTemp() < minDeliveryT_C) {
+				unmetDrawVolume_L += drawVolume_L[i];
+			}
+			if(i + 1 == result.numStepsRun) {
+				ASSERTTRUE(energyInput_kWh == result.energyInput_kWh);
+				ASSERTTRUE(unmetDrawVolume_L == result.unmetDrawVolume_L);
+			}
+		}
+
+		// pruning only stops the configurations that would have failed anyway
+		ASSERTTRUE(result.meetsDelivery == (unmetDrawVolume_L <= maxUnmetFraction * scheduleDrawVolume_L));
+		if(result.meetsDelivery) {
+			ASSERTTRUE(result.numStepsRun == N);
+			numMeeting++;
+		} else {
+			ASSERTTRUE(result.numStepsRun < N);
+			numPruned++;
+		}
+	}
+	ASSERTTRUE(numMeeting > 0 && numPruned > 0);
+
+	// the front is the configurations that meet delivery and that no other one beats
+	auto beats = [](const HPWH::SizingResult &a,const HPWH::SizingResult &b) {
+		bool asGood = a.energyInput_kWh <= b.energyInput_kWh && a.tankVolume_L <= b.tankVolume_L
+			&& a.compressorCapacity_kW <= b.compressorCapacity_kW && a.resistanceCapacity_kW <= b.resistanceCapacity_kW;
+		bool better = a.energyInput_kWh < b.energyInput_kWh || a.tankVolume_L < b.tankVolume_L
+			|| a.compressorCapacity_kW < b.compressorCapacity_kW || a.resistanceCapacity_kW < b.resistanceCapacity_kW;
+		return asGood && better;
+	};
+	int numOptimal = 0;
+	for(const HPWH::SizingResult &result: results) {
+		bool isBeaten = false;
+		for(const HPWH::SizingResult &other: results) {
+			isBeaten = isBeaten || (other.meetsDelivery && beats(other,result));
+		}
+		ASSERTTRUE(result.isParetoOptimal == (result.meetsDelivery && !isBeaten));
+		numOptimal += result.isParetoOptimal;
+	}
+	ASSERTTRUE(numOptimal > 0);
+}
+
+void testSweepInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"TamScalable_SP");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	std::vector<HPWH::SizingResult> results;
+	HPWH::SizingGrid grid;
+
+	ASSERTTRUE(hpwh.runSizingSweep(grid,0,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),minDeliveryT_C,maxUnmetFraction,results) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.runSizingSweep(grid,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),minDeliveryT_C,-0.1,results) == HPWH::HPWH_ABORT);
+	grid.tankVolumes_L = {-100.};
+	ASSERTTRUE(hpwh.runSizingSweep(grid,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),minDeliveryT_C,maxUnmetFraction,results) == HPWH::HPWH_ABORT);
+
+	// an empty grid runs the model as it is, and a setpoint the model cannot take is not run
+	grid.tankVolumes_L.clear();
+	grid.setpoints_C = {hpwh.getSetpoint(),200.};
+	ASSERTTRUE(hpwh.runSizingSweep(grid,1440,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),minDeliveryT_C,maxUnmetFraction,results) == 0);
+	ASSERTTRUE(results.size() == 2);
+	ASSERTTRUE(results[0].isConfigurable && results[0].tankVolume_L == hpwh.getTankSize());
+	ASSERTTRUE(!results[1].isConfigurable && results[1].numStepsRun == 0 && !results[1].isParetoOptimal);
+
+	FILE *summary = tmpfile();
+	ASSERTTRUE(HPWH::writeSizingSummary(summary,results,HPWH::CSVOPT_IPUNITS) == 0);
+	rewind(summary);
+	int numLines = 0;
+	for(int c = fgetc(summary); c != EOF; c = fgetc(summary)) {
+		numLines += (c == '\n');
+	}
+	fclose(summary);
+	ASSERTTRUE(numLines == 3);
+}
@@ -6,12 +6,14 @@
 
 void testGetStateOfCharge();
 void testChargeBelowSetpoint();
+void testIncrementalSoCMatchesFull();
 
 
 int main()
 {
 	testGetStateOfCharge();
 	testChargeBelowSetpoint();
+	testIncrementalSoCMatchesFull();
 }
 
 void testGetStateOfCharge() {
@@ -77,3 +79,25 @@ void testChargeBelowSetpoint() {
 	chargeFraction = hpwh.calcSoCFraction(tMains_C, tMinUseful_C, F_TO_C(140.));
 	ASSERTTRUE(cmpd(chargeFraction, 0.875));
 }
+
+void testIncrementalSoCMatchesFull() {
+	const string models[] = {"Sanden80", "ColmacCxV_5_SP"};
+	double tMains_C = F_TO_C(55.);
+	double tMinUseful_C = F_TO_C(110.);
+
+	for(const string &model: models) {
+		HPWH hpwh;
+		string input = model;
+		getHPWHObject(hpwh,input);
+		ASSERTTRUE(hpwh.switchToSoCControls(0.85,0.05,tMinUseful_C,true,tMains_C) == 0);
+		// the cross check would replace a tracked value that is off with the full one, so it stays off here
+		hpwh.setDoSoCCrossCheck(false);
+
+		// draw the tank down and let the compressor recover, checking the tracked SoC every step
+		for(int i = 0; i < 600; i++) {
+			double draw_L = (i % 60 < 10) ? GAL_TO_L(3.) : 0.;
+			ASSERTTRUE(hpwh.runOneStep(tMains_C,draw_L,20.,20.,HPWH::DR_ALLOW) == 0);
+			ASSERTTRUE(cmpd(hpwh.getSoCFraction(),hpwh.calcSoCFraction(tMains_C,tMinUseful_C),1.e-9));
+		}
+	}
+}
@@ -0,0 +1,36 @@
+/*
+ * unit tests for the model topology found at init
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::string;
+
+void testTopology(string input,HPWH::STEP_TOPOLOGY topology);
+
+int main()
+{
+	testTopology("restankRealistic",HPWH::TOPOLOGY_RESISTANCE);
+	testTopology("AOSmithHPTU50",HPWH::TOPOLOGY_INTEGRATED);
+	testTopology("Stiebel220E",HPWH::TOPOLOGY_INTEGRATED);
+	testTopology("Sanden80",HPWH::TOPOLOGY_SINGLEPASS);
+	testTopology("ColmacCxV_5_SP",HPWH::TOPOLOGY_SINGLEPASS);
+	testTopology("ColmacCxV_5_MP",HPWH::TOPOLOGY_MULTIPASS);
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+void testTopology(string input,HPWH::STEP_TOPOLOGY topology) {
+	HPWH hpwh;
+	getHPWHObject(hpwh,input);
+	ASSERTTRUE(hpwh.getStepTopology() == topology);
+
+	HPWH copy = hpwh;
+	ASSERTTRUE(copy.getStepTopology() == topology);
+}
+
@@ -0,0 +1,149 @@
+/*
+ * unit tests for the tank models
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testTankModelSelection();
+void testThermoclineConservesEnergy(string input);
+void testThermoclineMatchesNodal(string input);
+
+const int stepsPerDay = 1440;
+const double inletT_C = F_TO_C(58.);
+const double ambientT_C = 19.7;
+std::vector<double> drawVolume_L(stepsPerDay,0.);
+
+int main()
+{
+	// the DOE 24 hour draw pattern
+	const int drawStart_min[] = {0,60,120,180,240,300};
+	for(int draw = 0; draw < 6; draw++) {
+		for(int i = 0; i < 7; i++) {
+			drawVolume_L[drawStart_min[draw] + i] = GAL_TO_L(10.7 / 7.);
+		}
+	}
+
+	testTankModelSelection();
+	testThermoclineConservesEnergy("AOSmithHPTU50");
+	testThermoclineConservesEnergy("Stiebel220E");
+	testThermoclineConservesEnergy("Sanden80");
+	testThermoclineConservesEnergy("ColmacCxV_5_MP");
+	testThermoclineConservesEnergy("RheemHB50");
+	testThermoclineMatchesNodal("AOSmithHPTU50");
+	testThermoclineMatchesNodal("Rheem2020Prem50");
+	testThermoclineMatchesNodal("RheemHB50");
+	testThermoclineMatchesNodal("Sanden80");
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+void runDay(HPWH &hpwh) {
+	for(int i = 0; i < stepsPerDay; i++) {
+		ASSERTTRUE(hpwh.runOneStep(inletT_C,drawVolume_L[i],ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+	}
+}
+
+void testTankModelSelection() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+
+	ASSERTTRUE(hpwh.getTankModel() == HPWH::TANK_MODEL_NODAL);
+	ASSERTTRUE(hpwh.setTankModel(static_cast<HPWH::TANK_MODEL>(7)) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.getTankModel() == HPWH::TANK_MODEL_NODAL);
+	ASSERTTRUE(hpwh.setTankModel(HPWH::TANK_MODEL_THERMOCLINE) == 0);
+	ASSERTTRUE(hpwh.getTankModel() == HPWH::TANK_MODEL_THERMOCLINE);
+
+	// a copy keeps the engine and its zones, and runs on its own tank
+	runDay(hpwh);
+	HPWH copy = hpwh;
+	ASSERTTRUE(copy.getTankModel() == HPWH::TANK_MODEL_THERMOCLINE);
+	double heatContent_kJ = hpwh.getTankHeatContent_kJ();
+	runDay(copy);
+	ASSERTTRUE(hpwh.getTankHeatContent_kJ() == heatContent_kJ);
+	runDay(hpwh);
+	ASSERTTRUE(hpwh.getTankHeatContent_kJ() == copy.getTankHeatContent_kJ());
+	ASSERTTRUE(hpwh.getOutletTemp() == copy.getOutletTemp());
+
+	// a tank set from outside is refit
+	std::vector<double> layers(12,20.);
+	for(int i = 6; i < 12; i++) {
+		layers[i] = 50.;
+	}
+	ASSERTTRUE(hpwh.setTankLayerTemperatures(layers) == 0);
+	heatContent_kJ = hpwh.getTankHeatContent_kJ();
+	ASSERTTRUE(hpwh.runOneStep(inletT_C,0.,ambientT_C,ambientT_C,
+		static_cast<HPWH::DRMODES>(HPWH::DR_LOC | HPWH::DR_LOR)) == 0);
+	ASSERTTRUE(relcmpd(hpwh.getTankHeatContent_kJ(),heatContent_kJ,0.001));
+	ASSERTTRUE(hpwh.getTankNodeTemp(0) < 25. && hpwh.getTankNodeTemp(hpwh.getNumNodes() - 1) > 45.);
+
+	ASSERTTRUE(hpwh.setTankModel(HPWH::TANK_MODEL_NODAL) == 0);
+	ASSERTTRUE(hpwh.getTankModel() == HPWH::TANK_MODEL_NODAL);
+}
+
+// the heat in, less the standby losses and the heat drawn off, against the change in heat content, for each step
+double stepBalance_kJ(HPWH &hpwh,double stepDraw_L,double startHeatContent_kJ) {
+	double heatIn_kJ = 0.;
+	for(int j = 0; j < hpwh.getNumHeatSources(); j++) {
+		heatIn_kJ += KWH_TO_KJ(hpwh.getNthHeatSourceEnergyOutput(j));
+	}
+	double drawn_kJ = stepDraw_L * HPWH::DENSITYWATER_kgperL * HPWH::CPWATER_kJperkgC * (hpwh.getOutletTemp() - inletT_C);
+	return heatIn_kJ - KWH_TO_KJ(hpwh.getStandbyLosses()) - drawn_kJ - (hpwh.getTankHeatContent_kJ() - startHeatContent_kJ);
+}
+
+// each step of the thermocline model closes its energy balance at least as well as the nodal model does
+void testThermoclineConservesEnergy(string input) {
+	HPWH hpwhNodal,hpwhThermocline;
+	getHPWHObject(hpwhNodal,input);
+	getHPWHObject(hpwhThermocline,input);
+	hpwhNodal.setVerbosity(HPWH::VRB_silent);
+	hpwhThermocline.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwhThermocline.setTankModel(HPWH::TANK_MODEL_THERMOCLINE) == 0);
+
+	double maxNodal_kJ = 0.,maxThermocline_kJ = 0.;
+	for(int i = 0; i < stepsPerDay; i++) {
+		double nodalStart_kJ = hpwhNodal.getTankHeatContent_kJ();
+		double thermoclineStart_kJ = hpwhThermocline.getTankHeatContent_kJ();
+		ASSERTTRUE(hpwhNodal.runOneStep(inletT_C,drawVolume_L[i],ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(hpwhThermocline.runOneStep(inletT_C,drawVolume_L[i],ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		maxNodal_kJ = std::max(maxNodal_kJ,fabs(stepBalance_kJ(hpwhNodal,drawVolume_L[i],nodalStart_kJ)));
+		maxThermocline_kJ = std::max(maxThermocline_kJ,fabs(stepBalance_kJ(hpwhThermocline,drawVolume_L[i],thermoclineStart_kJ)));
+	}
+	// what is left is the heat the wrapped condensers drop with their smallest weights, which the nodes drop too
+	ASSERTTRUE(maxThermocline_kJ < 0.5);
+	ASSERTTRUE(maxThermocline_kJ <= maxNodal_kJ);
+}
+
+// the comparison on the DOE day; doc/thermoclineTankModel.md has the standard schedules
+void testThermoclineMatchesNodal(string input) {
+	HPWH hpwhNodal,hpwhThermocline;
+	getHPWHObject(hpwhNodal,input);
+	getHPWHObject(hpwhThermocline,input);
+	hpwhNodal.setVerbosity(HPWH::VRB_silent);
+	hpwhThermocline.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwhThermocline.setTankModel(HPWH::TANK_MODEL_THERMOCLINE) == 0);
+
+	double nodalInput_kWh = 0.,thermoclineInput_kWh = 0.;
+	double nodalOutletT_CL = 0.,thermoclineOutletT_CL = 0.,totalDraw_L = 0.;
+	for(int i = 0; i < stepsPerDay; i++) {
+		ASSERTTRUE(hpwhNodal.runOneStep(inletT_C,drawVolume_L[i],ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		ASSERTTRUE(hpwhThermocline.runOneStep(inletT_C,drawVolume_L[i],ambientT_C,ambientT_C,HPWH::DR_ALLOW) == 0);
+		for(int j = 0; j < hpwhNodal.getNumHeatSources(); j++) {
+			nodalInput_kWh += hpwhNodal.getNthHeatSourceEnergyInput(j);
+			thermoclineInput_kWh += hpwhThermocline.getNthHeatSourceEnergyInput(j);
+		}
+		nodalOutletT_CL += hpwhNodal.getOutletTemp() * drawVolume_L[i];
+		thermoclineOutletT_CL += hpwhThermocline.getOutletTemp() * drawVolume_L[i];
+		totalDraw_L += drawVolume_L[i];
+	}
+	ASSERTTRUE(relcmpd(thermoclineInput_kWh,nodalInput_kWh,0.05));
+	ASSERTTRUE(cmpd(thermoclineOutletT_CL / totalDraw_L,nodalOutletT_CL / totalDraw_L,1.5));
+}
@@ -11,6 +11,8 @@
 #include "HPWH.hh"
 #include <iostream>
 #include <string> 
+#include <limits>
+#include <algorithm>
 
 using std::cout;
 using std::string;
@@ -35,6 +37,11 @@ bool cmpd(double A, double B, double epsilon = 0.0001) {
 bool relcmpd(double A, double B, double epsilon = 0.00001) {
 	return fabs(A - B) < (epsilon *(fabs(A) < fabs(B) ? fabs(B) : fabs(A)));
 }
+//Widen a tolerance on results of the tank temperatures to a number of roundings of HPWH::tankReal_t,
+//which leaves it as is for double tanks
+double tankTolerance(double epsilon, double roundings) {
+	return std::max(epsilon, roundings * std::numeric_limits<HPWH::tankReal_t>::epsilon());
+}
 
 bool compressorIsRunning(HPWH& hpwh) {
 	return (bool)hpwh.isNthHeatSourceRunning(hpwh.getCompressorIndex());
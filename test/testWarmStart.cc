@@ -0,0 +1,229 @@
+/*
+ * unit tests for warmStart
+ */
+#include "HPWH.hh"
+#include "testUtilityFcts.cc"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::string;
+
+void testWarmStartMatchesSpinUp(string input);
+void testWarmStartKey();
+void testWarmStartCompressorStages();
+void testWarmStartDamagedCache();
+void testWarmStartInputs();
+
+int numCachedFiles();
+void nodesMatch(HPWH &a,HPWH &b);
+
+const int N = 1440;
+std::vector<double> inletT_C(N,F_TO_C(50.));
+std::vector<double> drawVolume_L(N,0.);
+std::vector<double> ambientT_C(N,19.);
+std::vector<HPWH::DRMODES> drStatus(N,HPWH::DR_ALLOW);
+string cacheDirectory;
+
+int main(int argc,char *argv[])
+{
+	// a fresh cache for each run of the test
+	std::filesystem::path cachePath = std::filesystem::path(argc > 1 ? argv[1] : "output") / "warmStartCache";
+	std::filesystem::remove_all(cachePath);
+	std::filesystem::create_directories(cachePath);
+	cacheDirectory = cachePath.string();
+
+	// 60 gal a day in a morning and an evening draw
+	for(int i = 7 * 60; i < 7 * 60 + 20; i++) {
+		drawVolume_L[i] = GAL_TO_L(1.5);
+	}
+	for(int i = 19 * 60; i < 19 * 60 + 10; i++) {
+		drawVolume_L[i] = GAL_TO_L(3.);
+	}
+
+	testWarmStartMatchesSpinUp("AOSmithHPTU50");
+	testWarmStartMatchesSpinUp("Sanden80");
+	testWarmStartKey();
+	testWarmStartCompressorStages();
+	testWarmStartDamagedCache();
+	testWarmStartInputs();
+
+	std::filesystem::remove_all(cachePath);
+
+	//Made it through the gauntlet
+	return 0;
+}
+
+// a run from the cached state goes on exactly as the run that spun up
+void testWarmStartMatchesSpinUp(string input) {
+	HPWH spunUp,cached,reference;
+	getHPWHObject(spunUp,input);
+	getHPWHObject(cached,input);
+	getHPWHObject(reference,input);
+	int numFiles = numCachedFiles();
+
+	ASSERTTRUE(spunUp.warmStart(cacheDirectory,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),2) == 0);
+	ASSERTTRUE(!spunUp.wasWarmStartCached());
+	ASSERTTRUE(numCachedFiles() == numFiles + 1);
+	for(int run = 0; run < 2; run++) {
+		for(int i = 0; i < N; i++) {
+			ASSERTTRUE(reference.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		}
+	}
+	nodesMatch(spunUp,reference);
+
+	ASSERTTRUE(cached.warmStart(cacheDirectory,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),2) == 0);
+	ASSERTTRUE(cached.wasWarmStartCached());
+	ASSERTTRUE(numCachedFiles() == numFiles + 1);
+	nodesMatch(cached,spunUp);
+
+	for(int i = 0; i < N; i++) {
+		ASSERTTRUE(spunUp.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(cached.runOneStep(inletT_C[i],drawVolume_L[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		nodesMatch(cached,spunUp);
+		for(int j = 0; j < spunUp.getNumHeatSources(); j++) {
+			ASSERTTRUE(cached.getNthHeatSourceEnergyInput(j) == spunUp.getNthHeatSourceEnergyInput(j));
+			ASSERTTRUE(cached.isNthHeatSourceRunning(j) == spunUp.isNthHeatSourceRunning(j));
+		}
+	}
+}
+
+// a change to the model or the schedule is a new spin-up, and the same model and schedule are not
+void testWarmStartKey() {
+	auto isCached = [](HPWH &hpwh,std::vector<double> &draws) {
+		ASSERTTRUE(hpwh.warmStart(cacheDirectory,N,inletT_C.data(),draws.data(),ambientT_C.data(),ambientT_C.data(),
+			drStatus.data()) == 0);
+		return hpwh.wasWarmStartCached();
+	};
+	HPWH hpwh;
+	getHPWHObject(hpwh,"Rheem2020Prem50");
+	isCached(hpwh,drawVolume_L);
+	HPWH same;
+	getHPWHObject(same,"Rheem2020Prem50");
+	ASSERTTRUE(isCached(same,drawVolume_L));
+
+	HPWH leaky;
+	getHPWHObject(leaky,"Rheem2020Prem50");
+	double UA;
+	ASSERTTRUE(leaky.getUA(UA) == 0);
+	ASSERTTRUE(leaky.setUA(1.1 * UA) == 0);
+	ASSERTTRUE(!isCached(leaky,drawVolume_L));
+
+	HPWH cooler;
+	getHPWHObject(cooler,"Rheem2020Prem50");
+	ASSERTTRUE(cooler.setSetpoint(cooler.getSetpoint() - 2.) == 0);
+	ASSERTTRUE(!isCached(cooler,drawVolume_L));
+
+	// the logics are in the key by their parameters
+	HPWH soc,moreSoC;
+	getHPWHObject(soc,"Sanden80");
+	getHPWHObject(moreSoC,"Sanden80");
+	ASSERTTRUE(soc.switchToSoCControls(0.8) == 0);
+	ASSERTTRUE(moreSoC.switchToSoCControls(0.85) == 0);
+	ASSERTTRUE(!isCached(soc,drawVolume_L));
+	ASSERTTRUE(!isCached(moreSoC,drawVolume_L));
+
+	std::vector<double> moreDraws = drawVolume_L;
+	moreDraws[N - 1] = 1.;
+	HPWH otherDay;
+	getHPWHObject(otherDay,"Rheem2020Prem50");
+	ASSERTTRUE(!isCached(otherDay,moreDraws));
+
+	// each of them is cached now
+	for(HPWH *model: {&leaky,&cooler,&soc,&moreSoC}) {
+		HPWH copy = *model;
+		ASSERTTRUE(isCached(copy,drawVolume_L));
+	}
+}
+
+// the staging is in the key, and the stage that leads comes back from the cache
+void testWarmStartCompressorStages() {
+	std::vector<double> plantDraws(drawVolume_L);
+	for(double &volume_L: plantDraws) {
+		volume_L *= 20.;
+	}
+	auto stagedPlant = [](HPWH &hpwh,double lagDecisionPoint) {
+		getHPWHObject(hpwh,"ColmacCxA_15_SP");
+		ASSERTTRUE(hpwh.setCompressorStages(3,{hpwh.bottomThird(lagDecisionPoint),hpwh.bottomThird(2. * lagDecisionPoint)}) == 0);
+	};
+	HPWH spunUp,cached,otherStaging;
+	stagedPlant(spunUp,dF_TO_dC(20.));
+	stagedPlant(cached,dF_TO_dC(20.));
+	stagedPlant(otherStaging,dF_TO_dC(30.));
+	ASSERTTRUE(spunUp.warmStart(cacheDirectory,N,inletT_C.data(),plantDraws.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data()) == 0);
+	ASSERTTRUE(!spunUp.wasWarmStartCached());
+	ASSERTTRUE(spunUp.getLeadCompressorStage() != 0);
+	ASSERTTRUE(otherStaging.warmStart(cacheDirectory,N,inletT_C.data(),plantDraws.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data()) == 0);
+	ASSERTTRUE(!otherStaging.wasWarmStartCached());
+	ASSERTTRUE(cached.warmStart(cacheDirectory,N,inletT_C.data(),plantDraws.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data()) == 0);
+	ASSERTTRUE(cached.wasWarmStartCached());
+	ASSERTTRUE(cached.getLeadCompressorStage() == spunUp.getLeadCompressorStage());
+
+	for(int i = 0; i < N; i++) {
+		ASSERTTRUE(spunUp.runOneStep(inletT_C[i],plantDraws[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		ASSERTTRUE(cached.runOneStep(inletT_C[i],plantDraws[i],ambientT_C[i],ambientT_C[i],drStatus[i]) == 0);
+		for(int k = 0; k < spunUp.getNumCompressorStages(); k++) {
+			ASSERTTRUE(cached.getNthCompressorStageEnergyInput(k) == spunUp.getNthCompressorStageEnergyInput(k));
+		}
+	}
+	nodesMatch(cached,spunUp);
+}
+
+// a file that cannot be read is simulated again, and replaced
+void testWarmStartDamagedCache() {
+	for(const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(cacheDirectory)) {
+		std::filesystem::resize_file(entry.path(),std::filesystem::file_size(entry.path()) / 2);
+	}
+	HPWH hpwh,reference;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	getHPWHObject(reference,"AOSmithHPTU50");
+	ASSERTTRUE(hpwh.warmStart(cacheDirectory,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),2) == 0);
+	ASSERTTRUE(!hpwh.wasWarmStartCached());
+	ASSERTTRUE(reference.warmStart(cacheDirectory,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),2) == 0);
+	ASSERTTRUE(reference.wasWarmStartCached());
+	nodesMatch(hpwh,reference);
+}
+
+void testWarmStartInputs() {
+	HPWH hpwh;
+	getHPWHObject(hpwh,"AOSmithHPTU50");
+	hpwh.setVerbosity(HPWH::VRB_silent);
+	ASSERTTRUE(hpwh.warmStart(cacheDirectory,0,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data()) == HPWH::HPWH_ABORT);
+	ASSERTTRUE(hpwh.warmStart(cacheDirectory,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+		drStatus.data(),0) == HPWH::HPWH_ABORT);
+
+	// without a cache to write to, every warm start spins up
+	string missingDirectory = cacheDirectory + "/missing";
+	for(int run = 0; run < 2; run++) {
+		ASSERTTRUE(hpwh.warmStart(missingDirectory,N,inletT_C.data(),drawVolume_L.data(),ambientT_C.data(),ambientT_C.data(),
+			drStatus.data()) == 0);
+		ASSERTTRUE(!hpwh.wasWarmStartCached());
+	}
+}
+
+int numCachedFiles() {
+	int numFiles = 0;
+	for(const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(cacheDirectory)) {
+		numFiles += entry.is_regular_file();
+	}
+	return numFiles;
+}
+
+void nodesMatch(HPWH &a,HPWH &b) {
+	ASSERTTRUE(a.getNumNodes() == b.getNumNodes());
+	for(int j = 0; j < a.getNumNodes(); j++) {
+		ASSERTTRUE(a.getTankNodeTemp(j) == b.getTankNodeTemp(j));
+	}
+}